@@ -54,14 +54,17 @@ CREATE TABLE IF NOT EXISTS requisites (
 -- ============================================================================
 CREATE TABLE IF NOT EXISTS documents (
     id INTEGER PRIMARY KEY AUTOINCREMENT,
-    doc_type TEXT NOT NULL CHECK(doc_type IN ('supply', 'sale', 'return', 'transfer')),
+    doc_type TEXT NOT NULL CHECK(doc_type IN ('supply', 'sale', 'return', 'transfer', 'writeoff')),
     number TEXT NOT NULL,
     date TEXT NOT NULL DEFAULT (date('now')),
     status TEXT NOT NULL DEFAULT 'DRAFT' CHECK(status IN ('DRAFT', 'POSTED', 'CANCELLED')),
     sender_id INTEGER,
     receiver_id INTEGER,
     total_amount TEXT NOT NULL DEFAULT '0.00',
+    line_count INTEGER NOT NULL DEFAULT 0,
+    total_qty_kg REAL NOT NULL DEFAULT 0,
     notes TEXT,
+    is_deleted INTEGER NOT NULL DEFAULT 0 CHECK(is_deleted IN (0, 1)),
     created_at TEXT NOT NULL DEFAULT (datetime('now')),
     updated_at TEXT NOT NULL DEFAULT (datetime('now')),
     FOREIGN KEY (sender_id) REFERENCES counterparties(id),
@@ -99,6 +102,61 @@ CREATE TABLE IF NOT EXISTS inventory_movements (
     FOREIGN KEY (product_id) REFERENCES products(id)
 );
 
+-- ============================================================================
+-- ТАБЛИЦА: stock_reservations (Резерв товара черновиками расходных документов)
+-- ============================================================================
+CREATE TABLE IF NOT EXISTS stock_reservations (
+    document_id INTEGER NOT NULL,
+    product_id INTEGER NOT NULL,
+    qty_kg REAL NOT NULL CHECK(qty_kg > 0),
+    created_at TEXT NOT NULL DEFAULT (datetime('now')),
+    PRIMARY KEY (document_id, product_id),
+    FOREIGN KEY (document_id) REFERENCES documents(id) ON DELETE CASCADE,
+    FOREIGN KEY (product_id) REFERENCES products(id)
+);
+
+-- ============================================================================
+-- ТАБЛИЦЫ: stock_snapshot_periods, stock_snapshots (Остатки на конец периода)
+-- ============================================================================
+-- Снимки создаёт закрытие периода (DocumentService::closeStockPeriods).
+-- Триггеры movements_snapshots_* (MigrationRunner::createStockSnapshotTables)
+-- поправляют снимки при проведении/отмене документов задним числом.
+CREATE TABLE IF NOT EXISTS stock_snapshot_periods (
+    period_end TEXT PRIMARY KEY,
+    created_at TEXT NOT NULL DEFAULT (datetime('now'))
+);
+
+CREATE TABLE IF NOT EXISTS stock_snapshots (
+    period_end TEXT NOT NULL,
+    product_id INTEGER NOT NULL,
+    balance_kg REAL NOT NULL,
+    PRIMARY KEY (period_end, product_id),
+    FOREIGN KEY (period_end) REFERENCES stock_snapshot_periods(period_end) ON DELETE CASCADE,
+    FOREIGN KEY (product_id) REFERENCES products(id)
+) WITHOUT ROWID;
+
+-- ============================================================================
+-- ТАБЛИЦА: stock_opening_balances (Входящие остатки на границу архива)
+-- ============================================================================
+-- Движения закрытых лет переносятся в отдельный файл (StockArchive);
+-- вместо них здесь остаётся остаток товара на дату as_of.
+CREATE TABLE IF NOT EXISTS stock_opening_balances (
+    product_id INTEGER PRIMARY KEY,
+    balance_kg REAL NOT NULL,
+    as_of TEXT NOT NULL,
+    FOREIGN KEY (product_id) REFERENCES products(id)
+);
+
+-- ============================================================================
+-- ТАБЛИЦА: change_seq (Счётчики изменений таблиц)
+-- ============================================================================
+-- Счётчики увеличивают триггеры, их создаёт MigrationRunner (ChangeTracker):
+-- модели по ним пропускают перечитывание, если данные не менялись.
+CREATE TABLE IF NOT EXISTS change_seq (
+    table_name TEXT PRIMARY KEY,
+    seq INTEGER NOT NULL DEFAULT 0
+);
+
 -- ============================================================================
 -- ИНДЕКСЫ для производительности
 -- ============================================================================
@@ -108,6 +166,7 @@ CREATE INDEX IF NOT EXISTS idx_documents_status ON documents(status);
 CREATE INDEX IF NOT EXISTS idx_documents_date ON documents(date);
 CREATE INDEX IF NOT EXISTS idx_documents_sender ON documents(sender_id);
 CREATE INDEX IF NOT EXISTS idx_documents_receiver ON documents(receiver_id);
+CREATE INDEX IF NOT EXISTS idx_documents_type_date ON documents(doc_type, date);
 
 -- Индексы для строк документов
 CREATE INDEX IF NOT EXISTS idx_document_lines_document ON document_lines(document_id);
@@ -118,6 +177,10 @@ CREATE INDEX IF NOT EXISTS idx_movements_document ON inventory_movements(documen
 CREATE INDEX IF NOT EXISTS idx_movements_product ON inventory_movements(product_id);
 CREATE INDEX IF NOT EXISTS idx_movements_date ON inventory_movements(movement_date);
 CREATE INDEX IF NOT EXISTS idx_movements_cancelled ON inventory_movements(cancelled_flag);
+CREATE INDEX IF NOT EXISTS idx_movements_product_date ON inventory_movements(product_id, movement_date);
+
+-- Индекс для резервов
+CREATE INDEX IF NOT EXISTS idx_reservations_product ON stock_reservations(product_id);
 
 -- Индексы для контрагентов
 CREATE INDEX IF NOT EXISTS idx_counterparties_type ON counterparties(type);
@@ -126,3 +189,18 @@ CREATE INDEX IF NOT EXISTS idx_counterparties_active ON counterparties(is_active
 -- Индексы для товаров
 CREATE INDEX IF NOT EXISTS idx_products_active ON products(is_active);
 CREATE INDEX IF NOT EXISTS idx_products_sort ON products(sort);
+
+-- Индексы по name COLLATE RU (idx_products_active_name, idx_products_name,
+-- idx_counterparties_active_name, idx_counterparties_name) и таблицу db_meta
+-- создаёт MigrationRunner::createCollatedIndexes(): сортировка RU регистрируется
+-- в приложении (SqlCollation), и без неё такие индексы создавать нельзя.
+
+-- total_amount, line_count и total_qty_kg документов ведут триггеры
+-- document_lines_totals_* (MigrationRunner::createDocumentAggregates).
+
+-- ============================================================================
+-- ПОЛНОТЕКСТОВЫЙ ПОИСК (FTS5)
+-- ============================================================================
+-- products_fts, counterparties_fts, documents_fts и триггеры синхронизации
+-- создаёт MigrationRunner::createSearchIndex(): этот файл выполняется
+-- по операторам через ';', а тела триггеров BEGIN ... END его содержат.
@@ -0,0 +1,110 @@
+#ifndef CHANGEBUS_H
+#define CHANGEBUS_H
+
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QSet>
+#include <QSqlDatabase>
+#include <QString>
+
+class QLocalServer;
+class QTimer;
+class QLocalSocket;
+
+// таблица -> rowid изменённых строк; пустое множество — строк слишком много, перечитать таблицу целиком
+using ChangeSet = QHash<QString, QSet<qint64>>;
+
+/**
+ * @brief Уведомления об изменениях между экземплярами приложения на одной базе
+ *
+ * DbManager ставит на каждое соединение хуки SQLite: update hook собирает
+ * (таблица, rowid) изменённых строк отслеживаемых таблиц (см. ChangeTracker),
+ * rollback hook их отбрасывает, а после фиксации набор уходит в шину.
+ * В режиме WAL набор отправляется из wal hook — он вызывается уже после
+ * фиксации, и получатель гарантированно прочитает новые данные.
+ *
+ * Шина — QLocalServer с именем от пути к базе. Первый экземпляр становится
+ * узлом и пересылает сообщения остальным, прочие подключаются к нему.
+ * Узел закрылся — клиенты через случайную паузу переподключаются, и один из
+ * них занимает его место. Сообщение — длина и QDataStream с набором изменений.
+ *
+ * remoteChanged приходит в GUI только для изменений других экземпляров:
+ * свои операции представления узнают из сигналов WriteQueue. С сервером
+ * базы его записи тоже приходят сигналами WriteQueue (событиями сервера),
+ * поэтому его сообщения отбрасываются (ignoreSender) — иначе изменение
+ * остатка учитывалось бы дважды.
+ *
+ * Без хуков (Qt со своей копией SQLite, см. DbManager::sqliteHandle) шина
+ * раз в kPollMs сверяет счётчики ChangeTracker в ReadPool и сообщает о
+ * сдвинувшихся таблицах целиком. Свои изменения тогда тоже приходят как
+ * чужие: лишнее перечитывание, но не пропущенное изменение. Экземпляры
+ * одной сборки либо все с хуками, либо все опрашивают.
+ */
+class ChangeBus : public QObject
+{
+    Q_OBJECT
+
+public:
+    static ChangeBus& instance();
+
+    // подключиться к экземплярам на той же базе; вызывать из GUI до старта WriteQueue
+    void start(const QString& databasePath);
+    void stop();
+
+    // хуки на соединении; без них соединение просто не сообщает о своих изменениях
+    static bool installHooks(QSqlDatabase& db);
+    static void removeHooks(QSqlDatabase& db);
+
+    // отправить зафиксированные изменения; из любого потока, отправка — в потоке шины
+    void publish(const ChangeSet& changes);
+
+    // не сообщать remoteChanged об изменениях экземпляра instanceId (pid); 0 — сообщать обо всех
+    void ignoreSender(qint64 instanceId) { m_ignoredSender = instanceId; }
+
+    // rowid изменённых строк таблицы; пусто — таблица не менялась или менялась целиком
+    static QList<int> rowIds(const ChangeSet& changes, const QString& table);
+    // таблица изменена целиком: строки не перечислены
+    static bool isTableReset(const ChangeSet& changes, const QString& table);
+
+    static constexpr int kMaxRowsPerTable = 1000;
+    static constexpr int kReconnectMs = 500;
+    static constexpr int kPollMs = 1000;
+
+signals:
+    void remoteChanged(const ChangeSet& changes);
+
+private:
+    ChangeBus();
+
+    ChangeBus(const ChangeBus&) = delete;
+    ChangeBus& operator=(const ChangeBus&) = delete;
+
+    void broadcast(const ChangeSet& changes);
+
+    void connectOrListen();
+    void startPolling();
+    void poll();
+    void scheduleReconnect();
+    void onNewConnection();
+    void onHubLost();
+    void readFrames(QLocalSocket* socket);
+    void handleFrame(const QByteArray& frame, QLocalSocket* from);
+    static void writeFrame(QLocalSocket* socket, const QByteArray& frame);
+
+private:
+    QString m_serverName;
+    qint64 m_instanceId = 0;
+    qint64 m_ignoredSender = 0;             // сервер базы, к которому подключена WriteQueue
+    bool m_resyncOnConnect = false;
+
+    QLocalServer* m_server = nullptr;       // этот экземпляр — узел
+    QList<QLocalSocket*> m_peers;           // клиенты узла
+    QLocalSocket* m_hub = nullptr;          // этот экземпляр — клиент
+
+    QTimer* m_pollTimer = nullptr;          // хуков нет: опрос счётчиков
+    bool m_pollRunning = false;
+    QHash<QString, qint64> m_polledVersions;
+};
+
+#endif // CHANGEBUS_H
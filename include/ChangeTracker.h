@@ -0,0 +1,40 @@
+#ifndef CHANGETRACKER_H
+#define CHANGETRACKER_H
+
+#include <QSqlDatabase>
+#include <QString>
+#include <QStringList>
+
+/**
+ * @brief Счётчики изменений таблиц (change_seq)
+ *
+ * Триггеры, которые создаёт MigrationRunner, увеличивают счётчик таблицы на
+ * каждую вставленную, изменённую или удалённую строку products,
+ * counterparties, documents, document_lines и inventory_movements.
+ * Счётчики только растут, поэтому сумма счётчиков набора таблиц меняется
+ * тогда и только тогда, когда изменилась хотя бы одна из них.
+ *
+ * Модель запоминает версию, прочитанную вместе с данными (версия читается
+ * до данных: запись между ними приведёт к лишнему перечитыванию, но не к
+ * пропущенному), и на «Обновить» перечитывает данные, только если версия
+ * сдвинулась. Чтение версии — поиск по первичному ключу маленькой таблицы.
+ *
+ * PRAGMA data_version не подходит: он свой у каждого соединения, не различает
+ * таблицы и не видит изменений, сделанных этим же соединением.
+ */
+class ChangeTracker
+{
+public:
+    static const QStringList& trackedTables();
+
+    // версия набора таблиц; -1 — счётчиков нет или чтение не удалось (перечитывать всегда)
+    static qint64 version(QSqlDatabase db, const QStringList& tables);
+
+    // версия не известна или сдвинулась относительно загруженной
+    static bool isStale(qint64 loaded, qint64 current)
+    {
+        return loaded < 0 || current < 0 || loaded != current;
+    }
+};
+
+#endif // CHANGETRACKER_H
@@ -5,6 +5,8 @@
 #include <QSqlDatabase>
 #include <QString>
 
+struct sqlite3;
+
 class DbManager : public QObject
 {
     Q_OBJECT
@@ -18,6 +20,23 @@ public:
     QSqlDatabase database() const;
     QString databasePath() const;
 
+    /**
+     * @brief Открыть дополнительное соединение к той же базе
+     *
+     * Соединение принадлежит вызывающему потоку и должно использоваться только в нём.
+     * Закрывать через closeConnection() из того же потока.
+     */
+    QSqlDatabase openConnection(const QString& connectionName) const;
+    static void closeConnection(const QString& connectionName);
+
+    /**
+     * @brief Хэндл sqlite3 соединения для прямых вызовов C API (сортировка, хуки)
+     *
+     * nullptr, если драйвер не отдаёт хэндл или Qt собран со своей копией
+     * SQLite (даже той же версии): такой хэндл передавать в нашу библиотеку нельзя.
+     */
+    static sqlite3* sqliteHandle(QSqlDatabase& db);
+
     void close();
 
 private:
@@ -33,6 +52,8 @@ private:
 
 private:
     bool enableForeignKeys();
+    bool enableWal();
+    static bool configureConnection(QSqlDatabase& db);
 
     bool ensureInitialized();
     bool hasTable(const QString& tableName) const;
@@ -2,41 +2,203 @@
 #define DOCUMENTSERVICE_H
 
 #include <QObject>
+#include <QHash>
+#include <QList>
+#include <QSqlDatabase>
 #include <QString>
+
+#include <functional>
+
+#include "ChangeBus.h"
 #include "repositories/IDocumentRepository.h"
 #include "repositories/IDocumentLineRepository.h"
 #include "repositories/IStockRepository.h"
 #include "repositories/IProductRepository.h"
 
+class StockReservations;
+class StockTimeline;
+
+// product id -> изменение остатка, кг
+using StockDeltas = QHash<int, double>;
+
+// document id -> новый резерв по товарам (пустой — резерв снят)
+using ReservationChanges = QHash<int, QHash<int, double>>;
+
+/**
+ * @brief Операции с документами: сохранение, проведение, отмена, списание
+ *
+ * Все проверки выполняются до BEGIN, внутри транзакции — только запись.
+ * Сервис не показывает никаких диалогов: при ошибке возвращает false/-1,
+ * текст ошибки доступен через lastError().
+ *
+ * Черновики расходных документов (ТТН, продажа) резервируют свои строки:
+ * сохранить черновик можно только в пределах доступного остатка
+ * (остаток - резерв других документов). При проведении доступный остаток
+ * проверяется снова: отмена поступления могла уменьшить остаток ниже
+ * резервов. Остаток берётся из StockTimeline, резерв — из StockReservations,
+ * так что проверка обходится без запросов к журналу.
+ *
+ * После каждой операции сервис испускает типизированный сигнал с id
+ * документов и изменениями остатков по товарам, чтобы представления
+ * обновляли только затронутые строки. Внутри группы WriteQueue сигналы
+ * копятся и испускаются только после фиксации всей группы.
+ */
 class DocumentService : public QObject
 {
     Q_OBJECT
 
 public:
     explicit DocumentService(
+        QSqlDatabase db,
         IDocumentRepository* docRepo,
         IDocumentLineRepository* lineRepo,
         IStockRepository* stockRepo,
         IProductRepository* productRepo,
         QObject *parent = nullptr
     );
-    
+
+    /**
+     * @brief Сохранить черновик (шапка + изменения строк)
+     * @param doc Шапка документа; id <= 0 — новый документ
+     * @param lines Изменения строк; после успеха у вставленных строк заполнен id
+     * @return ID документа или -1 при ошибке
+     */
+    int saveDraft(const Document &doc, DocumentLinesDiff &lines);
+
     /**
      * @brief Провести документ (создать движения товара)
      */
     bool postDocument(int documentId);
-    
+
     /**
      * @brief Отменить документ (storno)
      */
     bool cancelDocument(int documentId);
 
+    /**
+     * @brief Отменить набор проведённых документов одной транзакцией
+     *
+     * Всё или ничего: если какой-то документ не в статусе POSTED, ничего не меняется.
+     * @return Число отменённых документов или -1 при ошибке
+     */
+    int cancelDocuments(const QList<int> &documentIds);
+
+    /**
+     * @brief Отменить все проведённые документы, попадающие под фильтр
+     * @return Число отменённых документов (0 — подходящих нет) или -1 при ошибке
+     */
+    int cancelPosted(const DocumentFilter &filter);
+
+    /**
+     * @brief Списать товар со склада (создаётся проведённый документ writeoff)
+     * @return ID документа списания или -1 при ошибке
+     */
+    int writeOff(int productId, double qtyKg, const QString &reason);
+
+    /**
+     * @brief Удалить документ по правилам статуса
+     *
+     * DRAFT — физическое удаление, POSTED — отмена, CANCELLED — скрытие.
+     */
+    bool deleteDocument(int documentId);
+
+    /**
+     * @brief Закрыть периоды: снять остатки на конец каждого периода, закончившегося до today
+     *
+     * Периоды выровнены по календарю: periodMonths = 1 — месяц, 3 — квартал.
+     * Снимки идут по порядку от последнего существующего, каждый считается от предыдущего.
+     * @return Число созданных снимков или -1 при ошибке
+     */
+    int closeStockPeriods(const QDate &today, int periodMonths = kSnapshotPeriodMonths);
+
+    static constexpr int kSnapshotPeriodMonths = 1;
+
+    /**
+     * @brief Перенести закрытые годы в архив (StockArchive)
+     *
+     * В рабочей базе остаются текущий год и keepYears предыдущих. Граница —
+     * снимок остатков на 31 декабря. После переноса документы с датой не позже
+     * границы нельзя сохранить или провести. Выполняется вне транзакции:
+     * архив подключается через ATTACH.
+     * @return Число перенесённых документов (0 — переносить нечего) или -1 при ошибке
+     */
+    int archiveClosedYears(const QDate &today, int keepYears = kArchiveKeepYears);
+
+    static constexpr int kArchiveKeepYears = 1;
+
+    QString lastError() const { return m_lastError; }
+
+    /**
+     * @brief Агрегат резервов в памяти, обновляется после фиксации
+     */
+    void setReservations(StockReservations *reservations) { m_reservations = reservations; }
+
+    /**
+     * @brief Остатки по датам в памяти, обновляются после фиксации
+     */
+    void setTimeline(StockTimeline *timeline) { m_timeline = timeline; }
+
+    /**
+     * @brief Применить (или отбросить) резервы и сигналы, отложенные до фиксации внешней транзакции
+     */
+    void commitPending(bool committed);
+
+    /**
+     * @brief Обновить агрегаты по изменениям другого экземпляра приложения (см. ChangeBus)
+     *
+     * Агрегаты в памяти знают только о своих изменениях. Резервы перечитываются
+     * для изменённых документов, остатки по датам — для товаров изменённых
+     * движений; целиком — только если шина не перечислила строки или движение
+     * удалено (архив) и его товар уже не узнать.
+     */
+    void refreshStockCaches(const ChangeSet &changes);
+
+signals:
+    void documentSaved(int documentId, DocumentType type);
+    void documentPosted(int documentId, DocumentType type, const StockDeltas &deltas);
+    void documentsCancelled(const QList<int> &documentIds, const StockDeltas &deltas);
+    void documentDeleted(int documentId);
+
+    // сводный сигнал для представлений остатков: приходит после documentPosted/documentsCancelled
+    void stockChanged(const StockDeltas &deltas);
+
+    // агрегаты в памяти изменены; приходят раньше сигналов о документах той же операции.
+    // Нужны копиям агрегатов у клиентов сервера базы
+    void reservationsChanged(const ReservationChanges &changes);
+    void timelineChanged(const QList<MovementTotal> &changes);
+    void stockCachesReloaded();
+
 private:
+    bool fail(const QString &message);
+    bool checkPeriodOpen(const QDate &date);
+
+    // POSTED -> CANCELLED и отмена движений набором UPDATE ... IN (...)
+    int cancelBatch(const QList<int> &documentIds, const char *context);
+
+    // кг по товарам после применения изменений к текущим строкам документа
+    static QHash<int, double> qtyByProduct(const QList<DocumentLine> &current, const DocumentLinesDiff &diff);
+    bool checkAvailable(int documentId, const QHash<int, double> &required);
+    double currentBalance(int productId) const;
+    double reservedByOthers(int productId, int documentId) const;
+    void publishReservation(int documentId, const QHash<int, double> &qtyByProduct, bool deferred);
+    void publishEvent(std::function<void()> emitEvent, bool deferred);
+    void publishTimeline(const QList<MovementTotal> &changes, bool deferred);
+
+private:
+    QSqlDatabase m_db;
     IDocumentRepository* m_docRepo;
     IDocumentLineRepository* m_lineRepo;
     IStockRepository* m_stockRepo;
     IProductRepository* m_productRepo;
+    StockReservations* m_reservations = nullptr;
+    StockTimeline* m_timeline = nullptr;
+
+    // ждут фиксации группы в WriteQueue
+    ReservationChanges m_pendingReservations;
+    QList<MovementTotal> m_pendingTimeline;
+    QList<std::function<void()>> m_pendingEvents;
+
+    QString m_lastError;
 };
 
 #endif // DOCUMENTSERVICE_H
-
@@ -0,0 +1,33 @@
+#ifndef JSONFORMAT_H
+#define JSONFORMAT_H
+
+#include <QJsonObject>
+#include <QString>
+
+#include "repositories/IDocumentLineRepository.h"
+#include "repositories/IDocumentRepository.h"
+#include "repositories/IStockRepository.h"
+
+/**
+ * @brief JSON-представление документов и остатков для HTTP API и консольной утилиты
+ *
+ * Суммы и цены — строками: в double они потеряли бы копейки.
+ * Выгрузка документа (document + lines) читается обратно draftFromJson,
+ * так что экспорт одной базы загружается в другую черновиками.
+ */
+namespace JsonFormat {
+
+QJsonObject documentToJson(const Document& doc);
+QJsonObject lineToJson(const DocumentLine& line);
+QJsonObject balanceToJson(const StockBalance& balance);
+
+/**
+ * Черновик из JSON: type, number, date (ГГГГ-ММ-ДД, по умолчанию — сегодня),
+ * senderId, receiverId, notes, lines[productId, qtyKg, price].
+ * id и статус из JSON не берутся. false — текст ошибки в error.
+ */
+bool draftFromJson(const QJsonObject& o, Document& doc, DocumentLinesDiff& lines, QString& error);
+
+} // namespace JsonFormat
+
+#endif // JSONFORMAT_H
@@ -27,8 +27,26 @@ private:
     bool createDocumentsTable();
     bool createDocumentLinesTable();
     bool createInventoryMovementsTable();
+    bool createStockReservationsTable();
+    // снимки остатков на конец периода и триггеры, поправляющие их задним числом
+    bool createStockSnapshotTables();
+    // входящие остатки на границу архива (см. StockArchive)
+    bool createStockOpeningBalancesTable();
+    // итоги документов (сумма, число строк, вес), которые ведут триггеры на document_lines
+    bool createDocumentAggregates();
+    // счётчики изменений таблиц для пропуска лишних перечитываний (см. ChangeTracker)
+    bool createChangeCounters();
     
     bool createIndexes();
+
+    // FTS5-индексы поиска и триггеры синхронизации; без FTS5 в SQLite — пропускаются
+    bool createSearchIndex();
+    bool fts5Available();
+
+    // индексы по name COLLATE RU (см. SqlCollation); без RU — удаляются
+    bool createCollatedIndexes();
+    QString metaValue(const QString &key);
+    bool setMetaValue(const QString &key, const QString &value);
     
     bool executeQuery(const QString &sql, const QString &errorContext = "");
     
@@ -0,0 +1,78 @@
+#ifndef MPSCQUEUE_H
+#define MPSCQUEUE_H
+
+#include <atomic>
+
+/**
+ * @brief Узел интрузивной очереди: элемент очереди наследуется от него
+ */
+struct MpscNode {
+    std::atomic<MpscNode*> next{nullptr};
+};
+
+/**
+ * @brief Lock-free очередь «много писателей — один читатель» (алгоритм Вьюкова)
+ *
+ * push() можно вызывать из любого потока, pop() — только из одного потока-читателя.
+ * Очередь не владеет элементами и не выделяет память.
+ *
+ * pop() может вернуть nullptr, пока другой писатель не закончил push():
+ * читатель в этом случае просто повторяет попытку.
+ */
+class MpscQueue
+{
+public:
+    MpscQueue()
+        : m_head(&m_stub)
+        , m_tail(&m_stub)
+    {
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    void push(MpscNode* node)
+    {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        MpscNode* prev = m_head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    MpscNode* pop()
+    {
+        MpscNode* tail = m_tail;
+        MpscNode* next = tail->next.load(std::memory_order_acquire);
+
+        if (tail == &m_stub) {
+            if (!next) return nullptr;
+            m_tail = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+
+        if (next) {
+            m_tail = next;
+            return tail;
+        }
+
+        // писатель успел сделать exchange, но ещё не связал узел
+        if (tail != m_head.load(std::memory_order_acquire))
+            return nullptr;
+
+        push(&m_stub);
+
+        next = tail->next.load(std::memory_order_acquire);
+        if (next) {
+            m_tail = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+private:
+    std::atomic<MpscNode*> m_head;
+    MpscNode* m_tail;     // только поток-читатель
+    MpscNode m_stub;
+};
+
+#endif // MPSCQUEUE_H
@@ -0,0 +1,65 @@
+#ifndef READPOOL_H
+#define READPOOL_H
+
+#include <QFuture>
+#include <QMutex>
+#include <QPromise>
+#include <QSqlDatabase>
+#include <QThreadPool>
+
+#include <functional>
+#include <memory>
+
+/**
+ * @brief Пул потоков для фоновых запросов на чтение
+ *
+ * Каждый поток пула держит своё соединение к базе (WAL позволяет читать
+ * параллельно с потоком записи). Задача получает это соединение и
+ * возвращает результат через QFuture; в GUI удобно future.then(this, ...).
+ *
+ * shutdown() вызывается из main до закрытия базы: ждёт задачи и
+ * останавливает потоки, соединения закрываются в своих потоках.
+ */
+class ReadPool
+{
+public:
+    static ReadPool& instance();
+
+    template <typename T>
+    QFuture<T> run(std::function<T(QSqlDatabase)> job)
+    {
+        // QPromise только перемещаемый, а QRunnable из std::function требует копирования
+        auto promise = std::make_shared<QPromise<T>>();
+        promise->start();
+        QFuture<T> future = promise->future();
+
+        const bool started = start([promise, job = std::move(job)](QSqlDatabase db) {
+            promise->addResult(job(db));
+            promise->finish();
+        });
+
+        if (!started) {
+            promise->addResult(T{});
+            promise->finish();
+        }
+        return future;
+    }
+
+    void shutdown();
+
+    static constexpr int kMaxThreads = 2;
+
+private:
+    ReadPool();
+
+    ReadPool(const ReadPool&) = delete;
+    ReadPool& operator=(const ReadPool&) = delete;
+
+    bool start(std::function<void(QSqlDatabase)> task);
+
+private:
+    QMutex m_lock;
+    std::unique_ptr<QThreadPool> m_pool;
+};
+
+#endif // READPOOL_H
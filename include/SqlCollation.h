@@ -0,0 +1,46 @@
+#ifndef SQLCOLLATION_H
+#define SQLCOLLATION_H
+
+#include <QSqlDatabase>
+#include <QString>
+#include <QStringView>
+
+/**
+ * @brief Русская сортировка «RU» для SQLite на основе QCollator
+ *
+ * Встроенная BINARY сравнивает байты UTF-8: «мука» оказывается после «Яблоко»,
+ * а «ООО "Б"» — перед «ООО А». RU сравнивает как QCollator для ru_RU:
+ * без учёта регистра и знаков препинания, числа — по значению.
+ *
+ * DbManager регистрирует RU на каждом соединении (основное, поток записи,
+ * ReadPool) до первого запроса. Индексы по name COLLATE RU создаёт
+ * MigrationRunner, и только если регистрация удалась: база с такими
+ * индексами без RU не сможет менять products/counterparties.
+ *
+ * Регистрация идёт через sqlite3_create_collation_v2 на хэндле драйвера,
+ * поэтому Qt должен использовать ту же библиотеку SQLite, что и приложение
+ * (сборка Qt с -system-sqlite). При несовпадении версий RU не регистрируется,
+ * а запросы сортируют по BINARY, как раньше.
+ */
+class SqlCollation
+{
+public:
+    static constexpr const char* kName = "RU";
+
+    // зарегистрировать RU на соединении; false — сортировка остаётся BINARY
+    static bool install(QSqlDatabase& db);
+
+    // RU зарегистрирована (на всех соединениях процесса — одна и та же библиотека)
+    static bool isAvailable();
+
+    // "p.name COLLATE RU" или просто "p.name", если RU нет
+    static QString orderBy(const QString& column);
+
+    // сравнить как ORDER BY orderBy(): по RU, без неё — по кодам символов, как BINARY
+    static int compare(QStringView a, QStringView b);
+
+    // отпечаток правил сравнения: сменился — индексы RU нужно перестроить
+    static QString fingerprint();
+};
+
+#endif // SQLCOLLATION_H
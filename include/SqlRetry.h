@@ -0,0 +1,75 @@
+#ifndef SQLRETRY_H
+#define SQLRETRY_H
+
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QString>
+
+#include <functional>
+
+/**
+ * @brief Статистика конкуренции за блокировку базы
+ */
+struct SqlRetryStats {
+    quint64 busyErrors = 0;     // ответов SQLITE_BUSY / SQLITE_LOCKED
+    quint64 retries = 0;        // повторов отдельных запросов
+    quint64 txRetries = 0;      // повторов транзакций целиком
+    quint64 gaveUp = 0;         // попытки исчерпаны, ошибка ушла вызывающему
+    quint64 lockWaits = 0;      // запросов, которым пришлось ждать блокировку
+    qint64 lockWaitUs = 0;      // суммарное ожидание, включая busy_timeout внутри SQLite
+    qint64 maxLockWaitUs = 0;
+};
+
+/**
+ * @brief Выполнение запросов с повтором при SQLITE_BUSY / SQLITE_LOCKED
+ *
+ * Сначала ждёт сама SQLite (busy_timeout, его ставит DbManager). Если
+ * блокировку так и не дали, запрос повторяется с экспоненциальной паузой
+ * и случайным разбросом, но не больше kMaxAttempts раз.
+ *
+ * Повторять отдельный запрос можно только вне транзакции. Внутри открытой
+ * WriteTransaction запрос не повторяется: поток отмечает, что транзакция
+ * упёрлась в блокировку, и её целиком откатывает и повторяет transaction().
+ * BEGIN, COMMIT и ROLLBACK (execControl) повторяются всегда: после BUSY
+ * транзакция остаётся в прежнем состоянии.
+ */
+class SqlRetry
+{
+public:
+    // блокировка занята другим соединением или процессом
+    static bool isBusy(const QSqlError& error);
+
+    // подготовленный запрос; повторяется, если соединение вне транзакции
+    static bool exec(const QSqlDatabase& db, QSqlQuery& query);
+
+    // управляющий запрос транзакции (BEGIN IMMEDIATE, COMMIT, ROLLBACK)
+    static bool execControl(const QSqlDatabase& db, QSqlQuery& query, const QString& sql);
+
+    /**
+     * @brief Выполнять транзакцию заново, пока она срывается из-за блокировки
+     * @param attempt Открывает, выполняет и фиксирует транзакцию; должна быть
+     *        идемпотентной: после неудачи вся её работа откатывается
+     * @return Результат последней попытки
+     */
+    static bool transaction(const QString& context, const std::function<bool()>& attempt);
+
+    // в текущей транзакции этого потока был BUSY/LOCKED: фиксировать её нельзя
+    static bool busyInTransaction();
+
+    // пауза перед повтором номер attempt (с 1)
+    static int backoffMs(int attempt);
+
+    static SqlRetryStats stats();
+    static void logStats();
+
+    static constexpr int kBusyTimeoutMs = 1000;
+    static constexpr int kMaxAttempts = 5;
+    static constexpr int kBaseDelayMs = 10;
+    static constexpr int kMaxDelayMs = 200;
+
+private:
+    static bool run(QSqlQuery& query, const QString& sql, bool retry, bool inTransaction);
+};
+
+#endif // SQLRETRY_H
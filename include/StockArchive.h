@@ -0,0 +1,78 @@
+#ifndef STOCKARCHIVE_H
+#define STOCKARCHIVE_H
+
+#include <QDate>
+#include <QSqlDatabase>
+#include <QString>
+
+/**
+ * @brief Архив закрытых лет: документы и движения в отдельном файле SQLite
+ *
+ * Проведённые и отменённые документы по дату архива включительно вместе со
+ * строками и движениями переносятся в wholesale_trade_archive.db. В рабочей
+ * базе вместо них остаётся входящий остаток (stock_opening_balances), поэтому
+ * текущие остатки считаются как раньше — по рабочей базе, без архива.
+ *
+ * Архив подключается (ATTACH) только на время отчёта или переноса. После
+ * attach() на соединении доступны временные представления all_documents,
+ * all_document_lines, all_inventory_movements, all_stock_snapshot_periods и
+ * all_stock_snapshots — рабочие и архивные строки вместе. Граница берётся из
+ * db_meta рабочей базы: строки, уже скопированные в архив, но ещё не удалённые
+ * из рабочей базы, в представлениях не задваиваются.
+ *
+ * ATTACH/DETACH нельзя выполнять внутри транзакции. Объект принадлежит потоку
+ * своего соединения; деструктор отключает архив, если его подключил этот объект.
+ */
+class StockArchive
+{
+public:
+    explicit StockArchive(QSqlDatabase db, const QString &path = defaultPath());
+    ~StockArchive();
+
+    StockArchive(const StockArchive&) = delete;
+    StockArchive& operator=(const StockArchive&) = delete;
+
+    static QString defaultPath();
+
+    bool exists() const;
+
+    /**
+     * @brief Подключить архив и создать представления all_*
+     * @param create Создать файл и таблицы архива, если их нет (только для переноса)
+     */
+    bool attach(bool create = false);
+    void detach();
+    bool isAttached() const { return m_attached; }
+
+    /**
+     * @brief Перенести закрытые документы с датой <= periodEnd в архив
+     *
+     * Две транзакции: сначала копия в архив, затем в рабочей базе — входящий
+     * остаток, удаление перенесённого и новая граница архива. Повторный запуск
+     * после сбоя между ними докопирует недостающее и завершит перенос.
+     * На конец periodEnd должен быть снимок остатков. Архив должен быть подключён.
+     * @return Число перенесённых документов или -1 при ошибке
+     */
+    int moveThrough(const QDate &periodEnd);
+
+    // дата, по которую включительно данные лежат в архиве (невалидная — архива нет)
+    static QDate archivedThrough(QSqlDatabase db);
+
+    QString lastError() const { return m_lastError; }
+
+    static constexpr const char *kSchema = "archive";
+
+private:
+    bool createTables();
+    bool createViews();
+    bool exec(const QString &sql, const char *context);
+    bool fail(const QString &message);
+
+private:
+    QSqlDatabase m_db;
+    QString m_path;
+    QString m_lastError;
+    bool m_attached = false;
+};
+
+#endif // STOCKARCHIVE_H
@@ -0,0 +1,51 @@
+#ifndef STOCKRESERVATIONS_H
+#define STOCKRESERVATIONS_H
+
+#include <QHash>
+#include <QList>
+#include <QReadWriteLock>
+
+#include "repositories/IStockRepository.h"
+
+/**
+ * @brief Резервы товара черновиками в памяти (агрегат по товарам)
+ *
+ * Источник истины — таблица stock_reservations; здесь её копия,
+ * которую поток записи обновляет после фиксации, а формы читают
+ * без запросов к БД. Доступно к отгрузке = остаток - резерв.
+ *
+ * Потокобезопасен: запись из потока WriteQueue, чтение из GUI.
+ */
+class StockReservations
+{
+public:
+    StockReservations() = default;
+
+    StockReservations(const StockReservations&) = delete;
+    StockReservations& operator=(const StockReservations&) = delete;
+
+    void load(const QList<StockReservation>& rows);
+    QList<StockReservation> rows() const;
+
+    // заменить резерв документа; пустой набор снимает резерв
+    void setDocument(int documentId, const QHash<int, double>& qtyByProduct);
+    void removeDocument(int documentId);
+
+    bool hasDocument(int documentId) const;
+    double reservedBy(int documentId, int productId) const;
+
+    double reserved(int productId) const;
+
+    // резерв по товару без учёта указанного документа (его собственные строки не мешают ему)
+    double reservedExcluding(int productId, int documentId) const;
+
+private:
+    void removeDocumentLocked(int documentId);
+
+private:
+    mutable QReadWriteLock m_lock;
+    QHash<int, double> m_byProduct;                 // product id -> кг
+    QHash<int, QHash<int, double>> m_byDocument;    // document id -> (product id -> кг)
+};
+
+#endif // STOCKRESERVATIONS_H
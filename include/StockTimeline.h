@@ -0,0 +1,67 @@
+#ifndef STOCKTIMELINE_H
+#define STOCKTIMELINE_H
+
+#include <QDate>
+#include <QHash>
+#include <QList>
+#include <QReadWriteLock>
+
+#include "repositories/IStockRepository.h"
+
+/**
+ * @brief Остатки товаров на любую дату в памяти (дерево Фенвика по дням)
+ *
+ * Для каждого товара — дерево Фенвика по номеру дня от общей базовой даты:
+ * точка — сумма неотменённых движений за день, префикс — остаток на конец дня.
+ * balanceAt() — O(log n) по числу дней, balancesAt() — O(товаров · log n),
+ * без запросов к inventory_movements.
+ *
+ * Строится потоком WriteQueue из журнала при старте и обновляется им же
+ * после фиксации проведения/отмены (как StockReservations). Читают GUI и отчёты.
+ * Память — 8 байт на товар-день с начала журнала (≈3 КБ на товар за год).
+ *
+ * Потокобезопасен: запись из потока WriteQueue, чтение из любых потоков.
+ */
+class StockTimeline
+{
+public:
+    StockTimeline() = default;
+
+    StockTimeline(const StockTimeline&) = delete;
+    StockTimeline& operator=(const StockTimeline&) = delete;
+
+    void load(const QList<MovementTotal>& totals);
+
+    // изменения после фиксации: движение +qty на дату, отмена — -qty на дату движения
+    void apply(const QList<MovementTotal>& changes);
+
+    // перечитанные из базы движения набора товаров вместо прежних; возвращает внесённые изменения
+    QList<MovementTotal> replaceProducts(const QList<int>& productIds, const QList<MovementTotal>& totals);
+
+    bool isLoaded() const;
+
+    // движения по товарам и дням (ненулевые суммы); load(totals()) восстанавливает копию
+    QList<MovementTotal> totals() const;
+
+    // остаток на конец дня date
+    double balanceAt(int productId, const QDate& date) const;
+    // текущий остаток: все движения, включая будущие даты
+    double balance(int productId) const;
+    QHash<int, double> balancesAt(const QDate& date) const;
+
+    // дата самого раннего движения (невалидная, если журнал пуст)
+    QDate firstDate() const;
+
+private:
+    void addLocked(int productId, qint64 day, double qtyKg);
+    void rebaseLocked(qint64 newBaseDay);
+    static void growTree(QList<double>& tree, qsizetype minSize);
+
+private:
+    mutable QReadWriteLock m_lock;
+    bool m_loaded = false;
+    qint64 m_baseDay = 0;                      // юлианский день позиции 0
+    QHash<int, QList<double>> m_trees;         // product id -> дерево Фенвика
+};
+
+#endif // STOCKTIMELINE_H
@@ -0,0 +1,179 @@
+#ifndef WRITEQUEUE_H
+#define WRITEQUEUE_H
+
+#include <QByteArray>
+#include <QObject>
+#include <QFuture>
+#include <QSemaphore>
+#include <QSqlDatabase>
+#include <QString>
+
+#include <atomic>
+#include <functional>
+
+#include "DocumentService.h"
+#include "MpscQueue.h"
+#include "StockReservations.h"
+#include "StockTimeline.h"
+#include "repositories/IDocumentRepository.h"
+#include "repositories/IDocumentLineRepository.h"
+
+class QThread;
+class RemoteClient;
+enum class RemoteOp : quint16;
+
+/**
+ * @brief Результат команды записи
+ */
+struct WriteResult {
+    bool ok = false;
+    int id = 0;                 // ID документа (saveDraft, writeOff)
+    int count = 0;              // cancelPosted: сколько документов отменено; closeStockPeriods: сколько снимков;
+                                // archiveClosedYears: сколько документов перенесено
+    QString error;
+    DocumentLinesDiff lines;    // saveDraft: применённые строки с заполненными id
+};
+
+/**
+ * @brief Копия резервов и остатков по датам для клиентов сервера базы
+ */
+struct StockCachesSnapshot {
+    QList<StockReservation> reservations;
+    QList<MovementTotal> totals;
+};
+
+/**
+ * @brief Статистика очереди записи
+ */
+struct WriteQueueStats {
+    quint64 commands = 0;
+    quint64 groups = 0;
+    quint64 failedGroups = 0;
+    int maxGroupSize = 0;
+};
+
+/**
+ * @brief Очередь записи: все операции, меняющие склад, выполняет один поток
+ *
+ * Команды из любого потока кладутся в lock-free MPSC очередь. Поток записи
+ * собирает команды, пришедшие в течение kGroupWindowMs, и выполняет их одной
+ * транзакцией (групповая фиксация — один fsync на группу). Каждая команда
+ * работает в своей точке сохранения, поэтому ошибка одной не откатывает другие.
+ *
+ * Команды, которым нужна работа вне транзакции (ATTACH архива), выполняются
+ * отдельно от групп и сами управляют своими транзакциями.
+ *
+ * Результат возвращается через QFuture; в GUI удобно использовать
+ * future.then(this, ...), чтобы продолжение выполнилось в потоке виджета.
+ *
+ * Удалённый режим (setRemote): команды уходят серверу базы и выполняются
+ * его очередью записи, своего потока нет. Сигналы тогда — события сервера.
+ * Резервы и остатки по датам — копия агрегатов сервера: снимок при
+ * подключении (запрос в фоне, GUI не ждёт) и изменения из событий сервера.
+ * События, пришедшие до ответа со снимком, в нём уже учтены. Сервер
+ * закрыл соединение — неотвеченные команды завершаются ошибкой, а очередь
+ * запускает свой поток записи (как без сервера) и сообщает remoteLost.
+ *
+ * Сигналы DocumentService ретранслируются в поток, где живёт очередь (GUI):
+ * любое окно может подписаться и обновить только затронутые строки, даже
+ * если операцию выполнило другое окно. Сигналы приходят раньше продолжений
+ * future той же группы.
+ */
+class WriteQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit WriteQueue(QObject* parent = nullptr);
+    ~WriteQueue() override;
+
+    // выполнять команды на сервере базы; вызывать до start(), client живёт в том же потоке
+    void setRemote(RemoteClient* client);
+    bool isRemote() const { return m_remote != nullptr; }
+
+    bool start();
+    void stop();
+
+    QFuture<WriteResult> saveDraft(const Document& doc, const DocumentLinesDiff& lines);
+    QFuture<WriteResult> postDocument(int documentId);
+    QFuture<WriteResult> cancelDocument(int documentId);
+    QFuture<WriteResult> cancelPosted(const DocumentFilter& filter);
+    QFuture<WriteResult> writeOff(int productId, double qtyKg, const QString& reason);
+    QFuture<WriteResult> deleteDocument(int documentId);
+    QFuture<WriteResult> closeStockPeriods(const QDate& today,
+                                           int periodMonths = DocumentService::kSnapshotPeriodMonths);
+    QFuture<WriteResult> archiveClosedYears(const QDate& today,
+                                            int keepYears = DocumentService::kArchiveKeepYears);
+
+    // обновить резервы и остатки по датам по изменениям другого экземпляра (строки из ChangeBus)
+    QFuture<WriteResult> refreshStockCaches(const ChangeSet& changes);
+
+    // снимок агрегатов в потоке записи: изменения, о которых уже были сигналы, в него вошли,
+    // последующие — нет (сервер базы отдаёт его новым клиентам)
+    QFuture<StockCachesSnapshot> stockCachesSnapshot();
+
+    WriteQueueStats stats() const;
+
+    // резервы черновиков; агрегат обновляет поток записи после фиксации группы
+    const StockReservations& reservations() const { return m_reservations; }
+
+    // остатки на любую дату; строится потоком записи при старте (см. timelineLoaded)
+    const StockTimeline& timeline() const { return m_timeline; }
+
+signals:
+    void documentSaved(int documentId, DocumentType type);
+    void documentPosted(int documentId, DocumentType type, const StockDeltas& deltas);
+    void documentsCancelled(const QList<int>& documentIds, const StockDeltas& deltas);
+    void documentDeleted(int documentId);
+    void stockChanged(const StockDeltas& deltas);
+    void timelineLoaded();
+
+    // изменения агрегатов; приходят раньше сигналов о документах той же операции
+    void reservationsChanged(const ReservationChanges& changes);
+    void timelineChanged(const QList<MovementTotal>& changes);
+    void stockCachesReloaded();
+
+    // сервер базы пропал: очередь перешла на свой поток записи
+    void remoteLost(const QString& error);
+
+public:
+    // окно сбора команд в одну группу
+    static constexpr int kGroupWindowMs = 2;
+    static constexpr int kMaxGroupSize = 64;
+
+private:
+    using Job = std::function<WriteResult(DocumentService&)>;
+    struct Command;
+
+    // exclusive — команда выполняется одна, без общей транзакции группы
+    QFuture<WriteResult> submit(const char* name, Job job, bool exclusive = false);
+    Command* takeCommand();
+
+    void run();
+    void runGroup(QSqlDatabase db, DocumentService& service, QList<Command*>& group);
+    void runExclusive(DocumentService& service, Command* cmd);
+
+    QFuture<WriteResult> submitRemote(RemoteOp op, const QByteArray& args);
+    void onServerEvent(RemoteOp op, const QByteArray& payload);
+    void loadRemoteCaches();
+    void onRemoteDisconnected();
+
+private:
+    StockReservations m_reservations;
+    StockTimeline m_timeline;
+
+    MpscQueue m_queue;
+    QSemaphore m_pending;
+    QThread* m_thread = nullptr;
+    RemoteClient* m_remote = nullptr;
+    quint64 m_cachesRequest = 0;         // номер последнего запроса снимка у сервера
+    bool m_cachesLoading = false;        // ждём снимок: события изменений агрегатов в него войдут
+    std::atomic_bool m_running{false};
+
+    std::atomic<quint64> m_commands{0};
+    std::atomic<quint64> m_groups{0};
+    std::atomic<quint64> m_failedGroups{0};
+    std::atomic<int> m_maxGroupSize{0};
+};
+
+#endif // WRITEQUEUE_H
@@ -0,0 +1,73 @@
+#ifndef WRITETRANSACTION_H
+#define WRITETRANSACTION_H
+
+#include <QElapsedTimer>
+#include <QSqlDatabase>
+#include <QString>
+
+/**
+ * @brief Статистика удержания блокировки записи SQLite
+ */
+struct WriteLockStats {
+    quint64 committed = 0;
+    quint64 rolledBack = 0;
+    qint64 lastUs = 0;
+    qint64 maxUs = 0;
+    qint64 totalUs = 0;
+};
+
+/**
+ * @brief Пишущая транзакция (BEGIN IMMEDIATE ... COMMIT)
+ *
+ * Блокировка записи берётся сразу при BEGIN и держится до commit()/rollback().
+ * Если commit() не вызван, деструктор откатывает транзакцию.
+ * Время удержания блокировки попадает в общую статистику.
+ *
+ * Если на этом соединении уже открыта WriteTransaction (групповая фиксация
+ * в WriteQueue), вложенная работает через SAVEPOINT: её откат не затрагивает
+ * остальные команды группы, а фиксирует всё внешняя транзакция.
+ *
+ * BEGIN и COMMIT при занятой блокировке повторяются (SqlRetry); повтор
+ * транзакции целиком — дело вызывающего, см. SqlRetry::transaction().
+ *
+ * Внутри транзакции не должно быть никакого взаимодействия с пользователем.
+ */
+class WriteTransaction
+{
+public:
+    WriteTransaction(QSqlDatabase db, const QString& context);
+    ~WriteTransaction();
+
+    WriteTransaction(const WriteTransaction&) = delete;
+    WriteTransaction& operator=(const WriteTransaction&) = delete;
+
+    bool isActive() const { return m_active; }
+    bool isNested() const { return !m_savepoint.isEmpty(); }
+
+    bool commit();
+    void rollback();
+
+    QString lastError() const { return m_lastError; }
+
+    static WriteLockStats stats();
+
+    // на соединении открыта WriteTransaction этого потока
+    static bool isOpen(const QSqlDatabase& db);
+
+    // порог, выше которого удержание блокировки пишется в лог как предупреждение
+    static constexpr qint64 kSlowLockUs = 5000;
+
+private:
+    bool exec(const QString& sql);
+    void finish(bool committed);
+
+private:
+    QSqlDatabase m_db;
+    QString m_context;
+    QString m_savepoint;
+    QString m_lastError;
+    QElapsedTimer m_timer;
+    bool m_active = false;
+};
+
+#endif // WRITETRANSACTION_H
@@ -0,0 +1,71 @@
+#ifndef DBSERVER_H
+#define DBSERVER_H
+
+#include <QList>
+#include <QObject>
+#include <QString>
+
+#include "remote/RemoteProtocol.h"
+
+class QLocalServer;
+class QLocalSocket;
+class WriteQueue;
+
+/**
+ * @brief Статистика сервера базы
+ */
+struct DbServerStats {
+    int clients = 0;
+    quint64 snapshots = 0;      // снимки резервов и остатков для новых клиентов
+    quint64 writes = 0;
+    quint64 rejected = 0;       // неизвестная операция или испорченные аргументы
+};
+
+/**
+ * @brief Сервер базы: единственный процесс, который пишет в файл SQLite
+ *
+ * Принимает клиентов по QLocalSocket (протокол — RemoteProtocol). Запись —
+ * командами единственной WriteQueue: запросы всех клиентов попадают в одни
+ * и те же группы, и блокировку записи никто не оспаривает. Читают клиенты
+ * сами, своими соединениями (WAL). Резервы и остатки по датам сервер отдаёт
+ * снимком при подключении, дальше — изменениями в событиях.
+ *
+ * Ответ уходит клиенту, когда готов; события WriteQueue рассылаются всем.
+ * Клиент отключился — его ещё не готовые ответы отбрасываются.
+ */
+class DbServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DbServer(WriteQueue* writeQueue, QObject* parent = nullptr);
+    ~DbServer() override;
+
+    bool listen(const QString& serverName);
+    void close();
+
+    DbServerStats stats() const;
+    void logStats() const;
+
+private:
+    void onNewConnection();
+    void onReadyRead(QLocalSocket* socket);
+    void handleRequest(QLocalSocket* socket, const RemoteProtocol::Frame& request);
+    void sendReply(QLocalSocket* socket, quint32 id, RemoteOp op, const RemoteReply& reply);
+    void broadcast(RemoteOp op, const QByteArray& payload);
+
+    // команда WriteQueue; false — аргументы испорчены
+    static bool isWrite(RemoteOp op);
+    bool submitWrite(RemoteOp op, const QByteArray& args, QFuture<WriteResult>& future);
+
+private:
+    WriteQueue* m_writeQueue;
+    QLocalServer* m_server = nullptr;
+    QList<QLocalSocket*> m_clients;
+
+    quint64 m_snapshots = 0;
+    quint64 m_writes = 0;
+    quint64 m_rejected = 0;
+};
+
+#endif // DBSERVER_H
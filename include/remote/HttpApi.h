@@ -0,0 +1,76 @@
+#ifndef HTTPAPI_H
+#define HTTPAPI_H
+
+#include <QObject>
+#include <QString>
+
+#include <atomic>
+
+class QThread;
+class WriteQueue;
+
+/**
+ * @brief Статистика HTTP API
+ */
+struct HttpApiStats {
+    quint64 requests = 0;
+    quint64 notModified = 0;    // ответ 304 по If-None-Match, без обращения к данным
+    quint64 cacheHits = 0;      // тело взято из кэша ответов
+    quint64 errors = 0;         // ответы 4xx/5xx
+};
+
+/**
+ * @brief HTTP/JSON API остатков и документов на localhost
+ *
+ *   GET  /stock                      остатки активных товаров
+ *   GET  /stock/{productId}          остаток, резерв черновиков и доступное количество
+ *   GET  /documents?from=&to=        документы за период (даты ISO, по умолчанию — сегодня)
+ *   POST /documents                  создать черновик (JSON: type, number, date,
+ *                                    senderId, receiverId, notes, lines[productId, qtyKg, price])
+ *
+ * Сервер работает в своём потоке со своим соединением к базе и GUI не
+ * трогает. ETag ответа — версия счётчиков изменений его таблиц
+ * (ChangeTracker): совпал с If-None-Match — 304 без чтения данных.
+ * Тело /stock кэшируется до следующего изменения таблиц. Список документов
+ * уходит по частям (chunked): страница по kDocumentPageSize читается, когда
+ * клиент разобрал отправленное (bytesWritten), поток HTTP при этом не ждёт
+ * ни клиента, ни базы. Страницы читаются по ходу отдачи, поэтому документ,
+ * изменённый за это время, может прийти уже в новом виде.
+ *
+ * Черновик создаётся командой WriteQueue, как из формы; ответ — 201 с id
+ * или 422 с текстом ошибки DocumentService.
+ */
+class HttpApi : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit HttpApi(WriteQueue* writeQueue, QObject* parent = nullptr);
+    ~HttpApi() override;
+
+    // слушать 127.0.0.1:port; false — порт занят или база недоступна
+    bool start(quint16 port);
+    void stop();
+
+    HttpApiStats stats() const;
+    void logStats() const;
+
+    static constexpr int kMaxRequestBytes = 1024 * 1024;
+    static constexpr int kDocumentPageSize = 200;
+    static constexpr qint64 kMaxPendingWriteBytes = 256 * 1024;
+    static constexpr int kMaxCachedBytes = 4 * 1024 * 1024;
+
+private:
+    class Worker;
+
+    WriteQueue* m_writeQueue;
+    QThread* m_thread = nullptr;
+    Worker* m_worker = nullptr;
+
+    std::atomic<quint64> m_requests{0};
+    std::atomic<quint64> m_notModified{0};
+    std::atomic<quint64> m_cacheHits{0};
+    std::atomic<quint64> m_errors{0};
+};
+
+#endif // HTTPAPI_H
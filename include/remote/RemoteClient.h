@@ -0,0 +1,72 @@
+#ifndef REMOTECLIENT_H
+#define REMOTECLIENT_H
+
+#include <QByteArray>
+#include <QFuture>
+#include <QHash>
+#include <QObject>
+#include <QPromise>
+#include <QString>
+
+#include <memory>
+
+#include "remote/RemoteProtocol.h"
+
+class QLocalSocket;
+
+/**
+ * @brief Подключение к серверу базы (WholesaleTradeServer)
+ *
+ * request() отправляет запрос и сразу возвращает QFuture: ответ придёт из
+ * цикла событий потока, где живёт клиент. call() — то же самое, но ждёт
+ * ответ на месте (рукопожатие при подключении); в потоке GUI его не зовут:
+ * ожидание крутит цикл событий и повторно входит в обработчики событий.
+ *
+ * События сервера приходят сигналом serverEvent. Соединение живёт в одном
+ * потоке: из других потоков нужен свой RemoteClient.
+ */
+class RemoteClient : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit RemoteClient(QObject* parent = nullptr);
+    ~RemoteClient() override;
+
+    /**
+     * @brief Подключиться и сверить версию протокола
+     * @return false — сервера нет или он другой версии
+     */
+    bool connectToServer(const QString& serverName, int timeoutMs = kConnectTimeoutMs);
+    bool isConnected() const;
+    void disconnectFromServer();
+
+    QFuture<RemoteReply> request(RemoteOp op, const QByteArray& args = QByteArray());
+    RemoteReply call(RemoteOp op, const QByteArray& args = QByteArray(), int timeoutMs = kCallTimeoutMs);
+
+    QString lastError() const { return m_lastError; }
+
+    // pid процесса сервера из ответа Hello: отправитель его сообщений в ChangeBus
+    qint64 serverPid() const { return m_serverPid; }
+
+    static constexpr int kConnectTimeoutMs = 500;
+    static constexpr int kCallTimeoutMs = 30000;
+
+signals:
+    void serverEvent(RemoteOp op, const QByteArray& payload);
+    void disconnected();
+
+private:
+    void onReadyRead();
+    void onDisconnected();
+    void failPending(const QString& error);
+
+private:
+    QLocalSocket* m_socket = nullptr;
+    quint32 m_nextId = 1;
+    QHash<quint32, std::shared_ptr<QPromise<RemoteReply>>> m_pending;
+    QString m_lastError;
+    qint64 m_serverPid = 0;
+};
+
+#endif // REMOTECLIENT_H
@@ -0,0 +1,132 @@
+#ifndef REMOTEPROTOCOL_H
+#define REMOTEPROTOCOL_H
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QIODevice>
+#include <QString>
+
+#include "WriteQueue.h"
+#include "repositories/IDocumentRepository.h"
+#include "repositories/IDocumentLineRepository.h"
+#include "repositories/IStockRepository.h"
+
+/**
+ * @brief Операции сервера базы (WholesaleTradeServer)
+ *
+ * Номера — часть протокола: новые операции только добавляются в конец группы.
+ */
+enum class RemoteOp : quint16 {
+    Hello = 1,
+
+    // 100–211 — чтение репозиториев в версии 1 протокола; номера не переиспользуются
+
+    // снимок резервов и остатков по датам из WriteQueue сервера
+    StockCaches = 250,
+
+    // запись — команды WriteQueue сервера
+    SaveDraft = 300,
+    PostDocument,
+    CancelDocument,
+    CancelPosted,
+    WriteOff,
+    DeleteDocument,
+    CloseStockPeriods,
+    ArchiveClosedYears,
+
+    // события сервера (сигналы его WriteQueue), приходят всем клиентам
+    DocumentSavedEvent = 400,
+    DocumentPostedEvent,
+    DocumentsCancelledEvent,
+    DocumentDeletedEvent,
+    StockChangedEvent,
+    ReservationsChangedEvent,
+    TimelineChangedEvent,
+    StockCachesReloadedEvent
+};
+
+/**
+ * @brief Ответ сервера на запрос
+ */
+struct RemoteReply {
+    bool ok = false;
+    QString error;
+    QByteArray payload;         // результат операции, упакованный RemoteProtocol::pack
+};
+
+/**
+ * @brief Двоичный протокол между сервером базы и клиентами по QLocalSocket
+ *
+ * Кадр в сокете — QByteArray в QDataStream (длина + байты), как у ChangeBus.
+ * Внутри кадра: вид (запрос, ответ, событие), номер запроса, операция и
+ * аргументы или результат в QDataStream. Номер запроса выбирает клиент;
+ * ответы приходят в порядке готовности, а не в порядке запросов, поэтому
+ * долгая команда одного клиента не задерживает ответы остальным.
+ *
+ * Версия сверяется операцией Hello при подключении; в ответе — pid сервера.
+ */
+namespace RemoteProtocol {
+
+constexpr quint8 kVersion = 3;
+constexpr QDataStream::Version kStreamVersion = QDataStream::Qt_6_0;
+
+enum class FrameKind : quint8 {
+    Request = 1,
+    Reply = 2,
+    Event = 3
+};
+
+struct Frame {
+    FrameKind kind = FrameKind::Request;
+    quint32 id = 0;                 // 0 — событие
+    RemoteOp op = RemoteOp::Hello;
+    RemoteReply reply;              // у запроса и события заполнен только payload
+};
+
+// имя локального сокета сервера для базы по пути databasePath
+QString serverName(const QString& databasePath);
+
+QByteArray encodeFrame(const Frame& frame);
+bool decodeFrame(const QByteArray& bytes, Frame& frame);
+
+// прочитать из сокета все пришедшие целиком кадры (без разбора)
+QList<QByteArray> readFrames(QIODevice* device);
+void writeFrame(QIODevice* device, const QByteArray& bytes);
+
+template <typename... Args>
+QByteArray pack(const Args&... args)
+{
+    QByteArray bytes;
+    QDataStream out(&bytes, QIODevice::WriteOnly);
+    out.setVersion(kStreamVersion);
+    (out << ... << args);
+    return bytes;
+}
+
+template <typename... Args>
+bool unpack(const QByteArray& bytes, Args&... args)
+{
+    QDataStream in(bytes);
+    in.setVersion(kStreamVersion);
+    (in >> ... >> args);
+    return in.status() == QDataStream::Ok;
+}
+
+} // namespace RemoteProtocol
+
+QDataStream& operator<<(QDataStream& out, const Document& d);
+QDataStream& operator>>(QDataStream& in, Document& d);
+QDataStream& operator<<(QDataStream& out, const DocumentFilter& f);
+QDataStream& operator>>(QDataStream& in, DocumentFilter& f);
+QDataStream& operator<<(QDataStream& out, const DocumentLine& l);
+QDataStream& operator>>(QDataStream& in, DocumentLine& l);
+QDataStream& operator<<(QDataStream& out, const DocumentLinesDiff& diff);
+QDataStream& operator>>(QDataStream& in, DocumentLinesDiff& diff);
+QDataStream& operator<<(QDataStream& out, const MovementTotal& t);
+QDataStream& operator>>(QDataStream& in, MovementTotal& t);
+QDataStream& operator<<(QDataStream& out, const StockReservation& r);
+QDataStream& operator>>(QDataStream& in, StockReservation& r);
+QDataStream& operator<<(QDataStream& out, const WriteResult& r);
+QDataStream& operator>>(QDataStream& in, WriteResult& r);
+
+#endif // REMOTEPROTOCOL_H
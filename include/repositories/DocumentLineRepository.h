@@ -13,8 +13,10 @@ public:
     int create(const DocumentLine& line) override;
     DocumentLine findById(int id) override;
     QList<DocumentLine> findByDocument(int documentId) override;
+    std::optional<QHash<int, QList<DocumentLine>>> findByDocuments(const QList<int>& documentIds) override;
     bool deleteByDocument(int documentId) override;
     bool update(const DocumentLine& line) override;
+    bool applyDiff(int documentId, DocumentLinesDiff& diff) override;
 
 private:
     DocumentLine lineFromQuery(const QSqlQuery& q) const;
@@ -16,9 +16,18 @@ public:
     QList<Document> findAll() override;
     QList<Document> findByStatus(DocumentStatus status) override;
     QList<Document> findByDateRange(const QDate& from, const QDate& to) override;
+    std::optional<QList<Document>> findPageByDateRange(const QDate& from, const QDate& to,
+                                                       const QDate& afterDate, int afterId, int limit) override;
     bool update(const Document& document) override;
     bool cancel(int id) override;
     bool exists(int id) override;
+    bool updateStatus(int id, DocumentStatus from, DocumentStatus to) override;
+    int updateStatusBatch(const QList<int>& ids, DocumentStatus from, DocumentStatus to) override;
+    std::optional<QList<int>> findIds(DocumentStatus status, const DocumentFilter& filter) override;
+    int countIds(DocumentStatus status, const DocumentFilter& filter) override;
+    bool numberExists(const QString& number, DocumentType type, int excludeId) override;
+    bool remove(int id) override;
+    bool softDelete(int id) override;
 
 private:
     static QString docTypeToDb(DocumentType t);
@@ -27,6 +36,9 @@ private:
     static DocumentStatus statusFromDb(const QString& s);
 
     Document documentFromQuery(const QSqlQuery& q) const;
+    // условие findIds/countIds и его параметры
+    static QString filterWhere(const DocumentFilter& filter);
+    static void bindFilter(QSqlQuery& q, DocumentStatus status, const DocumentFilter& filter);
     bool executeQuery(QSqlQuery& q, const QString& context) const;
 
 private:
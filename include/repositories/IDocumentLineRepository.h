@@ -1,9 +1,12 @@
 #ifndef IDOCUMENTLINEREPOSITORY_H
 #define IDOCUMENTLINEREPOSITORY_H
 
+#include <QHash>
 #include <QList>
 #include <QString>
 
+#include <optional>
+
 #include "DecimalUtils.h"
 
 /**
@@ -21,6 +24,19 @@ struct DocumentLine {
     bool isValid() const { return id > 0 && documentId > 0 && productId > 0; }
 };
 
+/**
+ * @brief Изменения строк документа относительно загруженного состояния
+ *
+ * После applyDiff у вставленных строк заполняется id.
+ */
+struct DocumentLinesDiff {
+    QList<DocumentLine> inserted;
+    QList<DocumentLine> updated;
+    QList<int> deletedIds;
+
+    bool isEmpty() const { return inserted.isEmpty() && updated.isEmpty() && deletedIds.isEmpty(); }
+};
+
 /**
  * @brief Интерфейс репозитория строк документов
  */
@@ -43,6 +59,12 @@ public:
      * @brief Найти все строки документа
      */
     virtual QList<DocumentLine> findByDocument(int documentId) = 0;
+
+    /**
+     * @brief Строки набора документов одним запросом на пачку id (document id -> строки по порядку)
+     * @return Строки или std::nullopt при ошибке запроса
+     */
+    virtual std::optional<QHash<int, QList<DocumentLine>>> findByDocuments(const QList<int> &documentIds) = 0;
     
     /**
      * @brief Удалить все строки документа
@@ -53,6 +75,11 @@ public:
      * @brief Обновить строку
      */
     virtual bool update(const DocumentLine &line) = 0;
+
+    /**
+     * @brief Применить изменения строк документа (вызывать внутри транзакции)
+     */
+    virtual bool applyDiff(int documentId, DocumentLinesDiff &diff) = 0;
 };
 
 #endif // IDOCUMENTLINEREPOSITORY_H
@@ -5,6 +5,8 @@
 #include <QString>
 #include <QDate>
 
+#include <optional>
+
 #include "DecimalUtils.h"
 
 /**
@@ -14,7 +16,8 @@ enum class DocumentType {
     Supply,
     Sale,
     Return,
-    Transfer
+    Transfer,
+    WriteOff
 };
 
 /**
@@ -37,7 +40,10 @@ struct Document {
     DocumentStatus status = DocumentStatus::Draft;
     int senderId = 0;
     int receiverId = 0;
+    // итоги по строкам; ведут триггеры document_lines_totals_*, приложение их не пишет
     Decimal totalAmount = 0;
+    int lineCount = 0;
+    double totalQtyKg = 0.0;
     QString notes;
     QString createdAt;
     QString updatedAt;
@@ -50,6 +56,18 @@ struct Document {
     static DocumentStatus statusFromString(const QString &str);
 };
 
+/**
+ * @brief Отбор документов для массовых операций
+ *
+ * Пустые поля не ограничивают выборку.
+ */
+struct DocumentFilter {
+    QDate dateFrom;
+    QDate dateTo;
+    int senderId = 0;
+    std::optional<DocumentType> docType;
+};
+
 /**
  * @brief Интерфейс репозитория документов
  */
@@ -64,9 +82,55 @@ public:
     virtual QList<Document> findAll() = 0;
     virtual QList<Document> findByStatus(DocumentStatus status) = 0;
     virtual QList<Document> findByDateRange(const QDate &from, const QDate &to) = 0;
+
+    /**
+     * @brief Страница findByDateRange по ключу (date, id): не больше limit документов
+     *        строго после (afterDate, afterId) в том же порядке; afterId <= 0 — с начала
+     * @return Страница или std::nullopt при ошибке запроса (пустая страница — конец периода)
+     */
+    virtual std::optional<QList<Document>> findPageByDateRange(const QDate &from, const QDate &to,
+                                                               const QDate &afterDate, int afterId, int limit) = 0;
     virtual bool update(const Document &document) = 0;
     virtual bool cancel(int id) = 0;
     virtual bool exists(int id) = 0;
+
+    /**
+     * @brief Сменить статус, только если документ сейчас в статусе from
+     */
+    virtual bool updateStatus(int id, DocumentStatus from, DocumentStatus to) = 0;
+
+    /**
+     * @brief Сменить статус набору документов (UPDATE ... WHERE id IN (...))
+     * @return Число изменённых документов или -1 при ошибке
+     */
+    virtual int updateStatusBatch(const QList<int> &ids, DocumentStatus from, DocumentStatus to) = 0;
+
+    /**
+     * @brief ID документов в статусе status, попадающих под фильтр (без скрытых)
+     * @return ID или std::nullopt при ошибке запроса
+     */
+    virtual std::optional<QList<int>> findIds(DocumentStatus status, const DocumentFilter &filter) = 0;
+
+    /**
+     * @brief Сколько id вернул бы findIds, одним COUNT(*)
+     * @return Число документов или -1 при ошибке
+     */
+    virtual int countIds(DocumentStatus status, const DocumentFilter &filter) = 0;
+
+    /**
+     * @brief Номер уже занят другим (не скрытым) документом этого типа
+     */
+    virtual bool numberExists(const QString &number, DocumentType type, int excludeId) = 0;
+
+    /**
+     * @brief Физически удалить документ (только черновик)
+     */
+    virtual bool remove(int id) = 0;
+
+    /**
+     * @brief Скрыть документ из списков (soft-delete), освободив номер
+     */
+    virtual bool softDelete(int id) = 0;
 };
 
 #endif // IDOCUMENTREPOSITORY_H
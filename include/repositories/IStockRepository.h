@@ -2,6 +2,7 @@
 #define ISTOCKREPOSITORY_H
 
 #include <QList>
+#include <QHash>
 #include <QDate>
 
 struct InventoryMovement {
@@ -25,6 +26,24 @@ struct StockBalance {
     bool isValid() const { return productId > 0; }
 };
 
+/**
+ * @brief Сумма неотменённых движений товара за день
+ */
+struct MovementTotal {
+    int productId = 0;
+    QDate date;
+    double qtyKg = 0.0;
+};
+
+/**
+ * @brief Резерв товара черновиком расходного документа
+ */
+struct StockReservation {
+    int documentId = 0;
+    int productId = 0;
+    double qtyKg = 0.0;
+};
+
 /**
  * @brief Интерфейс репозитория складских операций
  * 
@@ -65,9 +84,35 @@ public:
      * @return true если успешно
      */
     virtual bool cancelMovement(int id) = 0;
+
+    /**
+     * @brief Отменить все движения набора документов одним UPDATE на пачку
+     * @return Число отменённых движений или -1 при ошибке
+     */
+    virtual int cancelMovementsByDocuments(const QList<int> &documentIds) = 0;
+
+    /**
+     * @brief Суммы неотменённых движений набора документов по товарам и датам
+     */
+    virtual QList<MovementTotal> activeMovementTotalsByDocuments(const QList<int> &documentIds) = 0;
+
+    /**
+     * @brief Суммы всех неотменённых движений по товарам и датам (для StockTimeline)
+     */
+    virtual QList<MovementTotal> findActiveMovementTotals() = 0;
+
+    /**
+     * @brief То же для набора товаров, с их входящими остатками архива
+     */
+    virtual QList<MovementTotal> findActiveMovementTotalsByProducts(const QList<int> &productIds) = 0;
+
+    /**
+     * @brief Товары движений: id движения -> id товара (удалённых движений в ответе нет)
+     */
+    virtual QHash<int, int> findMovementProducts(const QList<int> &movementIds) = 0;
     
     /**
-     * @brief Получить текущий остаток товара (сумма всех неотмененных движений)
+     * @brief Получить текущий остаток товара (входящий остаток архива + неотменённые движения)
      * @param productId ID товара
      * @return Остаток в кг
      */
@@ -82,6 +127,46 @@ public:
      * @brief Получить остатки только активных товаров
      */
     virtual QList<StockBalance> getActiveStockBalances() = 0;
+
+    /**
+     * @brief Остатки всех товаров на конец дня date
+     *
+     * Считается от ближайшего снимка stock_snapshots не позже date плюс
+     * неотменённые движения после него, а не по всему журналу.
+     * Даты раньше границы архива читаются из подключаемого на время запроса архива.
+     */
+    virtual QList<StockBalance> getBalancesAsOf(const QDate &date) = 0;
+
+    /**
+     * @brief Дата последнего снимка остатков (невалидная, если снимков нет)
+     */
+    virtual QDate lastSnapshotDate() = 0;
+
+    /**
+     * @brief Дата самого раннего движения (невалидная, если движений нет)
+     */
+    virtual QDate firstMovementDate() = 0;
+
+    /**
+     * @brief Снять остатки на конец дня periodEnd от предыдущего снимка
+     * @return true если успешно
+     */
+    virtual bool createSnapshot(const QDate &periodEnd) = 0;
+
+    /**
+     * @brief Заменить резерв документа (product id -> кг); пустой набор снимает резерв
+     */
+    virtual bool replaceReservations(int documentId, const QHash<int, double> &qtyByProduct) = 0;
+
+    /**
+     * @brief Все действующие резервы
+     */
+    virtual QList<StockReservation> findAllReservations() = 0;
+
+    /**
+     * @brief Резервы набора документов: document id -> (product id -> кг); документов без резерва в ответе нет
+     */
+    virtual QHash<int, QHash<int, double>> findReservationsByDocuments(const QList<int> &documentIds) = 0;
 };
 
 #endif // ISTOCKREPOSITORY_H
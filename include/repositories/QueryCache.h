@@ -0,0 +1,83 @@
+#ifndef QUERYCACHE_H
+#define QUERYCACHE_H
+
+#include <QCache>
+#include <QList>
+#include <QMutex>
+#include <QSqlDatabase>
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+
+#include <optional>
+
+struct QueryCacheStats {
+    quint64 hits = 0;
+    quint64 misses = 0;
+    quint64 stale = 0;          // запись была, но таблицы с тех пор менялись
+    int entries = 0;
+    qint64 bytes = 0;           // оценка памяти под строки
+    qint64 maxBytes = 0;
+};
+
+/**
+ * @brief Кэш результатов повторяющихся SELECT (списки товаров и контрагентов, остатки)
+ *
+ * Ключ — текст запроса и значения параметров. Запись помечена таблицами,
+ * от которых зависит результат, и версией их счётчиков изменений
+ * (ChangeTracker) на момент чтения. При обращении версия сверяется с
+ * текущей: любая запись в эти таблицы — с любого соединения, в том числе
+ * из потока записи — делает запись устаревшей, и запрос выполняется заново.
+ *
+ * Объём ограничен оценкой памяти под строки; при переполнении вытесняются
+ * давно не использованные записи. Кэш общий для всех потоков.
+ */
+class QueryCache
+{
+public:
+    using Rows = QList<QVariantList>;
+
+    static QueryCache& instance();
+
+    /**
+     * @brief Строки запроса из кэша или из базы
+     * @param params Позиционные параметры (?), в порядке следования
+     * @param tables Таблицы, от которых зависит результат; должны отслеживаться ChangeTracker
+     * @param error Текст ошибки SQL, если нужен вызывающему
+     * @return nullopt — ошибка SQL
+     */
+    std::optional<Rows> select(QSqlDatabase db, const QString& sql, const QVariantList& params,
+                               const QStringList& tables, QString* error = nullptr);
+
+    void clear();
+    void setMaxBytes(qint64 bytes);
+
+    QueryCacheStats stats() const;
+    void logStats() const;
+
+    static constexpr qint64 kDefaultMaxBytes = 8 * 1024 * 1024;
+
+private:
+    QueryCache();
+
+    QueryCache(const QueryCache&) = delete;
+    QueryCache& operator=(const QueryCache&) = delete;
+
+    struct Entry {
+        Rows rows;
+        qint64 version = -1;
+    };
+
+    static QString makeKey(const QString& sql, const QVariantList& params, const QStringList& tables);
+    static qint64 estimateBytes(const Rows& rows);
+
+private:
+    mutable QMutex m_lock;
+    QCache<QString, Entry> m_cache;     // стоимость записи — оценка её памяти в байтах
+
+    quint64 m_hits = 0;
+    quint64 m_misses = 0;
+    quint64 m_stale = 0;
+};
+
+#endif // QUERYCACHE_H
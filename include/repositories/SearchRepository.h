@@ -0,0 +1,59 @@
+#ifndef SEARCHREPOSITORY_H
+#define SEARCHREPOSITORY_H
+
+#include <QList>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QString>
+
+#include <optional>
+
+#include "repositories/IDocumentRepository.h"
+
+struct SearchHit {
+    enum class Kind { Product, Counterparty, Document };
+
+    Kind kind = Kind::Product;
+    int id = 0;
+    QString title;                          // что показать в списке
+    QString details;                        // тип/адрес/дата — второй строкой
+    std::optional<DocumentType> docType;    // только для документов
+    double rank = 0.0;                      // bm25: чем меньше, тем лучше
+};
+
+/**
+ * @brief Полнотекстовый поиск по индексам *_fts (FTS5)
+ *
+ * Индексы поддерживаются триггерами (см. MigrationRunner::createSearchIndex),
+ * поэтому искать можно из любого соединения, в том числе из ReadPool.
+ * Каждое слово запроса ищется как префикс: «мук пшен» найдёт
+ * «Мука пшеничная». Результаты упорядочены по bm25.
+ */
+class SearchRepository
+{
+public:
+    explicit SearchRepository(QSqlDatabase db);
+
+    // false — SQLite без FTS5, индексы не созданы
+    bool isAvailable() const;
+
+    QList<SearchHit> searchProducts(const QString& text, int limit = kDefaultLimit, bool onlyActive = true) const;
+    QList<SearchHit> searchCounterparties(const QString& text, int limit = kDefaultLimit) const;
+    QList<SearchHit> searchDocuments(const QString& text, int limit = kDefaultLimit) const;
+
+    // всё сразу: товары, контрагенты, документы — по limit каждого вида
+    QList<SearchHit> searchAll(const QString& text, int limit = kDefaultLimit) const;
+
+    // выражение MATCH из пользовательского ввода; пустое — искать нечего
+    static QString matchExpression(const QString& text);
+
+    static constexpr int kDefaultLimit = 20;
+
+private:
+    bool executeQuery(QSqlQuery& q, const QString& context) const;
+
+private:
+    QSqlDatabase m_db;
+};
+
+#endif // SEARCHREPOSITORY_H
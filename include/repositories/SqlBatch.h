@@ -0,0 +1,23 @@
+#ifndef SQLBATCH_H
+#define SQLBATCH_H
+
+#include <QString>
+#include <QStringList>
+
+/**
+ * @brief Помощники для запросов вида WHERE id IN (?, ?, ...)
+ *
+ * Старые сборки SQLite ограничивают число параметров 999,
+ * поэтому большие наборы id режутся на пачки по kSqlMaxBatchIds.
+ */
+inline constexpr qsizetype kSqlMaxBatchIds = 500;
+
+inline QString sqlPlaceholders(qsizetype count)
+{
+    QStringList marks;
+    marks.reserve(count);
+    for (qsizetype i = 0; i < count; ++i) marks.append("?");
+    return marks.join(", ");
+}
+
+#endif // SQLBATCH_H
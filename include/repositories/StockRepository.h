@@ -15,14 +15,32 @@ public:
     QList<InventoryMovement> findMovementsByDocument(int documentId) override;
     QList<InventoryMovement> findMovementsByProduct(int productId) override;
     bool cancelMovement(int id) override;
+    int cancelMovementsByDocuments(const QList<int>& documentIds) override;
+    QList<MovementTotal> activeMovementTotalsByDocuments(const QList<int>& documentIds) override;
+    QList<MovementTotal> findActiveMovementTotals() override;
+    QList<MovementTotal> findActiveMovementTotalsByProducts(const QList<int>& productIds) override;
+    QHash<int, int> findMovementProducts(const QList<int>& movementIds) override;
 
     double getStockBalance(int productId) override;
     QList<StockBalance> getAllStockBalances() override;
     QList<StockBalance> getActiveStockBalances() override;
+    QList<StockBalance> getBalancesAsOf(const QDate& date) override;
+
+    QDate lastSnapshotDate() override;
+    QDate firstMovementDate() override;
+    bool createSnapshot(const QDate& periodEnd) override;
+
+    bool replaceReservations(int documentId, const QHash<int, double>& qtyByProduct) override;
+    QList<StockReservation> findAllReservations() override;
+    QHash<int, QHash<int, double>> findReservationsByDocuments(const QList<int>& documentIds) override;
 
 private:
     InventoryMovement movementFromQuery(const QSqlQuery& q) const;
     bool executeQuery(QSqlQuery& q, const QString& context) const;
+    // последний снимок раньше date (inclusive — не позже), пустая строка — снимков нет;
+    // prefix "all_" — по представлениям рабочей базы и подключённого архива
+    QString snapshotBefore(const QString& date, bool inclusive, const QString& prefix = QString());
+    QList<StockBalance> balancesAsOf(const QDate& date, const QString& prefix);
 
 private:
     QSqlDatabase m_db;
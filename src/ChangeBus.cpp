@@ -0,0 +1,450 @@
+#include "ChangeBus.h"
+#include "ChangeTracker.h"
+#include "DbManager.h"
+#include "ReadPool.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRandomGenerator>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QTimer>
+#include <QLoggingCategory>
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+#include <sqlite3.h>
+
+Q_LOGGING_CATEGORY(changeBus, "db.changebus")
+
+namespace {
+
+constexpr quint8 kProtocolVersion = 1;
+constexpr int kConnectTimeoutMs = 200;
+
+// как wal_autocheckpoint по умолчанию: свой wal hook отключает встроенный
+constexpr int kWalCheckpointPages = 1000;
+
+std::atomic<bool> g_started{false};
+std::atomic<bool> g_hooksUnavailable{false};
+
+/**
+ * Состояние хуков одного соединения. Хуки вызываются в потоке соединения,
+ * поэтому набор изменений блокировок не требует.
+ */
+struct HookState {
+    sqlite3* handle = nullptr;
+    bool wal = false;
+    ChangeSet pending;                  // текущая транзакция
+    QSet<QString> overflow;             // таблицы, где строк больше kMaxRowsPerTable
+    ChangeSet committed;                // зафиксировано, ждёт wal hook
+};
+
+QMutex g_hooksLock;
+QHash<QString, std::shared_ptr<HookState>> g_hooks;     // имя соединения -> состояние
+
+void mergeInto(ChangeSet& target, const ChangeSet& source)
+{
+    for (auto it = source.cbegin(); it != source.cend(); ++it) {
+        auto existing = target.find(it.key());
+        if (existing == target.end()) {
+            target.insert(it.key(), it.value());
+        } else if (existing->isEmpty() || it->isEmpty()) {
+            existing->clear();
+        } else {
+            existing->unite(it.value());
+            if (existing->size() > ChangeBus::kMaxRowsPerTable) existing->clear();
+        }
+    }
+}
+
+void flush(HookState* state)
+{
+    if (state->committed.isEmpty()) return;
+    ChangeBus::instance().publish(state->committed);
+    state->committed.clear();
+}
+
+void onUpdate(void* arg, int, const char* dbName, const char* table, sqlite3_int64 rowId)
+{
+    // архив и временные таблицы другим экземплярам не интересны
+    if (!g_started.load(std::memory_order_relaxed) || qstrcmp(dbName, "main") != 0)
+        return;
+
+    const QString name = QString::fromLatin1(table);
+    if (!ChangeTracker::trackedTables().contains(name))
+        return;
+
+    auto* state = static_cast<HookState*>(arg);
+    if (state->overflow.contains(name))
+        return;
+
+    QSet<qint64>& rows = state->pending[name];
+    rows.insert(rowId);
+    if (rows.size() > ChangeBus::kMaxRowsPerTable) {
+        rows.clear();
+        state->overflow.insert(name);
+    }
+}
+
+int onCommit(void* arg)
+{
+    auto* state = static_cast<HookState*>(arg);
+    if (!state->pending.isEmpty()) {
+        mergeInto(state->committed, state->pending);
+        state->pending.clear();
+        state->overflow.clear();
+    }
+
+    // без WAL хука после фиксации нет; читатели ждут блокировку писателя и так
+    if (!state->wal) flush(state);
+    return 0;
+}
+
+void onRollback(void* arg)
+{
+    // откат точки сохранения сюда не приходит: такие строки уйдут лишним уведомлением
+    auto* state = static_cast<HookState*>(arg);
+    state->pending.clear();
+    state->overflow.clear();
+}
+
+int onWal(void* arg, sqlite3* handle, const char* dbName, int pages)
+{
+    auto* state = static_cast<HookState*>(arg);
+    if (qstrcmp(dbName, "main") == 0) flush(state);
+
+    if (pages >= kWalCheckpointPages)
+        sqlite3_wal_checkpoint_v2(handle, dbName, SQLITE_CHECKPOINT_PASSIVE, nullptr, nullptr);
+    return SQLITE_OK;
+}
+
+} // namespace
+
+ChangeBus& ChangeBus::instance()
+{
+    static ChangeBus bus;
+    return bus;
+}
+
+ChangeBus::ChangeBus()
+    : m_instanceId(QCoreApplication::applicationPid())
+{
+}
+
+void ChangeBus::start(const QString& databasePath)
+{
+    if (g_started) return;
+
+    const QByteArray hash = QCryptographicHash::hash(databasePath.toUtf8(), QCryptographicHash::Md5).toHex();
+    m_serverName = "WholesaleTrade-" + QString::fromLatin1(hash.left(16));
+
+    g_started = true;
+    connectOrListen();
+
+    if (g_hooksUnavailable)
+        startPolling();
+}
+
+void ChangeBus::stop()
+{
+    if (!g_started) return;
+
+    // короткоживущий процесс (консольная утилита) публикует изменения перед самым выходом
+    QCoreApplication::sendPostedEvents(this);
+    g_started = false;
+
+    if (m_hub) {
+        m_hub->disconnect(this);
+        m_hub->flush();
+        m_hub->abort();
+        delete m_hub;
+        m_hub = nullptr;
+    }
+
+    for (QLocalSocket* peer : std::as_const(m_peers)) {
+        peer->disconnect(this);
+        peer->flush();
+        peer->abort();
+        delete peer;
+    }
+    m_peers.clear();
+
+    delete m_server;
+    m_server = nullptr;
+
+    delete m_pollTimer;
+    m_pollTimer = nullptr;
+    m_polledVersions.clear();
+
+    qInfo(changeBus) << "ChangeBus: stopped";
+}
+
+bool ChangeBus::installHooks(QSqlDatabase& db)
+{
+    sqlite3* handle = DbManager::sqliteHandle(db);
+    if (!handle) {
+        // соединение не сообщит о своих изменениях — остаётся опрос счётчиков
+        if (!g_hooksUnavailable.exchange(true) && g_started)
+            QMetaObject::invokeMethod(&instance(), &ChangeBus::startPolling, Qt::QueuedConnection);
+        return false;
+    }
+
+    auto state = std::make_shared<HookState>();
+    state->handle = handle;
+
+    QSqlQuery q(db);
+    state->wal = q.exec("PRAGMA journal_mode") && q.next()
+              && q.value(0).toString().compare("wal", Qt::CaseInsensitive) == 0;
+
+    sqlite3_update_hook(handle, &onUpdate, state.get());
+    sqlite3_commit_hook(handle, &onCommit, state.get());
+    sqlite3_rollback_hook(handle, &onRollback, state.get());
+    if (state->wal)
+        sqlite3_wal_hook(handle, &onWal, state.get());
+
+    QMutexLocker lock(&g_hooksLock);
+    g_hooks.insert(db.connectionName(), std::move(state));
+    return true;
+}
+
+void ChangeBus::removeHooks(QSqlDatabase& db)
+{
+    std::shared_ptr<HookState> state;
+    {
+        QMutexLocker lock(&g_hooksLock);
+        state = g_hooks.take(db.connectionName());
+    }
+    if (!state) return;
+
+    sqlite3_update_hook(state->handle, nullptr, nullptr);
+    sqlite3_commit_hook(state->handle, nullptr, nullptr);
+    sqlite3_rollback_hook(state->handle, nullptr, nullptr);
+    if (state->wal) {
+        sqlite3_wal_hook(state->handle, nullptr, nullptr);
+        sqlite3_wal_autocheckpoint(state->handle, kWalCheckpointPages);
+    }
+}
+
+QList<int> ChangeBus::rowIds(const ChangeSet& changes, const QString& table)
+{
+    QList<int> ids;
+    const auto it = changes.constFind(table);
+    if (it == changes.cend()) return ids;
+
+    ids.reserve(it->size());
+    for (qint64 id : *it) ids.append(int(id));
+    return ids;
+}
+
+bool ChangeBus::isTableReset(const ChangeSet& changes, const QString& table)
+{
+    const auto it = changes.constFind(table);
+    return it != changes.cend() && it->isEmpty();
+}
+
+void ChangeBus::publish(const ChangeSet& changes)
+{
+    if (!g_started || changes.isEmpty()) return;
+
+    // сокеты принадлежат потоку шины (GUI), хуки вызываются и из потока записи
+    QMetaObject::invokeMethod(this, [this, changes]() { broadcast(changes); }, Qt::QueuedConnection);
+}
+
+void ChangeBus::broadcast(const ChangeSet& changes)
+{
+    if (!g_started) return;
+
+    QByteArray frame;
+    {
+        QDataStream out(&frame, QIODevice::WriteOnly);
+        out.setVersion(QDataStream::Qt_6_0);
+        out << kProtocolVersion << m_instanceId << changes;
+    }
+
+    if (m_server) {
+        for (QLocalSocket* peer : std::as_const(m_peers))
+            writeFrame(peer, frame);
+    } else if (m_hub) {
+        writeFrame(m_hub, frame);
+    }
+}
+
+void ChangeBus::connectOrListen()
+{
+    if (!g_started) return;
+
+    auto* socket = new QLocalSocket(this);
+    socket->connectToServer(m_serverName);
+    if (socket->waitForConnected(kConnectTimeoutMs)) {
+        m_hub = socket;
+        connect(m_hub, &QLocalSocket::readyRead, this, [this]() { readFrames(m_hub); });
+        connect(m_hub, &QLocalSocket::disconnected, this, &ChangeBus::onHubLost);
+        qInfo(changeBus) << "ChangeBus: connected to" << m_serverName;
+    } else {
+        delete socket;
+
+        m_server = new QLocalServer(this);
+        m_server->setSocketOptions(QLocalServer::UserAccessOption);
+        bool listening = m_server->listen(m_serverName);
+        if (!listening && m_server->serverError() == QAbstractSocket::AddressInUseError) {
+            // файл сокета остался от упавшего узла: подключиться к нему не удалось
+            QLocalServer::removeServer(m_serverName);
+            listening = m_server->listen(m_serverName);
+        }
+
+        if (!listening) {
+            qWarning(changeBus) << "ChangeBus: cannot listen on" << m_serverName << ":" << m_server->errorString();
+            delete m_server;
+            m_server = nullptr;
+            scheduleReconnect();
+            return;
+        }
+
+        connect(m_server, &QLocalServer::newConnection, this, &ChangeBus::onNewConnection);
+        qInfo(changeBus) << "ChangeBus: listening on" << m_serverName;
+    }
+
+    // пока шины не было, чужие изменения не приходили: пусть представления сверят счётчики
+    if (m_resyncOnConnect) {
+        m_resyncOnConnect = false;
+        ChangeSet all;
+        for (const QString& table : ChangeTracker::trackedTables()) all.insert(table, {});
+        emit remoteChanged(all);
+    }
+}
+
+void ChangeBus::startPolling()
+{
+    if (!g_started || m_pollTimer) return;
+
+    m_pollTimer = new QTimer(this);
+    m_pollTimer->setInterval(kPollMs);
+    connect(m_pollTimer, &QTimer::timeout, this, &ChangeBus::poll);
+    m_pollTimer->start();
+    poll();
+
+    qWarning(changeBus) << "ChangeBus: SQLite hooks are unavailable, polling change counters every" << kPollMs << "ms";
+}
+
+void ChangeBus::poll()
+{
+    // прошлый опрос ещё в пуле: потоки чтения заняты, не добавляем им работы
+    if (m_pollRunning) return;
+    m_pollRunning = true;
+
+    ReadPool::instance().run<QHash<QString, qint64>>([](QSqlDatabase db) {
+        QHash<QString, qint64> versions;
+        for (const QString& table : ChangeTracker::trackedTables())
+            versions.insert(table, ChangeTracker::version(db, {table}));
+        return versions;
+    }).then(this, [this](const QHash<QString, qint64>& versions) {
+        m_pollRunning = false;
+        if (!g_started) return;
+
+        // первый опрос — отсчёт; нечитаемый счётчик не сравниваем
+        ChangeSet changes;
+        for (auto it = versions.cbegin(); it != versions.cend(); ++it) {
+            if (it.value() < 0) continue;
+            const auto previous = m_polledVersions.constFind(it.key());
+            if (previous != m_polledVersions.cend() && previous.value() != it.value())
+                changes.insert(it.key(), {});
+            m_polledVersions.insert(it.key(), it.value());
+        }
+
+        if (!changes.isEmpty())
+            emit remoteChanged(changes);
+    });
+}
+
+void ChangeBus::scheduleReconnect()
+{
+    m_resyncOnConnect = true;
+
+    // случайная пауза: клиенты упавшего узла не должны занимать имя одновременно
+    const int delay = kReconnectMs + int(QRandomGenerator::global()->bounded(kReconnectMs));
+    QTimer::singleShot(delay, this, &ChangeBus::connectOrListen);
+}
+
+void ChangeBus::onNewConnection()
+{
+    while (QLocalSocket* peer = m_server->nextPendingConnection()) {
+        m_peers.append(peer);
+        connect(peer, &QLocalSocket::readyRead, this, [this, peer]() { readFrames(peer); });
+        connect(peer, &QLocalSocket::disconnected, this, [this, peer]() {
+            m_peers.removeOne(peer);
+            peer->deleteLater();
+        });
+    }
+}
+
+void ChangeBus::onHubLost()
+{
+    qInfo(changeBus) << "ChangeBus: hub disconnected, reconnecting";
+    if (m_hub) {
+        m_hub->deleteLater();
+        m_hub = nullptr;
+    }
+    scheduleReconnect();
+}
+
+void ChangeBus::readFrames(QLocalSocket* socket)
+{
+    QDataStream in(socket);
+    in.setVersion(QDataStream::Qt_6_0);
+
+    for (;;) {
+        in.startTransaction();
+        QByteArray frame;
+        in >> frame;
+        if (!in.commitTransaction())
+            return;     // кадр ещё не пришёл целиком
+        handleFrame(frame, socket);
+    }
+}
+
+void ChangeBus::handleFrame(const QByteArray& frame, QLocalSocket* from)
+{
+    QDataStream in(frame);
+    in.setVersion(QDataStream::Qt_6_0);
+
+    quint8 version = 0;
+    qint64 sender = 0;
+    ChangeSet changes;
+    in >> version;
+    if (version != kProtocolVersion) {
+        qWarning(changeBus) << "ChangeBus: unsupported message version" << version;
+        return;
+    }
+    in >> sender >> changes;
+    if (in.status() != QDataStream::Ok) {
+        qWarning(changeBus) << "ChangeBus: malformed message";
+        return;
+    }
+
+    // узел пересылает сообщение всем клиентам, кроме отправителя
+    if (m_server) {
+        for (QLocalSocket* peer : std::as_const(m_peers)) {
+            if (peer != from) writeFrame(peer, frame);
+        }
+    }
+
+    if (sender != m_instanceId && sender != m_ignoredSender && !changes.isEmpty())
+        emit remoteChanged(changes);
+}
+
+void ChangeBus::writeFrame(QLocalSocket* socket, const QByteArray& frame)
+{
+    if (socket->state() != QLocalSocket::ConnectedState) return;
+
+    QDataStream out(socket);
+    out.setVersion(QDataStream::Qt_6_0);
+    out << frame;
+}
@@ -0,0 +1,43 @@
+#include "ChangeTracker.h"
+#include "repositories/SqlBatch.h"
+
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QVariant>
+#include <QLoggingCategory>
+
+Q_LOGGING_CATEGORY(changeTracker, "db.changes")
+
+const QStringList& ChangeTracker::trackedTables()
+{
+    static const QStringList tables = {
+        "products",
+        "counterparties",
+        "documents",
+        "document_lines",
+        "inventory_movements"
+    };
+    return tables;
+}
+
+qint64 ChangeTracker::version(QSqlDatabase db, const QStringList& tables)
+{
+    if (tables.isEmpty()) return -1;
+
+    QSqlQuery q(db);
+    q.setForwardOnly(true);
+    q.prepare(QString("SELECT COALESCE(SUM(seq), 0), COUNT(*) FROM change_seq WHERE table_name IN (%1)")
+                  .arg(sqlPlaceholders(tables.size())));
+    for (const QString& table : tables) q.addBindValue(table);
+
+    if (!q.exec() || !q.next()) {
+        qWarning(changeTracker) << "ChangeTracker::version SQL error:" << q.lastError().text();
+        return -1;
+    }
+
+    // таблица без счётчика — изменения не отслеживаются
+    if (q.value(1).toInt() != tables.size())
+        return -1;
+
+    return q.value(0).toLongLong();
+}
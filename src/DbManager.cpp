@@ -1,4 +1,7 @@
 #include "DbManager.h"
+#include "SqlCollation.h"
+#include "ChangeBus.h"
+#include "SqlRetry.h"
 
 #include <QStandardPaths>
 #include <QDir>
@@ -8,6 +11,9 @@
 #include <QFile>
 #include <QTextStream>
 #include <QDirIterator>
+#include <QSqlDriver>
+
+#include <sqlite3.h>
 
 DbManager& DbManager::instance()
 {
@@ -51,6 +57,13 @@ bool DbManager::initialize()
         return false;
     }
 
+    // WAL нужен, чтобы чтение в GUI не ждало поток записи (и наоборот)
+    if (!enableWal()) {
+        qWarning() << "DbManager: WAL is not enabled, readers may block the writer";
+    }
+
+    configureConnection(m_db);
+
     debugPrintResourcesOnce();
 
     if (!ensureInitialized()) {
@@ -79,11 +92,139 @@ QString DbManager::databasePath() const
 void DbManager::close()
 {
     if (m_db.isOpen()) {
+        ChangeBus::removeHooks(m_db);
         m_db.close();
         qInfo() << "DbManager: Database connection closed";
     }
 }
 
+QSqlDatabase DbManager::openConnection(const QString& connectionName) const
+{
+    QSqlDatabase db = QSqlDatabase::contains(connectionName)
+        ? QSqlDatabase::database(connectionName, false)
+        : QSqlDatabase::addDatabase("QSQLITE", connectionName);
+
+    db.setDatabaseName(m_databasePath);
+
+    if (!db.isOpen() && !db.open()) {
+        qCritical() << "DbManager: Cannot open connection" << connectionName << ":" << db.lastError().text();
+        return db;
+    }
+
+    QSqlQuery q(db);
+    if (!q.exec("PRAGMA foreign_keys = ON")) {
+        qCritical() << "DbManager: Cannot enable foreign keys on" << connectionName << ":" << q.lastError().text();
+    }
+
+    configureConnection(db);
+
+    qInfo() << "DbManager: Connection" << connectionName << "opened";
+    return db;
+}
+
+void DbManager::closeConnection(const QString& connectionName)
+{
+    if (!QSqlDatabase::contains(connectionName))
+        return;
+
+    {
+        QSqlDatabase db = QSqlDatabase::database(connectionName, false);
+        if (db.isOpen()) {
+            ChangeBus::removeHooks(db);
+            db.close();
+        }
+    }
+    QSqlDatabase::removeDatabase(connectionName);
+    qInfo() << "DbManager: Connection" << connectionName << "closed";
+}
+
+bool DbManager::configureConnection(QSqlDatabase& db)
+{
+    // индексы по name COLLATE RU требуют сортировку на каждом соединении, которое пишет или читает по ним
+    if (!SqlCollation::install(db)) {
+        qWarning() << "DbManager: RU collation is not registered on" << db.connectionName();
+    }
+
+    // изменения, зафиксированные этим соединением, уходят другим экземплярам приложения
+    if (!ChangeBus::installHooks(db)) {
+        qWarning() << "DbManager: change hooks are not installed on" << db.connectionName();
+    }
+
+    // несколько соединений пишут в одну базу: сначала блокировку ждёт сама SQLite,
+    // потом повторяет SqlRetry
+    QSqlQuery q(db);
+    if (!q.exec(QString("PRAGMA busy_timeout = %1").arg(SqlRetry::kBusyTimeoutMs))) {
+        qWarning() << "DbManager: Cannot set busy_timeout:" << q.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+namespace {
+
+// PRAGMA temp_store_directory читает глобальную sqlite3_temp_directory своей копии SQLite:
+// увидеть там строку, записанную нами, можно только в общей с Qt копии библиотеки
+bool sharesSqliteLibrary(QSqlDatabase& db)
+{
+    const QString marker = QDir::tempPath() + "/.";     // существующий каталог, такую строку никто не ставит
+    char* const saved = sqlite3_temp_directory;
+    sqlite3_temp_directory = sqlite3_mprintf("%s", marker.toUtf8().constData());
+
+    QSqlQuery q(db);
+    const bool shared = q.exec("PRAGMA temp_store_directory") && q.next() && q.value(0).toString() == marker;
+    q.finish();
+
+    sqlite3_free(sqlite3_temp_directory);
+    sqlite3_temp_directory = saved;
+    return shared;
+}
+
+} // namespace
+
+sqlite3* DbManager::sqliteHandle(QSqlDatabase& db)
+{
+    const QVariant handle = db.driver() ? db.driver()->handle() : QVariant();
+    if (!handle.isValid() || qstrcmp(handle.typeName(), "sqlite3*") != 0) {
+        qWarning() << "DbManager: driver does not expose a sqlite3 handle";
+        return nullptr;
+    }
+
+    // хэндл от другой копии SQLite (Qt со встроенной sqlite) трогать нельзя
+    QSqlQuery q(db);
+    if (!q.exec("SELECT sqlite_version()") || !q.next()) {
+        qWarning() << "DbManager: cannot read sqlite_version:" << q.lastError().text();
+        return nullptr;
+    }
+    const QString driverVersion = q.value(0).toString();
+    if (driverVersion != QLatin1String(sqlite3_libversion())) {
+        qWarning() << "DbManager: Qt SQLite" << driverVersion << "differs from linked" << sqlite3_libversion();
+        return nullptr;
+    }
+
+    // встроенная в Qt копия той же версии проходит сверку версий, но глобальное состояние
+    // (мьютексы, аллокатор) у неё своё; проверяем один раз, на первом соединении
+    static const bool shared = sharesSqliteLibrary(db);
+    if (!shared) {
+        qWarning() << "DbManager: Qt uses its own copy of SQLite" << driverVersion;
+        return nullptr;
+    }
+
+    return *static_cast<sqlite3* const*>(handle.data());
+}
+
+bool DbManager::enableWal()
+{
+    QSqlQuery query(m_db);
+    if (!query.exec("PRAGMA journal_mode = WAL") || !query.next()) {
+        qWarning() << "DbManager: Cannot switch journal_mode:" << query.lastError().text();
+        return false;
+    }
+
+    const QString mode = query.value(0).toString().toLower();
+    qInfo() << "DbManager: journal_mode =" << mode;
+    return mode == "wal";
+}
+
 bool DbManager::enableForeignKeys()
 {
     QSqlQuery query(m_db);
@@ -1,14 +1,51 @@
 #include "DocumentService.h"
+#include "StockArchive.h"
+#include "StockReservations.h"
+#include "StockTimeline.h"
+#include "WriteTransaction.h"
 #include "repositories/IDocumentRepository.h"
 #include "repositories/IDocumentLineRepository.h"
 #include "repositories/IStockRepository.h"
 #include "repositories/IProductRepository.h"
+#include <QDateTime>
 #include <QDebug>
+#include <QHash>
+#include <QSet>
 #include <QLoggingCategory>
 
+#include <utility>
+
 Q_LOGGING_CATEGORY(docService, "service.document")
 
+namespace {
+
+// допуск при сравнении остатков в кг
+constexpr double kQtyEpsilon = 1e-9;
+
+bool isOutgoing(DocumentType type)
+{
+    return type == DocumentType::Transfer
+        || type == DocumentType::Sale
+        || type == DocumentType::WriteOff;
+}
+
+// черновики этих типов держат резерв
+bool reservesStock(DocumentType type)
+{
+    return type == DocumentType::Transfer || type == DocumentType::Sale;
+}
+
+// последний день периода, в который попадает date
+QDate periodEndOf(const QDate &date, int periodMonths)
+{
+    const int startMonth = (date.month() - 1) / periodMonths * periodMonths;
+    return QDate(date.year(), 1, 1).addMonths(startMonth + periodMonths).addDays(-1);
+}
+
+} // namespace
+
 DocumentService::DocumentService(
+    QSqlDatabase db,
     IDocumentRepository* docRepo,
     IDocumentLineRepository* lineRepo,
     IStockRepository* stockRepo,
@@ -16,6 +53,7 @@ DocumentService::DocumentService(
     QObject *parent
 )
     : QObject(parent)
+    , m_db(db)
     , m_docRepo(docRepo)
     , m_lineRepo(lineRepo)
     , m_stockRepo(stockRepo)
@@ -23,34 +61,319 @@ DocumentService::DocumentService(
 {
 }
 
+bool DocumentService::fail(const QString &message)
+{
+    m_lastError = message;
+    qWarning(docService) << "DocumentService:" << message;
+    return false;
+}
 
-bool DocumentService::postDocument(int documentId)
+QHash<int, double> DocumentService::qtyByProduct(const QList<DocumentLine> &current, const DocumentLinesDiff &diff)
 {
-    Document doc = m_docRepo->findById(documentId);
-    if (!doc.isValid()) {
-        qWarning(docService) << "DocumentService::postDocument: Invalid document id" << documentId;
-        return false;
+    QHash<int, DocumentLine> byId;
+    byId.reserve(current.size());
+    for (const auto &line : current)
+        byId.insert(line.id, line);
+
+    for (int id : diff.deletedIds)
+        byId.remove(id);
+    for (const auto &line : diff.updated)
+        byId.insert(line.id, line);
+
+    QHash<int, double> res;
+    for (const auto &line : std::as_const(byId))
+        res[line.productId] += line.qtyKg;
+    for (const auto &line : diff.inserted)
+        res[line.productId] += line.qtyKg;
+
+    for (auto it = res.begin(); it != res.end();) {
+        if (it.value() <= 0.0) it = res.erase(it);
+        else ++it;
     }
-    
-    if (doc.status != DocumentStatus::Draft) {
-        qWarning(docService) << "DocumentService::postDocument: Document already posted or cancelled";
-        return false;
+    return res;
+}
+
+bool DocumentService::checkAvailable(int documentId, const QHash<int, double> &required)
+{
+    for (auto it = required.constBegin(); it != required.constEnd(); ++it) {
+        const double balance = currentBalance(it.key());
+        const double reserved = reservedByOthers(it.key(), documentId);
+
+        if (balance - reserved + kQtyEpsilon < it.value()) {
+            const Product product = m_productRepo->findById(it.key());
+            const QString name = product.name.isEmpty() ? QString("ID=%1").arg(it.key()) : product.name;
+            return fail(QString("Недостаточно доступного остатка по товару %1.\n"
+                                "Остаток: %2, в резерве других документов: %3, требуется: %4")
+                            .arg(name)
+                            .arg(QString::number(balance, 'f', 3))
+                            .arg(QString::number(reserved, 'f', 3))
+                            .arg(QString::number(it.value(), 'f', 3)));
+        }
+    }
+    return true;
+}
+
+double DocumentService::currentBalance(int productId) const
+{
+    if (!m_timeline || !m_timeline->isLoaded())
+        return m_stockRepo->getStockBalance(productId);
+
+    double balance = m_timeline->balance(productId);
+    // движения команд той же группы в дерево ещё не попали
+    for (const MovementTotal &t : m_pendingTimeline) {
+        if (t.productId == productId)
+            balance += t.qtyKg;
+    }
+    return balance;
+}
+
+double DocumentService::reservedByOthers(int productId, int documentId) const
+{
+    if (!m_reservations) return 0.0;
+
+    double reserved = m_reservations->reservedExcluding(productId, documentId);
+
+    // команды той же группы уже поменяли резерв, но в агрегат он ещё не попал
+    for (auto it = m_pendingReservations.constBegin(); it != m_pendingReservations.constEnd(); ++it) {
+        if (it.key() == documentId) continue;
+        reserved += it->value(productId, 0.0) - m_reservations->reservedBy(it.key(), productId);
+    }
+    return reserved > 0.0 ? reserved : 0.0;
+}
+
+void DocumentService::publishReservation(int documentId, const QHash<int, double> &qtyByProduct, bool deferred)
+{
+    if (!m_reservations) return;
+
+    // во вложенной транзакции изменения станут видны только после фиксации всей группы
+    if (deferred) {
+        m_pendingReservations.insert(documentId, qtyByProduct);
+        return;
+    }
+    m_reservations->setDocument(documentId, qtyByProduct);
+    emit reservationsChanged({{documentId, qtyByProduct}});
+}
+
+void DocumentService::publishEvent(std::function<void()> emitEvent, bool deferred)
+{
+    if (deferred) {
+        m_pendingEvents.append(std::move(emitEvent));
+        return;
+    }
+    emitEvent();
+}
+
+void DocumentService::publishTimeline(const QList<MovementTotal> &changes, bool deferred)
+{
+    if (!m_timeline || changes.isEmpty()) return;
+
+    if (deferred) {
+        m_pendingTimeline.append(changes);
+        return;
+    }
+    m_timeline->apply(changes);
+    emit timelineChanged(changes);
+}
+
+void DocumentService::commitPending(bool committed)
+{
+    const ReservationChanges reservations = std::exchange(m_pendingReservations, {});
+    if (committed && m_reservations && !reservations.isEmpty()) {
+        for (auto it = reservations.constBegin(); it != reservations.constEnd(); ++it)
+            m_reservations->setDocument(it.key(), it.value());
+        emit reservationsChanged(reservations);
     }
-    
-    QList<DocumentLine> lines = m_lineRepo->findByDocument(documentId);
 
-    if (doc.docType == DocumentType::Transfer || doc.docType == DocumentType::Sale) {
-        for (const auto &line : lines) {
-            double balance = m_stockRepo->getStockBalance(line.productId);
-            if (balance < line.qtyKg) {
-                qWarning(docService) << "DocumentService::postDocument: Insufficient stock for product" << line.productId;
-                return false;
+    const QList<MovementTotal> timeline = std::exchange(m_pendingTimeline, {});
+    if (committed && m_timeline && !timeline.isEmpty()) {
+        m_timeline->apply(timeline);
+        emit timelineChanged(timeline);
+    }
+
+    // резервы и остатки по датам уже обновлены — подписчики увидят согласованное состояние
+    const QList<std::function<void()>> events = std::move(m_pendingEvents);
+    m_pendingEvents.clear();
+    if (committed) {
+        for (const auto &emitEvent : events)
+            emitEvent();
+    }
+}
+
+void DocumentService::refreshStockCaches(const ChangeSet &changes)
+{
+    bool reloaded = false;
+
+    // резерв меняется только вместе со строкой документа: сохранение, проведение, удаление
+    if (m_reservations) {
+        const QList<int> documentIds = ChangeBus::rowIds(changes, "documents");
+        if (ChangeBus::isTableReset(changes, "documents")) {
+            m_reservations->load(m_stockRepo->findAllReservations());
+            reloaded = true;
+        } else if (!documentIds.isEmpty()) {
+            const ReservationChanges found = m_stockRepo->findReservationsByDocuments(documentIds);
+            ReservationChanges applied;
+            for (int documentId : documentIds) {
+                const QHash<int, double> qty = found.value(documentId);
+                if (qty.isEmpty() && !m_reservations->hasDocument(documentId)) continue;
+                m_reservations->setDocument(documentId, qty);
+                applied.insert(documentId, qty);
             }
+            if (!applied.isEmpty())
+                emit reservationsChanged(applied);
         }
     }
 
-    double multiplier = (doc.docType == DocumentType::Supply || doc.docType == DocumentType::Return) ? 1.0 : -1.0;
-    
+    if (m_timeline) {
+        const QList<int> movementIds = ChangeBus::rowIds(changes, "inventory_movements");
+        const QHash<int, int> products = m_stockRepo->findMovementProducts(movementIds);
+        if (ChangeBus::isTableReset(changes, "inventory_movements") || products.size() < movementIds.size()) {
+            m_timeline->load(m_stockRepo->findActiveMovementTotals());
+            reloaded = true;
+        } else if (!products.isEmpty()) {
+            const QList<int> productIds = QSet<int>(products.cbegin(), products.cend()).values();
+            const QList<MovementTotal> applied =
+                m_timeline->replaceProducts(productIds, m_stockRepo->findActiveMovementTotalsByProducts(productIds));
+            if (!applied.isEmpty())
+                emit timelineChanged(applied);
+        }
+    }
+
+    if (reloaded)
+        emit stockCachesReloaded();
+}
+
+int DocumentService::saveDraft(const Document &doc, DocumentLinesDiff &lines)
+{
+    m_lastError.clear();
+
+    // ---- проверки до BEGIN ----
+    if (doc.number.trimmed().isEmpty()) {
+        fail("Введите номер документа");
+        return -1;
+    }
+
+    if (m_docRepo->numberExists(doc.number, doc.docType, doc.id)) {
+        fail(QString("Документ с номером %1 уже существует").arg(doc.number.trimmed()));
+        return -1;
+    }
+
+    if (!checkPeriodOpen(doc.date))
+        return -1;
+
+    if (doc.id > 0) {
+        const Document current = m_docRepo->findById(doc.id);
+        if (!current.isValid()) {
+            fail("Документ не найден");
+            return -1;
+        }
+        if (current.status != DocumentStatus::Draft) {
+            fail("Редактировать можно только черновик (DRAFT)");
+            return -1;
+        }
+    }
+
+    // резерв считаем по всем строкам черновика, а не только по изменённым
+    const bool reserves = reservesStock(doc.docType);
+    QHash<int, double> reservation;
+    if (reserves) {
+        const QList<DocumentLine> current = doc.id > 0 ? m_lineRepo->findByDocument(doc.id) : QList<DocumentLine>();
+        reservation = qtyByProduct(current, lines);
+        if (!checkAvailable(doc.id, reservation))
+            return -1;
+    }
+
+    Document toSave = doc;
+    toSave.status = DocumentStatus::Draft;
+
+    // ---- запись ----
+    WriteTransaction tx(m_db, "saveDraft");
+    if (!tx.isActive()) {
+        fail("Не удалось начать транзакцию: " + tx.lastError());
+        return -1;
+    }
+
+    int docId = toSave.id;
+    if (docId <= 0) {
+        docId = m_docRepo->create(toSave);
+        if (docId <= 0) {
+            fail("Не удалось создать документ");
+            return -1;
+        }
+    } else if (!m_docRepo->update(toSave)) {
+        fail("Не удалось обновить документ");
+        return -1;
+    }
+
+    if (!lines.isEmpty() && !m_lineRepo->applyDiff(docId, lines)) {
+        fail("Не удалось сохранить строки документа");
+        return -1;
+    }
+
+    if (reserves && !m_stockRepo->replaceReservations(docId, reservation)) {
+        fail("Не удалось сохранить резерв товара");
+        return -1;
+    }
+
+    if (!tx.commit()) {
+        fail("Не удалось зафиксировать транзакцию: " + tx.lastError());
+        return -1;
+    }
+
+    if (reserves)
+        publishReservation(docId, reservation, tx.isNested());
+
+    const DocumentType type = doc.docType;
+    publishEvent([this, docId, type]() { emit documentSaved(docId, type); }, tx.isNested());
+
+    qInfo(docService) << "DocumentService::saveDraft: Saved document" << docId;
+    return docId;
+}
+
+bool DocumentService::postDocument(int documentId)
+{
+    m_lastError.clear();
+
+    // ---- проверки до BEGIN ----
+    Document doc = m_docRepo->findById(documentId);
+    if (!doc.isValid())
+        return fail(QString("Документ ID=%1 не найден").arg(documentId));
+
+    if (doc.status != DocumentStatus::Draft)
+        return fail("Провести можно только документ в статусе DRAFT");
+
+    // движения архивного периода уже свёрнуты во входящий остаток
+    if (!checkPeriodOpen(doc.date))
+        return false;
+
+    const QList<DocumentLine> lines = m_lineRepo->findByDocument(documentId);
+    if (lines.isEmpty())
+        return fail("В документе нет строк товаров");
+
+    const bool reserves = reservesStock(doc.docType);
+
+    // резерв не гарантирует остаток: после сохранения черновика могли отменить поступление,
+    // а резервы, перенесённые миграцией, с остатком не сверялись. Свой резерв не мешает.
+    if (isOutgoing(doc.docType)) {
+        // один товар может встречаться в нескольких строках
+        if (!checkAvailable(documentId, qtyByProduct(lines, DocumentLinesDiff())))
+            return false;
+    }
+
+    const double multiplier = isOutgoing(doc.docType) ? -1.0 : 1.0;
+
+    StockDeltas deltas;
+    for (const auto &line : lines)
+        deltas[line.productId] += line.qtyKg * multiplier;
+
+    QList<MovementTotal> timeline;
+    for (auto it = deltas.constBegin(); it != deltas.constEnd(); ++it)
+        timeline.append({it.key(), doc.date, it.value()});
+
+    // ---- запись ----
+    WriteTransaction tx(m_db, "postDocument");
+    if (!tx.isActive())
+        return fail("Не удалось начать транзакцию: " + tx.lastError());
+
     for (const auto &line : lines) {
         InventoryMovement movement;
         movement.documentId = documentId;
@@ -58,58 +381,345 @@ bool DocumentService::postDocument(int documentId)
         movement.qtyDeltaKg = line.qtyKg * multiplier;
         movement.movementDate = doc.date;
         movement.cancelledFlag = false;
-        
-        m_stockRepo->createMovement(movement);
-    }
 
-    doc.status = DocumentStatus::Posted;
-    if (!m_docRepo->update(doc)) {
-        qCritical(docService) << "DocumentService::postDocument: Failed to update document status";
-        return false;
+        if (m_stockRepo->createMovement(movement) <= 0)
+            return fail(QString("Не удалось создать движение по товару ID=%1").arg(line.productId));
     }
-    
+
+    // статус меняем только из DRAFT: повторное проведение не создаст дублей движений
+    if (!m_docRepo->updateStatus(documentId, DocumentStatus::Draft, DocumentStatus::Posted))
+        return fail("Документ уже проведён или изменён");
+
+    // резерв превращается в движения
+    if (reserves && !m_stockRepo->replaceReservations(documentId, {}))
+        return fail("Не удалось снять резерв документа");
+
+    if (!tx.commit())
+        return fail("Не удалось зафиксировать транзакцию: " + tx.lastError());
+
+    if (reserves)
+        publishReservation(documentId, {}, tx.isNested());
+    publishTimeline(timeline, tx.isNested());
+
+    const DocumentType type = doc.docType;
+    publishEvent([this, documentId, type, deltas]() {
+        emit documentPosted(documentId, type, deltas);
+        emit stockChanged(deltas);
+    }, tx.isNested());
+
     qInfo(docService) << "DocumentService::postDocument: Posted document" << documentId;
     return true;
 }
 
 bool DocumentService::cancelDocument(int documentId)
 {
+    m_lastError.clear();
+
     Document doc = m_docRepo->findById(documentId);
-    if (!doc.isValid()) {
-        qWarning(docService) << "DocumentService::cancelDocument: Invalid document id" << documentId;
+    if (!doc.isValid())
+        return fail(QString("Документ ID=%1 не найден").arg(documentId));
+
+    if (doc.status == DocumentStatus::Cancelled)
+        return fail("Документ уже отменён");
+
+    if (doc.status != DocumentStatus::Posted)
+        return fail("Отменить можно только документ в статусе POSTED");
+
+    if (cancelBatch({documentId}, "cancelDocument") < 0)
         return false;
+
+    qInfo(docService) << "DocumentService::cancelDocument: Cancelled document" << documentId;
+    return true;
+}
+
+int DocumentService::cancelDocuments(const QList<int> &documentIds)
+{
+    m_lastError.clear();
+
+    if (documentIds.isEmpty())
+        return 0;
+
+    const int cancelled = cancelBatch(documentIds, "cancelDocuments");
+    if (cancelled < 0)
+        return -1;
+
+    qInfo(docService) << "DocumentService::cancelDocuments: Cancelled" << cancelled << "documents";
+    return cancelled;
+}
+
+int DocumentService::cancelPosted(const DocumentFilter &filter)
+{
+    m_lastError.clear();
+
+    const std::optional<QList<int>> ids = m_docRepo->findIds(DocumentStatus::Posted, filter);
+    if (!ids) {
+        fail("Не удалось выбрать проведённые документы");
+        return -1;
     }
-    
-    if (doc.status == DocumentStatus::Cancelled) {
-        qWarning(docService) << "DocumentService::cancelDocument: Document already cancelled";
-        return false;
+    if (ids->isEmpty())
+        return 0;
+
+    const int cancelled = cancelBatch(*ids, "cancelPosted");
+    if (cancelled < 0)
+        return -1;
+
+    qInfo(docService) << "DocumentService::cancelPosted: Cancelled" << cancelled << "documents"
+                      << "from" << filter.dateFrom << "to" << filter.dateTo << "sender" << filter.senderId;
+    return cancelled;
+}
+
+int DocumentService::cancelBatch(const QList<int> &documentIds, const char *context)
+{
+    WriteTransaction tx(m_db, context);
+    if (!tx.isActive()) {
+        fail("Не удалось начать транзакцию: " + tx.lastError());
+        return -1;
     }
-    
-    if (doc.status != DocumentStatus::Posted) {
-        qWarning(docService) << "DocumentService::cancelDocument: Can only cancel posted documents";
-        return false;
+
+    // статус меняется только у POSTED; если хоть один документ успели изменить — откатываем всё
+    const int updated = m_docRepo->updateStatusBatch(documentIds, DocumentStatus::Posted, DocumentStatus::Cancelled);
+    if (updated < 0) {
+        fail("Не удалось изменить статус документов");
+        return -1;
+    }
+    if (updated != documentIds.size()) {
+        fail(documentIds.size() == 1
+                 ? QString("Документ уже отменён или изменён")
+                 : QString("Часть документов уже отменена или изменена (%1 из %2)").arg(documentIds.size() - updated).arg(documentIds.size()));
+        return -1;
     }
 
-    const QList<InventoryMovement> movements = m_stockRepo->findMovementsByDocument(documentId);
-    bool cancelledAny = false;
-    for (const auto &movement : movements) {
-        if (movement.cancelledFlag) continue;
-        cancelledAny = m_stockRepo->cancelMovement(movement.id) || cancelledAny;
+    // изменения остатков для подписчиков: минус сумма ещё не отменённых движений (по датам — для StockTimeline)
+    QList<MovementTotal> timeline = m_stockRepo->activeMovementTotalsByDocuments(documentIds);
+    StockDeltas deltas;
+    for (MovementTotal &t : timeline) {
+        t.qtyKg = -t.qtyKg;
+        deltas[t.productId] += t.qtyKg;
     }
 
-    if (!cancelledAny) {
-        qWarning(docService) << "DocumentService::cancelDocument: No active movements to cancel";
-        return false;
+    // остатки считаются по неотменённым движениям, поэтому пересчитываются этим же UPDATE
+    if (m_stockRepo->cancelMovementsByDocuments(documentIds) < 0) {
+        fail("Не удалось отменить движения склада");
+        return -1;
     }
-    
-    // Обновляем статус документа
-    doc.status = DocumentStatus::Cancelled;
-    if (!m_docRepo->cancel(documentId)) {
-        qCritical(docService) << "DocumentService::cancelDocument: Failed to update document status";
-        return false;
+
+    if (!tx.commit()) {
+        fail("Не удалось зафиксировать транзакцию: " + tx.lastError());
+        return -1;
     }
-    
-    qInfo(docService) << "DocumentService::cancelDocument: Cancelled document" << documentId;
+
+    publishTimeline(timeline, tx.isNested());
+    publishEvent([this, documentIds, deltas]() {
+        emit documentsCancelled(documentIds, deltas);
+        emit stockChanged(deltas);
+    }, tx.isNested());
+
+    return updated;
+}
+
+int DocumentService::closeStockPeriods(const QDate &today, int periodMonths)
+{
+    m_lastError.clear();
+
+    if (!today.isValid() || periodMonths <= 0 || 12 % periodMonths != 0) {
+        fail("Некорректный период снимков остатков");
+        return -1;
+    }
+
+    const QDate last = m_stockRepo->lastSnapshotDate();
+    const QDate first = last.isValid() ? last.addDays(1) : m_stockRepo->firstMovementDate();
+    if (!first.isValid())
+        return 0;   // журнал пуст — снимать нечего
+
+    int created = 0;
+    for (QDate end = periodEndOf(first, periodMonths); end < today;
+         end = periodEndOf(end.addDays(1), periodMonths)) {
+        WriteTransaction tx(m_db, "closeStockPeriods");
+        if (!tx.isActive()) {
+            fail("Не удалось начать транзакцию: " + tx.lastError());
+            return -1;
+        }
+
+        if (!m_stockRepo->createSnapshot(end)) {
+            fail("Не удалось снять остатки на " + end.toString("dd.MM.yyyy"));
+            return -1;
+        }
+
+        if (!tx.commit()) {
+            fail("Не удалось зафиксировать снимок остатков: " + tx.lastError());
+            return -1;
+        }
+        ++created;
+    }
+
+    if (created > 0)
+        qInfo(docService) << "DocumentService::closeStockPeriods: created" << created << "snapshots";
+    return created;
+}
+
+int DocumentService::archiveClosedYears(const QDate &today, int keepYears)
+{
+    m_lastError.clear();
+
+    if (!today.isValid() || keepYears < 0) {
+        fail("Некорректные параметры архивации");
+        return -1;
+    }
+
+    const QDate end(today.year() - keepYears - 1, 12, 31);
+
+    const QDate archived = StockArchive::archivedThrough(m_db);
+    if (archived.isValid() && archived >= end)
+        return 0;
+
+    // граница архива — снимок на конец года; его создаёт closeStockPeriods
+    const QDate lastSnapshot = m_stockRepo->lastSnapshotDate();
+    if (!lastSnapshot.isValid() || lastSnapshot < end)
+        return 0;
+
+    const QDate first = m_stockRepo->firstMovementDate();
+    if (!first.isValid() || first > end)
+        return 0;
+
+    StockArchive archive(m_db);
+    if (!archive.attach(true)) {
+        fail(archive.lastError());
+        return -1;
+    }
+
+    const int moved = archive.moveThrough(end);
+    if (moved < 0) {
+        fail("Не удалось перенести документы в архив: " + archive.lastError());
+        return -1;
+    }
+
+    qInfo(docService) << "DocumentService::archiveClosedYears: through" << end << "-" << moved << "documents";
+    return moved;
+}
+
+bool DocumentService::checkPeriodOpen(const QDate &date)
+{
+    const QDate archived = StockArchive::archivedThrough(m_db);
+    if (archived.isValid() && date <= archived)
+        return fail(QString("Период по %1 закрыт и перенесён в архив").arg(archived.toString("dd.MM.yyyy")));
     return true;
 }
 
+int DocumentService::writeOff(int productId, double qtyKg, const QString &reason)
+{
+    m_lastError.clear();
+
+    if (productId <= 0) {
+        fail("Не выбран товар");
+        return -1;
+    }
+    if (qtyKg <= 0.0) {
+        fail("Некорректное количество списания");
+        return -1;
+    }
+
+    // списать можно только то, что не зарезервировано черновиками
+    if (!checkAvailable(0, {{productId, qtyKg}}))
+        return -1;
+
+    Document doc;
+    doc.docType = DocumentType::WriteOff;
+    doc.number = QString("WRITEOFF-%1").arg(QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss-zzz"));
+    doc.date = QDate::currentDate();
+    doc.status = DocumentStatus::Posted;
+    doc.notes = reason.trimmed();
+
+    WriteTransaction tx(m_db, "writeOff");
+    if (!tx.isActive()) {
+        fail("Не удалось начать транзакцию: " + tx.lastError());
+        return -1;
+    }
+
+    const int docId = m_docRepo->create(doc);
+    if (docId <= 0) {
+        fail("Не удалось создать документ списания");
+        return -1;
+    }
+
+    InventoryMovement movement;
+    movement.documentId = docId;
+    movement.productId = productId;
+    movement.qtyDeltaKg = -qtyKg;
+    movement.movementDate = doc.date;
+
+    if (m_stockRepo->createMovement(movement) <= 0) {
+        fail("Не удалось создать движение списания");
+        return -1;
+    }
+
+    if (!tx.commit()) {
+        fail("Не удалось зафиксировать списание: " + tx.lastError());
+        return -1;
+    }
+
+    publishTimeline({{productId, doc.date, -qtyKg}}, tx.isNested());
+
+    const StockDeltas deltas{{productId, -qtyKg}};
+    publishEvent([this, docId, deltas]() {
+        emit documentPosted(docId, DocumentType::WriteOff, deltas);
+        emit stockChanged(deltas);
+    }, tx.isNested());
+
+    qInfo(docService) << "DocumentService::writeOff: Product" << productId << "qty" << qtyKg << "doc" << docId;
+    return docId;
+}
+
+bool DocumentService::deleteDocument(int documentId)
+{
+    m_lastError.clear();
+
+    const Document doc = m_docRepo->findById(documentId);
+    if (!doc.isValid())
+        return fail(QString("Документ ID=%1 не найден").arg(documentId));
+
+    // POSTED: "удаление" = корректная отмена (storno)
+    if (doc.status == DocumentStatus::Posted)
+        return cancelDocument(documentId);
+
+    // CANCELLED: soft-delete (склад не трогаем)
+    if (doc.status == DocumentStatus::Cancelled) {
+        WriteTransaction tx(m_db, "softDelete");
+        if (!tx.isActive())
+            return fail("Не удалось начать транзакцию: " + tx.lastError());
+
+        if (!m_docRepo->softDelete(documentId))
+            return fail("Не удалось скрыть документ");
+
+        if (!tx.commit())
+            return fail("Не удалось зафиксировать транзакцию: " + tx.lastError());
+
+        publishEvent([this, documentId]() { emit documentDeleted(documentId); }, tx.isNested());
+        return true;
+    }
+
+    // DRAFT: физическое удаление, движений быть не должно
+    if (!m_stockRepo->findMovementsByDocument(documentId).isEmpty())
+        return fail("Нельзя удалить DRAFT: у документа уже есть движения склада.\nИспользуйте отмену.");
+
+    WriteTransaction tx(m_db, "deleteDocument");
+    if (!tx.isActive())
+        return fail("Не удалось начать транзакцию: " + tx.lastError());
+
+    if (!m_lineRepo->deleteByDocument(documentId))
+        return fail("Не удалось удалить строки документа");
+
+    if (!m_stockRepo->replaceReservations(documentId, {}))
+        return fail("Не удалось снять резерв документа");
+
+    if (!m_docRepo->remove(documentId))
+        return fail("Документ не найден или уже не черновик");
+
+    if (!tx.commit())
+        return fail("Не удалось зафиксировать транзакцию: " + tx.lastError());
+
+    publishReservation(documentId, {}, tx.isNested());
+    publishEvent([this, documentId]() { emit documentDeleted(documentId); }, tx.isNested());
+
+    qInfo(docService) << "DocumentService::deleteDocument: Deleted draft" << documentId;
+    return true;
+}
@@ -0,0 +1,83 @@
+#include "JsonFormat.h"
+
+#include <QJsonArray>
+
+namespace JsonFormat {
+
+QJsonObject documentToJson(const Document& doc)
+{
+    return QJsonObject{
+        {"id", doc.id},
+        {"type", doc.docTypeString()},
+        {"number", doc.number},
+        {"date", doc.date.toString(Qt::ISODate)},
+        {"status", doc.statusString()},
+        {"senderId", doc.senderId},
+        {"receiverId", doc.receiverId},
+        {"totalAmount", decimalToString(doc.totalAmount)},
+        {"lineCount", doc.lineCount},
+        {"totalQtyKg", doc.totalQtyKg},
+        {"notes", doc.notes}
+    };
+}
+
+QJsonObject lineToJson(const DocumentLine& line)
+{
+    return QJsonObject{
+        {"productId", line.productId},
+        {"qtyKg", line.qtyKg},
+        {"price", decimalToString(line.price)},
+        {"lineSum", decimalToString(line.lineSum)}
+    };
+}
+
+QJsonObject balanceToJson(const StockBalance& balance)
+{
+    return QJsonObject{
+        {"productId", balance.productId},
+        {"name", balance.productName},
+        {"unit", balance.unit},
+        {"balanceKg", balance.balanceKg}
+    };
+}
+
+bool draftFromJson(const QJsonObject& o, Document& doc, DocumentLinesDiff& lines, QString& error)
+{
+    const QString type = o.value("type").toString();
+    doc = Document();
+    doc.docType = Document::docTypeFromString(type);
+    // неизвестная строка превращается в тип по умолчанию — сверяем обратно
+    if (doc.docTypeString() != type) {
+        error = QString("Неизвестный тип документа: %1").arg(type);
+        return false;
+    }
+
+    doc.number = o.value("number").toString();
+    doc.date = o.contains("date") ? QDate::fromString(o.value("date").toString(), Qt::ISODate)
+                                  : QDate::currentDate();
+    doc.senderId = o.value("senderId").toInt();
+    doc.receiverId = o.value("receiverId").toInt();
+    doc.notes = o.value("notes").toString();
+    if (!doc.date.isValid()) {
+        error = "Дата документа — ГГГГ-ММ-ДД";
+        return false;
+    }
+
+    lines = DocumentLinesDiff();
+    for (const QJsonValue& value : o.value("lines").toArray()) {
+        const QJsonObject l = value.toObject();
+        DocumentLine line;
+        line.productId = l.value("productId").toInt();
+        line.qtyKg = l.value("qtyKg").toDouble();
+        line.price = decimalFromVariant(l.value("price").toVariant());
+        line.lineSum = line.price * Decimal(line.qtyKg);
+        if (line.productId <= 0 || line.qtyKg <= 0.0) {
+            error = "В строке нужны productId и qtyKg больше нуля";
+            return false;
+        }
+        lines.inserted.append(line);
+    }
+    return true;
+}
+
+} // namespace JsonFormat
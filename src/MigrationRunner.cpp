@@ -1,4 +1,6 @@
 #include "MigrationRunner.h"
+#include "SqlCollation.h"
+#include "ChangeTracker.h"
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QDebug>
@@ -32,6 +34,14 @@ static bool columnExists(QSqlDatabase& db, const QString& tableName, const QStri
     return false;
 }
 
+static bool triggerExists(QSqlDatabase& db, const QString& triggerName)
+{
+    QSqlQuery q(db);
+    q.prepare("SELECT 1 FROM sqlite_master WHERE type = 'trigger' AND name = ?");
+    q.addBindValue(triggerName);
+    return q.exec() && q.next();
+}
+
 bool MigrationRunner::runMigrations()
 {
     if (!m_db.isOpen()) {
@@ -79,6 +89,42 @@ bool MigrationRunner::runMigrations()
                 return false;
             }
 
+            if (!createSearchIndex()) {
+                qCritical(migration) << "MigrationRunner: Failed to create search index";
+                m_db.rollback();
+                return false;
+            }
+
+            if (!createCollatedIndexes()) {
+                qCritical(migration) << "MigrationRunner: Failed to create collated indexes";
+                m_db.rollback();
+                return false;
+            }
+
+            if (!createStockSnapshotTables()) {
+                qCritical(migration) << "MigrationRunner: Failed to create stock snapshots";
+                m_db.rollback();
+                return false;
+            }
+
+            if (!createStockOpeningBalancesTable()) {
+                qCritical(migration) << "MigrationRunner: Failed to create stock_opening_balances";
+                m_db.rollback();
+                return false;
+            }
+
+            if (!createDocumentAggregates()) {
+                qCritical(migration) << "MigrationRunner: Failed to create document aggregates";
+                m_db.rollback();
+                return false;
+            }
+
+            if (!createChangeCounters()) {
+                qCritical(migration) << "MigrationRunner: Failed to create change counters";
+                m_db.rollback();
+                return false;
+            }
+
             if (!m_db.commit()) {
                 qCritical(migration) << "MigrationRunner: Cannot commit transaction:" << m_db.lastError().text();
                 m_db.rollback();
@@ -119,6 +165,88 @@ bool MigrationRunner::runMigrations()
             return false;
         }
 
+        // списки документов листаются по (doc_type, date, id)
+        if (!executeQuery(
+                "CREATE INDEX IF NOT EXISTS idx_documents_type_date ON documents(doc_type, date)",
+                "createIndexes: documents_type_date"
+            )) {
+            qCritical(migration) << "MigrationRunner: Failed to create idx_documents_type_date";
+            m_db.rollback();
+            return false;
+        }
+
+        // журнал движений по товару листается по (movement_date, id)
+        if (!executeQuery(
+                "CREATE INDEX IF NOT EXISTS idx_movements_product_date ON inventory_movements(product_id, movement_date)",
+                "createIndexes: movements_product_date"
+            )) {
+            qCritical(migration) << "MigrationRunner: Failed to create idx_movements_product_date";
+            m_db.rollback();
+            return false;
+        }
+
+        const bool hadReservations = tableExists("stock_reservations");
+        if (!createStockReservationsTable() || !executeQuery(
+                "CREATE INDEX IF NOT EXISTS idx_reservations_product ON stock_reservations(product_id)",
+                "createIndexes: reservations_product"
+            )) {
+            qCritical(migration) << "MigrationRunner: Failed to create stock_reservations";
+            m_db.rollback();
+            return false;
+        }
+
+        // черновики, созданные до появления резервов, резервируют свои строки;
+        // с остатком резерв здесь не сверяется — остаток проверит проведение
+        if (!hadReservations && !executeQuery(
+                "INSERT OR IGNORE INTO stock_reservations (document_id, product_id, qty_kg) "
+                "SELECT d.id, l.product_id, SUM(l.qty_kg) "
+                "FROM documents d JOIN document_lines l ON l.document_id = d.id "
+                "WHERE d.status = 'DRAFT' AND d.is_deleted = 0 AND d.doc_type IN ('transfer', 'sale') "
+                "GROUP BY d.id, l.product_id "
+                "HAVING SUM(l.qty_kg) > 0",
+                "backfill stock_reservations"
+            )) {
+            qCritical(migration) << "MigrationRunner: Failed to backfill stock_reservations";
+            m_db.rollback();
+            return false;
+        }
+
+        if (!createSearchIndex()) {
+            qCritical(migration) << "MigrationRunner: Failed to create search index";
+            m_db.rollback();
+            return false;
+        }
+
+        if (!createCollatedIndexes()) {
+            qCritical(migration) << "MigrationRunner: Failed to create collated indexes";
+            m_db.rollback();
+            return false;
+        }
+
+        if (!createStockSnapshotTables()) {
+            qCritical(migration) << "MigrationRunner: Failed to create stock snapshots";
+            m_db.rollback();
+            return false;
+        }
+
+        if (!createStockOpeningBalancesTable()) {
+            qCritical(migration) << "MigrationRunner: Failed to create stock_opening_balances";
+            m_db.rollback();
+            return false;
+        }
+
+        if (!createDocumentAggregates()) {
+            qCritical(migration) << "MigrationRunner: Failed to create document aggregates";
+            m_db.rollback();
+            return false;
+        }
+
+        if (!createChangeCounters()) {
+            qCritical(migration) << "MigrationRunner: Failed to create change counters";
+            m_db.rollback();
+            return false;
+        }
+
         if (!executeQuery(
                 "UPDATE documents "
                 "SET number = number || ' [del ' || id || ']' "
@@ -167,7 +295,8 @@ bool MigrationRunner::createAllTables()
            createRequisitesTable() &&
            createDocumentsTable() &&
            createDocumentLinesTable() &&
-           createInventoryMovementsTable();
+           createInventoryMovementsTable() &&
+           createStockReservationsTable();
 }
 
 bool MigrationRunner::createProductsTable()
@@ -238,6 +367,8 @@ bool MigrationRunner::createDocumentsTable()
             sender_id INTEGER,
             receiver_id INTEGER,
             total_amount TEXT NOT NULL DEFAULT '0.00',
+            line_count INTEGER NOT NULL DEFAULT 0,
+            total_qty_kg REAL NOT NULL DEFAULT 0,
             notes TEXT,
             is_deleted INTEGER NOT NULL DEFAULT 0 CHECK(is_deleted IN (0, 1)),
             created_at TEXT NOT NULL DEFAULT (datetime('now')),
@@ -289,6 +420,203 @@ bool MigrationRunner::createInventoryMovementsTable()
     return executeQuery(sql, "createInventoryMovementsTable");
 }
 
+bool MigrationRunner::createStockReservationsTable()
+{
+    QString sql = R"(
+        CREATE TABLE IF NOT EXISTS stock_reservations (
+            document_id INTEGER NOT NULL,
+            product_id INTEGER NOT NULL,
+            qty_kg REAL NOT NULL CHECK(qty_kg > 0),
+            created_at TEXT NOT NULL DEFAULT (datetime('now')),
+            PRIMARY KEY (document_id, product_id),
+            FOREIGN KEY (document_id) REFERENCES documents(id) ON DELETE CASCADE,
+            FOREIGN KEY (product_id) REFERENCES products(id)
+        )
+    )";
+
+    return executeQuery(sql, "createStockReservationsTable");
+}
+
+bool MigrationRunner::createStockSnapshotTables()
+{
+    bool success = true;
+
+    success &= executeQuery(R"(
+        CREATE TABLE IF NOT EXISTS stock_snapshot_periods (
+            period_end TEXT PRIMARY KEY,
+            created_at TEXT NOT NULL DEFAULT (datetime('now'))
+        )
+    )", "createStockSnapshotTables: periods");
+
+    // остаток товара на конец дня period_end включительно; нулевые строки не обязательны
+    success &= executeQuery(R"(
+        CREATE TABLE IF NOT EXISTS stock_snapshots (
+            period_end TEXT NOT NULL,
+            product_id INTEGER NOT NULL,
+            balance_kg REAL NOT NULL,
+            PRIMARY KEY (period_end, product_id),
+            FOREIGN KEY (period_end) REFERENCES stock_snapshot_periods(period_end) ON DELETE CASCADE,
+            FOREIGN KEY (product_id) REFERENCES products(id)
+        ) WITHOUT ROWID
+    )", "createStockSnapshotTables: snapshots");
+
+    if (!success) return false;
+
+    // проведение или отмена задним числом сдвигает все снимки с period_end >= даты движения;
+    // обычное движение «сегодня» позже всех снимков, и SELECT ничего не вставляет
+    const QStringList triggers = {
+        R"(CREATE TRIGGER IF NOT EXISTS movements_snapshots_ai AFTER INSERT ON inventory_movements
+        WHEN new.cancelled_flag = 0 BEGIN
+            INSERT INTO stock_snapshots (period_end, product_id, balance_kg)
+            SELECT period_end, new.product_id, new.qty_delta_kg
+            FROM stock_snapshot_periods WHERE period_end >= new.movement_date
+            ON CONFLICT (period_end, product_id) DO UPDATE SET balance_kg = balance_kg + excluded.balance_kg;
+        END)",
+        R"(CREATE TRIGGER IF NOT EXISTS movements_snapshots_au
+        AFTER UPDATE OF product_id, qty_delta_kg, movement_date, cancelled_flag ON inventory_movements BEGIN
+            INSERT INTO stock_snapshots (period_end, product_id, balance_kg)
+            SELECT period_end, old.product_id, -old.qty_delta_kg
+            FROM stock_snapshot_periods WHERE period_end >= old.movement_date AND old.cancelled_flag = 0
+            ON CONFLICT (period_end, product_id) DO UPDATE SET balance_kg = balance_kg + excluded.balance_kg;
+            INSERT INTO stock_snapshots (period_end, product_id, balance_kg)
+            SELECT period_end, new.product_id, new.qty_delta_kg
+            FROM stock_snapshot_periods WHERE period_end >= new.movement_date AND new.cancelled_flag = 0
+            ON CONFLICT (period_end, product_id) DO UPDATE SET balance_kg = balance_kg + excluded.balance_kg;
+        END)",
+        R"(CREATE TRIGGER IF NOT EXISTS movements_snapshots_ad AFTER DELETE ON inventory_movements
+        WHEN old.cancelled_flag = 0 BEGIN
+            INSERT INTO stock_snapshots (period_end, product_id, balance_kg)
+            SELECT period_end, old.product_id, -old.qty_delta_kg
+            FROM stock_snapshot_periods WHERE period_end >= old.movement_date
+            ON CONFLICT (period_end, product_id) DO UPDATE SET balance_kg = balance_kg + excluded.balance_kg;
+        END)"
+    };
+
+    for (const QString &sql : triggers) {
+        if (!executeQuery(sql, "createStockSnapshotTables: trigger"))
+            return false;
+    }
+
+    return true;
+}
+
+bool MigrationRunner::createStockOpeningBalancesTable()
+{
+    // остаток товара на as_of по перенесённым в архив движениям; текущий остаток — он плюс движения рабочей базы
+    return executeQuery(R"(
+        CREATE TABLE IF NOT EXISTS stock_opening_balances (
+            product_id INTEGER PRIMARY KEY,
+            balance_kg REAL NOT NULL,
+            as_of TEXT NOT NULL,
+            FOREIGN KEY (product_id) REFERENCES products(id)
+        )
+    )", "createStockOpeningBalancesTable");
+}
+
+bool MigrationRunner::createDocumentAggregates()
+{
+    bool success = true;
+
+    if (!columnExists(m_db, "documents", "line_count"))
+        success &= executeQuery("ALTER TABLE documents ADD COLUMN line_count INTEGER NOT NULL DEFAULT 0",
+                                "createDocumentAggregates: line_count");
+    if (!columnExists(m_db, "documents", "total_qty_kg"))
+        success &= executeQuery("ALTER TABLE documents ADD COLUMN total_qty_kg REAL NOT NULL DEFAULT 0",
+                                "createDocumentAggregates: total_qty_kg");
+    if (!success) return false;
+
+    const bool hadTriggers = triggerExists(m_db, "document_lines_totals_ai");
+
+    // суммы в TEXT с двумя знаками: сложение в double и printf('%.2f') на каждом шаге
+    // дают точный результат, ошибка не накапливается
+    const QStringList triggers = {
+        R"(CREATE TRIGGER IF NOT EXISTS document_lines_totals_ai AFTER INSERT ON document_lines BEGIN
+            UPDATE documents
+            SET total_amount = printf('%.2f', total_amount + new.line_sum),
+                line_count = line_count + 1,
+                total_qty_kg = round(total_qty_kg + new.qty_kg, 6)
+            WHERE id = new.document_id;
+        END)",
+        R"(CREATE TRIGGER IF NOT EXISTS document_lines_totals_au
+        AFTER UPDATE OF document_id, qty_kg, line_sum ON document_lines BEGIN
+            UPDATE documents
+            SET total_amount = printf('%.2f', total_amount - old.line_sum),
+                line_count = line_count - 1,
+                total_qty_kg = round(total_qty_kg - old.qty_kg, 6)
+            WHERE id = old.document_id;
+            UPDATE documents
+            SET total_amount = printf('%.2f', total_amount + new.line_sum),
+                line_count = line_count + 1,
+                total_qty_kg = round(total_qty_kg + new.qty_kg, 6)
+            WHERE id = new.document_id;
+        END)",
+        R"(CREATE TRIGGER IF NOT EXISTS document_lines_totals_ad AFTER DELETE ON document_lines BEGIN
+            UPDATE documents
+            SET total_amount = printf('%.2f', total_amount - old.line_sum),
+                line_count = line_count - 1,
+                total_qty_kg = round(total_qty_kg - old.qty_kg, 6)
+            WHERE id = old.document_id;
+        END)"
+    };
+
+    for (const QString &sql : triggers) {
+        if (!executeQuery(sql, "createDocumentAggregates: trigger"))
+            return false;
+    }
+
+    // до триггеров итог писало приложение, а строк и веса не было — пересчитываем один раз
+    if (!hadTriggers) {
+        return executeQuery(R"(
+            UPDATE documents
+            SET total_amount = (SELECT printf('%.2f', COALESCE(SUM(l.line_sum), 0))
+                                FROM document_lines l WHERE l.document_id = documents.id),
+                line_count = (SELECT COUNT(*) FROM document_lines l WHERE l.document_id = documents.id),
+                total_qty_kg = (SELECT round(COALESCE(SUM(l.qty_kg), 0), 6)
+                                FROM document_lines l WHERE l.document_id = documents.id)
+        )", "createDocumentAggregates: backfill");
+    }
+
+    return true;
+}
+
+bool MigrationRunner::createChangeCounters()
+{
+    if (!executeQuery(R"(
+        CREATE TABLE IF NOT EXISTS change_seq (
+            table_name TEXT PRIMARY KEY,
+            seq INTEGER NOT NULL DEFAULT 0
+        )
+    )", "createChangeCounters: table"))
+        return false;
+
+    for (const QString &table : ChangeTracker::trackedTables()) {
+        QSqlQuery q(m_db);
+        q.prepare("INSERT OR IGNORE INTO change_seq (table_name, seq) VALUES (?, 0)");
+        q.addBindValue(table);
+        if (!q.exec()) {
+            qCritical(migration) << "MigrationRunner: Cannot register change counter" << table << ":" << q.lastError().text();
+            return false;
+        }
+
+        // триггеры строчные: массовый UPDATE увеличит счётчик на число строк, это не мешает
+        static const char *const events[][2] = {
+            {"ai", "INSERT"},
+            {"au", "UPDATE"},
+            {"ad", "DELETE"}
+        };
+        for (const auto &event : events) {
+            const QString sql = QString(
+                "CREATE TRIGGER IF NOT EXISTS change_seq_%1_%2 AFTER %3 ON %1 BEGIN "
+                "UPDATE change_seq SET seq = seq + 1 WHERE table_name = '%1'; "
+                "END").arg(table, event[0], event[1]);
+            if (!executeQuery(sql, "createChangeCounters: trigger"))
+                return false;
+        }
+    }
+
+    return true;
+}
+
 bool MigrationRunner::createIndexes()
 {
     bool success = true;
@@ -313,6 +641,10 @@ bool MigrationRunner::createIndexes()
         "CREATE INDEX IF NOT EXISTS idx_documents_is_deleted ON documents(is_deleted)",
         "createIndexes: documents_is_deleted"
     );
+    success &= executeQuery(
+        "CREATE INDEX IF NOT EXISTS idx_documents_type_date ON documents(doc_type, date)",
+        "createIndexes: documents_type_date"
+    );
 
     success &= executeQuery(
         "CREATE INDEX IF NOT EXISTS idx_document_lines_document ON document_lines(document_id)",
@@ -339,6 +671,15 @@ bool MigrationRunner::createIndexes()
         "CREATE INDEX IF NOT EXISTS idx_movements_cancelled ON inventory_movements(cancelled_flag)",
         "createIndexes: movements_cancelled"
     );
+    success &= executeQuery(
+        "CREATE INDEX IF NOT EXISTS idx_movements_product_date ON inventory_movements(product_id, movement_date)",
+        "createIndexes: movements_product_date"
+    );
+
+    success &= executeQuery(
+        "CREATE INDEX IF NOT EXISTS idx_reservations_product ON stock_reservations(product_id)",
+        "createIndexes: reservations_product"
+    );
 
     success &= executeQuery(
         "CREATE INDEX IF NOT EXISTS idx_counterparties_type ON counterparties(type)",
@@ -361,6 +702,201 @@ bool MigrationRunner::createIndexes()
     return success;
 }
 
+bool MigrationRunner::fts5Available()
+{
+    QSqlQuery query(m_db);
+    if (!query.exec("SELECT sqlite_compileoption_used('ENABLE_FTS5')") || !query.next())
+        return false;
+    return query.value(0).toInt() == 1;
+}
+
+bool MigrationRunner::createSearchIndex()
+{
+    if (!fts5Available()) {
+        qWarning(migration) << "MigrationRunner: SQLite built without FTS5, search index skipped";
+        return true;
+    }
+
+    const bool hadProducts = tableExists("products_fts");
+    const bool hadCounterparties = tableExists("counterparties_fts");
+    const bool hadDocuments = tableExists("documents_fts");
+
+    // unicode61 приводит кириллицу к нижнему регистру (LIKE этого не умеет);
+    // prefix — индексы для поиска по началу слова ("мук"* без полного перебора)
+    bool success = true;
+
+    // товары и документы — external content: текст хранится только в исходной таблице
+    success &= executeQuery(R"(
+        CREATE VIRTUAL TABLE IF NOT EXISTS products_fts USING fts5(
+            name,
+            content = 'products', content_rowid = 'id',
+            tokenize = 'unicode61 remove_diacritics 2', prefix = '2 3'
+        )
+    )", "createSearchIndex: products_fts");
+
+    success &= executeQuery(R"(
+        CREATE VIRTUAL TABLE IF NOT EXISTS documents_fts USING fts5(
+            number, notes,
+            content = 'documents', content_rowid = 'id',
+            tokenize = 'unicode61 remove_diacritics 2', prefix = '2 3'
+        )
+    )", "createSearchIndex: documents_fts");
+
+    // ИНН лежит в requisites, поэтому у контрагентов индекс со своей копией текста
+    success &= executeQuery(R"(
+        CREATE VIRTUAL TABLE IF NOT EXISTS counterparties_fts USING fts5(
+            name, address, inn,
+            tokenize = 'unicode61 remove_diacritics 2', prefix = '2 3'
+        )
+    )", "createSearchIndex: counterparties_fts");
+
+    if (!success) return false;
+
+    const QStringList triggers = {
+        R"(CREATE TRIGGER IF NOT EXISTS products_fts_ai AFTER INSERT ON products BEGIN
+            INSERT INTO products_fts (rowid, name) VALUES (new.id, new.name);
+        END)",
+        R"(CREATE TRIGGER IF NOT EXISTS products_fts_ad AFTER DELETE ON products BEGIN
+            INSERT INTO products_fts (products_fts, rowid, name) VALUES ('delete', old.id, old.name);
+        END)",
+        R"(CREATE TRIGGER IF NOT EXISTS products_fts_au AFTER UPDATE OF name ON products BEGIN
+            INSERT INTO products_fts (products_fts, rowid, name) VALUES ('delete', old.id, old.name);
+            INSERT INTO products_fts (rowid, name) VALUES (new.id, new.name);
+        END)",
+
+        R"(CREATE TRIGGER IF NOT EXISTS documents_fts_ai AFTER INSERT ON documents BEGIN
+            INSERT INTO documents_fts (rowid, number, notes) VALUES (new.id, new.number, new.notes);
+        END)",
+        R"(CREATE TRIGGER IF NOT EXISTS documents_fts_ad AFTER DELETE ON documents BEGIN
+            INSERT INTO documents_fts (documents_fts, rowid, number, notes) VALUES ('delete', old.id, old.number, old.notes);
+        END)",
+        R"(CREATE TRIGGER IF NOT EXISTS documents_fts_au AFTER UPDATE OF number, notes ON documents BEGIN
+            INSERT INTO documents_fts (documents_fts, rowid, number, notes) VALUES ('delete', old.id, old.number, old.notes);
+            INSERT INTO documents_fts (rowid, number, notes) VALUES (new.id, new.number, new.notes);
+        END)",
+
+        R"(CREATE TRIGGER IF NOT EXISTS counterparties_fts_ai AFTER INSERT ON counterparties BEGIN
+            INSERT INTO counterparties_fts (rowid, name, address, inn)
+            VALUES (new.id, new.name, new.address, (SELECT inn FROM requisites WHERE counterparty_id = new.id));
+        END)",
+        R"(CREATE TRIGGER IF NOT EXISTS counterparties_fts_ad AFTER DELETE ON counterparties BEGIN
+            DELETE FROM counterparties_fts WHERE rowid = old.id;
+        END)",
+        R"(CREATE TRIGGER IF NOT EXISTS counterparties_fts_au AFTER UPDATE OF name, address ON counterparties BEGIN
+            UPDATE counterparties_fts SET name = new.name, address = new.address WHERE rowid = new.id;
+        END)",
+        R"(CREATE TRIGGER IF NOT EXISTS requisites_fts_ai AFTER INSERT ON requisites BEGIN
+            UPDATE counterparties_fts SET inn = new.inn WHERE rowid = new.counterparty_id;
+        END)",
+        R"(CREATE TRIGGER IF NOT EXISTS requisites_fts_au AFTER UPDATE OF inn ON requisites BEGIN
+            UPDATE counterparties_fts SET inn = new.inn WHERE rowid = new.counterparty_id;
+        END)",
+        R"(CREATE TRIGGER IF NOT EXISTS requisites_fts_ad AFTER DELETE ON requisites BEGIN
+            UPDATE counterparties_fts SET inn = NULL WHERE rowid = old.counterparty_id;
+        END)"
+    };
+
+    for (const QString &sql : triggers) {
+        if (!executeQuery(sql, "createSearchIndex: trigger"))
+            return false;
+    }
+
+    // индекс появился у существующей базы — заполняем его один раз
+    if (!hadProducts)
+        success &= executeQuery("INSERT INTO products_fts (products_fts) VALUES ('rebuild')",
+                                "createSearchIndex: rebuild products_fts");
+    if (!hadDocuments)
+        success &= executeQuery("INSERT INTO documents_fts (documents_fts) VALUES ('rebuild')",
+                                "createSearchIndex: rebuild documents_fts");
+    if (!hadCounterparties)
+        success &= executeQuery(
+            "INSERT INTO counterparties_fts (rowid, name, address, inn) "
+            "SELECT c.id, c.name, c.address, r.inn "
+            "FROM counterparties c LEFT JOIN requisites r ON r.counterparty_id = c.id",
+            "createSearchIndex: fill counterparties_fts");
+
+    return success;
+}
+
+QString MigrationRunner::metaValue(const QString &key)
+{
+    QSqlQuery query(m_db);
+    query.prepare("SELECT value FROM db_meta WHERE key = ?");
+    query.addBindValue(key);
+    if (!query.exec() || !query.next())
+        return QString();
+    return query.value(0).toString();
+}
+
+bool MigrationRunner::setMetaValue(const QString &key, const QString &value)
+{
+    QSqlQuery query(m_db);
+    query.prepare("INSERT INTO db_meta (key, value) VALUES (?, ?) "
+                  "ON CONFLICT(key) DO UPDATE SET value = excluded.value");
+    query.addBindValue(key);
+    query.addBindValue(value);
+
+    if (!query.exec()) {
+        qCritical(migration) << "MigrationRunner: Cannot store" << key << ":" << query.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+bool MigrationRunner::createCollatedIndexes()
+{
+    if (!executeQuery(
+            "CREATE TABLE IF NOT EXISTS db_meta (key TEXT PRIMARY KEY, value TEXT NOT NULL)",
+            "createCollatedIndexes: db_meta"
+        )) {
+        return false;
+    }
+
+    if (!SqlCollation::isAvailable()) {
+        // индекс с незарегистрированной сортировкой ломает любую запись в таблицу
+        qWarning(migration) << "MigrationRunner: RU collation is not available, collated indexes dropped";
+        return executeQuery("DROP INDEX IF EXISTS idx_products_active_name", "createCollatedIndexes: drop")
+            && executeQuery("DROP INDEX IF EXISTS idx_products_name", "createCollatedIndexes: drop")
+            && executeQuery("DROP INDEX IF EXISTS idx_counterparties_active_name", "createCollatedIndexes: drop")
+            && executeQuery("DROP INDEX IF EXISTS idx_counterparties_name", "createCollatedIndexes: drop")
+            && executeQuery("DELETE FROM db_meta WHERE key = 'collation_ru'", "createCollatedIndexes: meta");
+    }
+
+    bool success = true;
+
+    // WHERE is_active = 1 ORDER BY name и ORDER BY is_active DESC, name — прямо по индексу
+    success &= executeQuery(
+        "CREATE INDEX IF NOT EXISTS idx_products_active_name ON products(is_active DESC, name COLLATE RU)",
+        "createCollatedIndexes: products_active_name"
+    );
+    success &= executeQuery(
+        "CREATE INDEX IF NOT EXISTS idx_products_name ON products(name COLLATE RU)",
+        "createCollatedIndexes: products_name"
+    );
+    success &= executeQuery(
+        "CREATE INDEX IF NOT EXISTS idx_counterparties_active_name ON counterparties(is_active, name COLLATE RU)",
+        "createCollatedIndexes: counterparties_active_name"
+    );
+    success &= executeQuery(
+        "CREATE INDEX IF NOT EXISTS idx_counterparties_name ON counterparties(name COLLATE RU)",
+        "createCollatedIndexes: counterparties_name"
+    );
+    if (!success) return false;
+
+    // другая версия Qt/ICU может сравнивать иначе — порядок в индексах надо пересобрать
+    const QString fingerprint = SqlCollation::fingerprint();
+    const QString stored = metaValue("collation_ru");
+    if (stored != fingerprint) {
+        if (!stored.isEmpty())
+            qInfo(migration) << "MigrationRunner: RU collation changed" << stored << "->" << fingerprint << ", reindexing";
+        if (!executeQuery("REINDEX RU", "createCollatedIndexes: reindex"))
+            return false;
+        return setMetaValue("collation_ru", fingerprint);
+    }
+
+    return true;
+}
+
 bool MigrationRunner::executeQuery(const QString &sql, const QString &errorContext)
 {
     QSqlQuery query(m_db);
@@ -450,9 +986,10 @@ bool MigrationRunner::loadTestDataInline()
 (4, '6164567890', '616401001', '046015207', 'ПАО "Альфа-Банк"', '40702810100000004567', '30101810600000000207'),
 (5, '1650123456', '165001001', '049205774', 'ПАО "Тинькофф Банк"', '40702810100000007890', '30101810145250000774'))",
 
-        R"(INSERT OR IGNORE INTO documents (doc_type, number, date, status, sender_id, receiver_id, total_amount, notes, is_deleted) VALUES
-('transfer', 'ТТН-001', date('now', '-2 days'), 'POSTED', 2, 1, '45500.00', 'ТТН на поставку муки', 0),
-('transfer', 'ТТН-002', date('now', '-1 days'), 'DRAFT', 3, 1, '23500.00', 'ТТН на поставку круп', 0))",
+        // итоги документов считают триггеры document_lines_totals_*
+        R"(INSERT OR IGNORE INTO documents (doc_type, number, date, status, sender_id, receiver_id, notes, is_deleted) VALUES
+('transfer', 'ТТН-001', date('now', '-2 days'), 'POSTED', 2, 1, 'ТТН на поставку муки', 0),
+('transfer', 'ТТН-002', date('now', '-1 days'), 'DRAFT', 3, 1, 'ТТН на поставку круп', 0))",
 
         R"(INSERT OR IGNORE INTO document_lines (document_id, product_id, qty_kg, price, line_sum) VALUES
 (1, 1, 1000.0, '45.50', '45500.00'),
@@ -0,0 +1,77 @@
+#include "ReadPool.h"
+#include "DbManager.h"
+
+#include <QAtomicInt>
+#include <QLoggingCategory>
+#include <QMutexLocker>
+
+Q_LOGGING_CATEGORY(readPool, "db.readpool")
+
+namespace {
+
+QAtomicInt connectionCounter;
+
+// соединение потока пула: открывается при первой задаче, закрывается при выходе потока
+struct ThreadConnection {
+    QString name;
+
+    ~ThreadConnection()
+    {
+        if (!name.isEmpty())
+            DbManager::closeConnection(name);
+    }
+
+    QSqlDatabase database()
+    {
+        if (name.isEmpty())
+            name = QString("WholesaleTradeReader-%1").arg(connectionCounter.fetchAndAddRelaxed(1));
+        return DbManager::instance().openConnection(name);
+    }
+};
+
+thread_local ThreadConnection threadConnection;
+
+} // namespace
+
+ReadPool& ReadPool::instance()
+{
+    static ReadPool pool;
+    return pool;
+}
+
+ReadPool::ReadPool()
+    : m_pool(std::make_unique<QThreadPool>())
+{
+    m_pool->setMaxThreadCount(kMaxThreads);
+    m_pool->setObjectName("ReadPool");
+}
+
+bool ReadPool::start(std::function<void(QSqlDatabase)> task)
+{
+    QMutexLocker lock(&m_lock);
+    if (!m_pool) {
+        qWarning(readPool) << "ReadPool: task rejected, pool is shut down";
+        return false;
+    }
+
+    m_pool->start([task = std::move(task)]() {
+        task(threadConnection.database());
+    });
+    return true;
+}
+
+void ReadPool::shutdown()
+{
+    std::unique_ptr<QThreadPool> pool;
+    {
+        QMutexLocker lock(&m_lock);
+        pool = std::move(m_pool);
+    }
+    if (!pool) return;
+
+    // деструктор пула дожидается задач и завершает потоки — их соединения закрываются там же
+    pool->waitForDone();
+    pool.reset();
+
+    qInfo(readPool) << "ReadPool: stopped";
+}
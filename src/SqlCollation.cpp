@@ -0,0 +1,83 @@
+#include "SqlCollation.h"
+#include "DbManager.h"
+
+#include <QCollator>
+#include <QLocale>
+#include <QStringView>
+#include <QLoggingCategory>
+
+#include <atomic>
+
+#include <sqlite3.h>
+
+Q_LOGGING_CATEGORY(sqlCollation, "db.collation")
+
+namespace {
+
+std::atomic<bool> g_available{false};
+
+QCollator makeCollator()
+{
+    QCollator collator(QLocale(QLocale::Russian, QLocale::Russia));
+    collator.setCaseSensitivity(Qt::CaseInsensitive);
+    collator.setIgnorePunctuation(true);
+    collator.setNumericMode(true);
+    return collator;
+}
+
+// SQLite вызывает сравнение из потока соединения; QCollator не потокобезопасен,
+// поэтому у каждого потока свой экземпляр
+int compareRu(void*, int lenA, const void* a, int lenB, const void* b)
+{
+    thread_local const QCollator collator = makeCollator();
+
+    const QStringView viewA(static_cast<const char16_t*>(a), lenA / 2);
+    const QStringView viewB(static_cast<const char16_t*>(b), lenB / 2);
+    return collator.compare(viewA, viewB);
+}
+
+} // namespace
+
+bool SqlCollation::install(QSqlDatabase& db)
+{
+    sqlite3* sqlite = DbManager::sqliteHandle(db);
+    if (!sqlite) {
+        qWarning(sqlCollation) << "SqlCollation: no usable sqlite3 handle, RU collation disabled";
+        return false;
+    }
+
+    const int rc = sqlite3_create_collation_v2(sqlite, kName, SQLITE_UTF16_ALIGNED,
+                                               nullptr, &compareRu, nullptr);
+    if (rc != SQLITE_OK) {
+        qWarning(sqlCollation) << "SqlCollation: sqlite3_create_collation_v2 failed:" << sqlite3_errstr(rc);
+        return false;
+    }
+
+    g_available = true;
+    return true;
+}
+
+bool SqlCollation::isAvailable()
+{
+    return g_available.load();
+}
+
+QString SqlCollation::orderBy(const QString& column)
+{
+    return isAvailable() ? column + " COLLATE " + kName : column;
+}
+
+int SqlCollation::compare(QStringView a, QStringView b)
+{
+    if (!isAvailable())
+        return a.compare(b);
+
+    thread_local const QCollator collator = makeCollator();
+    return collator.compare(a, b);
+}
+
+QString SqlCollation::fingerprint()
+{
+    // правила задаёт ICU/платформа, поставляемые вместе с Qt
+    return QString("%1/%2").arg(qVersion(), makeCollator().locale().name());
+}
@@ -0,0 +1,156 @@
+#include "SqlRetry.h"
+#include "WriteTransaction.h"
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRandomGenerator>
+#include <QThread>
+#include <QLoggingCategory>
+
+#include <sqlite3.h>
+
+#include <utility>
+
+Q_LOGGING_CATEGORY(sqlRetry, "db.retry")
+
+namespace {
+
+QMutex g_statsMutex;
+SqlRetryStats g_stats;
+
+// транзакция этого потока получила BUSY/LOCKED; сбрасывает transaction()
+thread_local bool t_busyInTransaction = false;
+
+} // namespace
+
+bool SqlRetry::isBusy(const QSqlError& error)
+{
+    if (error.type() == QSqlError::NoError)
+        return false;
+
+    // драйвер отдаёт код sqlite3_errcode; расширенные коды несут основной в младшем байте
+    bool ok = false;
+    const int code = error.nativeErrorCode().toInt(&ok) & 0xff;
+    if (ok)
+        return code == SQLITE_BUSY || code == SQLITE_LOCKED;
+
+    return error.databaseText().contains("locked", Qt::CaseInsensitive);
+}
+
+bool SqlRetry::exec(const QSqlDatabase& db, QSqlQuery& query)
+{
+    const bool inTransaction = WriteTransaction::isOpen(db);
+    return run(query, QString(), !inTransaction, inTransaction);
+}
+
+bool SqlRetry::execControl(const QSqlDatabase& db, QSqlQuery& query, const QString& sql)
+{
+    // COMMIT идёт при ещё открытой транзакции: исчерпанные попытки должны её сорвать
+    return run(query, sql, true, WriteTransaction::isOpen(db));
+}
+
+bool SqlRetry::run(QSqlQuery& query, const QString& sql, bool retry, bool inTransaction)
+{
+    QElapsedTimer waited;
+    waited.start();
+
+    bool ok = false;
+    bool busy = false;
+    int attempt = 1;
+    for (;; ++attempt) {
+        ok = sql.isEmpty() ? query.exec() : query.exec(sql);
+        if (ok || !isBusy(query.lastError()))
+            break;
+
+        busy = true;
+        {
+            QMutexLocker lock(&g_statsMutex);
+            ++g_stats.busyErrors;
+        }
+
+        if (!retry || attempt >= kMaxAttempts) {
+            if (inTransaction) t_busyInTransaction = true;
+            break;
+        }
+
+        {
+            QMutexLocker lock(&g_statsMutex);
+            ++g_stats.retries;
+        }
+        const int delay = backoffMs(attempt);
+        qDebug(sqlRetry) << "SqlRetry: database is locked, attempt" << attempt << "of" << kMaxAttempts
+                         << "- retry in" << delay << "ms";
+        QThread::msleep(static_cast<unsigned long>(delay));
+    }
+
+    if (!busy)
+        return ok;
+
+    // вместе с ожиданием внутри SQLite (busy_timeout)
+    const qint64 us = waited.nsecsElapsed() / 1000;
+    {
+        QMutexLocker lock(&g_statsMutex);
+        ++g_stats.lockWaits;
+        g_stats.lockWaitUs += us;
+        if (us > g_stats.maxLockWaitUs) g_stats.maxLockWaitUs = us;
+        if (!ok) ++g_stats.gaveUp;
+    }
+
+    if (ok) {
+        qInfo(sqlRetry) << "SqlRetry: lock acquired after" << attempt << "attempts," << us / 1000 << "ms";
+    } else {
+        qWarning(sqlRetry) << "SqlRetry: giving up after" << attempt << "attempts," << us / 1000 << "ms:"
+                           << query.lastError().text();
+    }
+    return ok;
+}
+
+bool SqlRetry::transaction(const QString& context, const std::function<bool()>& attempt)
+{
+    for (int i = 1;; ++i) {
+        t_busyInTransaction = false;
+        const bool ok = attempt();
+        const bool busy = std::exchange(t_busyInTransaction, false);
+
+        if (ok || !busy || i >= kMaxAttempts)
+            return ok;
+
+        {
+            QMutexLocker lock(&g_statsMutex);
+            ++g_stats.txRetries;
+        }
+        const int delay = backoffMs(i);
+        qInfo(sqlRetry) << "SqlRetry:" << context << "- transaction hit a lock, attempt" << i
+                        << "of" << kMaxAttempts << "- retry in" << delay << "ms";
+        QThread::msleep(static_cast<unsigned long>(delay));
+    }
+}
+
+bool SqlRetry::busyInTransaction()
+{
+    return t_busyInTransaction;
+}
+
+int SqlRetry::backoffMs(int attempt)
+{
+    const int shift = qBound(0, attempt - 1, 16);
+    const int ceiling = qMin(kMaxDelayMs, kBaseDelayMs << shift);
+    // разброс, чтобы соперники не просыпались одновременно
+    return ceiling / 2 + QRandomGenerator::global()->bounded(ceiling / 2 + 1);
+}
+
+SqlRetryStats SqlRetry::stats()
+{
+    QMutexLocker lock(&g_statsMutex);
+    return g_stats;
+}
+
+void SqlRetry::logStats()
+{
+    const SqlRetryStats s = stats();
+    qInfo(sqlRetry) << "SqlRetry: busy" << s.busyErrors << "retries" << s.retries
+                    << "transaction retries" << s.txRetries << "gave up" << s.gaveUp
+                    << "lock waits" << s.lockWaits << "total" << s.lockWaitUs / 1000 << "ms"
+                    << "max" << s.maxLockWaitUs / 1000 << "ms";
+}
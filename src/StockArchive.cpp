@@ -0,0 +1,384 @@
+#include "StockArchive.h"
+#include "DbManager.h"
+#include "WriteTransaction.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStringList>
+#include <QLoggingCategory>
+
+Q_LOGGING_CATEGORY(stockArchive, "db.archive")
+
+namespace {
+
+const QString kDocumentColumns =
+    "id, doc_type, number, date, status, sender_id, receiver_id, total_amount, line_count, total_qty_kg, "
+    "notes, is_deleted, created_at, updated_at";
+const QString kLineColumns = "id, document_id, product_id, qty_kg, price, line_sum, created_at";
+const QString kMovementColumns = "id, document_id, product_id, qty_delta_kg, movement_date, cancelled_flag, created_at";
+
+// граница архива из рабочей базы; '' — архива ещё нет
+const QString kBoundary = "(SELECT COALESCE(MAX(value), '') FROM main.db_meta WHERE key = 'archive_through')";
+
+} // namespace
+
+StockArchive::StockArchive(QSqlDatabase db, const QString &path)
+    : m_db(db)
+    , m_path(path)
+{
+}
+
+StockArchive::~StockArchive()
+{
+    detach();
+}
+
+QString StockArchive::defaultPath()
+{
+    const QFileInfo info(DbManager::instance().databasePath());
+    return info.absolutePath() + "/" + info.completeBaseName() + "_archive.db";
+}
+
+bool StockArchive::exists() const
+{
+    return QFile::exists(m_path);
+}
+
+bool StockArchive::exec(const QString &sql, const char *context)
+{
+    QSqlQuery q(m_db);
+    if (!q.exec(sql)) {
+        m_lastError = q.lastError().text();
+        qWarning(stockArchive) << "StockArchive:" << context << "SQL error:" << m_lastError;
+        return false;
+    }
+    return true;
+}
+
+bool StockArchive::fail(const QString &message)
+{
+    m_lastError = message;
+    qWarning(stockArchive) << "StockArchive:" << message;
+    return false;
+}
+
+bool StockArchive::attach(bool create)
+{
+    if (m_attached) return true;
+    m_lastError.clear();
+
+    // без create отчёт не должен заводить пустой файл архива
+    if (!create && !exists())
+        return fail("Файл архива не найден: " + m_path);
+
+    QSqlQuery q(m_db);
+    q.prepare(QString("ATTACH DATABASE ? AS %1").arg(kSchema));
+    q.addBindValue(m_path);
+    if (!q.exec())
+        return fail("Не удалось подключить архив: " + q.lastError().text());
+    m_attached = true;
+
+    if ((create && !createTables()) || !createViews()) {
+        detach();
+        return false;
+    }
+
+    qInfo(stockArchive) << "StockArchive: attached" << m_path << "to" << m_db.connectionName();
+    return true;
+}
+
+void StockArchive::detach()
+{
+    if (!m_attached) return;
+
+    // временные представления ссылаются на archive.*, убираем их первыми
+    for (const char *view : {"all_documents", "all_document_lines", "all_inventory_movements",
+                             "all_stock_snapshot_periods", "all_stock_snapshots"})
+        exec(QString("DROP VIEW IF EXISTS temp.%1").arg(view), "detach");
+
+    if (exec(QString("DETACH DATABASE %1").arg(kSchema), "detach"))
+        m_attached = false;
+}
+
+bool StockArchive::createTables()
+{
+    // те же столбцы, что в рабочей базе; внешних ключей нет — справочники остаются в рабочей
+    const QStringList ddl = {
+        R"(CREATE TABLE IF NOT EXISTS archive.documents (
+            id INTEGER PRIMARY KEY,
+            doc_type TEXT NOT NULL,
+            number TEXT NOT NULL,
+            date TEXT NOT NULL,
+            status TEXT NOT NULL,
+            sender_id INTEGER,
+            receiver_id INTEGER,
+            total_amount TEXT NOT NULL,
+            line_count INTEGER NOT NULL,
+            total_qty_kg REAL NOT NULL,
+            notes TEXT,
+            is_deleted INTEGER NOT NULL,
+            created_at TEXT NOT NULL,
+            updated_at TEXT NOT NULL
+        ))",
+        R"(CREATE TABLE IF NOT EXISTS archive.document_lines (
+            id INTEGER PRIMARY KEY,
+            document_id INTEGER NOT NULL,
+            product_id INTEGER NOT NULL,
+            qty_kg REAL NOT NULL,
+            price TEXT NOT NULL,
+            line_sum TEXT NOT NULL,
+            created_at TEXT NOT NULL
+        ))",
+        R"(CREATE TABLE IF NOT EXISTS archive.inventory_movements (
+            id INTEGER PRIMARY KEY,
+            document_id INTEGER NOT NULL,
+            product_id INTEGER NOT NULL,
+            qty_delta_kg REAL NOT NULL,
+            movement_date TEXT NOT NULL,
+            cancelled_flag INTEGER NOT NULL,
+            created_at TEXT NOT NULL
+        ))",
+        R"(CREATE TABLE IF NOT EXISTS archive.stock_snapshot_periods (
+            period_end TEXT PRIMARY KEY,
+            created_at TEXT NOT NULL
+        ))",
+        R"(CREATE TABLE IF NOT EXISTS archive.stock_snapshots (
+            period_end TEXT NOT NULL,
+            product_id INTEGER NOT NULL,
+            balance_kg REAL NOT NULL,
+            PRIMARY KEY (period_end, product_id)
+        ) WITHOUT ROWID)",
+        "CREATE INDEX IF NOT EXISTS archive.idx_documents_type_date ON documents(doc_type, date)",
+        "CREATE INDEX IF NOT EXISTS archive.idx_document_lines_document ON document_lines(document_id)",
+        "CREATE INDEX IF NOT EXISTS archive.idx_movements_document ON inventory_movements(document_id)",
+        "CREATE INDEX IF NOT EXISTS archive.idx_movements_product_date ON inventory_movements(product_id, movement_date)"
+    };
+
+    for (const QString &sql : ddl) {
+        if (!exec(sql, "createTables")) return false;
+    }
+
+    // архив, созданный до итогов документов (line_count, total_qty_kg)
+    QSqlQuery q(m_db);
+    if (!q.exec("SELECT COUNT(*) FROM pragma_table_info('documents', 'archive') WHERE name = 'line_count'") || !q.next())
+        return fail("Не удалось прочитать схему архива: " + q.lastError().text());
+    if (q.value(0).toInt() == 0) {
+        return exec("ALTER TABLE archive.documents ADD COLUMN line_count INTEGER NOT NULL DEFAULT 0", "createTables")
+            && exec("ALTER TABLE archive.documents ADD COLUMN total_qty_kg REAL NOT NULL DEFAULT 0", "createTables");
+    }
+    return true;
+}
+
+bool StockArchive::createViews()
+{
+    // архивная сторона видна только до границы: скопированное, но ещё не удалённое
+    // из рабочей базы (сбой между транзакциями переноса) не задваивается
+    const QStringList views = {
+        QString("CREATE TEMP VIEW IF NOT EXISTS all_documents AS "
+                "SELECT %1 FROM main.documents "
+                "UNION ALL SELECT %1 FROM archive.documents WHERE date <= %2")
+            .arg(kDocumentColumns, kBoundary),
+        QString("CREATE TEMP VIEW IF NOT EXISTS all_document_lines AS "
+                "SELECT %1 FROM main.document_lines "
+                "UNION ALL SELECT %1 FROM archive.document_lines "
+                "WHERE document_id IN (SELECT id FROM archive.documents WHERE date <= %2)")
+            .arg(kLineColumns, kBoundary),
+        QString("CREATE TEMP VIEW IF NOT EXISTS all_inventory_movements AS "
+                "SELECT %1 FROM main.inventory_movements "
+                "UNION ALL SELECT %1 FROM archive.inventory_movements WHERE movement_date <= %2")
+            .arg(kMovementColumns, kBoundary),
+        QString("CREATE TEMP VIEW IF NOT EXISTS all_stock_snapshot_periods AS "
+                "SELECT period_end, created_at FROM main.stock_snapshot_periods "
+                "UNION ALL SELECT period_end, created_at FROM archive.stock_snapshot_periods WHERE period_end < %1")
+            .arg(kBoundary),
+        QString("CREATE TEMP VIEW IF NOT EXISTS all_stock_snapshots AS "
+                "SELECT period_end, product_id, balance_kg FROM main.stock_snapshots "
+                "UNION ALL SELECT period_end, product_id, balance_kg FROM archive.stock_snapshots WHERE period_end < %1")
+            .arg(kBoundary)
+    };
+
+    for (const QString &sql : views) {
+        if (!exec(sql, "createViews")) return false;
+    }
+    return true;
+}
+
+QDate StockArchive::archivedThrough(QSqlDatabase db)
+{
+    QSqlQuery q(db);
+    if (!q.exec("SELECT value FROM db_meta WHERE key = 'archive_through'") || !q.next())
+        return QDate();
+    return QDate::fromString(q.value(0).toString(), Qt::ISODate);
+}
+
+int StockArchive::moveThrough(const QDate &periodEnd)
+{
+    m_lastError.clear();
+
+    if (!m_attached) {
+        fail("Архив не подключён");
+        return -1;
+    }
+    if (!periodEnd.isValid()) {
+        fail("Некорректная дата архива");
+        return -1;
+    }
+
+    const QString end = periodEnd.toString(Qt::ISODate);
+
+    {
+        QSqlQuery q(m_db);
+        q.prepare("SELECT 1 FROM stock_snapshot_periods WHERE period_end = ?");
+        q.addBindValue(end);
+        if (!q.exec() || !q.next()) {
+            fail("Нет снимка остатков на " + periodEnd.toString("dd.MM.yyyy"));
+            return -1;
+        }
+    }
+
+    // черновики остаются в рабочей базе: их ещё можно исправить или удалить
+    if (!exec("DROP TABLE IF EXISTS temp.archive_docs", "moveThrough")
+        || !exec("CREATE TEMP TABLE archive_docs (id INTEGER PRIMARY KEY)", "moveThrough")) {
+        return -1;
+    }
+
+    int moved = 0;
+
+    // ---- 1. копия в архив ----
+    {
+        WriteTransaction tx(m_db, "StockArchive.copy");
+        if (!tx.isActive()) {
+            fail("Не удалось начать транзакцию: " + tx.lastError());
+            return -1;
+        }
+
+        QSqlQuery q(m_db);
+        q.prepare("INSERT INTO temp.archive_docs (id) SELECT id FROM main.documents "
+                  "WHERE date <= ? AND status IN ('POSTED', 'CANCELLED')");
+        q.addBindValue(end);
+        if (!q.exec()) {
+            fail("Не удалось выбрать документы для архива: " + q.lastError().text());
+            return -1;
+        }
+        moved = q.numRowsAffected();
+
+        const QString docs = "(SELECT id FROM temp.archive_docs)";
+        const QStringList copy = {
+            QString("INSERT OR IGNORE INTO archive.documents (%1) SELECT %1 FROM main.documents WHERE id IN %2")
+                .arg(kDocumentColumns, docs),
+            QString("INSERT OR IGNORE INTO archive.document_lines (%1) SELECT %1 FROM main.document_lines "
+                    "WHERE document_id IN %2").arg(kLineColumns, docs),
+            QString("INSERT OR IGNORE INTO archive.inventory_movements (%1) SELECT %1 FROM main.inventory_movements "
+                    "WHERE document_id IN %2").arg(kMovementColumns, docs)
+        };
+        for (const QString &sql : copy) {
+            if (!exec(sql, "moveThrough: copy")) return -1;
+        }
+
+        // снимки до границы нужны отчётам по архивным датам; снимок на саму границу остаётся в рабочей
+        q.prepare("INSERT OR IGNORE INTO archive.stock_snapshot_periods (period_end, created_at) "
+                  "SELECT period_end, created_at FROM main.stock_snapshot_periods WHERE period_end < ?");
+        q.addBindValue(end);
+        if (!q.exec()) {
+            fail("Не удалось перенести снимки остатков: " + q.lastError().text());
+            return -1;
+        }
+        q.prepare("INSERT OR IGNORE INTO archive.stock_snapshots (period_end, product_id, balance_kg) "
+                  "SELECT period_end, product_id, balance_kg FROM main.stock_snapshots WHERE period_end < ?");
+        q.addBindValue(end);
+        if (!q.exec()) {
+            fail("Не удалось перенести снимки остатков: " + q.lastError().text());
+            return -1;
+        }
+
+        if (!tx.commit()) {
+            fail("Не удалось зафиксировать архив: " + tx.lastError());
+            return -1;
+        }
+    }
+
+    // ---- 2. рабочая база: входящий остаток вместо перенесённого ----
+    {
+        WriteTransaction tx(m_db, "StockArchive.prune");
+        if (!tx.isActive()) {
+            fail("Не удалось начать транзакцию: " + tx.lastError());
+            return -1;
+        }
+
+        // удаляем только то, что уже лежит в архиве
+        QSqlQuery q(m_db);
+        if (!q.exec("SELECT COUNT(*) FROM temp.archive_docs t "
+                    "WHERE NOT EXISTS (SELECT 1 FROM archive.documents a WHERE a.id = t.id)")
+            || !q.next() || q.value(0).toInt() != 0) {
+            fail("Архив не содержит всех переносимых документов");
+            return -1;
+        }
+
+        if (!exec("DROP TABLE IF EXISTS temp.archive_opening", "moveThrough")
+            || !exec("CREATE TEMP TABLE archive_opening AS "
+                     "SELECT product_id, SUM(qty_delta_kg) AS qty_kg FROM main.inventory_movements "
+                     "WHERE cancelled_flag = 0 AND document_id IN (SELECT id FROM temp.archive_docs) "
+                     "GROUP BY product_id", "moveThrough: opening")) {
+            return -1;
+        }
+
+        q.prepare("INSERT INTO main.stock_opening_balances (product_id, balance_kg, as_of) "
+                  "SELECT product_id, qty_kg, ? FROM temp.archive_opening WHERE true "
+                  "ON CONFLICT (product_id) DO UPDATE SET "
+                  "balance_kg = balance_kg + excluded.balance_kg, as_of = excluded.as_of");
+        q.addBindValue(end);
+        if (!q.exec()) {
+            fail("Не удалось записать входящие остатки: " + q.lastError().text());
+            return -1;
+        }
+
+        q.prepare("DELETE FROM main.stock_snapshots WHERE period_end < ?");
+        q.addBindValue(end);
+        bool ok = q.exec();
+        if (ok) {
+            q.prepare("DELETE FROM main.stock_snapshot_periods WHERE period_end < ?");
+            q.addBindValue(end);
+            ok = q.exec();
+        }
+        if (!ok) {
+            fail("Не удалось удалить перенесённые снимки: " + q.lastError().text());
+            return -1;
+        }
+
+        // movements_snapshots_ad вычитает удалённые движения из оставшихся снимков (period_end >= end);
+        // остаток не изменился — он перешёл во входящий, поэтому возвращаем те же суммы
+        if (!exec("DELETE FROM main.inventory_movements WHERE document_id IN (SELECT id FROM temp.archive_docs)",
+                  "moveThrough: movements")
+            || !exec("UPDATE main.stock_snapshots SET balance_kg = balance_kg + "
+                     "(SELECT o.qty_kg FROM temp.archive_opening o WHERE o.product_id = stock_snapshots.product_id) "
+                     "WHERE product_id IN (SELECT product_id FROM temp.archive_opening)",
+                     "moveThrough: snapshots")
+            || !exec("DELETE FROM main.document_lines WHERE document_id IN (SELECT id FROM temp.archive_docs)",
+                     "moveThrough: lines")
+            || !exec("DELETE FROM main.documents WHERE id IN (SELECT id FROM temp.archive_docs)",
+                     "moveThrough: documents")) {
+            return -1;
+        }
+
+        q.prepare("INSERT INTO db_meta (key, value) VALUES ('archive_through', ?) "
+                  "ON CONFLICT (key) DO UPDATE SET value = excluded.value");
+        q.addBindValue(end);
+        if (!q.exec()) {
+            fail("Не удалось записать границу архива: " + q.lastError().text());
+            return -1;
+        }
+
+        if (!tx.commit()) {
+            fail("Не удалось зафиксировать перенос в архив: " + tx.lastError());
+            return -1;
+        }
+    }
+
+    exec("DROP TABLE IF EXISTS temp.archive_opening", "moveThrough");
+    exec("DROP TABLE IF EXISTS temp.archive_docs", "moveThrough");
+
+    qInfo(stockArchive) << "StockArchive::moveThrough:" << end << "-" << moved << "documents moved to" << m_path;
+    return moved;
+}
@@ -0,0 +1,100 @@
+#include "StockReservations.h"
+
+#include <QReadLocker>
+#include <QWriteLocker>
+
+namespace {
+
+// остатки накопленных вычитаний double не должны давать «резерв» 1e-15 кг
+constexpr double kQtyEpsilon = 1e-9;
+
+} // namespace
+
+void StockReservations::load(const QList<StockReservation>& rows)
+{
+    QWriteLocker lock(&m_lock);
+    m_byProduct.clear();
+    m_byDocument.clear();
+
+    for (const auto& r : rows) {
+        m_byDocument[r.documentId][r.productId] += r.qtyKg;
+        m_byProduct[r.productId] += r.qtyKg;
+    }
+}
+
+QList<StockReservation> StockReservations::rows() const
+{
+    QReadLocker lock(&m_lock);
+
+    QList<StockReservation> res;
+    for (auto d = m_byDocument.constBegin(); d != m_byDocument.constEnd(); ++d) {
+        for (auto p = d->constBegin(); p != d->constEnd(); ++p)
+            res.append({d.key(), p.key(), p.value()});
+    }
+    return res;
+}
+
+void StockReservations::removeDocumentLocked(int documentId)
+{
+    const auto it = m_byDocument.constFind(documentId);
+    if (it == m_byDocument.constEnd())
+        return;
+
+    for (auto p = it->constBegin(); p != it->constEnd(); ++p) {
+        double& total = m_byProduct[p.key()];
+        total -= p.value();
+        if (total < kQtyEpsilon)
+            m_byProduct.remove(p.key());
+    }
+    m_byDocument.erase(it);
+}
+
+void StockReservations::setDocument(int documentId, const QHash<int, double>& qtyByProduct)
+{
+    QWriteLocker lock(&m_lock);
+    removeDocumentLocked(documentId);
+
+    if (qtyByProduct.isEmpty())
+        return;
+
+    m_byDocument.insert(documentId, qtyByProduct);
+    for (auto it = qtyByProduct.constBegin(); it != qtyByProduct.constEnd(); ++it)
+        m_byProduct[it.key()] += it.value();
+}
+
+void StockReservations::removeDocument(int documentId)
+{
+    QWriteLocker lock(&m_lock);
+    removeDocumentLocked(documentId);
+}
+
+bool StockReservations::hasDocument(int documentId) const
+{
+    QReadLocker lock(&m_lock);
+    return m_byDocument.contains(documentId);
+}
+
+double StockReservations::reservedBy(int documentId, int productId) const
+{
+    QReadLocker lock(&m_lock);
+    const auto it = m_byDocument.constFind(documentId);
+    return it == m_byDocument.constEnd() ? 0.0 : it->value(productId, 0.0);
+}
+
+double StockReservations::reserved(int productId) const
+{
+    QReadLocker lock(&m_lock);
+    return m_byProduct.value(productId, 0.0);
+}
+
+double StockReservations::reservedExcluding(int productId, int documentId) const
+{
+    QReadLocker lock(&m_lock);
+    double total = m_byProduct.value(productId, 0.0);
+
+    const auto it = m_byDocument.constFind(documentId);
+    if (it != m_byDocument.constEnd())
+        total -= it->value(productId, 0.0);
+
+    return total > kQtyEpsilon ? total : 0.0;
+}
@@ -0,0 +1,215 @@
+#include "StockTimeline.h"
+
+#include <QReadLocker>
+#include <QWriteLocker>
+
+namespace {
+
+// запас дней в конце дерева, чтобы не расширять его каждый день
+constexpr qsizetype kHeadroomDays = 366;
+
+// разность префиксов пустого дня — не всегда ровно ноль
+constexpr double kZeroKg = 1e-12;
+
+// [0..pos] включительно
+double prefixSum(const QList<double>& tree, qsizetype pos)
+{
+    double sum = 0.0;
+    for (qsizetype i = qMin(pos, tree.size() - 1) + 1; i > 0; i -= i & -i)
+        sum += tree[i - 1];
+    return sum;
+}
+
+void pointAdd(QList<double>& tree, qsizetype pos, double value)
+{
+    for (qsizetype i = pos + 1; i <= tree.size(); i += i & -i)
+        tree[i - 1] += value;
+}
+
+// дерево из значений по дням за O(n)
+void buildInPlace(QList<double>& values)
+{
+    const qsizetype n = values.size();
+    for (qsizetype i = 1; i <= n; ++i) {
+        const qsizetype parent = i + (i & -i);
+        if (parent <= n) values[parent - 1] += values[i - 1];
+    }
+}
+
+// обратно к значениям по дням
+QList<double> pointValues(const QList<double>& tree)
+{
+    QList<double> values(tree.size());
+    double previous = 0.0;
+    for (qsizetype i = 0; i < tree.size(); ++i) {
+        const double current = prefixSum(tree, i);
+        values[i] = current - previous;
+        previous = current;
+    }
+    return values;
+}
+
+} // namespace
+
+void StockTimeline::load(const QList<MovementTotal>& totals)
+{
+    QWriteLocker lock(&m_lock);
+    m_trees.clear();
+    m_baseDay = 0;
+
+    qint64 first = 0;
+    for (const auto& t : totals) {
+        const qint64 day = t.date.toJulianDay();
+        if (first == 0 || day < first) first = day;
+    }
+    m_baseDay = first;
+
+    // сначала значения по дням, потом построение деревьев одним проходом
+    for (const auto& t : totals) {
+        QList<double>& values = m_trees[t.productId];
+        const qsizetype pos = t.date.toJulianDay() - m_baseDay;
+        if (pos >= values.size()) values.resize(pos + 1 + kHeadroomDays, 0.0);
+        values[pos] += t.qtyKg;
+    }
+    for (auto it = m_trees.begin(); it != m_trees.end(); ++it)
+        buildInPlace(it.value());
+
+    m_loaded = true;
+}
+
+void StockTimeline::apply(const QList<MovementTotal>& changes)
+{
+    QWriteLocker lock(&m_lock);
+    for (const auto& c : changes)
+        addLocked(c.productId, c.date.toJulianDay(), c.qtyKg);
+}
+
+QList<MovementTotal> StockTimeline::replaceProducts(const QList<int>& productIds,
+                                                    const QList<MovementTotal>& totals)
+{
+    QHash<int, QHash<qint64, double>> wanted;     // product id -> (день -> кг)
+    for (const auto& t : totals)
+        wanted[t.productId][t.date.toJulianDay()] += t.qtyKg;
+
+    QWriteLocker lock(&m_lock);
+
+    // разница с деревом, а не новое дерево: подписчики получают её как обычные изменения
+    QList<MovementTotal> changes;
+    for (int productId : productIds) {
+        QHash<qint64, double> diff = wanted.value(productId);
+        const auto it = m_trees.constFind(productId);
+        if (it != m_trees.constEnd()) {
+            const QList<double> values = pointValues(it.value());
+            for (qsizetype pos = 0; pos < values.size(); ++pos) {
+                if (qAbs(values.at(pos)) > kZeroKg)
+                    diff[m_baseDay + pos] -= values.at(pos);
+            }
+        }
+
+        for (auto d = diff.constBegin(); d != diff.constEnd(); ++d) {
+            if (qAbs(d.value()) <= kZeroKg) continue;
+            addLocked(productId, d.key(), d.value());
+            changes.append({productId, QDate::fromJulianDay(d.key()), d.value()});
+        }
+    }
+    return changes;
+}
+
+void StockTimeline::addLocked(int productId, qint64 day, double qtyKg)
+{
+    if (m_trees.isEmpty() || m_baseDay == 0) m_baseDay = day;
+    if (day < m_baseDay) rebaseLocked(day);
+
+    QList<double>& tree = m_trees[productId];
+    const qsizetype pos = day - m_baseDay;
+    if (pos >= tree.size())
+        growTree(tree, pos + 1 + kHeadroomDays);
+
+    pointAdd(tree, pos, qtyKg);
+}
+
+void StockTimeline::growTree(QList<double>& tree, qsizetype minSize)
+{
+    // удвоение: расширение раз в год, а не на каждый новый день
+    QList<double> values = pointValues(tree);
+    values.resize(qMax(minSize, tree.size() * 2), 0.0);
+    buildInPlace(values);
+    tree = std::move(values);
+}
+
+void StockTimeline::rebaseLocked(qint64 newBaseDay)
+{
+    // движение раньше всего журнала — редкость, перестраиваем всё
+    const qsizetype shift = m_baseDay - newBaseDay;
+    for (auto it = m_trees.begin(); it != m_trees.end(); ++it) {
+        QList<double> values = pointValues(it.value());
+        values.insert(0, shift, 0.0);
+        buildInPlace(values);
+        it.value() = std::move(values);
+    }
+    m_baseDay = newBaseDay;
+}
+
+bool StockTimeline::isLoaded() const
+{
+    QReadLocker lock(&m_lock);
+    return m_loaded;
+}
+
+QList<MovementTotal> StockTimeline::totals() const
+{
+    QReadLocker lock(&m_lock);
+
+    QList<MovementTotal> res;
+    for (auto it = m_trees.constBegin(); it != m_trees.constEnd(); ++it) {
+        const QList<double> values = pointValues(it.value());
+        for (qsizetype pos = 0; pos < values.size(); ++pos) {
+            if (qAbs(values.at(pos)) > kZeroKg)
+                res.append({it.key(), QDate::fromJulianDay(m_baseDay + pos), values.at(pos)});
+        }
+    }
+    return res;
+}
+
+double StockTimeline::balanceAt(int productId, const QDate& date) const
+{
+    QReadLocker lock(&m_lock);
+
+    const auto it = m_trees.constFind(productId);
+    if (it == m_trees.constEnd() || !date.isValid()) return 0.0;
+
+    const qint64 pos = date.toJulianDay() - m_baseDay;
+    if (pos < 0) return 0.0;
+    return prefixSum(it.value(), pos);
+}
+
+double StockTimeline::balance(int productId) const
+{
+    QReadLocker lock(&m_lock);
+
+    const auto it = m_trees.constFind(productId);
+    if (it == m_trees.constEnd() || it->isEmpty()) return 0.0;
+    return prefixSum(it.value(), it->size() - 1);
+}
+
+QHash<int, double> StockTimeline::balancesAt(const QDate& date) const
+{
+    QReadLocker lock(&m_lock);
+
+    QHash<int, double> res;
+    if (!date.isValid()) return res;
+
+    const qint64 pos = date.toJulianDay() - m_baseDay;
+    if (pos < 0) return res;
+
+    res.reserve(m_trees.size());
+    for (auto it = m_trees.constBegin(); it != m_trees.constEnd(); ++it)
+        res.insert(it.key(), prefixSum(it.value(), pos));
+    return res;
+}
+
+QDate StockTimeline::firstDate() const
+{
+    QReadLocker lock(&m_lock);
+    return m_trees.isEmpty() ? QDate() : QDate::fromJulianDay(m_baseDay);
+}
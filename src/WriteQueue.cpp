@@ -0,0 +1,588 @@
+#include "WriteQueue.h"
+#include "DbManager.h"
+#include "DocumentService.h"
+#include "WriteTransaction.h"
+#include "SqlRetry.h"
+
+#include "repositories/DocumentRepository.h"
+#include "repositories/DocumentLineRepository.h"
+#include "repositories/StockRepository.h"
+#include "repositories/ProductRepository.h"
+
+#include "remote/RemoteClient.h"
+#include "remote/RemoteProtocol.h"
+
+#include <QDeadlineTimer>
+#include <QElapsedTimer>
+#include <QList>
+#include <QPointer>
+#include <QPromise>
+#include <QThread>
+#include <QLoggingCategory>
+
+#include <utility>
+
+Q_LOGGING_CATEGORY(writeQueue, "db.writequeue")
+
+namespace {
+
+const QString kWriterConnection = "WholesaleTradeWriter";
+
+QFuture<WriteResult> readyResult(const WriteResult& r)
+{
+    QPromise<WriteResult> promise;
+    promise.start();
+    promise.addResult(r);
+    promise.finish();
+    return promise.future();
+}
+
+} // namespace
+
+struct WriteQueue::Command : MpscNode {
+    const char* name = "";
+    Job job;                     // пустой job — команда остановки потока
+    bool exclusive = false;
+    QPromise<WriteResult> promise;
+};
+
+WriteQueue::WriteQueue(QObject* parent)
+    : QObject(parent)
+{
+}
+
+WriteQueue::~WriteQueue()
+{
+    stop();
+}
+
+void WriteQueue::setRemote(RemoteClient* client)
+{
+    m_remote = client;
+}
+
+bool WriteQueue::start()
+{
+    if (m_thread) return true;
+
+    if (m_remote) {
+        if (m_running) return true;
+        m_running = true;
+        connect(m_remote, &RemoteClient::serverEvent, this, &WriteQueue::onServerEvent);
+        connect(m_remote, &RemoteClient::disconnected, this, &WriteQueue::onRemoteDisconnected);
+        loadRemoteCaches();
+        qInfo(writeQueue) << "WriteQueue: commands go to the database server";
+        return true;
+    }
+
+    m_running = true;
+    m_thread = QThread::create([this]() { run(); });
+    m_thread->setObjectName("WriteQueue");
+    m_thread->start();
+
+    qInfo(writeQueue) << "WriteQueue: writer thread started";
+    return true;
+}
+
+void WriteQueue::stop()
+{
+    if (m_remote && m_running) {
+        m_running = false;
+        disconnect(m_remote, nullptr, this, nullptr);
+        return;
+    }
+
+    if (!m_thread) return;
+
+    m_running = false;
+
+    auto* sentinel = new Command;
+    sentinel->name = "stop";
+    sentinel->promise.start();
+    m_queue.push(sentinel);
+    m_pending.release();
+
+    m_thread->wait();
+    delete m_thread;
+    m_thread = nullptr;
+
+    // поток записи завершён, теперь единственный читатель очереди — мы
+    while (MpscNode* node = m_queue.pop()) {
+        auto* cmd = static_cast<Command*>(node);
+        WriteResult r;
+        r.error = "Очередь записи остановлена";
+        cmd->promise.addResult(r);
+        cmd->promise.finish();
+        delete cmd;
+    }
+
+    qInfo(writeQueue) << "WriteQueue: writer thread stopped";
+}
+
+WriteQueueStats WriteQueue::stats() const
+{
+    WriteQueueStats s;
+    s.commands = m_commands.load();
+    s.groups = m_groups.load();
+    s.failedGroups = m_failedGroups.load();
+    s.maxGroupSize = m_maxGroupSize.load();
+    return s;
+}
+
+QFuture<WriteResult> WriteQueue::submit(const char* name, Job job, bool exclusive)
+{
+    auto* cmd = new Command;
+    cmd->name = name;
+    cmd->job = std::move(job);
+    cmd->exclusive = exclusive;
+    cmd->promise.start();
+    QFuture<WriteResult> future = cmd->promise.future();
+
+    if (!m_running) {
+        WriteResult r;
+        r.error = "Очередь записи не запущена";
+        cmd->promise.addResult(r);
+        cmd->promise.finish();
+        delete cmd;
+        return future;
+    }
+
+    m_queue.push(cmd);
+    m_pending.release();
+    return future;
+}
+
+QFuture<WriteResult> WriteQueue::saveDraft(const Document& doc, const DocumentLinesDiff& lines)
+{
+    if (m_remote)
+        return submitRemote(RemoteOp::SaveDraft, RemoteProtocol::pack(doc, lines));
+
+    return submit("saveDraft", [doc, lines](DocumentService& service) mutable {
+        WriteResult r;
+        r.id = service.saveDraft(doc, lines);
+        r.ok = r.id > 0;
+        r.error = service.lastError();
+        r.lines = lines;
+        return r;
+    });
+}
+
+QFuture<WriteResult> WriteQueue::postDocument(int documentId)
+{
+    if (m_remote)
+        return submitRemote(RemoteOp::PostDocument, RemoteProtocol::pack(qint32(documentId)));
+
+    return submit("postDocument", [documentId](DocumentService& service) {
+        WriteResult r;
+        r.id = documentId;
+        r.ok = service.postDocument(documentId);
+        r.error = service.lastError();
+        return r;
+    });
+}
+
+QFuture<WriteResult> WriteQueue::cancelDocument(int documentId)
+{
+    if (m_remote)
+        return submitRemote(RemoteOp::CancelDocument, RemoteProtocol::pack(qint32(documentId)));
+
+    return submit("cancelDocument", [documentId](DocumentService& service) {
+        WriteResult r;
+        r.id = documentId;
+        r.ok = service.cancelDocument(documentId);
+        r.error = service.lastError();
+        return r;
+    });
+}
+
+QFuture<WriteResult> WriteQueue::cancelPosted(const DocumentFilter& filter)
+{
+    if (m_remote)
+        return submitRemote(RemoteOp::CancelPosted, RemoteProtocol::pack(filter));
+
+    return submit("cancelPosted", [filter](DocumentService& service) {
+        WriteResult r;
+        r.count = service.cancelPosted(filter);
+        r.ok = r.count >= 0;
+        r.error = service.lastError();
+        return r;
+    });
+}
+
+QFuture<WriteResult> WriteQueue::writeOff(int productId, double qtyKg, const QString& reason)
+{
+    if (m_remote)
+        return submitRemote(RemoteOp::WriteOff, RemoteProtocol::pack(qint32(productId), qtyKg, reason));
+
+    return submit("writeOff", [productId, qtyKg, reason](DocumentService& service) {
+        WriteResult r;
+        r.id = service.writeOff(productId, qtyKg, reason);
+        r.ok = r.id > 0;
+        r.error = service.lastError();
+        return r;
+    });
+}
+
+QFuture<WriteResult> WriteQueue::deleteDocument(int documentId)
+{
+    if (m_remote)
+        return submitRemote(RemoteOp::DeleteDocument, RemoteProtocol::pack(qint32(documentId)));
+
+    return submit("deleteDocument", [documentId](DocumentService& service) {
+        WriteResult r;
+        r.id = documentId;
+        r.ok = service.deleteDocument(documentId);
+        r.error = service.lastError();
+        return r;
+    });
+}
+
+QFuture<WriteResult> WriteQueue::closeStockPeriods(const QDate& today, int periodMonths)
+{
+    if (m_remote)
+        return submitRemote(RemoteOp::CloseStockPeriods, RemoteProtocol::pack(today, qint32(periodMonths)));
+
+    return submit("closeStockPeriods", [today, periodMonths](DocumentService& service) {
+        WriteResult r;
+        r.count = service.closeStockPeriods(today, periodMonths);
+        r.ok = r.count >= 0;
+        r.error = service.lastError();
+        return r;
+    });
+}
+
+QFuture<WriteResult> WriteQueue::archiveClosedYears(const QDate& today, int keepYears)
+{
+    if (m_remote)
+        return submitRemote(RemoteOp::ArchiveClosedYears, RemoteProtocol::pack(today, qint32(keepYears)));
+
+    // ATTACH/DETACH невозможны внутри транзакции группы
+    return submit("archiveClosedYears", [today, keepYears](DocumentService& service) {
+        WriteResult r;
+        r.count = service.archiveClosedYears(today, keepYears);
+        r.ok = r.count >= 0;
+        r.error = service.lastError();
+        return r;
+    }, true);
+}
+
+QFuture<WriteResult> WriteQueue::refreshStockCaches(const ChangeSet& changes)
+{
+    if (!changes.contains("documents") && !changes.contains("inventory_movements")) {
+        WriteResult r;
+        r.ok = true;
+        return readyResult(r);
+    }
+
+    if (m_remote) {
+        // сервер получает те же изменения и присылает изменения своих агрегатов событиями
+        WriteResult r;
+        r.ok = m_remote->isConnected();
+        if (!r.ok) r.error = m_remote->lastError();
+        return readyResult(r);
+    }
+
+    // вне группы: отложенные изменения резервов легли бы поверх перечитанных
+    return submit("refreshStockCaches", [changes](DocumentService& service) {
+        service.refreshStockCaches(changes);
+        WriteResult r;
+        r.ok = true;
+        return r;
+    }, true);
+}
+
+QFuture<StockCachesSnapshot> WriteQueue::stockCachesSnapshot()
+{
+    auto snapshot = std::make_shared<StockCachesSnapshot>();
+
+    // вне группы: отложенные изменения группы ещё не попали в агрегаты, а сигналы о них придут позже
+    return submit("stockCachesSnapshot", [this, snapshot](DocumentService&) {
+        snapshot->reservations = m_reservations.rows();
+        snapshot->totals = m_timeline.totals();
+        WriteResult r;
+        r.ok = true;
+        return r;
+    }, true).then([snapshot](const WriteResult&) { return *snapshot; });
+}
+
+QFuture<WriteResult> WriteQueue::submitRemote(RemoteOp op, const QByteArray& args)
+{
+    if (!m_running) {
+        WriteResult r;
+        r.error = "Очередь записи не запущена";
+        return readyResult(r);
+    }
+
+    return m_remote->request(op, args).then([](const RemoteReply& reply) {
+        WriteResult r;
+        if (!reply.ok) {
+            r.error = reply.error;
+        } else if (!RemoteProtocol::unpack(reply.payload, r)) {
+            r = WriteResult();
+            r.error = "Испорченный ответ сервера базы";
+        }
+        return r;
+    });
+}
+
+void WriteQueue::onServerEvent(RemoteOp op, const QByteArray& payload)
+{
+    qint32 documentId = 0;
+    DocumentType type = DocumentType::Supply;
+    QList<int> documentIds;
+    StockDeltas deltas;
+
+    switch (op) {
+    case RemoteOp::DocumentSavedEvent:
+        if (RemoteProtocol::unpack(payload, documentId, type))
+            emit documentSaved(documentId, type);
+        break;
+    case RemoteOp::DocumentPostedEvent:
+        if (RemoteProtocol::unpack(payload, documentId, type, deltas))
+            emit documentPosted(documentId, type, deltas);
+        break;
+    case RemoteOp::DocumentsCancelledEvent:
+        if (RemoteProtocol::unpack(payload, documentIds, deltas))
+            emit documentsCancelled(documentIds, deltas);
+        break;
+    case RemoteOp::DocumentDeletedEvent:
+        if (RemoteProtocol::unpack(payload, documentId))
+            emit documentDeleted(documentId);
+        break;
+    case RemoteOp::StockChangedEvent:
+        if (RemoteProtocol::unpack(payload, deltas))
+            emit stockChanged(deltas);
+        break;
+    case RemoteOp::ReservationsChangedEvent: {
+        ReservationChanges changes;
+        if (m_cachesLoading || !RemoteProtocol::unpack(payload, changes)) break;
+        for (auto it = changes.constBegin(); it != changes.constEnd(); ++it)
+            m_reservations.setDocument(it.key(), it.value());
+        emit reservationsChanged(changes);
+        break;
+    }
+    case RemoteOp::TimelineChangedEvent: {
+        QList<MovementTotal> changes;
+        if (m_cachesLoading || !RemoteProtocol::unpack(payload, changes)) break;
+        m_timeline.apply(changes);
+        emit timelineChanged(changes);
+        break;
+    }
+    case RemoteOp::StockCachesReloadedEvent:
+        loadRemoteCaches();
+        break;
+    default:
+        qWarning(writeQueue) << "WriteQueue: unknown server event" << quint16(op);
+        break;
+    }
+}
+
+void WriteQueue::loadRemoteCaches()
+{
+    const quint64 request = ++m_cachesRequest;
+    m_cachesLoading = true;
+
+    // продолжение без контекста выполняется прямо при разборе ответа, в порядке кадров:
+    // события после ответа применятся уже к загруженному снимку
+    QPointer<WriteQueue> guard(this);
+    m_remote->request(RemoteOp::StockCaches).then([guard, request](const RemoteReply& reply) {
+        if (!guard || request != guard->m_cachesRequest) return;
+        guard->m_cachesLoading = false;
+
+        StockCachesSnapshot snapshot;
+        if (!reply.ok || !RemoteProtocol::unpack(reply.payload, snapshot.reservations, snapshot.totals)) {
+            qWarning(writeQueue) << "WriteQueue: cannot load stock caches from the server:" << reply.error;
+            return;
+        }
+        guard->m_reservations.load(snapshot.reservations);
+        guard->m_timeline.load(snapshot.totals);
+        emit guard->stockCachesReloaded();
+        emit guard->timelineLoaded();
+    });
+}
+
+void WriteQueue::onRemoteDisconnected()
+{
+    if (!m_remote || !m_running) return;
+
+    // неотвеченные команды клиент уже завершил ошибкой; дальше пишем сами, как без сервера:
+    // блокировку записи делим с остальными экземплярами, об их изменениях узнаём через ChangeBus
+    qWarning(writeQueue) << "WriteQueue: database server closed the connection, starting own writer thread";
+    disconnect(m_remote, nullptr, this, nullptr);
+    m_remote = nullptr;
+    m_running = false;
+    m_cachesLoading = false;
+    ++m_cachesRequest;
+
+    start();
+    emit remoteLost("Соединение с сервером базы потеряно");
+}
+
+WriteQueue::Command* WriteQueue::takeCommand()
+{
+    // семафор отпускается после push, но соседний писатель мог ещё не связать свой узел
+    MpscNode* node = m_queue.pop();
+    while (!node) {
+        QThread::yieldCurrentThread();
+        node = m_queue.pop();
+    }
+    return static_cast<Command*>(node);
+}
+
+void WriteQueue::run()
+{
+    QSqlDatabase db = DbManager::instance().openConnection(kWriterConnection);
+
+    {
+        DocumentRepository docRepo(db);
+        DocumentLineRepository lineRepo(db);
+        StockRepository stockRepo(db);
+        ProductRepository productRepo(db);
+        DocumentService service(db, &docRepo, &lineRepo, &stockRepo, &productRepo);
+
+        m_reservations.load(stockRepo.findAllReservations());
+        service.setReservations(&m_reservations);
+
+        m_timeline.load(stockRepo.findActiveMovementTotals());
+        service.setTimeline(&m_timeline);
+        emit timelineLoaded();
+
+        // service живёт в потоке записи, очередь — в GUI: соединения будут queued
+        connect(&service, &DocumentService::documentSaved, this, &WriteQueue::documentSaved);
+        connect(&service, &DocumentService::documentPosted, this, &WriteQueue::documentPosted);
+        connect(&service, &DocumentService::documentsCancelled, this, &WriteQueue::documentsCancelled);
+        connect(&service, &DocumentService::documentDeleted, this, &WriteQueue::documentDeleted);
+        connect(&service, &DocumentService::stockChanged, this, &WriteQueue::stockChanged);
+        connect(&service, &DocumentService::reservationsChanged, this, &WriteQueue::reservationsChanged);
+        connect(&service, &DocumentService::timelineChanged, this, &WriteQueue::timelineChanged);
+        connect(&service, &DocumentService::stockCachesReloaded, this, &WriteQueue::stockCachesReloaded);
+        connect(&service, &DocumentService::stockCachesReloaded, this, &WriteQueue::timelineLoaded);
+
+        bool stopping = false;
+        Command* carried = nullptr;     // уже взята из очереди, но в группу не входит
+        while (!stopping) {
+            QList<Command*> group;
+            if (carried) {
+                group.append(std::exchange(carried, nullptr));
+            } else {
+                m_pending.acquire();
+                group.append(takeCommand());
+            }
+
+            if (group.first()->exclusive) {
+                runExclusive(service, group.first());
+                continue;
+            }
+
+            // добираем команды, пришедшие в пределах окна
+            QDeadlineTimer window(kGroupWindowMs);
+            while (group.size() < kMaxGroupSize && group.last()->job) {
+                if (!m_pending.tryAcquire(1, window))
+                    break;
+                Command* next = takeCommand();
+                if (next->exclusive) {
+                    carried = next;
+                    break;
+                }
+                group.append(next);
+            }
+
+            if (!group.last()->job) {
+                stopping = true;
+                Command* sentinel = group.takeLast();
+                sentinel->promise.finish();
+                delete sentinel;
+            }
+
+            if (!group.isEmpty())
+                runGroup(db, service, group);
+        }
+    }
+
+    db = QSqlDatabase();
+    DbManager::closeConnection(kWriterConnection);
+}
+
+void WriteQueue::runExclusive(DocumentService& service, Command* cmd)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // команда сама открывает и фиксирует свои транзакции
+    const WriteResult r = cmd->job(service);
+    service.commitPending(r.ok);
+
+    cmd->promise.addResult(r);
+    cmd->promise.finish();
+
+    ++m_commands;
+    ++m_groups;
+    if (!r.ok) ++m_failedGroups;
+
+    qDebug(writeQueue) << "WriteQueue: exclusive command" << cmd->name
+                       << (r.ok ? "done" : "failed") << "in" << timer.nsecsElapsed() / 1000 << "us";
+    delete cmd;
+}
+
+void WriteQueue::runGroup(QSqlDatabase db, DocumentService& service, QList<Command*>& group)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QList<WriteResult> results;
+    results.reserve(group.size());
+
+    const QString context = QString("writeQueue.group(%1)").arg(group.size());
+    bool committed = false;
+    QString txError;
+
+    // после отката от группы ничего не остаётся, и команды можно выполнить заново
+    SqlRetry::transaction(context, [&] {
+        results.clear();
+        WriteTransaction tx(db, context);
+        if (tx.isActive()) {
+            for (Command* cmd : group)
+                results.append(cmd->job(service));
+            // команда упёрлась в блокировку и откатила свою точку сохранения — повторяем всю группу
+            if (SqlRetry::busyInTransaction()) {
+                tx.rollback();
+                txError = "база данных занята другим соединением";
+            } else if (!(committed = tx.commit())) {
+                txError = tx.lastError();
+            }
+        } else {
+            txError = tx.lastError();
+        }
+        service.commitPending(committed);
+        return committed;
+    });
+
+    if (!committed) {
+        const QString error = "Не удалось зафиксировать транзакцию: " + txError;
+        results.resize(group.size());
+        for (auto& r : results) {
+            r.ok = false;
+            r.error = error;
+        }
+    }
+
+    // результаты отдаём только после фиксации всей группы
+    for (int i = 0; i < group.size(); ++i) {
+        Command* cmd = group.at(i);
+        cmd->promise.addResult(results.at(i));
+        cmd->promise.finish();
+        delete cmd;
+    }
+
+    m_commands += group.size();
+    ++m_groups;
+    if (!committed) ++m_failedGroups;
+
+    int prevMax = m_maxGroupSize.load();
+    while (group.size() > prevMax && !m_maxGroupSize.compare_exchange_weak(prevMax, group.size())) {
+    }
+
+    qDebug(writeQueue) << "WriteQueue: group of" << group.size() << "commands"
+                       << (committed ? "committed" : "failed") << "in" << timer.nsecsElapsed() / 1000 << "us";
+    group.clear();
+}
@@ -0,0 +1,142 @@
+#include "WriteTransaction.h"
+#include "SqlRetry.h"
+
+#include <QHash>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QLoggingCategory>
+
+Q_LOGGING_CATEGORY(writeTx, "db.transaction")
+
+namespace {
+
+QMutex g_statsMutex;
+WriteLockStats g_stats;
+
+// глубина вложенности по имени соединения; соединение живёт в одном потоке
+thread_local QHash<QString, int> t_depth;
+
+} // namespace
+
+WriteTransaction::WriteTransaction(QSqlDatabase db, const QString& context)
+    : m_db(db)
+    , m_context(context)
+{
+    if (!m_db.isOpen()) {
+        m_lastError = "База данных не открыта";
+        qCritical(writeTx) << "WriteTransaction:" << m_context << "- database is not open";
+        return;
+    }
+
+    int& depth = t_depth[m_db.connectionName()];
+
+    if (depth > 0) {
+        m_savepoint = QString("wt_sp_%1").arg(depth);
+        if (!exec("SAVEPOINT " + m_savepoint)) {
+            qCritical(writeTx) << "WriteTransaction:" << m_context << "- SAVEPOINT failed:" << m_lastError;
+            m_savepoint.clear();
+            return;
+        }
+    } else {
+        // IMMEDIATE: блокировка записи берётся сразу, а не при первом INSERT/UPDATE
+        if (!exec("BEGIN IMMEDIATE")) {
+            qCritical(writeTx) << "WriteTransaction:" << m_context << "- BEGIN failed:" << m_lastError;
+            return;
+        }
+    }
+
+    ++depth;
+    m_timer.start();
+    m_active = true;
+}
+
+WriteTransaction::~WriteTransaction()
+{
+    if (m_active)
+        rollback();
+}
+
+bool WriteTransaction::exec(const QString& sql)
+{
+    QSqlQuery q(m_db);
+    if (!SqlRetry::execControl(m_db, q, sql)) {
+        m_lastError = q.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+bool WriteTransaction::commit()
+{
+    if (!m_active) return false;
+
+    const QString sql = isNested() ? "RELEASE " + m_savepoint : QString("COMMIT");
+    if (!exec(sql)) {
+        qCritical(writeTx) << "WriteTransaction:" << m_context << "-" << sql << "failed:" << m_lastError;
+        rollback();
+        return false;
+    }
+
+    finish(true);
+    return true;
+}
+
+void WriteTransaction::rollback()
+{
+    if (!m_active) return;
+
+    if (isNested()) {
+        // ROLLBACK TO оставляет точку сохранения открытой, её нужно снять
+        if (!exec("ROLLBACK TO " + m_savepoint) || !exec("RELEASE " + m_savepoint)) {
+            qCritical(writeTx) << "WriteTransaction:" << m_context << "- ROLLBACK TO failed:" << m_lastError;
+        }
+    } else if (!exec("ROLLBACK")) {
+        qCritical(writeTx) << "WriteTransaction:" << m_context << "- ROLLBACK failed:" << m_lastError;
+    }
+
+    finish(false);
+}
+
+void WriteTransaction::finish(bool committed)
+{
+    m_active = false;
+    --t_depth[m_db.connectionName()];
+
+    const qint64 us = m_timer.nsecsElapsed() / 1000;
+
+    // блокировку держит и учитывает только внешняя транзакция
+    if (isNested()) {
+        qDebug(writeTx) << "WriteTransaction:" << m_context << "- savepoint" << m_savepoint
+                        << (committed ? "released" : "rolled back") << "after" << us << "us";
+        return;
+    }
+
+    {
+        QMutexLocker lock(&g_statsMutex);
+        if (committed) ++g_stats.committed;
+        else ++g_stats.rolledBack;
+        g_stats.lastUs = us;
+        g_stats.totalUs += us;
+        if (us > g_stats.maxUs) g_stats.maxUs = us;
+    }
+
+    if (us > kSlowLockUs) {
+        qWarning(writeTx) << "WriteTransaction:" << m_context << "- write lock held" << us << "us";
+    } else {
+        qDebug(writeTx) << "WriteTransaction:" << m_context << "- write lock held" << us << "us"
+                        << (committed ? "(commit)" : "(rollback)");
+    }
+}
+
+WriteLockStats WriteTransaction::stats()
+{
+    QMutexLocker lock(&g_statsMutex);
+    return g_stats;
+}
+
+bool WriteTransaction::isOpen(const QSqlDatabase& db)
+{
+    return t_depth.value(db.connectionName()) > 0;
+}
@@ -0,0 +1,487 @@
+#include "ChangeBus.h"
+#include "DbManager.h"
+#include "JsonFormat.h"
+#include "MigrationRunner.h"
+#include "ReadPool.h"
+#include "SqlRetry.h"
+#include "WriteQueue.h"
+#include "remote/RemoteClient.h"
+#include "remote/RemoteProtocol.h"
+#include "repositories/DocumentLineRepository.h"
+#include "repositories/DocumentRepository.h"
+#include "repositories/StockRepository.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDate>
+#include <QEventLoop>
+#include <QFile>
+#include <QFutureWatcher>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QDebug>
+
+#include <cstdio>
+#include <optional>
+#include <utility>
+
+/*
+ * Консольная утилита для пакетных операций без GUI:
+ *
+ *   WholesaleTradeCli post [id...] [--from D --to D] [--type T]    провести документы / черновики за период
+ *   WholesaleTradeCli cancel [id...] [--from D --to D] [--type T]  отменить документы / проведённые за период
+ *   WholesaleTradeCli balances [--date D] [--all]                  остатки (на дату — по снимкам)
+ *   WholesaleTradeCli export [--from D --to D] [--out file]        документы со строками
+ *   WholesaleTradeCli import [file] [--post]                       черновики из выгрузки export
+ *   WholesaleTradeCli vacuum                                       сжать базу и обновить статистику
+ *
+ * Результат — JSON в stdout, журнал — в stderr. Код выхода: 0 — всё выполнено,
+ * 1 — часть операций не удалась, 2 — ошибка в аргументах или база недоступна.
+ *
+ * Запись идёт через WriteQueue, как в GUI: команды пакета попадают в общие
+ * группы (одна фиксация на группу), а при запущенном сервере базы — в его очередь.
+ */
+
+namespace {
+
+enum ExitCode {
+    ExitOk = 0,
+    ExitFailed = 1,
+    ExitUsage = 2
+};
+
+constexpr int kExportPageSize = 500;
+
+void printJson(const QJsonValue& value)
+{
+    const QByteArray bytes = value.isObject() ? QJsonDocument(value.toObject()).toJson(QJsonDocument::Compact)
+                                              : QJsonDocument(value.toArray()).toJson(QJsonDocument::Compact);
+    std::fwrite(bytes.constData(), 1, size_t(bytes.size()), stdout);
+    std::fputc('\n', stdout);
+}
+
+int usageError(const QString& message)
+{
+    printJson(QJsonObject{{"error", message}});
+    return ExitUsage;
+}
+
+// в удалённом режиме ответы сервера приходят через цикл событий главного потока
+WriteResult await(const QFuture<WriteResult>& future)
+{
+    QFutureWatcher<WriteResult> watcher;
+    QEventLoop loop;
+    QObject::connect(&watcher, &QFutureWatcherBase::finished, &loop, &QEventLoop::quit);
+    watcher.setFuture(future);
+    if (!future.isFinished())
+        loop.exec();
+
+    if (future.resultCount() == 0) {
+        WriteResult r;
+        r.error = "Команда записи не выполнена";
+        return r;
+    }
+    return future.result();
+}
+
+QJsonObject resultToJson(const WriteResult& r)
+{
+    QJsonObject o{{"id", r.id}, {"ok", r.ok}};
+    if (!r.ok) o.insert("error", r.error);
+    return o;
+}
+
+struct Options {
+    QStringList args;
+    QDate from;
+    QDate to;
+    QDate date;
+    std::optional<DocumentType> type;
+    QString out;
+    bool post = false;
+    bool all = false;
+    bool hasPeriod = false;
+};
+
+bool parseDate(const QString& text, QDate& date)
+{
+    date = QDate::fromString(text, Qt::ISODate);
+    return date.isValid();
+}
+
+QList<int> parseIds(const QStringList& args, bool& ok)
+{
+    QList<int> ids;
+    ok = true;
+    for (const QString& arg : args) {
+        const int id = arg.toInt(&ok);
+        if (!ok || id <= 0) {
+            ok = false;
+            return {};
+        }
+        ids.append(id);
+    }
+    return ids;
+}
+
+DocumentFilter filterFrom(const Options& options)
+{
+    DocumentFilter filter;
+    filter.dateFrom = options.from;
+    filter.dateTo = options.to;
+    filter.docType = options.type;
+    return filter;
+}
+
+int runPost(WriteQueue& writeQueue, const Options& options)
+{
+    bool ok = false;
+    QList<int> ids = parseIds(options.args, ok);
+    if (!ok) return usageError("post: ID документов — положительные числа");
+
+    // без ID — черновики за период тем же фильтром, что у cancelPosted: только id, без скрытых
+    if (ids.isEmpty()) {
+        if (!options.hasPeriod) return usageError("post: укажите ID документов или период --from/--to");
+        const std::optional<QList<int>> drafts =
+            DocumentRepository(DbManager::instance().database()).findIds(DocumentStatus::Draft, filterFrom(options));
+        if (!drafts) {
+            printJson(QJsonObject{{"ok", false}, {"error", "Не удалось выбрать черновики за период"}});
+            return ExitFailed;
+        }
+        ids = *drafts;
+    }
+
+    // все команды подаются сразу: очередь записи проведёт их общими группами
+    QList<QFuture<WriteResult>> futures;
+    futures.reserve(ids.size());
+    for (int id : std::as_const(ids))
+        futures.append(writeQueue.postDocument(id));
+
+    QJsonArray results;
+    int failed = 0;
+    for (qsizetype i = 0; i < futures.size(); ++i) {
+        WriteResult r = await(futures.at(i));
+        r.id = ids.at(i);
+        if (!r.ok) ++failed;
+        results.append(resultToJson(r));
+    }
+
+    printJson(QJsonObject{{"posted", int(ids.size()) - failed}, {"failed", failed}, {"results", results}});
+    return failed == 0 ? ExitOk : ExitFailed;
+}
+
+int runCancel(WriteQueue& writeQueue, const Options& options)
+{
+    bool ok = false;
+    const QList<int> ids = parseIds(options.args, ok);
+    if (!ok) return usageError("cancel: ID документов — положительные числа");
+
+    // без ID — проведённые за период, одной командой
+    if (ids.isEmpty()) {
+        if (!options.hasPeriod) return usageError("cancel: укажите ID документов или период --from/--to");
+        const WriteResult r = await(writeQueue.cancelPosted(filterFrom(options)));
+        QJsonObject o{{"ok", r.ok}, {"cancelled", r.count}};
+        if (!r.ok) o.insert("error", r.error);
+        printJson(o);
+        return r.ok ? ExitOk : ExitFailed;
+    }
+
+    QList<QFuture<WriteResult>> futures;
+    futures.reserve(ids.size());
+    for (int id : ids)
+        futures.append(writeQueue.cancelDocument(id));
+
+    QJsonArray results;
+    int failed = 0;
+    for (const QFuture<WriteResult>& future : std::as_const(futures)) {
+        const WriteResult r = await(future);
+        if (!r.ok) ++failed;
+        results.append(resultToJson(r));
+    }
+
+    printJson(QJsonObject{{"cancelled", int(ids.size()) - failed}, {"failed", failed}, {"results", results}});
+    return failed == 0 ? ExitOk : ExitFailed;
+}
+
+int runBalances(const Options& options)
+{
+    StockRepository repository(DbManager::instance().database());
+    const QList<StockBalance> balances = options.date.isValid() ? repository.getBalancesAsOf(options.date)
+                                       : options.all             ? repository.getAllStockBalances()
+                                                                 : repository.getActiveStockBalances();
+
+    QJsonArray items;
+    for (const StockBalance& b : balances)
+        items.append(JsonFormat::balanceToJson(b));
+    printJson(items);
+    return ExitOk;
+}
+
+// массив не закрывается: оборванная выгрузка не должна читаться как полная
+int exportFailed(QFile& out, int exported)
+{
+    out.write("\n");
+    out.close();
+    printJson(QJsonObject{{"ok", false}, {"exported", exported}, {"error", "Ошибка чтения базы, выгрузка прервана"}});
+    return ExitFailed;
+}
+
+int runExport(const Options& options)
+{
+    QFile out(options.out);
+    const bool opened = options.out.isEmpty() ? out.open(stdout, QIODevice::WriteOnly)
+                                              : out.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    if (!opened) return usageError(QString("export: не удалось открыть %1: %2").arg(options.out, out.errorString()));
+
+    const QDate from = options.hasPeriod ? options.from : QDate::currentDate();
+    const QDate to = options.hasPeriod ? options.to : QDate::currentDate();
+
+    QSqlDatabase db = DbManager::instance().database();
+    DocumentRepository documents(db);
+    DocumentLineRepository lines(db);
+
+    // страница документов по ключу и её строки одним запросом: выгрузка за год
+    // не собирается в памяти целиком и не делает запрос на каждый документ
+    int exported = 0;
+    out.write("[");
+    QDate afterDate;
+    int afterId = 0;
+    for (;;) {
+        const std::optional<QList<Document>> loaded =
+            documents.findPageByDateRange(from, to, afterDate, afterId, kExportPageSize);
+        if (!loaded) return exportFailed(out, exported);
+        const QList<Document>& page = *loaded;
+
+        QList<int> ids;
+        for (const Document& doc : page) {
+            if (!options.type || doc.docType == *options.type) ids.append(doc.id);
+        }
+        const std::optional<QHash<int, QList<DocumentLine>>> linesByDocument = lines.findByDocuments(ids);
+        if (!linesByDocument) return exportFailed(out, exported);
+
+        for (const Document& doc : page) {
+            if (options.type && doc.docType != *options.type) continue;
+
+            QJsonObject o = JsonFormat::documentToJson(doc);
+            QJsonArray items;
+            for (const DocumentLine& line : linesByDocument->value(doc.id))
+                items.append(JsonFormat::lineToJson(line));
+            o.insert("lines", items);
+
+            if (exported++ > 0) out.write(",\n");
+            out.write(QJsonDocument(o).toJson(QJsonDocument::Compact));
+        }
+
+        if (page.size() < kExportPageSize) break;
+        afterDate = page.last().date;
+        afterId = page.last().id;
+    }
+    out.write("]\n");
+    out.close();
+
+    if (!options.out.isEmpty())
+        printJson(QJsonObject{{"exported", exported}, {"file", options.out}});
+    return ExitOk;
+}
+
+int runImport(WriteQueue& writeQueue, const Options& options)
+{
+    if (options.args.size() > 1) return usageError("import: укажите один файл или - для stdin");
+
+    const QString path = options.args.value(0, "-");
+    QFile in(path == "-" ? QString() : path);
+    const bool opened = path == "-" ? in.open(stdin, QIODevice::ReadOnly) : in.open(QIODevice::ReadOnly);
+    if (!opened) return usageError(QString("import: не удалось открыть %1: %2").arg(path, in.errorString()));
+
+    QJsonParseError parseError;
+    const QJsonDocument json = QJsonDocument::fromJson(in.readAll(), &parseError);
+    if (parseError.error != QJsonParseError::NoError || !json.isArray())
+        return usageError(QString("import: ожидается JSON-массив документов (%1)").arg(parseError.errorString()));
+
+    const QJsonArray source = json.array();
+    QJsonArray results;
+    int failed = 0;
+
+    // разбор — до записи: испорченный элемент не мешает остальным
+    QList<QFuture<WriteResult>> futures;
+    QList<qsizetype> positions;
+    for (qsizetype i = 0; i < source.size(); ++i) {
+        Document doc;
+        DocumentLinesDiff lines;
+        QString error;
+        if (!JsonFormat::draftFromJson(source.at(i).toObject(), doc, lines, error)) {
+            ++failed;
+            results.append(QJsonObject{{"index", int(i)}, {"ok", false}, {"error", error}});
+            continue;
+        }
+        futures.append(writeQueue.saveDraft(doc, lines));
+        positions.append(i);
+    }
+
+    QList<QFuture<WriteResult>> posts;
+    QList<QJsonObject> pending;
+    for (qsizetype k = 0; k < futures.size(); ++k) {
+        const WriteResult r = await(futures.at(k));
+        QJsonObject o = resultToJson(r);
+        o.insert("index", int(positions.at(k)));
+        if (!r.ok) {
+            ++failed;
+            results.append(o);
+            continue;
+        }
+        if (options.post) {
+            posts.append(writeQueue.postDocument(r.id));
+            pending.append(o);
+        } else {
+            results.append(o);
+        }
+    }
+
+    for (qsizetype k = 0; k < posts.size(); ++k) {
+        const WriteResult r = await(posts.at(k));
+        QJsonObject o = pending.at(k);
+        o.insert("posted", r.ok);
+        if (!r.ok) {
+            ++failed;
+            o.insert("error", r.error);
+        }
+        results.append(o);
+    }
+
+    printJson(QJsonObject{{"imported", int(source.size()) - failed}, {"failed", failed}, {"results", results}});
+    return failed == 0 ? ExitOk : ExitFailed;
+}
+
+qint64 databaseBytes(QSqlDatabase db)
+{
+    QSqlQuery q(db);
+    if (!q.exec("SELECT page_count * page_size FROM pragma_page_count(), pragma_page_size()") || !q.next())
+        return -1;
+    return q.value(0).toLongLong();
+}
+
+int runVacuum()
+{
+    QSqlDatabase db = DbManager::instance().database();
+    const qint64 before = databaseBytes(db);
+
+    // VACUUM ждёт записи других процессов, поэтому повторяется, как любой запрос вне транзакции
+    for (const char* sql : {"PRAGMA wal_checkpoint(TRUNCATE)", "VACUUM", "PRAGMA optimize", "PRAGMA wal_checkpoint(TRUNCATE)"}) {
+        QSqlQuery q(db);
+        q.prepare(sql);
+        if (!SqlRetry::exec(db, q)) {
+            printJson(QJsonObject{{"ok", false}, {"step", sql}, {"error", q.lastError().text()}});
+            return ExitFailed;
+        }
+    }
+
+    printJson(QJsonObject{{"ok", true}, {"bytesBefore", before}, {"bytesAfter", databaseBytes(db)}});
+    return ExitOk;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    // та же база, что у GUI и сервера
+    QCoreApplication::setApplicationName("WholesaleTradeApp");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Пакетные операции с базой склада. Результат — JSON в stdout.");
+    const QCommandLineOption helpOption = parser.addHelpOption();
+    parser.addPositionalArgument("command", "post | cancel | balances | export | import | vacuum");
+    parser.addPositionalArgument("args", "ID документов (post, cancel) или файл выгрузки (import)", "[args...]");
+    const QCommandLineOption fromOption("from", "Начало периода, ГГГГ-ММ-ДД", "date");
+    const QCommandLineOption toOption("to", "Конец периода, ГГГГ-ММ-ДД", "date");
+    const QCommandLineOption dateOption("date", "balances: остатки на дату, ГГГГ-ММ-ДД", "date");
+    const QCommandLineOption typeOption("type", "Тип документа: supply, sale, return, transfer, writeoff", "type");
+    const QCommandLineOption outOption("out", "export: файл выгрузки (по умолчанию stdout)", "file");
+    const QCommandLineOption postOption("post", "import: провести загруженные черновики");
+    const QCommandLineOption allOption("all", "balances: включая неактивные товары");
+    parser.addOptions({fromOption, toOption, dateOption, typeOption, outOption, postOption, allOption});
+    // process() при неизвестном ключе завершил бы процесс с кодом 1, а это ошибка в аргументах
+    if (!parser.parse(app.arguments()))
+        return usageError(parser.errorText());
+    if (parser.isSet(helpOption))
+        parser.showHelp(ExitOk);
+
+    QStringList positional = parser.positionalArguments();
+    if (positional.isEmpty())
+        return usageError("Не указана команда");
+    const QString command = positional.takeFirst();
+
+    Options options;
+    options.args = positional;
+    options.out = parser.value(outOption);
+    options.post = parser.isSet(postOption);
+    options.all = parser.isSet(allOption);
+
+    if (parser.isSet(fromOption) || parser.isSet(toOption)) {
+        // одна граница — период из одного дня
+        const QString fromText = parser.isSet(fromOption) ? parser.value(fromOption) : parser.value(toOption);
+        const QString toText = parser.isSet(toOption) ? parser.value(toOption) : parser.value(fromOption);
+        if (!parseDate(fromText, options.from) || !parseDate(toText, options.to) || options.from > options.to)
+            return usageError("--from и --to — даты ГГГГ-ММ-ДД, --from не позже --to");
+        options.hasPeriod = true;
+    }
+    if (parser.isSet(dateOption) && !parseDate(parser.value(dateOption), options.date))
+        return usageError("--date — дата ГГГГ-ММ-ДД");
+    if (parser.isSet(typeOption)) {
+        Document probe;
+        probe.docType = Document::docTypeFromString(parser.value(typeOption));
+        if (probe.docTypeString() != parser.value(typeOption))
+            return usageError(QString("Неизвестный тип документа: %1").arg(parser.value(typeOption)));
+        options.type = probe.docType;
+    }
+
+    const QStringList writeCommands{"post", "cancel", "import"};
+    // без очереди записи: чтение и обслуживание на своём соединении
+    const QStringList localCommands{"balances", "export", "vacuum"};
+    if (!writeCommands.contains(command) && !localCommands.contains(command))
+        return usageError(QString("Неизвестная команда: %1").arg(command));
+
+    DbManager& dbManager = DbManager::instance();
+    if (!dbManager.initialize()) {
+        printJson(QJsonObject{{"error", "Не удалось открыть базу данных"}});
+        return ExitUsage;
+    }
+
+    MigrationRunner migrationRunner(dbManager.database());
+    if (!migrationRunner.runMigrations()) {
+        printJson(QJsonObject{{"error", "Не удалось выполнить миграции базы данных"}});
+        dbManager.close();
+        return ExitUsage;
+    }
+
+    int rc = ExitOk;
+    if (localCommands.contains(command)) {
+        if (command == "balances") rc = runBalances(options);
+        else if (command == "export") rc = runExport(options);
+        else rc = runVacuum();
+    } else {
+        // открытые GUI узнают о проведённых документах через шину
+        ChangeBus::instance().start(dbManager.databasePath());
+
+        RemoteClient remote;
+        WriteQueue writeQueue;
+        if (remote.connectToServer(RemoteProtocol::serverName(dbManager.databasePath())))
+            writeQueue.setRemote(&remote);
+        writeQueue.start();
+
+        if (command == "post") rc = runPost(writeQueue, options);
+        else if (command == "cancel") rc = runCancel(writeQueue, options);
+        else rc = runImport(writeQueue, options);
+
+        SqlRetry::logStats();
+        ChangeBus::instance().stop();
+        writeQueue.stop();
+    }
+
+    ReadPool::instance().shutdown();
+    dbManager.close();
+    return rc;
+}
@@ -1,14 +1,19 @@
 #include "MainWindow.h"
+#include "ChangeBus.h"
 #include "DbManager.h"
 #include "MigrationRunner.h"
-#include "DocumentService.h"
-
-#include "repositories/DocumentRepository.h"
-#include "repositories/DocumentLineRepository.h"
-#include "repositories/StockRepository.h"
-#include "repositories/ProductRepository.h"
+#include "ReadPool.h"
+#include "SqlRetry.h"
+#include "WriteQueue.h"
+#include "remote/HttpApi.h"
+#include "remote/RemoteClient.h"
+#include "remote/RemoteProtocol.h"
+#include "repositories/QueryCache.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QDate>
+#include <QDebug>
 #include <QMessageBox>
 #include <QStyleFactory>
 
@@ -17,6 +22,21 @@ int main(int argc, char *argv[])
     QApplication app(argc, argv);
     app.setStyle(QStyleFactory::create("Fusion"));
 
+    // --http-port N: HTTP API для сайта и терминалов сбора (HttpApi), по умолчанию выключен
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    const QCommandLineOption httpPortOption("http-port", "Порт HTTP API на 127.0.0.1 (0 — выключен)", "port", "0");
+    parser.addOption(httpPortOption);
+    parser.process(app);
+    bool portOk = false;
+    const quint16 httpPort = parser.value(httpPortOption).toUShort(&portOk);
+    if (!portOk) {
+        QMessageBox::critical(nullptr, "Ошибка",
+            QString("Неверный порт HTTP API: %1.\n"
+                    "Укажите число от 0 до 65535.").arg(parser.value(httpPortOption)));
+        return 1;
+    }
+
     DbManager& dbManager = DbManager::instance();
     if (!dbManager.initialize()) {
         QMessageBox::critical(nullptr, "Ошибка",
@@ -34,15 +54,52 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    DocumentRepository docRepo(dbManager.database());
-    DocumentLineRepository lineRepo(dbManager.database());
-    StockRepository stockRepo(dbManager.database());
-    ProductRepository productRepo(dbManager.database());
+    // изменения других экземпляров на той же базе; хуки на соединениях уже стоят
+    ChangeBus::instance().start(dbManager.databasePath());
+
+    // все операции, меняющие склад, выполняет отдельный поток записи со своим соединением,
+    // а если запущен сервер базы — его очередь записи, общая для всех рабочих мест
+    RemoteClient remote;
+    WriteQueue writeQueue;
+    if (remote.connectToServer(RemoteProtocol::serverName(dbManager.databasePath()))) {
+        writeQueue.setRemote(&remote);
+        // записи сервера приходят его событиями через WriteQueue, шина их повторила бы
+        ChangeBus::instance().ignoreSender(remote.serverPid());
+    }
+    writeQueue.start();
+
+    // сервер пропал — дальше пишем сами, а записи перезапущенного сервера узнаём через шину
+    QObject::connect(&writeQueue, &WriteQueue::remoteLost, &ChangeBus::instance(), [] {
+        ChangeBus::instance().ignoreSender(0);
+    });
+
+    // резервы и остатки по датам в памяти знают только о своих изменениях
+    QObject::connect(&ChangeBus::instance(), &ChangeBus::remoteChanged,
+                     &writeQueue, &WriteQueue::refreshStockCaches);
+
+    // периоды и архив сервер закрывает сам при запуске
+    if (!writeQueue.isRemote()) {
+        // закрытие прошедших периодов: снимки остатков для запросов «на дату»
+        writeQueue.closeStockPeriods(QDate::currentDate());
+
+        // закрытые годы уходят в архив, рабочая база остаётся небольшой
+        writeQueue.archiveClosedYears(QDate::currentDate());
+    }
 
-    DocumentService docService(&docRepo, &lineRepo, &stockRepo, &productRepo);
+    HttpApi httpApi(&writeQueue);
+    if (httpPort != 0 && !httpApi.start(httpPort))
+        qWarning() << "HTTP API is not started on port" << httpPort;
 
-    MainWindow window(&docService);
+    MainWindow window(&writeQueue);
     window.show();
 
-    return app.exec();
+    const int rc = app.exec();
+    QueryCache::instance().logStats();
+    SqlRetry::logStats();
+    httpApi.logStats();
+    httpApi.stop();
+    ChangeBus::instance().stop();
+    writeQueue.stop();
+    ReadPool::instance().shutdown();
+    return rc;
 }
@@ -0,0 +1,307 @@
+#include "remote/DbServer.h"
+#include "WriteQueue.h"
+
+#include <QCoreApplication>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QPointer>
+#include <QLoggingCategory>
+
+#include <utility>
+
+Q_LOGGING_CATEGORY(dbServer, "remote.server")
+
+namespace {
+
+constexpr int kProbeTimeoutMs = 200;
+
+template <typename T>
+RemoteReply okReply(const T& value)
+{
+    RemoteReply r;
+    r.ok = true;
+    r.payload = RemoteProtocol::pack(value);
+    return r;
+}
+
+RemoteReply badArguments()
+{
+    RemoteReply r;
+    r.error = "Испорченные аргументы запроса";
+    return r;
+}
+
+} // namespace
+
+DbServer::DbServer(WriteQueue* writeQueue, QObject* parent)
+    : QObject(parent)
+    , m_writeQueue(writeQueue)
+{
+    // события очереди — всем клиентам; свои изменения они узнают отсюда же
+    connect(m_writeQueue, &WriteQueue::documentSaved, this, [this](int documentId, DocumentType type) {
+        broadcast(RemoteOp::DocumentSavedEvent, RemoteProtocol::pack(qint32(documentId), type));
+    });
+    connect(m_writeQueue, &WriteQueue::documentPosted, this,
+            [this](int documentId, DocumentType type, const StockDeltas& deltas) {
+        broadcast(RemoteOp::DocumentPostedEvent, RemoteProtocol::pack(qint32(documentId), type, deltas));
+    });
+    connect(m_writeQueue, &WriteQueue::documentsCancelled, this,
+            [this](const QList<int>& documentIds, const StockDeltas& deltas) {
+        broadcast(RemoteOp::DocumentsCancelledEvent, RemoteProtocol::pack(documentIds, deltas));
+    });
+    connect(m_writeQueue, &WriteQueue::documentDeleted, this, [this](int documentId) {
+        broadcast(RemoteOp::DocumentDeletedEvent, RemoteProtocol::pack(qint32(documentId)));
+    });
+    connect(m_writeQueue, &WriteQueue::stockChanged, this, [this](const StockDeltas& deltas) {
+        broadcast(RemoteOp::StockChangedEvent, RemoteProtocol::pack(deltas));
+    });
+
+    // копии агрегатов у клиентов обновляются теми же изменениями, что и агрегаты сервера
+    connect(m_writeQueue, &WriteQueue::reservationsChanged, this, [this](const ReservationChanges& changes) {
+        broadcast(RemoteOp::ReservationsChangedEvent, RemoteProtocol::pack(changes));
+    });
+    connect(m_writeQueue, &WriteQueue::timelineChanged, this, [this](const QList<MovementTotal>& changes) {
+        broadcast(RemoteOp::TimelineChangedEvent, RemoteProtocol::pack(changes));
+    });
+    connect(m_writeQueue, &WriteQueue::stockCachesReloaded, this, [this]() {
+        broadcast(RemoteOp::StockCachesReloadedEvent, QByteArray());
+    });
+}
+
+DbServer::~DbServer()
+{
+    close();
+}
+
+bool DbServer::listen(const QString& serverName)
+{
+    close();
+
+    m_server = new QLocalServer(this);
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    bool listening = m_server->listen(serverName);
+    if (!listening && m_server->serverError() == QAbstractSocket::AddressInUseError) {
+        // живой сервер на этом имени ответил бы клиенту; проверяем, прежде чем забирать имя
+        QLocalSocket probe;
+        probe.connectToServer(serverName);
+        if (probe.waitForConnected(kProbeTimeoutMs)) {
+            qCritical(dbServer) << "DbServer: another server is already running on" << serverName;
+            delete m_server;
+            m_server = nullptr;
+            return false;
+        }
+        QLocalServer::removeServer(serverName);
+        listening = m_server->listen(serverName);
+    }
+
+    if (!listening) {
+        qCritical(dbServer) << "DbServer: cannot listen on" << serverName << ":" << m_server->errorString();
+        delete m_server;
+        m_server = nullptr;
+        return false;
+    }
+
+    connect(m_server, &QLocalServer::newConnection, this, &DbServer::onNewConnection);
+    qInfo(dbServer) << "DbServer: listening on" << serverName;
+    return true;
+}
+
+void DbServer::close()
+{
+    for (QLocalSocket* client : std::exchange(m_clients, {})) {
+        client->disconnect(this);
+        client->abort();
+        client->deleteLater();
+    }
+    if (m_server) {
+        m_server->close();
+        delete m_server;
+        m_server = nullptr;
+    }
+}
+
+DbServerStats DbServer::stats() const
+{
+    DbServerStats s;
+    s.clients = m_clients.size();
+    s.snapshots = m_snapshots;
+    s.writes = m_writes;
+    s.rejected = m_rejected;
+    return s;
+}
+
+void DbServer::logStats() const
+{
+    const DbServerStats s = stats();
+    qInfo(dbServer) << "DbServer: clients" << s.clients << "snapshots" << s.snapshots
+                    << "writes" << s.writes << "rejected" << s.rejected;
+}
+
+void DbServer::onNewConnection()
+{
+    while (QLocalSocket* client = m_server->nextPendingConnection()) {
+        m_clients.append(client);
+        connect(client, &QLocalSocket::readyRead, this, [this, client]() { onReadyRead(client); });
+        connect(client, &QLocalSocket::disconnected, this, [this, client]() {
+            m_clients.removeOne(client);
+            client->deleteLater();
+            qInfo(dbServer) << "DbServer: client disconnected," << m_clients.size() << "left";
+        });
+        qInfo(dbServer) << "DbServer: client connected," << m_clients.size() << "total";
+    }
+}
+
+void DbServer::onReadyRead(QLocalSocket* socket)
+{
+    for (const QByteArray& bytes : RemoteProtocol::readFrames(socket)) {
+        RemoteProtocol::Frame frame;
+        if (!RemoteProtocol::decodeFrame(bytes, frame) || frame.kind != RemoteProtocol::FrameKind::Request) {
+            qWarning(dbServer) << "DbServer: malformed frame, dropping client";
+            socket->abort();
+            return;
+        }
+        handleRequest(socket, frame);
+    }
+}
+
+void DbServer::handleRequest(QLocalSocket* socket, const RemoteProtocol::Frame& request)
+{
+    const quint32 id = request.id;
+    const RemoteOp op = request.op;
+    const QByteArray args = request.reply.payload;
+
+    if (op == RemoteOp::Hello) {
+        quint8 version = 0;
+        RemoteReply r;
+        r.ok = RemoteProtocol::unpack(args, version) && version == RemoteProtocol::kVersion;
+        if (r.ok)
+            r.payload = RemoteProtocol::pack(qint64(QCoreApplication::applicationPid()));
+        else
+            r.error = QString("Версия протокола клиента %1, сервера %2").arg(version).arg(RemoteProtocol::kVersion);
+        sendReply(socket, id, op, r);
+        return;
+    }
+
+    QPointer<QLocalSocket> client(socket);
+
+    if (op == RemoteOp::StockCaches) {
+        ++m_snapshots;
+        // ответ встаёт в очередь событий после сигналов об уже учтённых в снимке изменениях
+        m_writeQueue->stockCachesSnapshot().then(this, [this, client, id, op](const StockCachesSnapshot& snapshot) {
+            if (!client) return;
+            RemoteReply r;
+            r.ok = true;
+            r.payload = RemoteProtocol::pack(snapshot.reservations, snapshot.totals);
+            sendReply(client, id, op, r);
+        });
+        return;
+    }
+
+    if (!isWrite(op)) {
+        ++m_rejected;
+        RemoteReply r;
+        r.error = QString("Неизвестная операция %1").arg(quint16(op));
+        sendReply(socket, id, op, r);
+        return;
+    }
+
+    QFuture<WriteResult> future;
+    if (!submitWrite(op, args, future)) {
+        ++m_rejected;
+        sendReply(socket, id, op, badArguments());
+        return;
+    }
+
+    ++m_writes;
+    future.then(this, [this, client, id, op](const WriteResult& result) {
+        if (client) sendReply(client, id, op, okReply(result));
+    });
+}
+
+void DbServer::sendReply(QLocalSocket* socket, quint32 id, RemoteOp op, const RemoteReply& reply)
+{
+    if (socket->state() != QLocalSocket::ConnectedState) return;
+
+    RemoteProtocol::Frame frame;
+    frame.kind = RemoteProtocol::FrameKind::Reply;
+    frame.id = id;
+    frame.op = op;
+    frame.reply = reply;
+    RemoteProtocol::writeFrame(socket, RemoteProtocol::encodeFrame(frame));
+}
+
+void DbServer::broadcast(RemoteOp op, const QByteArray& payload)
+{
+    RemoteProtocol::Frame frame;
+    frame.kind = RemoteProtocol::FrameKind::Event;
+    frame.op = op;
+    frame.reply.payload = payload;
+    const QByteArray bytes = RemoteProtocol::encodeFrame(frame);
+
+    for (QLocalSocket* client : std::as_const(m_clients)) {
+        if (client->state() == QLocalSocket::ConnectedState)
+            RemoteProtocol::writeFrame(client, bytes);
+    }
+}
+
+bool DbServer::isWrite(RemoteOp op)
+{
+    const quint16 code = quint16(op);
+    return code >= quint16(RemoteOp::SaveDraft) && code <= quint16(RemoteOp::ArchiveClosedYears);
+}
+
+bool DbServer::submitWrite(RemoteOp op, const QByteArray& args, QFuture<WriteResult>& future)
+{
+    qint32 id = 0;
+
+    switch (op) {
+    case RemoteOp::SaveDraft: {
+        Document doc;
+        DocumentLinesDiff lines;
+        if (!RemoteProtocol::unpack(args, doc, lines)) return false;
+        future = m_writeQueue->saveDraft(doc, lines);
+        return true;
+    }
+    case RemoteOp::PostDocument:
+        if (!RemoteProtocol::unpack(args, id)) return false;
+        future = m_writeQueue->postDocument(id);
+        return true;
+    case RemoteOp::CancelDocument:
+        if (!RemoteProtocol::unpack(args, id)) return false;
+        future = m_writeQueue->cancelDocument(id);
+        return true;
+    case RemoteOp::CancelPosted: {
+        DocumentFilter filter;
+        if (!RemoteProtocol::unpack(args, filter)) return false;
+        future = m_writeQueue->cancelPosted(filter);
+        return true;
+    }
+    case RemoteOp::WriteOff: {
+        double qtyKg = 0.0;
+        QString reason;
+        if (!RemoteProtocol::unpack(args, id, qtyKg, reason)) return false;
+        future = m_writeQueue->writeOff(id, qtyKg, reason);
+        return true;
+    }
+    case RemoteOp::DeleteDocument:
+        if (!RemoteProtocol::unpack(args, id)) return false;
+        future = m_writeQueue->deleteDocument(id);
+        return true;
+    case RemoteOp::CloseStockPeriods: {
+        QDate today;
+        qint32 periodMonths = 0;
+        if (!RemoteProtocol::unpack(args, today, periodMonths)) return false;
+        future = m_writeQueue->closeStockPeriods(today, periodMonths);
+        return true;
+    }
+    case RemoteOp::ArchiveClosedYears: {
+        QDate today;
+        qint32 keepYears = 0;
+        if (!RemoteProtocol::unpack(args, today, keepYears)) return false;
+        future = m_writeQueue->archiveClosedYears(today, keepYears);
+        return true;
+    }
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,575 @@
+#include "remote/HttpApi.h"
+#include "ChangeTracker.h"
+#include "DbManager.h"
+#include "JsonFormat.h"
+#include "WriteQueue.h"
+
+#include "repositories/DocumentRepository.h"
+#include "repositories/ProductRepository.h"
+#include "repositories/StockRepository.h"
+
+#include <QCache>
+#include <QDate>
+#include <QHash>
+#include <QHostAddress>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPointer>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QThread>
+#include <QUrl>
+#include <QUrlQuery>
+#include <QLoggingCategory>
+
+#include <optional>
+
+Q_LOGGING_CATEGORY(httpApi, "remote.http")
+
+namespace {
+
+const QString kHttpConnection = "WholesaleTradeHttp";
+
+QByteArray statusText(int status)
+{
+    switch (status) {
+    case 200: return "OK";
+    case 201: return "Created";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 413: return "Payload Too Large";
+    case 422: return "Unprocessable Entity";
+    case 503: return "Service Unavailable";
+    default:  return "Internal Server Error";
+    }
+}
+
+QByteArray etagFor(qint64 version)
+{
+    return '"' + QByteArray::number(version) + '"';
+}
+
+// часть тела с Transfer-Encoding: chunked; пустая часть означала бы конец тела
+void writeChunk(QTcpSocket* socket, const QByteArray& data)
+{
+    if (data.isEmpty()) return;
+    socket->write(QByteArray::number(data.size(), 16) + "\r\n");
+    socket->write(data);
+    socket->write("\r\n");
+}
+
+} // namespace
+
+/**
+ * Всё, что живёт в потоке HTTP: сервер, соединения, соединение с базой, кэш тел ответов.
+ */
+class HttpApi::Worker : public QObject
+{
+public:
+    explicit Worker(HttpApi* api) : m_api(api) {}
+
+    bool listen(quint16 port);
+    void shutdown();
+
+private:
+    struct Request {
+        QByteArray method;
+        QUrl url;
+        QHash<QByteArray, QByteArray> headers;      // имена в нижнем регистре
+        QByteArray body;
+        bool keepAlive = true;
+    };
+
+    // отдача /documents: ключ следующей страницы
+    struct DocumentStream {
+        Request request;
+        QDate from;
+        QDate to;
+        QDate afterDate;
+        int afterId = 0;
+        bool empty = true;          // ни одного элемента ещё не отправлено
+    };
+
+    struct Connection {
+        QByteArray buffer;
+        bool waiting = false;       // ждём ответ WriteQueue или отдаём список: следующие запросы — после него
+        std::optional<DocumentStream> stream;
+    };
+
+    struct CachedBody {
+        qint64 version = -1;
+        QByteArray body;
+    };
+
+    void onNewConnection();
+    void processBuffer(QTcpSocket* socket);
+    // 0 — запрос ещё не пришёл целиком, -1 — испорчен, 1 — разобран
+    int takeRequest(Connection& conn, Request& request);
+    void handle(QTcpSocket* socket, const Request& request);
+
+    void getStock(QTcpSocket* socket, const Request& request);
+    void getStockItem(QTcpSocket* socket, const Request& request, int productId);
+    void getDocuments(QTcpSocket* socket, const Request& request);
+    // дописать страницы, пока буфер отправки не заполнится; resume — затем разобрать ждущие запросы
+    void pumpDocuments(QTcpSocket* socket, bool resume);
+    void createDraft(QTcpSocket* socket, const Request& request);
+
+    // ETag совпал с If-None-Match — 304 уже отправлен
+    bool answerNotModified(QTcpSocket* socket, const Request& request, qint64 version);
+    void respond(QTcpSocket* socket, const Request& request, int status, const QByteArray& body,
+                 qint64 version = -1);
+    void respondError(QTcpSocket* socket, const Request& request, int status, const QString& message);
+    QByteArray headers(const Request& request, int status, qint64 version) const;
+    void finishResponse(QTcpSocket* socket, const Request& request);
+
+private:
+    HttpApi* m_api;
+    QTcpServer* m_server = nullptr;
+    QHash<QTcpSocket*, Connection> m_connections;
+    QCache<QString, CachedBody> m_cache{HttpApi::kMaxCachedBytes};     // стоимость — размер тела
+    QSqlDatabase m_db;
+};
+
+bool HttpApi::Worker::listen(quint16 port)
+{
+    m_db = DbManager::instance().openConnection(kHttpConnection);
+    if (!m_db.isOpen()) {
+        qCritical(httpApi) << "HttpApi: cannot open database connection";
+        return false;
+    }
+
+    m_server = new QTcpServer(this);
+    if (!m_server->listen(QHostAddress::LocalHost, port)) {
+        qCritical(httpApi) << "HttpApi: cannot listen on port" << port << ":" << m_server->errorString();
+        shutdown();
+        return false;
+    }
+
+    connect(m_server, &QTcpServer::newConnection, this, [this]() { onNewConnection(); });
+    qInfo(httpApi) << "HttpApi: listening on 127.0.0.1:" << m_server->serverPort();
+    return true;
+}
+
+void HttpApi::Worker::shutdown()
+{
+    // сокеты — дети сервера и удаляются вместе с ним
+    for (auto it = m_connections.cbegin(); it != m_connections.cend(); ++it) {
+        it.key()->disconnect(this);
+        it.key()->abort();
+    }
+    m_connections.clear();
+
+    delete m_server;
+    m_server = nullptr;
+    m_cache.clear();
+
+    if (m_db.isValid()) {
+        m_db = QSqlDatabase();
+        DbManager::closeConnection(kHttpConnection);
+    }
+}
+
+void HttpApi::Worker::onNewConnection()
+{
+    while (QTcpSocket* socket = m_server->nextPendingConnection()) {
+        m_connections.insert(socket, Connection());
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { processBuffer(socket); });
+        connect(socket, &QTcpSocket::bytesWritten, this, [this, socket]() { pumpDocuments(socket, true); });
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]() {
+            m_connections.remove(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+void HttpApi::Worker::processBuffer(QTcpSocket* socket)
+{
+    auto it = m_connections.find(socket);
+    if (it == m_connections.end()) return;
+
+    it->buffer.append(socket->readAll());
+    if (it->buffer.size() > HttpApi::kMaxRequestBytes + 64 * 1024) {
+        Request request;
+        request.keepAlive = false;
+        respondError(socket, request, 413, "Запрос слишком большой");
+        return;
+    }
+
+    // запросы одного соединения обрабатываются строго по очереди
+    while (!it->waiting) {
+        Request request;
+        const int taken = takeRequest(*it, request);
+        if (taken == 0) return;
+        if (taken < 0) {
+            request.keepAlive = false;
+            respondError(socket, request, 400, "Некорректный HTTP-запрос");
+            return;
+        }
+
+        handle(socket, request);
+
+        // ответ мог закрыть соединение
+        it = m_connections.find(socket);
+        if (it == m_connections.end() || !request.keepAlive) return;
+    }
+}
+
+int HttpApi::Worker::takeRequest(Connection& conn, Request& request)
+{
+    const qsizetype headerEnd = conn.buffer.indexOf("\r\n\r\n");
+    if (headerEnd < 0)
+        return conn.buffer.size() > 64 * 1024 ? -1 : 0;
+
+    const QList<QByteArray> lines = conn.buffer.left(headerEnd).split('\n');
+    const QList<QByteArray> requestLine = lines.first().trimmed().split(' ');
+    if (requestLine.size() != 3 || !requestLine.at(2).startsWith("HTTP/1."))
+        return -1;
+
+    request.method = requestLine.at(0);
+    request.url = QUrl::fromEncoded(requestLine.at(1));
+    for (qsizetype i = 1; i < lines.size(); ++i) {
+        const qsizetype colon = lines.at(i).indexOf(':');
+        if (colon <= 0) continue;
+        request.headers.insert(lines.at(i).left(colon).trimmed().toLower(), lines.at(i).mid(colon + 1).trimmed());
+    }
+
+    const QByteArray connection = request.headers.value("connection").toLower();
+    request.keepAlive = requestLine.at(2) == "HTTP/1.1" ? connection != "close" : connection == "keep-alive";
+
+    bool ok = true;
+    const qint64 length = request.headers.value("content-length", "0").toLongLong(&ok);
+    if (!ok || length < 0 || length > HttpApi::kMaxRequestBytes)
+        return -1;
+
+    const qsizetype total = headerEnd + 4 + length;
+    if (conn.buffer.size() < total)
+        return 0;
+
+    request.body = conn.buffer.mid(headerEnd + 4, length);
+    conn.buffer.remove(0, total);
+    return 1;
+}
+
+void HttpApi::Worker::handle(QTcpSocket* socket, const Request& request)
+{
+    ++m_api->m_requests;
+
+    const QStringList path = request.url.path().split('/', Qt::SkipEmptyParts);
+    const bool get = request.method == "GET";
+
+    if (path.value(0) == "stock" && path.size() == 1) {
+        if (get) getStock(socket, request);
+        else respondError(socket, request, 405, "Метод не поддерживается");
+        return;
+    }
+
+    if (path.value(0) == "stock" && path.size() == 2) {
+        bool ok = false;
+        const int productId = path.at(1).toInt(&ok);
+        if (!ok || productId <= 0) respondError(socket, request, 404, "Товар не найден");
+        else if (get) getStockItem(socket, request, productId);
+        else respondError(socket, request, 405, "Метод не поддерживается");
+        return;
+    }
+
+    if (path.value(0) == "documents" && path.size() == 1) {
+        if (get) getDocuments(socket, request);
+        else if (request.method == "POST") createDraft(socket, request);
+        else respondError(socket, request, 405, "Метод не поддерживается");
+        return;
+    }
+
+    respondError(socket, request, 404, "Неизвестный адрес");
+}
+
+void HttpApi::Worker::getStock(QTcpSocket* socket, const Request& request)
+{
+    const qint64 version = ChangeTracker::version(m_db, {"products", "inventory_movements"});
+    if (answerNotModified(socket, request, version)) return;
+
+    const QString key = request.url.toString(QUrl::FullyEncoded);
+    if (const CachedBody* cached = version >= 0 ? m_cache.object(key) : nullptr) {
+        if (cached->version == version) {
+            ++m_api->m_cacheHits;
+            respond(socket, request, 200, cached->body, version);
+            return;
+        }
+    }
+
+    QJsonArray items;
+    for (const StockBalance& b : StockRepository(m_db).getActiveStockBalances())
+        items.append(JsonFormat::balanceToJson(b));
+    const QByteArray body = QJsonDocument(items).toJson(QJsonDocument::Compact);
+
+    if (version >= 0 && body.size() <= HttpApi::kMaxCachedBytes)
+        m_cache.insert(key, new CachedBody{version, body}, body.size());
+    respond(socket, request, 200, body, version);
+}
+
+void HttpApi::Worker::getStockItem(QTcpSocket* socket, const Request& request, int productId)
+{
+    // резерв зависит от черновиков, поэтому в версию входят и документы
+    const qint64 version = ChangeTracker::version(
+        m_db, {"products", "inventory_movements", "documents", "document_lines"});
+    if (answerNotModified(socket, request, version)) return;
+
+    const Product product = ProductRepository(m_db).findById(productId);
+    if (!product.isValid()) {
+        respondError(socket, request, 404, "Товар не найден");
+        return;
+    }
+
+    const double balance = StockRepository(m_db).getStockBalance(productId);
+    const double reserved = m_api->m_writeQueue->reservations().reservedExcluding(productId, 0);
+
+    QJsonObject item{
+        {"productId", product.id},
+        {"name", product.name},
+        {"unit", product.unit},
+        {"balanceKg", balance},
+        {"reservedKg", reserved},
+        {"availableKg", balance - reserved}
+    };
+    respond(socket, request, 200, QJsonDocument(item).toJson(QJsonDocument::Compact), version);
+}
+
+void HttpApi::Worker::getDocuments(QTcpSocket* socket, const Request& request)
+{
+    const QUrlQuery query(request.url);
+    const QString fromText = query.queryItemValue("from");
+    const QString toText = query.queryItemValue("to");
+    const QDate from = fromText.isEmpty() ? QDate::currentDate() : QDate::fromString(fromText, Qt::ISODate);
+    const QDate to = toText.isEmpty() ? QDate::currentDate() : QDate::fromString(toText, Qt::ISODate);
+    if (!from.isValid() || !to.isValid() || from > to) {
+        respondError(socket, request, 400, "Параметры from и to — даты ГГГГ-ММ-ДД, from не позже to");
+        return;
+    }
+
+    const qint64 version = ChangeTracker::version(m_db, {"documents"});
+    if (answerNotModified(socket, request, version)) return;
+
+    QByteArray head = headers(request, 200, version);
+    head += "Transfer-Encoding: chunked\r\n\r\n";
+    socket->write(head);
+    writeChunk(socket, "[");
+
+    Connection& conn = m_connections[socket];
+    conn.waiting = true;
+    conn.stream = DocumentStream{request, from, to};
+    pumpDocuments(socket, false);
+}
+
+void HttpApi::Worker::pumpDocuments(QTcpSocket* socket, bool resume)
+{
+    auto it = m_connections.find(socket);
+    if (it == m_connections.end() || !it->stream) return;
+
+    // клиент не успевает — следующая страница по bytesWritten, ответ в памяти не копится
+    while (socket->bytesToWrite() < HttpApi::kMaxPendingWriteBytes) {
+        DocumentStream& stream = *it->stream;
+        const std::optional<QList<Document>> loaded = DocumentRepository(m_db).findPageByDateRange(
+            stream.from, stream.to, stream.afterDate, stream.afterId, HttpApi::kDocumentPageSize);
+        if (!loaded) {
+            // заголовки 200 уже ушли: обрываем передачу без последнего чанка,
+            // чтобы клиент увидел неполный ответ, а не укороченный список
+            qWarning(httpApi) << "HttpApi: /documents query failed, aborting the stream";
+            ++m_api->m_errors;
+            m_connections.erase(it);
+            socket->abort();
+            return;
+        }
+        const QList<Document>& page = *loaded;
+
+        QByteArray chunk;
+        for (const Document& d : page) {
+            if (!stream.empty) chunk.append(',');
+            stream.empty = false;
+            chunk.append(QJsonDocument(JsonFormat::documentToJson(d)).toJson(QJsonDocument::Compact));
+        }
+        if (!page.isEmpty()) {
+            stream.afterDate = page.last().date;
+            stream.afterId = page.last().id;
+        }
+
+        if (page.size() == HttpApi::kDocumentPageSize) {
+            writeChunk(socket, chunk);
+            continue;
+        }
+
+        chunk.append(']');
+        writeChunk(socket, chunk);
+        socket->write("0\r\n\r\n");
+
+        const Request request = stream.request;
+        it->stream.reset();
+        it->waiting = false;
+        finishResponse(socket, request);
+
+        // за время отдачи могли прийти следующие запросы
+        if (resume && request.keepAlive) processBuffer(socket);
+        return;
+    }
+}
+
+void HttpApi::Worker::createDraft(QTcpSocket* socket, const Request& request)
+{
+    QJsonParseError parseError;
+    const QJsonDocument json = QJsonDocument::fromJson(request.body, &parseError);
+    if (parseError.error != QJsonParseError::NoError || !json.isObject()) {
+        respondError(socket, request, 400, "Тело запроса — JSON-объект документа");
+        return;
+    }
+
+    Document doc;
+    DocumentLinesDiff lines;
+    QString error;
+    if (!JsonFormat::draftFromJson(json.object(), doc, lines, error)) {
+        respondError(socket, request, 422, error);
+        return;
+    }
+
+    m_connections[socket].waiting = true;
+
+    // команды WriteQueue подаются из её потока: в удалённом режиме она говорит с сервером базы через GUI
+    QPointer<QTcpSocket> guard(socket);
+    WriteQueue* writeQueue = m_api->m_writeQueue;
+    QMetaObject::invokeMethod(writeQueue, [this, writeQueue, doc, lines, guard, request]() {
+        writeQueue->saveDraft(doc, lines).then(this, [this, guard, request](const WriteResult& r) {
+            const auto it = m_connections.find(guard.data());
+            if (!guard || it == m_connections.end()) return;
+            it->waiting = false;
+
+            if (r.ok) {
+                const QJsonObject created{{"id", r.id}, {"status", "DRAFT"}};
+                respond(guard, request, 201, QJsonDocument(created).toJson(QJsonDocument::Compact));
+            } else {
+                respondError(guard, request, 422, r.error);
+            }
+
+            // за время ожидания могли прийти следующие запросы
+            if (guard && request.keepAlive) processBuffer(guard);
+        });
+    }, Qt::QueuedConnection);
+}
+
+bool HttpApi::Worker::answerNotModified(QTcpSocket* socket, const Request& request, qint64 version)
+{
+    if (version < 0) return false;
+
+    const QByteArray etag = etagFor(version);
+    for (QByteArray candidate : request.headers.value("if-none-match").split(',')) {
+        candidate = candidate.trimmed();
+        if (candidate.startsWith("W/")) candidate = candidate.mid(2);
+        if (candidate == etag || candidate == "*") {
+            ++m_api->m_notModified;
+            socket->write(headers(request, 304, version) + "\r\n");
+            finishResponse(socket, request);
+            return true;
+        }
+    }
+    return false;
+}
+
+void HttpApi::Worker::respond(QTcpSocket* socket, const Request& request, int status, const QByteArray& body,
+                              qint64 version)
+{
+    if (status >= 400) ++m_api->m_errors;
+
+    QByteArray head = headers(request, status, version);
+    head += "Content-Length: " + QByteArray::number(body.size()) + "\r\n\r\n";
+    socket->write(head);
+    socket->write(body);
+    finishResponse(socket, request);
+}
+
+void HttpApi::Worker::respondError(QTcpSocket* socket, const Request& request, int status, const QString& message)
+{
+    const QJsonObject error{{"error", message}};
+    respond(socket, request, status, QJsonDocument(error).toJson(QJsonDocument::Compact));
+}
+
+QByteArray HttpApi::Worker::headers(const Request& request, int status, qint64 version) const
+{
+    QByteArray head = "HTTP/1.1 " + QByteArray::number(status) + ' ' + statusText(status) + "\r\n";
+    head += "Content-Type: application/json; charset=utf-8\r\n";
+    // клиент может хранить ответ, но каждый раз сверяет ETag
+    head += "Cache-Control: no-cache\r\n";
+    if (version >= 0)
+        head += "ETag: " + etagFor(version) + "\r\n";
+    head += request.keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+    return head;
+}
+
+void HttpApi::Worker::finishResponse(QTcpSocket* socket, const Request& request)
+{
+    if (!request.keepAlive) {
+        m_connections.remove(socket);
+        socket->disconnectFromHost();
+    }
+}
+
+HttpApi::HttpApi(WriteQueue* writeQueue, QObject* parent)
+    : QObject(parent)
+    , m_writeQueue(writeQueue)
+{
+}
+
+HttpApi::~HttpApi()
+{
+    stop();
+}
+
+bool HttpApi::start(quint16 port)
+{
+    if (m_thread) return true;
+
+    m_thread = new QThread;
+    m_thread->setObjectName("HttpApi");
+    m_worker = new Worker(this);
+    m_worker->moveToThread(m_thread);
+    m_thread->start();
+
+    bool listening = false;
+    QMetaObject::invokeMethod(m_worker, [this, port]() { return m_worker->listen(port); },
+                              Qt::BlockingQueuedConnection, &listening);
+    if (!listening) {
+        stop();
+        return false;
+    }
+    return true;
+}
+
+void HttpApi::stop()
+{
+    if (!m_thread) return;
+
+    // сокеты и соединение с базой закрываются в своём потоке
+    QMetaObject::invokeMethod(m_worker, [this]() { m_worker->shutdown(); }, Qt::BlockingQueuedConnection);
+    m_thread->quit();
+    m_thread->wait();
+
+    delete m_worker;
+    m_worker = nullptr;
+    delete m_thread;
+    m_thread = nullptr;
+}
+
+HttpApiStats HttpApi::stats() const
+{
+    HttpApiStats s;
+    s.requests = m_requests.load();
+    s.notModified = m_notModified.load();
+    s.cacheHits = m_cacheHits.load();
+    s.errors = m_errors.load();
+    return s;
+}
+
+void HttpApi::logStats() const
+{
+    const HttpApiStats s = stats();
+    qInfo(httpApi) << "HttpApi: requests" << s.requests << "not modified" << s.notModified
+                   << "cache hits" << s.cacheHits << "errors" << s.errors;
+}
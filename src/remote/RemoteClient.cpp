@@ -0,0 +1,165 @@
+#include "remote/RemoteClient.h"
+
+#include <QDeadlineTimer>
+#include <QLocalSocket>
+#include <QLoggingCategory>
+
+#include <utility>
+
+Q_LOGGING_CATEGORY(remoteClient, "remote.client")
+
+RemoteClient::RemoteClient(QObject* parent)
+    : QObject(parent)
+{
+}
+
+RemoteClient::~RemoteClient()
+{
+    disconnectFromServer();
+}
+
+bool RemoteClient::connectToServer(const QString& serverName, int timeoutMs)
+{
+    disconnectFromServer();
+
+    m_socket = new QLocalSocket(this);
+    m_socket->connectToServer(serverName);
+    if (!m_socket->waitForConnected(timeoutMs)) {
+        m_lastError = m_socket->errorString();
+        delete m_socket;
+        m_socket = nullptr;
+        return false;
+    }
+
+    connect(m_socket, &QLocalSocket::readyRead, this, &RemoteClient::onReadyRead);
+    connect(m_socket, &QLocalSocket::disconnected, this, &RemoteClient::onDisconnected);
+
+    RemoteReply hello = call(RemoteOp::Hello, RemoteProtocol::pack(RemoteProtocol::kVersion), timeoutMs);
+    if (hello.ok && !RemoteProtocol::unpack(hello.payload, m_serverPid)) {
+        hello.ok = false;
+        hello.error = "Неверный ответ сервера на Hello";
+    }
+    if (!hello.ok) {
+        qWarning(remoteClient) << "RemoteClient: handshake with" << serverName << "failed:" << hello.error;
+        m_lastError = hello.error;
+        disconnectFromServer();
+        return false;
+    }
+
+    qInfo(remoteClient) << "RemoteClient: connected to" << serverName;
+    return true;
+}
+
+bool RemoteClient::isConnected() const
+{
+    return m_socket && m_socket->state() == QLocalSocket::ConnectedState;
+}
+
+void RemoteClient::disconnectFromServer()
+{
+    if (!m_socket) return;
+
+    QLocalSocket* socket = std::exchange(m_socket, nullptr);
+    socket->disconnect(this);
+    socket->abort();
+    socket->deleteLater();
+    failPending("Соединение с сервером базы закрыто");
+}
+
+QFuture<RemoteReply> RemoteClient::request(RemoteOp op, const QByteArray& args)
+{
+    auto promise = std::make_shared<QPromise<RemoteReply>>();
+    promise->start();
+    QFuture<RemoteReply> future = promise->future();
+
+    if (!isConnected()) {
+        RemoteReply r;
+        r.error = "Нет соединения с сервером базы";
+        promise->addResult(r);
+        promise->finish();
+        return future;
+    }
+
+    if (m_nextId == 0) ++m_nextId;      // 0 — номер событий
+    const quint32 id = m_nextId++;
+    m_pending.insert(id, promise);
+
+    RemoteProtocol::Frame frame;
+    frame.kind = RemoteProtocol::FrameKind::Request;
+    frame.id = id;
+    frame.op = op;
+    frame.reply.payload = args;
+    RemoteProtocol::writeFrame(m_socket, RemoteProtocol::encodeFrame(frame));
+    return future;
+}
+
+RemoteReply RemoteClient::call(RemoteOp op, const QByteArray& args, int timeoutMs)
+{
+    QFuture<RemoteReply> future = request(op, args);
+
+    QDeadlineTimer deadline(timeoutMs);
+    while (!future.isFinished()) {
+        if (!m_socket) break;
+        m_socket->flush();
+        if (!m_socket->waitForReadyRead(int(deadline.remainingTime()))) {
+            m_lastError = deadline.hasExpired() ? QString("Сервер базы не ответил за %1 мс").arg(timeoutMs)
+                                                : m_socket->errorString();
+            qWarning(remoteClient) << "RemoteClient: call" << quint16(op) << "failed:" << m_lastError;
+            // опоздавший ответ всё равно придёт: соединение больше не годится
+            disconnectFromServer();
+            break;
+        }
+        onReadyRead();
+    }
+
+    if (!future.isFinished() || future.resultCount() == 0) {
+        RemoteReply r;
+        r.error = m_lastError;
+        return r;
+    }
+    return future.result();
+}
+
+void RemoteClient::onReadyRead()
+{
+    if (!m_socket) return;
+
+    for (const QByteArray& bytes : RemoteProtocol::readFrames(m_socket)) {
+        RemoteProtocol::Frame frame;
+        if (!RemoteProtocol::decodeFrame(bytes, frame)) {
+            qWarning(remoteClient) << "RemoteClient: malformed frame";
+            continue;
+        }
+
+        if (frame.kind == RemoteProtocol::FrameKind::Event) {
+            emit serverEvent(frame.op, frame.reply.payload);
+            continue;
+        }
+
+        const auto promise = m_pending.take(frame.id);
+        if (!promise) {
+            qWarning(remoteClient) << "RemoteClient: reply to unknown request" << frame.id;
+            continue;
+        }
+        promise->addResult(frame.reply);
+        promise->finish();
+    }
+}
+
+void RemoteClient::onDisconnected()
+{
+    qWarning(remoteClient) << "RemoteClient: server closed the connection";
+    disconnectFromServer();
+    emit disconnected();
+}
+
+void RemoteClient::failPending(const QString& error)
+{
+    const auto pending = std::exchange(m_pending, {});
+    for (const auto& promise : pending) {
+        RemoteReply r;
+        r.error = error;
+        promise->addResult(r);
+        promise->finish();
+    }
+}
@@ -0,0 +1,192 @@
+#include "remote/RemoteProtocol.h"
+
+#include <QCryptographicHash>
+
+namespace {
+
+// полная точность: сумма строки не должна округляться при передаче
+QString decimalToWire(const Decimal& value)
+{
+    return QString::fromStdString(value.str());
+}
+
+} // namespace
+
+namespace RemoteProtocol {
+
+QString serverName(const QString& databasePath)
+{
+    const QByteArray hash = QCryptographicHash::hash(databasePath.toUtf8(), QCryptographicHash::Md5).toHex();
+    return "WholesaleTradeServer-" + QString::fromLatin1(hash.left(16));
+}
+
+QByteArray encodeFrame(const Frame& frame)
+{
+    QByteArray bytes;
+    QDataStream out(&bytes, QIODevice::WriteOnly);
+    out.setVersion(kStreamVersion);
+    out << quint8(frame.kind) << frame.id << quint16(frame.op);
+    if (frame.kind == FrameKind::Reply)
+        out << frame.reply.ok << frame.reply.error;
+    out << frame.reply.payload;
+    return bytes;
+}
+
+bool decodeFrame(const QByteArray& bytes, Frame& frame)
+{
+    QDataStream in(bytes);
+    in.setVersion(kStreamVersion);
+
+    quint8 kind = 0;
+    quint16 op = 0;
+    in >> kind >> frame.id >> op;
+    if (kind < quint8(FrameKind::Request) || kind > quint8(FrameKind::Event))
+        return false;
+
+    frame.kind = FrameKind(kind);
+    frame.op = RemoteOp(op);
+    frame.reply = RemoteReply();
+    if (frame.kind == FrameKind::Reply)
+        in >> frame.reply.ok >> frame.reply.error;
+    in >> frame.reply.payload;
+    return in.status() == QDataStream::Ok;
+}
+
+QList<QByteArray> readFrames(QIODevice* device)
+{
+    QDataStream in(device);
+    in.setVersion(kStreamVersion);
+
+    QList<QByteArray> frames;
+    for (;;) {
+        in.startTransaction();
+        QByteArray bytes;
+        in >> bytes;
+        if (!in.commitTransaction())
+            break;      // кадр ещё не пришёл целиком
+        frames.append(bytes);
+    }
+    return frames;
+}
+
+void writeFrame(QIODevice* device, const QByteArray& bytes)
+{
+    QDataStream out(device);
+    out.setVersion(kStreamVersion);
+    out << bytes;
+}
+
+} // namespace RemoteProtocol
+
+QDataStream& operator<<(QDataStream& out, const Document& d)
+{
+    return out << qint32(d.id) << d.docType << d.number << d.date << d.status
+               << qint32(d.senderId) << qint32(d.receiverId) << decimalToWire(d.totalAmount)
+               << qint32(d.lineCount) << d.totalQtyKg << d.notes << d.createdAt << d.updatedAt;
+}
+
+QDataStream& operator>>(QDataStream& in, Document& d)
+{
+    qint32 id = 0, senderId = 0, receiverId = 0, lineCount = 0;
+    QString total;
+    in >> id >> d.docType >> d.number >> d.date >> d.status >> senderId >> receiverId >> total
+       >> lineCount >> d.totalQtyKg >> d.notes >> d.createdAt >> d.updatedAt;
+    d.id = id;
+    d.senderId = senderId;
+    d.receiverId = receiverId;
+    d.totalAmount = decimalFromString(total);
+    d.lineCount = lineCount;
+    return in;
+}
+
+QDataStream& operator<<(QDataStream& out, const DocumentFilter& f)
+{
+    out << f.dateFrom << f.dateTo << qint32(f.senderId) << f.docType.has_value();
+    if (f.docType) out << *f.docType;
+    return out;
+}
+
+QDataStream& operator>>(QDataStream& in, DocumentFilter& f)
+{
+    qint32 senderId = 0;
+    bool hasType = false;
+    in >> f.dateFrom >> f.dateTo >> senderId >> hasType;
+    f.senderId = senderId;
+    f.docType.reset();
+    if (hasType) {
+        DocumentType type = DocumentType::Supply;
+        in >> type;
+        f.docType = type;
+    }
+    return in;
+}
+
+QDataStream& operator<<(QDataStream& out, const DocumentLine& l)
+{
+    return out << qint32(l.id) << qint32(l.documentId) << qint32(l.productId) << l.qtyKg
+               << decimalToWire(l.price) << decimalToWire(l.lineSum) << l.createdAt;
+}
+
+QDataStream& operator>>(QDataStream& in, DocumentLine& l)
+{
+    qint32 id = 0, documentId = 0, productId = 0;
+    QString price, lineSum;
+    in >> id >> documentId >> productId >> l.qtyKg >> price >> lineSum >> l.createdAt;
+    l.id = id;
+    l.documentId = documentId;
+    l.productId = productId;
+    l.price = decimalFromString(price);
+    l.lineSum = decimalFromString(lineSum);
+    return in;
+}
+
+QDataStream& operator<<(QDataStream& out, const DocumentLinesDiff& diff)
+{
+    return out << diff.inserted << diff.updated << diff.deletedIds;
+}
+
+QDataStream& operator>>(QDataStream& in, DocumentLinesDiff& diff)
+{
+    return in >> diff.inserted >> diff.updated >> diff.deletedIds;
+}
+
+QDataStream& operator<<(QDataStream& out, const MovementTotal& t)
+{
+    return out << qint32(t.productId) << t.date << t.qtyKg;
+}
+
+QDataStream& operator>>(QDataStream& in, MovementTotal& t)
+{
+    qint32 productId = 0;
+    in >> productId >> t.date >> t.qtyKg;
+    t.productId = productId;
+    return in;
+}
+
+QDataStream& operator<<(QDataStream& out, const StockReservation& r)
+{
+    return out << qint32(r.documentId) << qint32(r.productId) << r.qtyKg;
+}
+
+QDataStream& operator>>(QDataStream& in, StockReservation& r)
+{
+    qint32 documentId = 0, productId = 0;
+    in >> documentId >> productId >> r.qtyKg;
+    r.documentId = documentId;
+    r.productId = productId;
+    return in;
+}
+
+QDataStream& operator<<(QDataStream& out, const WriteResult& r)
+{
+    return out << r.ok << qint32(r.id) << qint32(r.count) << r.error << r.lines;
+}
+
+QDataStream& operator>>(QDataStream& in, WriteResult& r)
+{
+    qint32 id = 0, count = 0;
+    in >> r.ok >> id >> count >> r.error >> r.lines;
+    r.id = id;
+    r.count = count;
+    return in;
+}
@@ -8,6 +8,7 @@ QString Document::docTypeString() const
         case DocumentType::Sale: return "sale";
         case DocumentType::Return: return "return";
         case DocumentType::Transfer: return "transfer";
+        case DocumentType::WriteOff: return "writeoff";
         default: return "supply";
     }
 }
@@ -28,6 +29,7 @@ DocumentType Document::docTypeFromString(const QString &str)
     if (str == "sale") return DocumentType::Sale;
     if (str == "return") return DocumentType::Return;
     if (str == "transfer") return DocumentType::Transfer;
+    if (str == "writeoff") return DocumentType::WriteOff;
     return DocumentType::Supply;
 }
 
@@ -1,5 +1,7 @@
 #include "repositories/DocumentLineRepository.h"
+#include "repositories/SqlBatch.h"
 #include "DecimalUtils.h"
+#include "SqlRetry.h"
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QLoggingCategory>
@@ -16,7 +18,7 @@ DocumentLineRepository::DocumentLineRepository(QSqlDatabase db)
 
 bool DocumentLineRepository::executeQuery(QSqlQuery& q, const QString& context) const
 {
-    if (!q.exec()) {
+    if (!SqlRetry::exec(m_db, q)) {
         qCritical(docLineRepo) << "DocumentLineRepository::" << context << "- SQL error:" << q.lastError().text();
         qCritical(docLineRepo) << "DocumentLineRepository::" << context << "- SQL:" << q.executedQuery();
         return false;
@@ -96,6 +98,33 @@ QList<DocumentLine> DocumentLineRepository::findByDocument(int documentId)
     return res;
 }
 
+std::optional<QHash<int, QList<DocumentLine>>> DocumentLineRepository::findByDocuments(const QList<int>& documentIds)
+{
+    QHash<int, QList<DocumentLine>> res;
+
+    for (qsizetype offset = 0; offset < documentIds.size(); offset += kSqlMaxBatchIds) {
+        const QList<int> batch = documentIds.mid(offset, kSqlMaxBatchIds);
+
+        QSqlQuery q(m_db);
+        q.setForwardOnly(true);
+        q.prepare(QString(R"(
+            SELECT id, document_id, product_id, qty_kg, price, line_sum, created_at
+            FROM document_lines
+            WHERE document_id IN (%1)
+            ORDER BY document_id, id
+        )").arg(sqlPlaceholders(batch.size())));
+        for (int id : batch) q.addBindValue(id);
+
+        if (!executeQuery(q, "findByDocuments")) return std::nullopt;
+        while (q.next()) {
+            const DocumentLine line = lineFromQuery(q);
+            res[line.documentId].append(line);
+        }
+    }
+
+    return res;
+}
+
 bool DocumentLineRepository::deleteByDocument(int documentId)
 {
     if (documentId <= 0) return false;
@@ -130,3 +159,64 @@ bool DocumentLineRepository::update(const DocumentLine& line)
     if (!executeQuery(q, "update")) return false;
     return q.numRowsAffected() > 0;
 }
+
+bool DocumentLineRepository::applyDiff(int documentId, DocumentLinesDiff& diff)
+{
+    if (documentId <= 0) return false;
+
+    if (!diff.deletedIds.isEmpty()) {
+        QSqlQuery q(m_db);
+        q.prepare("DELETE FROM document_lines WHERE id = :id AND document_id = :doc");
+        for (const int id : diff.deletedIds) {
+            q.bindValue(":id", id);
+            q.bindValue(":doc", documentId);
+            if (!executeQuery(q, "applyDiff: delete")) return false;
+        }
+    }
+
+    if (!diff.updated.isEmpty()) {
+        QSqlQuery q(m_db);
+        q.prepare(R"(
+            UPDATE document_lines
+            SET product_id = :prod,
+                qty_kg = :qty,
+                price = :price,
+                line_sum = :sum
+            WHERE id = :id AND document_id = :doc
+        )");
+        for (const auto& line : diff.updated) {
+            q.bindValue(":id", line.id);
+            q.bindValue(":doc", documentId);
+            q.bindValue(":prod", line.productId);
+            q.bindValue(":qty", line.qtyKg);
+            q.bindValue(":price", decimalToString(line.price));
+            q.bindValue(":sum", decimalToString(line.lineSum));
+            if (!executeQuery(q, "applyDiff: update")) return false;
+        }
+    }
+
+    if (!diff.inserted.isEmpty()) {
+        QSqlQuery q(m_db);
+        q.prepare(R"(
+            INSERT INTO document_lines (document_id, product_id, qty_kg, price, line_sum)
+            VALUES (:doc, :prod, :qty, :price, :sum)
+        )");
+        for (auto& line : diff.inserted) {
+            q.bindValue(":doc", documentId);
+            q.bindValue(":prod", line.productId);
+            q.bindValue(":qty", line.qtyKg);
+            q.bindValue(":price", decimalToString(line.price));
+            q.bindValue(":sum", decimalToString(line.lineSum));
+            if (!executeQuery(q, "applyDiff: insert")) return false;
+
+            line.documentId = documentId;
+            line.id = q.lastInsertId().toInt();
+        }
+    }
+
+    qDebug(docLineRepo) << "DocumentLineRepository::applyDiff: document" << documentId
+                        << "inserted" << diff.inserted.size()
+                        << "updated" << diff.updated.size()
+                        << "deleted" << diff.deletedIds.size();
+    return true;
+}
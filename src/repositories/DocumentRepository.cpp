@@ -1,5 +1,7 @@
 #include "repositories/DocumentRepository.h"
+#include "repositories/SqlBatch.h"
 #include "DecimalUtils.h"
+#include "SqlRetry.h"
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QLoggingCategory>
@@ -21,6 +23,7 @@ QString DocumentRepository::docTypeToDb(DocumentType t)
         case DocumentType::Sale:          return "sale";
         case DocumentType::Return:        return "return";
         case DocumentType::Transfer:      return "transfer";
+        case DocumentType::WriteOff:      return "writeoff";
     }
     return "supply";
 }
@@ -42,6 +45,7 @@ DocumentType DocumentRepository::docTypeFromDb(const QString& s)
     if (v == "sale") return DocumentType::Sale;
     if (v == "return") return DocumentType::Return;
     if (v == "transfer") return DocumentType::Transfer;
+    if (v == "writeoff") return DocumentType::WriteOff;
     return DocumentType::Supply;
 }
 
@@ -55,7 +59,7 @@ DocumentStatus DocumentRepository::statusFromDb(const QString& s)
 
 bool DocumentRepository::executeQuery(QSqlQuery& q, const QString& context) const
 {
-    if (!q.exec()) {
+    if (!SqlRetry::exec(m_db, q)) {
         qCritical(docRepo) << "DocumentRepository::" << context << "- SQL error:" << q.lastError().text();
         qCritical(docRepo) << "DocumentRepository::" << context << "- SQL:" << q.executedQuery();
         return false;
@@ -74,6 +78,8 @@ Document DocumentRepository::documentFromQuery(const QSqlQuery& q) const
     d.senderId = q.value("sender_id").isNull() ? 0 : q.value("sender_id").toInt();
     d.receiverId = q.value("receiver_id").isNull() ? 0 : q.value("receiver_id").toInt();
     d.totalAmount = decimalFromVariant(q.value("total_amount"));
+    d.lineCount = q.value("line_count").toInt();
+    d.totalQtyKg = q.value("total_qty_kg").toDouble();
     d.notes = q.value("notes").toString();
     d.createdAt = q.value("created_at").toString();
     d.updatedAt = q.value("updated_at").toString();
@@ -89,8 +95,8 @@ int DocumentRepository::create(const Document& document)
 
     QSqlQuery q(m_db);
     q.prepare(R"(
-        INSERT INTO documents (doc_type, number, date, status, sender_id, receiver_id, total_amount, notes)
-        VALUES (:type, :number, :date, :status, :sender, :receiver, :total, :notes)
+        INSERT INTO documents (doc_type, number, date, status, sender_id, receiver_id, notes)
+        VALUES (:type, :number, :date, :status, :sender, :receiver, :notes)
     )");
     q.bindValue(":type", docTypeToDb(document.docType));
     q.bindValue(":number", document.number.trimmed());
@@ -98,7 +104,6 @@ int DocumentRepository::create(const Document& document)
     q.bindValue(":status", statusToDb(document.status));
     q.bindValue(":sender", document.senderId == 0 ? QVariant() : QVariant(document.senderId));
     q.bindValue(":receiver", document.receiverId == 0 ? QVariant() : QVariant(document.receiverId));
-    q.bindValue(":total", decimalToString(document.totalAmount));
     q.bindValue(":notes", document.notes.trimmed().isEmpty() ? QVariant() : QVariant(document.notes.trimmed()));
 
     if (!executeQuery(q, "create")) return -1;
@@ -113,7 +118,8 @@ Document DocumentRepository::findById(int id)
 
     QSqlQuery q(m_db);
     q.prepare(R"(
-        SELECT id, doc_type, number, date, status, sender_id, receiver_id, total_amount, notes, created_at, updated_at
+        SELECT id, doc_type, number, date, status, sender_id, receiver_id, total_amount, line_count, total_qty_kg,
+               notes, created_at, updated_at
         FROM documents
         WHERE id = :id
     )");
@@ -129,7 +135,8 @@ Document DocumentRepository::findByNumber(const QString& number, DocumentType ty
 {
     QSqlQuery q(m_db);
     q.prepare(R"(
-        SELECT id, doc_type, number, date, status, sender_id, receiver_id, total_amount, notes, created_at, updated_at
+        SELECT id, doc_type, number, date, status, sender_id, receiver_id, total_amount, line_count, total_qty_kg,
+               notes, created_at, updated_at
         FROM documents
         WHERE number = :number AND doc_type = :type
         LIMIT 1
@@ -148,7 +155,8 @@ QList<Document> DocumentRepository::findAll()
     QList<Document> res;
     QSqlQuery q(m_db);
     q.prepare(R"(
-        SELECT id, doc_type, number, date, status, sender_id, receiver_id, total_amount, notes, created_at, updated_at
+        SELECT id, doc_type, number, date, status, sender_id, receiver_id, total_amount, line_count, total_qty_kg,
+               notes, created_at, updated_at
         FROM documents
         ORDER BY date DESC, id DESC
     )");
@@ -163,7 +171,8 @@ QList<Document> DocumentRepository::findByStatus(DocumentStatus status)
     QList<Document> res;
     QSqlQuery q(m_db);
     q.prepare(R"(
-        SELECT id, doc_type, number, date, status, sender_id, receiver_id, total_amount, notes, created_at, updated_at
+        SELECT id, doc_type, number, date, status, sender_id, receiver_id, total_amount, line_count, total_qty_kg,
+               notes, created_at, updated_at
         FROM documents
         WHERE status = :status
         ORDER BY date DESC, id DESC
@@ -180,7 +189,8 @@ QList<Document> DocumentRepository::findByDateRange(const QDate& from, const QDa
     QList<Document> res;
     QSqlQuery q(m_db);
     q.prepare(R"(
-        SELECT id, doc_type, number, date, status, sender_id, receiver_id, total_amount, notes, created_at, updated_at
+        SELECT id, doc_type, number, date, status, sender_id, receiver_id, total_amount, line_count, total_qty_kg,
+               notes, created_at, updated_at
         FROM documents
         WHERE date >= :from AND date <= :to
         ORDER BY date DESC, id DESC
@@ -193,6 +203,39 @@ QList<Document> DocumentRepository::findByDateRange(const QDate& from, const QDa
     return res;
 }
 
+std::optional<QList<Document>> DocumentRepository::findPageByDateRange(const QDate& from, const QDate& to,
+                                                                       const QDate& afterDate, int afterId, int limit)
+{
+    QString sql = R"(
+        SELECT id, doc_type, number, date, status, sender_id, receiver_id, total_amount, line_count, total_qty_kg,
+               notes, created_at, updated_at
+        FROM documents
+        WHERE date >= :from AND date <= :to
+    )";
+    // ключ вместо OFFSET: страница идёт по индексу date с любого места периода
+    if (afterId > 0)
+        sql += " AND (date < :afterDate OR (date = :afterDate AND id < :afterId))";
+    sql += " ORDER BY date DESC, id DESC LIMIT :limit";
+
+    QSqlQuery q(m_db);
+    q.setForwardOnly(true);
+    q.prepare(sql);
+    q.bindValue(":from", from.toString(Qt::ISODate));
+    q.bindValue(":to", to.toString(Qt::ISODate));
+    if (afterId > 0) {
+        q.bindValue(":afterDate", afterDate.toString(Qt::ISODate));
+        q.bindValue(":afterId", afterId);
+    }
+    q.bindValue(":limit", limit);
+
+    // ошибку не выдаём за конец периода: выгрузка оборвалась бы молча
+    if (!executeQuery(q, "findPageByDateRange")) return std::nullopt;
+
+    QList<Document> res;
+    while (q.next()) res.append(documentFromQuery(q));
+    return res;
+}
+
 bool DocumentRepository::update(const Document& document)
 {
     if (document.id <= 0) return false;
@@ -206,7 +249,6 @@ bool DocumentRepository::update(const Document& document)
             status = :status,
             sender_id = :sender,
             receiver_id = :receiver,
-            total_amount = :total,
             notes = :notes,
             updated_at = datetime('now')
         WHERE id = :id
@@ -218,7 +260,6 @@ bool DocumentRepository::update(const Document& document)
     q.bindValue(":status", statusToDb(document.status));
     q.bindValue(":sender", document.senderId == 0 ? QVariant() : QVariant(document.senderId));
     q.bindValue(":receiver", document.receiverId == 0 ? QVariant() : QVariant(document.receiverId));
-    q.bindValue(":total", decimalToString(document.totalAmount));
     q.bindValue(":notes", document.notes.trimmed().isEmpty() ? QVariant() : QVariant(document.notes.trimmed()));
 
     if (!executeQuery(q, "update")) return false;
@@ -253,3 +294,138 @@ bool DocumentRepository::exists(int id)
     if (!executeQuery(q, "exists")) return false;
     return q.next();
 }
+
+bool DocumentRepository::updateStatus(int id, DocumentStatus from, DocumentStatus to)
+{
+    if (id <= 0) return false;
+
+    QSqlQuery q(m_db);
+    q.prepare(R"(
+        UPDATE documents
+        SET status = :to,
+            updated_at = datetime('now')
+        WHERE id = :id AND status = :from
+    )");
+    q.bindValue(":id", id);
+    q.bindValue(":from", statusToDb(from));
+    q.bindValue(":to", statusToDb(to));
+
+    if (!executeQuery(q, "updateStatus")) return false;
+    return q.numRowsAffected() > 0;
+}
+
+int DocumentRepository::updateStatusBatch(const QList<int>& ids, DocumentStatus from, DocumentStatus to)
+{
+    int affected = 0;
+
+    // лимит параметров SQLite — режем набор на пачки
+    for (qsizetype offset = 0; offset < ids.size(); offset += kSqlMaxBatchIds) {
+        const QList<int> batch = ids.mid(offset, kSqlMaxBatchIds);
+
+        QSqlQuery q(m_db);
+        q.prepare(QString(R"(
+            UPDATE documents
+            SET status = ?,
+                updated_at = datetime('now')
+            WHERE status = ? AND id IN (%1)
+        )").arg(sqlPlaceholders(batch.size())));
+        q.addBindValue(statusToDb(to));
+        q.addBindValue(statusToDb(from));
+        for (int id : batch) q.addBindValue(id);
+
+        if (!executeQuery(q, "updateStatusBatch")) return -1;
+        affected += q.numRowsAffected();
+    }
+
+    return affected;
+}
+
+QString DocumentRepository::filterWhere(const DocumentFilter& filter)
+{
+    QString where = "status = :status AND is_deleted = 0";
+    if (filter.dateFrom.isValid()) where += " AND date >= :from";
+    if (filter.dateTo.isValid()) where += " AND date <= :to";
+    if (filter.senderId > 0) where += " AND sender_id = :sender";
+    if (filter.docType) where += " AND doc_type = :type";
+    return where;
+}
+
+void DocumentRepository::bindFilter(QSqlQuery& q, DocumentStatus status, const DocumentFilter& filter)
+{
+    q.bindValue(":status", statusToDb(status));
+    if (filter.dateFrom.isValid()) q.bindValue(":from", filter.dateFrom.toString(Qt::ISODate));
+    if (filter.dateTo.isValid()) q.bindValue(":to", filter.dateTo.toString(Qt::ISODate));
+    if (filter.senderId > 0) q.bindValue(":sender", filter.senderId);
+    if (filter.docType) q.bindValue(":type", docTypeToDb(*filter.docType));
+}
+
+std::optional<QList<int>> DocumentRepository::findIds(DocumentStatus status, const DocumentFilter& filter)
+{
+    QSqlQuery q(m_db);
+    q.prepare("SELECT id FROM documents WHERE " + filterWhere(filter) + " ORDER BY id");
+    bindFilter(q, status, filter);
+
+    if (!executeQuery(q, "findIds")) return std::nullopt;
+
+    QList<int> res;
+    while (q.next()) res.append(q.value(0).toInt());
+    return res;
+}
+
+int DocumentRepository::countIds(DocumentStatus status, const DocumentFilter& filter)
+{
+    QSqlQuery q(m_db);
+    q.prepare("SELECT COUNT(*) FROM documents WHERE " + filterWhere(filter));
+    bindFilter(q, status, filter);
+
+    if (!executeQuery(q, "countIds") || !q.next()) return -1;
+    return q.value(0).toInt();
+}
+
+bool DocumentRepository::numberExists(const QString& number, DocumentType type, int excludeId)
+{
+    QSqlQuery q(m_db);
+    q.prepare(R"(
+        SELECT 1 FROM documents
+        WHERE doc_type = :type AND number = :number AND is_deleted = 0 AND id <> :id
+        LIMIT 1
+    )");
+    q.bindValue(":type", docTypeToDb(type));
+    q.bindValue(":number", number.trimmed());
+    q.bindValue(":id", excludeId);
+
+    if (!executeQuery(q, "numberExists")) return false;
+    return q.next();
+}
+
+bool DocumentRepository::remove(int id)
+{
+    if (id <= 0) return false;
+
+    QSqlQuery q(m_db);
+    q.prepare("DELETE FROM documents WHERE id = :id AND status = 'DRAFT'");
+    q.bindValue(":id", id);
+
+    if (!executeQuery(q, "remove")) return false;
+    return q.numRowsAffected() > 0;
+}
+
+bool DocumentRepository::softDelete(int id)
+{
+    if (id <= 0) return false;
+
+    // В таблице documents действует UNIQUE(number, doc_type). Даже при soft-delete номер остаётся занятым.
+    // Поэтому при скрытии добавляем суффикс к номеру, чтобы освободить исходное значение.
+    QSqlQuery q(m_db);
+    q.prepare(R"(
+        UPDATE documents
+        SET is_deleted = 1,
+            number = CASE WHEN instr(number, '[del ') = 0 THEN number || ' [del ' || id || ']' ELSE number END,
+            updated_at = datetime('now')
+        WHERE id = :id
+    )");
+    q.bindValue(":id", id);
+
+    if (!executeQuery(q, "softDelete")) return false;
+    return q.numRowsAffected() > 0;
+}
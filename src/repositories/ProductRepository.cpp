@@ -1,5 +1,7 @@
 #include "repositories/ProductRepository.h"
 #include "DecimalUtils.h"
+#include "SqlCollation.h"
+#include "SqlRetry.h"
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QDebug>
@@ -72,9 +74,10 @@ QList<Product> ProductRepository::findAll()
     QList<Product> products;
     
     QSqlQuery query(m_db);
-    query.prepare("SELECT id, name, unit, price, is_active, created_at, updated_at "
+    // порядок берётся из idx_products_active_name, без сортировки в памяти
+    query.prepare(QString("SELECT id, name, unit, price, is_active, created_at, updated_at "
               "FROM products WHERE is_active = 1 "
-              "ORDER BY name");
+              "ORDER BY %1").arg(SqlCollation::orderBy("name")));
     
     if (!executeQuery(query, "findAll")) {
         return products;
@@ -93,9 +96,9 @@ QList<Product> ProductRepository::findAllIncludingInactive()
     QList<Product> products;
     
     QSqlQuery query(m_db);
-    query.prepare("SELECT id, name, unit, price, is_active, created_at, updated_at "
+    query.prepare(QString("SELECT id, name, unit, price, is_active, created_at, updated_at "
               "FROM products "
-              "ORDER BY name");
+              "ORDER BY %1").arg(SqlCollation::orderBy("name")));
     
     if (!executeQuery(query, "findAllIncludingInactive")) {
         return products;
@@ -243,7 +246,7 @@ Product ProductRepository::productFromQuery(const QSqlQuery &query) const
 
 bool ProductRepository::executeQuery(QSqlQuery &query, const QString &context) const
 {
-    if (!query.exec()) {
+    if (!SqlRetry::exec(m_db, query)) {
         qCritical(productRepo) << "ProductRepository::" << context 
                                 << "- SQL error:" << query.lastError().text();
         qCritical(productRepo) << "ProductRepository::" << context 
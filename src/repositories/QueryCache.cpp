@@ -0,0 +1,140 @@
+#include "repositories/QueryCache.h"
+#include "ChangeTracker.h"
+
+#include <QMutexLocker>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QSqlRecord>
+#include <QLoggingCategory>
+
+Q_LOGGING_CATEGORY(queryCache, "db.querycache")
+
+QueryCache& QueryCache::instance()
+{
+    static QueryCache cache;
+    return cache;
+}
+
+QueryCache::QueryCache()
+    : m_cache(kDefaultMaxBytes)
+{
+}
+
+std::optional<QueryCache::Rows> QueryCache::select(QSqlDatabase db, const QString& sql,
+                                                   const QVariantList& params, const QStringList& tables,
+                                                   QString* error)
+{
+    const QString key = makeKey(sql, params, tables);
+
+    // версия читается до данных: запись между ними лишь устарит кэш раньше времени
+    const qint64 version = ChangeTracker::version(db, tables);
+
+    {
+        QMutexLocker lock(&m_lock);
+        const Entry* entry = version >= 0 ? m_cache.object(key) : nullptr;
+        if (entry && entry->version == version) {
+            ++m_hits;
+            return entry->rows;
+        }
+        if (entry) {
+            m_cache.remove(key);
+            ++m_stale;
+        } else {
+            ++m_misses;
+        }
+    }
+
+    QSqlQuery q(db);
+    q.setForwardOnly(true);
+    bool ok = q.prepare(sql);
+    if (ok) {
+        for (const QVariant& value : params) q.addBindValue(value);
+        ok = q.exec();
+    }
+    if (!ok) {
+        qWarning(queryCache) << "QueryCache: SQL error:" << q.lastError().text();
+        if (error) *error = q.lastError().text();
+        return std::nullopt;
+    }
+
+    Rows rows;
+    const int columns = q.record().count();
+    while (q.next()) {
+        QVariantList row;
+        row.reserve(columns);
+        for (int i = 0; i < columns; ++i) row.append(q.value(i));
+        rows.append(std::move(row));
+    }
+
+    // без счётчиков изменений устаревание не заметить — такие запросы не кэшируем
+    if (version >= 0) {
+        QMutexLocker lock(&m_lock);
+        // не влезающую запись QCache удаляет сам
+        m_cache.insert(key, new Entry{rows, version}, estimateBytes(rows));
+    }
+
+    return rows;
+}
+
+void QueryCache::clear()
+{
+    QMutexLocker lock(&m_lock);
+    m_cache.clear();
+}
+
+void QueryCache::setMaxBytes(qint64 bytes)
+{
+    QMutexLocker lock(&m_lock);
+    m_cache.setMaxCost(bytes);
+}
+
+QueryCacheStats QueryCache::stats() const
+{
+    QMutexLocker lock(&m_lock);
+
+    QueryCacheStats s;
+    s.hits = m_hits;
+    s.misses = m_misses;
+    s.stale = m_stale;
+    s.entries = int(m_cache.count());
+    s.bytes = m_cache.totalCost();
+    s.maxBytes = m_cache.maxCost();
+    return s;
+}
+
+void QueryCache::logStats() const
+{
+    const QueryCacheStats s = stats();
+    qInfo(queryCache) << "QueryCache: hits" << s.hits << "misses" << s.misses << "stale" << s.stale
+                      << "entries" << s.entries << "bytes" << s.bytes << "/" << s.maxBytes;
+}
+
+QString QueryCache::makeKey(const QString& sql, const QVariantList& params, const QStringList& tables)
+{
+    // тип значения входит в ключ: 1 и "1" SQLite сравнивает по-разному
+    QString key = sql;
+    for (const QVariant& value : params) {
+        key += QChar(0x1f);
+        key += QString::fromLatin1(value.typeName());
+        key += ':';
+        key += value.isNull() ? QStringLiteral("NULL") : value.toString();
+    }
+    key += QChar(0x1e);
+    key += tables.join(',');
+    return key;
+}
+
+qint64 QueryCache::estimateBytes(const Rows& rows)
+{
+    qint64 bytes = 0;
+    for (const QVariantList& row : rows) {
+        bytes += qint64(sizeof(QVariantList)) + row.size() * qint64(sizeof(QVariant));
+        for (const QVariant& value : row) {
+            if (value.typeId() == QMetaType::QString)
+                bytes += value.toString().size() * qint64(sizeof(QChar));
+            else if (value.typeId() == QMetaType::QByteArray)
+                bytes += value.toByteArray().size();
+        }
+    }
+    return bytes;
+}
@@ -0,0 +1,189 @@
+#include "repositories/SearchRepository.h"
+
+#include <QSqlError>
+#include <QStringList>
+#include <QLoggingCategory>
+
+Q_LOGGING_CATEGORY(searchRepo, "repository.search")
+
+namespace {
+
+QString docTypeTitle(DocumentType type)
+{
+    switch (type) {
+        case DocumentType::Supply:   return "Поставка";
+        case DocumentType::Sale:     return "Продажа";
+        case DocumentType::Return:   return "Возврат";
+        case DocumentType::Transfer: return "ТТН";
+        case DocumentType::WriteOff: return "Списание";
+    }
+    return {};
+}
+
+} // namespace
+
+SearchRepository::SearchRepository(QSqlDatabase db)
+    : m_db(db)
+{
+    if (!m_db.isOpen()) {
+        qCritical(searchRepo) << "SearchRepository: Database is not open";
+    }
+}
+
+bool SearchRepository::executeQuery(QSqlQuery& q, const QString& context) const
+{
+    if (!q.exec()) {
+        qCritical(searchRepo) << "SearchRepository::" << context << "- SQL error:" << q.lastError().text();
+        qCritical(searchRepo) << "SearchRepository::" << context << "- SQL:" << q.executedQuery();
+        return false;
+    }
+    return true;
+}
+
+bool SearchRepository::isAvailable() const
+{
+    QSqlQuery q(m_db);
+    q.prepare("SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'products_fts'");
+    return executeQuery(q, "isAvailable") && q.next();
+}
+
+QString SearchRepository::matchExpression(const QString& text)
+{
+    // разбиваем ввод на слова сами: операторы FTS5 (AND, NEAR, ", *, :) из
+    // пользовательского текста не должны попасть в запрос
+    QStringList terms;
+    QString word;
+
+    const auto flush = [&]() {
+        if (!word.isEmpty()) terms.append('"' + word + "\"*");
+        word.clear();
+    };
+
+    for (const QChar ch : text) {
+        if (ch.isLetterOrNumber()) word += ch;
+        else flush();
+    }
+    flush();
+
+    return terms.join(' ');
+}
+
+QList<SearchHit> SearchRepository::searchProducts(const QString& text, int limit, bool onlyActive) const
+{
+    QList<SearchHit> hits;
+    const QString match = matchExpression(text);
+    if (match.isEmpty()) return hits;
+
+    QString sql = R"(
+        SELECT p.id, p.name, p.unit, p.is_active, bm25(products_fts) AS rank
+        FROM products_fts
+        JOIN products p ON p.id = products_fts.rowid
+        WHERE products_fts MATCH :match
+    )";
+    if (onlyActive) sql += " AND p.is_active = 1";
+    sql += " ORDER BY rank LIMIT :limit";
+
+    QSqlQuery q(m_db);
+    q.setForwardOnly(true);
+    q.prepare(sql);
+    q.bindValue(":match", match);
+    q.bindValue(":limit", limit);
+
+    if (!executeQuery(q, "searchProducts")) return hits;
+
+    while (q.next()) {
+        SearchHit hit;
+        hit.kind = SearchHit::Kind::Product;
+        hit.id = q.value(0).toInt();
+        hit.title = q.value(1).toString();
+        hit.details = "Товар, " + q.value(2).toString();
+        if (q.value(3).toInt() == 0) hit.details += " (неактивен)";
+        hit.rank = q.value(4).toDouble();
+        hits.append(hit);
+    }
+    return hits;
+}
+
+QList<SearchHit> SearchRepository::searchCounterparties(const QString& text, int limit) const
+{
+    QList<SearchHit> hits;
+    const QString match = matchExpression(text);
+    if (match.isEmpty()) return hits;
+
+    QSqlQuery q(m_db);
+    q.setForwardOnly(true);
+    q.prepare(R"(
+        SELECT c.id, c.name, c.address, r.inn, bm25(counterparties_fts) AS rank
+        FROM counterparties_fts
+        JOIN counterparties c ON c.id = counterparties_fts.rowid
+        LEFT JOIN requisites r ON r.counterparty_id = c.id
+        WHERE counterparties_fts MATCH :match AND c.is_active = 1
+        ORDER BY rank
+        LIMIT :limit
+    )");
+    q.bindValue(":match", match);
+    q.bindValue(":limit", limit);
+
+    if (!executeQuery(q, "searchCounterparties")) return hits;
+
+    while (q.next()) {
+        SearchHit hit;
+        hit.kind = SearchHit::Kind::Counterparty;
+        hit.id = q.value(0).toInt();
+        hit.title = q.value(1).toString();
+
+        QStringList details{"Контрагент"};
+        const QString inn = q.value(3).toString();
+        if (!inn.isEmpty()) details.append("ИНН " + inn);
+        const QString address = q.value(2).toString();
+        if (!address.isEmpty()) details.append(address);
+        hit.details = details.join(", ");
+
+        hit.rank = q.value(4).toDouble();
+        hits.append(hit);
+    }
+    return hits;
+}
+
+QList<SearchHit> SearchRepository::searchDocuments(const QString& text, int limit) const
+{
+    QList<SearchHit> hits;
+    const QString match = matchExpression(text);
+    if (match.isEmpty()) return hits;
+
+    QSqlQuery q(m_db);
+    q.setForwardOnly(true);
+    q.prepare(R"(
+        SELECT d.id, d.number, d.doc_type, d.date, d.status, bm25(documents_fts) AS rank
+        FROM documents_fts
+        JOIN documents d ON d.id = documents_fts.rowid
+        WHERE documents_fts MATCH :match AND d.is_deleted = 0
+        ORDER BY rank
+        LIMIT :limit
+    )");
+    q.bindValue(":match", match);
+    q.bindValue(":limit", limit);
+
+    if (!executeQuery(q, "searchDocuments")) return hits;
+
+    while (q.next()) {
+        SearchHit hit;
+        hit.kind = SearchHit::Kind::Document;
+        hit.id = q.value(0).toInt();
+        hit.docType = Document::docTypeFromString(q.value(2).toString());
+        hit.title = docTypeTitle(*hit.docType) + " №" + q.value(1).toString();
+        hit.details = q.value(3).toString() + ", " + q.value(4).toString();
+        hit.rank = q.value(5).toDouble();
+        hits.append(hit);
+    }
+    return hits;
+}
+
+QList<SearchHit> SearchRepository::searchAll(const QString& text, int limit) const
+{
+    // bm25 разных индексов между собой не сравнимы — группируем по виду
+    QList<SearchHit> hits = searchProducts(text, limit);
+    hits.append(searchCounterparties(text, limit));
+    hits.append(searchDocuments(text, limit));
+    return hits;
+}
@@ -1,4 +1,8 @@
 #include "repositories/StockRepository.h"
+#include "repositories/SqlBatch.h"
+#include "SqlCollation.h"
+#include "StockArchive.h"
+#include "SqlRetry.h"
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QLoggingCategory>
@@ -15,7 +19,7 @@ StockRepository::StockRepository(QSqlDatabase db)
 
 bool StockRepository::executeQuery(QSqlQuery& q, const QString& context) const
 {
-    if (!q.exec()) {
+    if (!SqlRetry::exec(m_db, q)) {
         qCritical(stockRepo) << "StockRepository::" << context << "- SQL error:" << q.lastError().text();
         qCritical(stockRepo) << "StockRepository::" << context << "- SQL:" << q.executedQuery();
         return false;
@@ -129,16 +133,155 @@ bool StockRepository::cancelMovement(int id)
     return q.numRowsAffected() > 0;
 }
 
+int StockRepository::cancelMovementsByDocuments(const QList<int>& documentIds)
+{
+    int affected = 0;
+
+    for (qsizetype offset = 0; offset < documentIds.size(); offset += kSqlMaxBatchIds) {
+        const QList<int> batch = documentIds.mid(offset, kSqlMaxBatchIds);
+
+        QSqlQuery q(m_db);
+        q.prepare(QString(R"(
+            UPDATE inventory_movements
+            SET cancelled_flag = 1
+            WHERE cancelled_flag = 0 AND document_id IN (%1)
+        )").arg(sqlPlaceholders(batch.size())));
+        for (int id : batch) q.addBindValue(id);
+
+        if (!executeQuery(q, "cancelMovementsByDocuments")) return -1;
+        affected += q.numRowsAffected();
+    }
+
+    return affected;
+}
+
+QList<MovementTotal> StockRepository::activeMovementTotalsByDocuments(const QList<int>& documentIds)
+{
+    QList<MovementTotal> res;
+
+    for (qsizetype offset = 0; offset < documentIds.size(); offset += kSqlMaxBatchIds) {
+        const QList<int> batch = documentIds.mid(offset, kSqlMaxBatchIds);
+
+        QSqlQuery q(m_db);
+        q.prepare(QString(R"(
+            SELECT product_id, movement_date, SUM(qty_delta_kg)
+            FROM inventory_movements
+            WHERE cancelled_flag = 0 AND document_id IN (%1)
+            GROUP BY product_id, movement_date
+        )").arg(sqlPlaceholders(batch.size())));
+        for (int id : batch) q.addBindValue(id);
+
+        if (!executeQuery(q, "activeMovementTotalsByDocuments")) return {};
+        while (q.next()) {
+            MovementTotal t;
+            t.productId = q.value(0).toInt();
+            t.date = QDate::fromString(q.value(1).toString(), Qt::ISODate);
+            t.qtyKg = q.value(2).toDouble();
+            res.append(t);
+        }
+    }
+
+    return res;
+}
+
+QList<MovementTotal> StockRepository::findActiveMovementTotals()
+{
+    QList<MovementTotal> res;
+
+    QSqlQuery q(m_db);
+    q.setForwardOnly(true);
+    // входящие остатки архива — как движение на дату границы
+    q.prepare(R"(
+        SELECT product_id, movement_date, SUM(qty_delta_kg)
+        FROM inventory_movements
+        WHERE cancelled_flag = 0
+        GROUP BY product_id, movement_date
+        UNION ALL
+        SELECT product_id, as_of, balance_kg
+        FROM stock_opening_balances
+    )");
+
+    if (!executeQuery(q, "findActiveMovementTotals")) return res;
+
+    while (q.next()) {
+        MovementTotal t;
+        t.productId = q.value(0).toInt();
+        t.date = QDate::fromString(q.value(1).toString(), Qt::ISODate);
+        t.qtyKg = q.value(2).toDouble();
+        res.append(t);
+    }
+    return res;
+}
+
+QList<MovementTotal> StockRepository::findActiveMovementTotalsByProducts(const QList<int>& productIds)
+{
+    QList<MovementTotal> res;
+
+    for (qsizetype offset = 0; offset < productIds.size(); offset += kSqlMaxBatchIds) {
+        const QList<int> batch = productIds.mid(offset, kSqlMaxBatchIds);
+        const QString placeholders = sqlPlaceholders(batch.size());
+
+        QSqlQuery q(m_db);
+        q.setForwardOnly(true);
+        q.prepare(QString(R"(
+            SELECT product_id, movement_date, SUM(qty_delta_kg)
+            FROM inventory_movements
+            WHERE cancelled_flag = 0 AND product_id IN (%1)
+            GROUP BY product_id, movement_date
+            UNION ALL
+            SELECT product_id, as_of, balance_kg
+            FROM stock_opening_balances
+            WHERE product_id IN (%1)
+        )").arg(placeholders));
+        for (int pass = 0; pass < 2; ++pass) {
+            for (int id : batch) q.addBindValue(id);
+        }
+
+        if (!executeQuery(q, "findActiveMovementTotalsByProducts")) return {};
+        while (q.next()) {
+            MovementTotal t;
+            t.productId = q.value(0).toInt();
+            t.date = QDate::fromString(q.value(1).toString(), Qt::ISODate);
+            t.qtyKg = q.value(2).toDouble();
+            res.append(t);
+        }
+    }
+
+    return res;
+}
+
+QHash<int, int> StockRepository::findMovementProducts(const QList<int>& movementIds)
+{
+    QHash<int, int> res;
+
+    for (qsizetype offset = 0; offset < movementIds.size(); offset += kSqlMaxBatchIds) {
+        const QList<int> batch = movementIds.mid(offset, kSqlMaxBatchIds);
+
+        QSqlQuery q(m_db);
+        q.setForwardOnly(true);
+        q.prepare(QString("SELECT id, product_id FROM inventory_movements WHERE id IN (%1)")
+                      .arg(sqlPlaceholders(batch.size())));
+        for (int id : batch) q.addBindValue(id);
+
+        if (!executeQuery(q, "findMovementProducts")) return {};
+        while (q.next())
+            res.insert(q.value(0).toInt(), q.value(1).toInt());
+    }
+
+    return res;
+}
+
 double StockRepository::getStockBalance(int productId)
 {
     if (productId <= 0) return 0.0;
 
     QSqlQuery q(m_db);
     q.prepare(R"(
-        SELECT COALESCE(SUM(qty_delta_kg), 0) AS bal
-        FROM inventory_movements
-        WHERE product_id = :prod
-          AND cancelled_flag = 0
+        SELECT COALESCE((SELECT balance_kg FROM stock_opening_balances WHERE product_id = :prod), 0)
+             + (SELECT COALESCE(SUM(qty_delta_kg), 0)
+                FROM inventory_movements
+                WHERE product_id = :prod
+                  AND cancelled_flag = 0) AS bal
     )");
     q.bindValue(":prod", productId);
 
@@ -153,18 +296,18 @@ QList<StockBalance> StockRepository::getAllStockBalances()
     QList<StockBalance> res;
 
     QSqlQuery q(m_db);
-    q.prepare(R"(
+    // товары идут в порядке индекса по name, остаток — по индексу движений товара
+    q.prepare(QString(R"(
         SELECT p.id AS product_id,
                p.name AS product_name,
                p.unit AS unit,
-               COALESCE(SUM(im.qty_delta_kg), 0) AS balance_kg
+               COALESCE((SELECT o.balance_kg FROM stock_opening_balances o WHERE o.product_id = p.id), 0)
+             + (SELECT COALESCE(SUM(im.qty_delta_kg), 0)
+                FROM inventory_movements im
+                WHERE im.product_id = p.id AND im.cancelled_flag = 0) AS balance_kg
         FROM products p
-        LEFT JOIN inventory_movements im
-               ON im.product_id = p.id
-              AND im.cancelled_flag = 0
-        GROUP BY p.id, p.name, p.unit
-        ORDER BY p.name
-    )");
+        ORDER BY %1
+    )").arg(SqlCollation::orderBy("p.name")));
 
     if (!executeQuery(q, "getAllStockBalances")) return res;
 
@@ -185,19 +328,18 @@ QList<StockBalance> StockRepository::getActiveStockBalances()
     QList<StockBalance> res;
 
     QSqlQuery q(m_db);
-    q.prepare(R"(
+    q.prepare(QString(R"(
         SELECT p.id AS product_id,
                p.name AS product_name,
                p.unit AS unit,
-               COALESCE(SUM(im.qty_delta_kg), 0) AS balance_kg
+               COALESCE((SELECT o.balance_kg FROM stock_opening_balances o WHERE o.product_id = p.id), 0)
+             + (SELECT COALESCE(SUM(im.qty_delta_kg), 0)
+                FROM inventory_movements im
+                WHERE im.product_id = p.id AND im.cancelled_flag = 0) AS balance_kg
         FROM products p
-        LEFT JOIN inventory_movements im
-               ON im.product_id = p.id
-              AND im.cancelled_flag = 0
         WHERE p.is_active = 1
-        GROUP BY p.id, p.name, p.unit
-        ORDER BY p.name
-    )");
+        ORDER BY %1
+    )").arg(SqlCollation::orderBy("p.name")));
 
     if (!executeQuery(q, "getActiveStockBalances")) return res;
 
@@ -212,3 +354,191 @@ QList<StockBalance> StockRepository::getActiveStockBalances()
 
     return res;
 }
+
+QString StockRepository::snapshotBefore(const QString& date, bool inclusive, const QString& prefix)
+{
+    QSqlQuery q(m_db);
+    q.prepare(QString("SELECT MAX(period_end) FROM %1stock_snapshot_periods WHERE period_end %2 :date")
+                  .arg(prefix, inclusive ? "<=" : "<"));
+    q.bindValue(":date", date);
+
+    if (!executeQuery(q, "snapshotBefore") || !q.next()) return QString();
+    return q.value(0).toString();
+}
+
+QList<StockBalance> StockRepository::getBalancesAsOf(const QDate& date)
+{
+    if (!date.isValid()) return {};
+
+    // даты до границы архива — по архиву, подключаемому только на время запроса
+    const QDate archived = StockArchive::archivedThrough(m_db);
+    if (archived.isValid() && date < archived) {
+        StockArchive archive(m_db);
+        if (!archive.attach()) {
+            qWarning(stockRepo) << "StockRepository::getBalancesAsOf:" << archive.lastError();
+            return {};
+        }
+        return balancesAsOf(date, "all_");
+    }
+
+    return balancesAsOf(date, QString());
+}
+
+QList<StockBalance> StockRepository::balancesAsOf(const QDate& date, const QString& prefix)
+{
+    QList<StockBalance> res;
+
+    const QString asOf = date.toString(Qt::ISODate);
+    const QString base = snapshotBefore(asOf, true, prefix);
+
+    // движения после снимка идут по idx_movements_product_date; без снимка base = '' — весь журнал
+    QSqlQuery q(m_db);
+    q.prepare(QString(R"(
+        SELECT p.id AS product_id,
+               p.name AS product_name,
+               p.unit AS unit,
+               COALESCE((SELECT s.balance_kg FROM %1stock_snapshots s
+                         WHERE s.period_end = :base AND s.product_id = p.id), 0)
+             + (SELECT COALESCE(SUM(im.qty_delta_kg), 0)
+                FROM %1inventory_movements im
+                WHERE im.product_id = p.id
+                  AND im.movement_date > :base AND im.movement_date <= :asOf
+                  AND im.cancelled_flag = 0) AS balance_kg
+        FROM products p
+        ORDER BY %2
+    )").arg(prefix, SqlCollation::orderBy("p.name")));
+    q.bindValue(":base", base);
+    q.bindValue(":asOf", asOf);
+
+    if (!executeQuery(q, "getBalancesAsOf")) return res;
+
+    while (q.next()) {
+        StockBalance b;
+        b.productId = q.value("product_id").toInt();
+        b.productName = q.value("product_name").toString();
+        b.unit = q.value("unit").toString();
+        b.balanceKg = q.value("balance_kg").toDouble();
+        res.append(b);
+    }
+
+    return res;
+}
+
+QDate StockRepository::lastSnapshotDate()
+{
+    QSqlQuery q(m_db);
+    q.prepare("SELECT MAX(period_end) FROM stock_snapshot_periods");
+
+    if (!executeQuery(q, "lastSnapshotDate") || !q.next()) return QDate();
+    return QDate::fromString(q.value(0).toString(), Qt::ISODate);
+}
+
+QDate StockRepository::firstMovementDate()
+{
+    QSqlQuery q(m_db);
+    q.prepare("SELECT MIN(movement_date) FROM inventory_movements");
+
+    if (!executeQuery(q, "firstMovementDate") || !q.next()) return QDate();
+    return QDate::fromString(q.value(0).toString(), Qt::ISODate);
+}
+
+bool StockRepository::createSnapshot(const QDate& periodEnd)
+{
+    if (!periodEnd.isValid()) return false;
+
+    const QString end = periodEnd.toString(Qt::ISODate);
+    const QString prev = snapshotBefore(end, false);
+
+    QSqlQuery q(m_db);
+    q.prepare("INSERT INTO stock_snapshot_periods (period_end) VALUES (:end)");
+    q.bindValue(":end", end);
+    if (!executeQuery(q, "createSnapshot")) return false;
+
+    // предыдущий снимок + движения периода; журнал целиком читается только для первого снимка
+    q.prepare(R"(
+        INSERT INTO stock_snapshots (period_end, product_id, balance_kg)
+        SELECT :end, product_id, SUM(qty)
+        FROM (
+            SELECT product_id, balance_kg AS qty
+            FROM stock_snapshots WHERE period_end = :prev
+            UNION ALL
+            SELECT product_id, qty_delta_kg
+            FROM inventory_movements
+            WHERE cancelled_flag = 0 AND movement_date > :prev AND movement_date <= :end
+        )
+        GROUP BY product_id
+    )");
+    q.bindValue(":end", end);
+    q.bindValue(":prev", prev);
+    if (!executeQuery(q, "createSnapshot")) return false;
+
+    qInfo(stockRepo) << "StockRepository::createSnapshot:" << end << "from" << (prev.isEmpty() ? "journal" : prev)
+                     << "-" << q.numRowsAffected() << "products";
+    return true;
+}
+
+bool StockRepository::replaceReservations(int documentId, const QHash<int, double>& qtyByProduct)
+{
+    if (documentId <= 0) return false;
+
+    QSqlQuery del(m_db);
+    del.prepare("DELETE FROM stock_reservations WHERE document_id = :doc");
+    del.bindValue(":doc", documentId);
+    if (!executeQuery(del, "replaceReservations: delete")) return false;
+
+    if (qtyByProduct.isEmpty()) return true;
+
+    QSqlQuery ins(m_db);
+    ins.prepare(R"(
+        INSERT INTO stock_reservations (document_id, product_id, qty_kg)
+        VALUES (:doc, :prod, :qty)
+    )");
+
+    for (auto it = qtyByProduct.constBegin(); it != qtyByProduct.constEnd(); ++it) {
+        if (it.value() <= 0.0) continue;
+        ins.bindValue(":doc", documentId);
+        ins.bindValue(":prod", it.key());
+        ins.bindValue(":qty", it.value());
+        if (!executeQuery(ins, "replaceReservations: insert")) return false;
+    }
+    return true;
+}
+
+QList<StockReservation> StockRepository::findAllReservations()
+{
+    QList<StockReservation> res;
+
+    QSqlQuery q(m_db);
+    q.prepare("SELECT document_id, product_id, qty_kg FROM stock_reservations");
+
+    if (!executeQuery(q, "findAllReservations")) return res;
+
+    while (q.next()) {
+        StockReservation r;
+        r.documentId = q.value("document_id").toInt();
+        r.productId = q.value("product_id").toInt();
+        r.qtyKg = q.value("qty_kg").toDouble();
+        res.append(r);
+    }
+    return res;
+}
+
+QHash<int, QHash<int, double>> StockRepository::findReservationsByDocuments(const QList<int>& documentIds)
+{
+    QHash<int, QHash<int, double>> res;
+
+    for (qsizetype offset = 0; offset < documentIds.size(); offset += kSqlMaxBatchIds) {
+        const QList<int> batch = documentIds.mid(offset, kSqlMaxBatchIds);
+
+        QSqlQuery q(m_db);
+        q.prepare(QString("SELECT document_id, product_id, qty_kg FROM stock_reservations WHERE document_id IN (%1)")
+                      .arg(sqlPlaceholders(batch.size())));
+        for (int id : batch) q.addBindValue(id);
+
+        if (!executeQuery(q, "findReservationsByDocuments")) return {};
+        while (q.next())
+            res[q.value(0).toInt()].insert(q.value(1).toInt(), q.value(2).toDouble());
+    }
+
+    return res;
+}
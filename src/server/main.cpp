@@ -0,0 +1,86 @@
+#include "ChangeBus.h"
+#include "DbManager.h"
+#include "MigrationRunner.h"
+#include "ReadPool.h"
+#include "SqlRetry.h"
+#include "WriteQueue.h"
+#include "remote/DbServer.h"
+#include "remote/HttpApi.h"
+#include "remote/RemoteProtocol.h"
+#include "repositories/QueryCache.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDate>
+#include <QDebug>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    // путь к базе строится от имени приложения: сервер обслуживает ту же базу, что открывает GUI
+    QCoreApplication::setApplicationName("WholesaleTradeApp");
+
+    // --http-port N: HTTP API для сайта и терминалов сбора (HttpApi), по умолчанию выключен
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    const QCommandLineOption httpPortOption("http-port", "Порт HTTP API на 127.0.0.1 (0 — выключен)", "port", "0");
+    parser.addOption(httpPortOption);
+    parser.process(app);
+    bool portOk = false;
+    const quint16 httpPort = parser.value(httpPortOption).toUShort(&portOk);
+    if (!portOk) {
+        // как и неизвестный ключ в process(): не запускаемся молча без API
+        qCritical() << "WholesaleTradeServer: --http-port must be a number from 0 to 65535, got"
+                    << parser.value(httpPortOption);
+        return 1;
+    }
+
+    DbManager& dbManager = DbManager::instance();
+    if (!dbManager.initialize()) {
+        qCritical() << "WholesaleTradeServer: cannot initialize database";
+        return 1;
+    }
+
+    MigrationRunner migrationRunner(dbManager.database());
+    if (!migrationRunner.runMigrations()) {
+        qCritical() << "WholesaleTradeServer: migrations failed";
+        dbManager.close();
+        return 1;
+    }
+
+    // GUI, запущенные без сервера, по-прежнему узнают об изменениях через шину
+    ChangeBus::instance().start(dbManager.databasePath());
+
+    WriteQueue writeQueue;
+    writeQueue.start();
+
+    QObject::connect(&ChangeBus::instance(), &ChangeBus::remoteChanged,
+                     &writeQueue, &WriteQueue::refreshStockCaches);
+
+    writeQueue.closeStockPeriods(QDate::currentDate());
+    writeQueue.archiveClosedYears(QDate::currentDate());
+
+    DbServer server(&writeQueue);
+    if (!server.listen(RemoteProtocol::serverName(dbManager.databasePath()))) {
+        writeQueue.stop();
+        ChangeBus::instance().stop();
+        ReadPool::instance().shutdown();
+        return 1;
+    }
+
+    HttpApi httpApi(&writeQueue);
+    if (httpPort != 0 && !httpApi.start(httpPort))
+        qWarning() << "WholesaleTradeServer: HTTP API is not started on port" << httpPort;
+
+    const int rc = app.exec();
+    httpApi.logStats();
+    httpApi.stop();
+    server.logStats();
+    server.close();
+    QueryCache::instance().logStats();
+    SqlRetry::logStats();
+    ChangeBus::instance().stop();
+    writeQueue.stop();
+    ReadPool::instance().shutdown();
+    return rc;
+}
@@ -95,12 +95,8 @@ JOIN products p ON p.name='Крупа рисовая'
 WHERE d.doc_type='transfer' AND d.number='ТТН-002';
 
 -- --- Totals ---
-UPDATE documents
-SET total_amount = (
-  SELECT printf('%.2f', COALESCE(SUM(line_sum),0)) FROM document_lines WHERE document_id = documents.id
-),
-updated_at = datetime('now')
-WHERE doc_type='transfer' AND number IN ('ТТН-001','ТТН-002');
+-- total_amount, line_count, total_qty_kg считают триггеры document_lines_totals_*
+-- (в новой базе — пересчётом при их создании)
 
 -- --- Inventory movements for POSTED docs only (ТТН-001) ---
 -- ВАЖНО: в твоей логике transfer = расход (qty_delta отрицательный)
@@ -0,0 +1,126 @@
+#include "BulkCancelForm.h"
+#include "DbManager.h"
+#include "ReadPool.h"
+#include "SqlCollation.h"
+#include "repositories/DocumentRepository.h"
+#include "repositories/QueryCache.h"
+
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QFormLayout>
+#include <QGroupBox>
+#include <QDateEdit>
+#include <QComboBox>
+#include <QLabel>
+#include <QPushButton>
+#include <QMessageBox>
+
+
+BulkCancelForm::BulkCancelForm(DocumentType docType, QWidget* parent)
+    : QDialog(parent)
+    , m_docType(docType)
+{
+    setupUi();
+    loadSenders();
+    updateCount();
+}
+
+void BulkCancelForm::setupUi()
+{
+    setWindowTitle("Массовая отмена документов");
+    setModal(true);
+    resize(460, 220);
+
+    auto* root = new QVBoxLayout(this);
+
+    auto* group = new QGroupBox("Отменить проведённые документы", this);
+    auto* form = new QFormLayout(group);
+
+    m_fromEdit = new QDateEdit(QDate::currentDate().addDays(-7), this);
+    m_fromEdit->setCalendarPopup(true);
+    form->addRow("С даты:", m_fromEdit);
+
+    m_toEdit = new QDateEdit(QDate::currentDate(), this);
+    m_toEdit->setCalendarPopup(true);
+    form->addRow("По дату:", m_toEdit);
+
+    m_senderCombo = new QComboBox(this);
+    form->addRow(m_docType == DocumentType::Supply ? "Поставщик:" : "Отправитель:", m_senderCombo);
+
+    m_countLabel = new QLabel(this);
+    form->addRow("Будет отменено:", m_countLabel);
+
+    root->addWidget(group);
+
+    auto* btns = new QHBoxLayout();
+    btns->addStretch();
+    m_okBtn = new QPushButton("Отменить документы", this);
+    m_cancelBtn = new QPushButton("Закрыть", this);
+    btns->addWidget(m_okBtn);
+    btns->addWidget(m_cancelBtn);
+    root->addLayout(btns);
+
+    connect(m_fromEdit, &QDateEdit::dateChanged, this, &BulkCancelForm::updateCount);
+    connect(m_toEdit, &QDateEdit::dateChanged, this, &BulkCancelForm::updateCount);
+    connect(m_senderCombo, &QComboBox::currentIndexChanged, this, &BulkCancelForm::updateCount);
+
+    connect(m_okBtn, &QPushButton::clicked, this, [this]() {
+        if (m_fromEdit->date() > m_toEdit->date()) {
+            QMessageBox::warning(this, "Ошибка", "Дата начала больше даты окончания");
+            return;
+        }
+        accept();
+    });
+    connect(m_cancelBtn, &QPushButton::clicked, this, &QDialog::reject);
+}
+
+void BulkCancelForm::loadSenders()
+{
+    m_senderCombo->clear();
+    m_senderCombo->addItem("Любой", 0);
+
+    QString error;
+    const auto rows = QueryCache::instance().select(
+        DbManager::instance().database(),
+        QString("SELECT id, name FROM counterparties ORDER BY %1").arg(SqlCollation::orderBy("name")),
+        {}, {"counterparties"}, &error);
+    if (!rows) {
+        QMessageBox::warning(this, "Ошибка БД", "Не удалось загрузить контрагентов:\n" + error);
+        return;
+    }
+
+    for (const QVariantList& row : *rows)
+        m_senderCombo->addItem(row.at(1).toString(), row.at(0).toInt());
+}
+
+DocumentFilter BulkCancelForm::filter() const
+{
+    DocumentFilter f;
+    f.dateFrom = m_fromEdit->date();
+    f.dateTo = m_toEdit->date();
+    f.senderId = m_senderCombo->currentData().toInt();
+    f.docType = m_docType;
+    return f;
+}
+
+void BulkCancelForm::updateCount()
+{
+    // то же условие, что применит DocumentService::cancelPosted; считаем в ReadPool, не в GUI
+    const DocumentFilter f = filter();
+    const quint64 request = ++m_countRequest;
+    m_okBtn->setEnabled(false);
+
+    ReadPool::instance().run<int>([f](QSqlDatabase db) {
+        return DocumentRepository(db).countIds(DocumentStatus::Posted, f);
+    }).then(this, [this, request](int count) {
+        // фильтр успели поменять — ответ уже не про него
+        if (request != m_countRequest) return;
+
+        if (count < 0) {
+            m_countLabel->setText("не удалось посчитать");
+            return;
+        }
+        m_countLabel->setText(QString("%1 док.").arg(count));
+        m_okBtn->setEnabled(count > 0 && m_fromEdit->date() <= m_toEdit->date());
+    });
+}
@@ -0,0 +1,46 @@
+#ifndef BULKCANCELFORM_H
+#define BULKCANCELFORM_H
+
+#include <QDialog>
+
+#include "repositories/IDocumentRepository.h"
+
+class QDateEdit;
+class QComboBox;
+class QLabel;
+class QPushButton;
+
+/**
+ * @brief Массовая отмена (storno) проведённых документов по фильтру
+ *
+ * Форма только собирает фильтр и показывает, сколько документов под него
+ * попадает; саму отмену выполняет вызывающий через WriteQueue::cancelPosted.
+ */
+class BulkCancelForm : public QDialog
+{
+    Q_OBJECT
+public:
+    explicit BulkCancelForm(DocumentType docType, QWidget* parent = nullptr);
+
+    DocumentFilter filter() const;
+
+private:
+    void setupUi();
+    void loadSenders();
+    void updateCount();
+
+private:
+    DocumentType m_docType;
+
+    QDateEdit* m_fromEdit = nullptr;
+    QDateEdit* m_toEdit = nullptr;
+    QComboBox* m_senderCombo = nullptr;
+    QLabel* m_countLabel = nullptr;
+
+    QPushButton* m_okBtn = nullptr;
+    QPushButton* m_cancelBtn = nullptr;
+
+    quint64 m_countRequest = 0;     // ответ пула применяется, только если он на последний запрос
+};
+
+#endif // BULKCANCELFORM_H
@@ -6,21 +6,41 @@
 #include "widgets/TTNWidget.h"
 #include "widgets/StockBalancesWidget.h"
 #include "widgets/MovementsWidget.h"
+#include "widgets/SearchCompleter.h"
+#include "ProductForm.h"
+#include "CounterpartyForm.h"
+#include "SupplyForm.h"
+#include "TTNForm.h"
+#include "DbManager.h"
+#include "WriteQueue.h"
 
 #include <QMenuBar>
 #include <QMenu>
 #include <QAction>
 #include <QMessageBox>
 #include <QApplication>
+#include <QElapsedTimer>
+#include <QLineEdit>
+#include <QLoggingCategory>
+#include <QTimer>
+#include <QVBoxLayout>
 
-MainWindow::MainWindow(DocumentService* docService, QWidget *parent)
+Q_LOGGING_CATEGORY(mainWindow, "ui.mainwindow")
+
+MainWindow::MainWindow(WriteQueue* writeQueue, QWidget *parent)
     : QMainWindow(parent)
-    , m_docService(docService)
+    , m_writeQueue(writeQueue)
 {
     setupUi();
     createMenuBar();
     setWindowTitle("Система управления оптовой торговлей");
     resize(1200, 800);
+
+    connect(m_writeQueue, &WriteQueue::remoteLost, this, [this](const QString& error) {
+        QMessageBox::warning(this, "Сервер базы",
+            error + ".\nДокументы теперь проводятся напрямую в файл базы; "
+            "операции, отправленные серверу в момент обрыва, стоит проверить.");
+    });
 }
 
 MainWindow::~MainWindow() {}
@@ -30,14 +50,77 @@ void MainWindow::setupUi()
     m_tabWidget = new QTabWidget(this);
     setCentralWidget(m_tabWidget);
 
-    m_tabWidget->addTab(new ProductsWidget(this), "Товары");
-    m_tabWidget->addTab(new CounterpartiesWidget(this), "Контрагенты");
+    // виджеты вкладок делают запросы в конструкторе — создаём их только когда понадобятся
+    addLazyTab("Товары", [this]() { return new ProductsWidget(this); });
+    addLazyTab("Контрагенты", [this]() { return new CounterpartiesWidget(this); });
+
+    addLazyTab("Поставки", [this]() { return new SupplyWidget(m_writeQueue, this); });
+    addLazyTab("ТТН", [this]() { return new TTNWidget(m_writeQueue, this); });
+
+    addLazyTab("Остатки", [this]() { return new StockBalancesWidget(m_writeQueue, this); });
+    addLazyTab("Движения", [this]() { return new MovementsWidget(m_writeQueue, this); });
+
+    connect(m_tabWidget, &QTabWidget::currentChanged, this, &MainWindow::onCurrentTabChanged);
+    ensureTab(m_tabWidget->currentIndex());
+
+    // остальные вкладки создаём по одной, пока приложение простаивает
+    m_prewarmTimer = new QTimer(this);
+    m_prewarmTimer->setSingleShot(true);
+    connect(m_prewarmTimer, &QTimer::timeout, this, &MainWindow::onPrewarmTick);
+    m_prewarmTimer->start(kPrewarmDelayMs);
+}
+
+void MainWindow::addLazyTab(const QString& title, std::function<QWidget*()> factory)
+{
+    auto* placeholder = new QWidget(m_tabWidget);
+    auto* layout = new QVBoxLayout(placeholder);
+    layout->setContentsMargins(0, 0, 0, 0);
+
+    m_tabs.append({placeholder, std::move(factory)});
+    m_tabWidget->addTab(placeholder, title);
+}
+
+void MainWindow::ensureTab(int index)
+{
+    if (index < 0 || index >= m_tabs.size()) return;
+
+    LazyTab& tab = m_tabs[index];
+    if (!tab.factory) return;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // factory сбрасываем до вызова: создание не должно повториться даже при рекурсивном currentChanged
+    const auto factory = std::move(tab.factory);
+    tab.factory = nullptr;
+
+    QWidget* widget = factory();
+    tab.placeholder->layout()->addWidget(widget);
 
-    m_tabWidget->addTab(new SupplyWidget(m_docService, this), "Поставки");
-    m_tabWidget->addTab(new TTNWidget(this), "ТТН");
+    qDebug(mainWindow) << "MainWindow: tab" << m_tabWidget->tabText(index)
+                       << "created in" << timer.elapsed() << "ms";
+}
 
-    m_tabWidget->addTab(new StockBalancesWidget(this), "Остатки");
-    m_tabWidget->addTab(new MovementsWidget(this), "Движения");
+void MainWindow::onCurrentTabChanged(int index)
+{
+    ensureTab(index);
+}
+
+void MainWindow::onPrewarmTick()
+{
+    // пользователь занят (открыт модальный диалог и т.п.) — попробуем позже
+    if (QApplication::activeModalWidget() || QApplication::activePopupWidget()) {
+        m_prewarmTimer->start(kPrewarmStepMs);
+        return;
+    }
+
+    for (int i = 0; i < m_tabs.size(); ++i) {
+        if (!m_tabs[i].factory) continue;
+
+        ensureTab(i);
+        m_prewarmTimer->start(kPrewarmStepMs);
+        return;
+    }
 }
 
 void MainWindow::createMenuBar()
@@ -51,6 +134,63 @@ void MainWindow::createMenuBar()
     QMenu* helpMenu = menuBar->addMenu("Справка");
     QAction* aboutAction = helpMenu->addAction("О программе");
     connect(aboutAction, &QAction::triggered, this, &MainWindow::onAboutClicked);
+
+    createSearchBox();
+}
+
+void MainWindow::createSearchBox()
+{
+    if (!SearchRepository(DbManager::instance().database()).isAvailable()) {
+        qWarning(mainWindow) << "MainWindow: search index is not available, search box disabled";
+        return;
+    }
+
+    m_searchEdit = new QLineEdit(this);
+    m_searchEdit->setPlaceholderText("Поиск: товар, контрагент, ИНН, номер документа");
+    m_searchEdit->setClearButtonEnabled(true);
+    m_searchEdit->setMinimumWidth(320);
+    menuBar()->setCornerWidget(m_searchEdit, Qt::TopRightCorner);
+
+    auto* completer = new SearchCompleter(SearchCompleter::Scope::Everything, this);
+    completer->attach(m_searchEdit);
+    connect(completer, &SearchCompleter::hitActivated, this, &MainWindow::onSearchHitActivated);
+}
+
+void MainWindow::onSearchHitActivated(const SearchHit& hit)
+{
+    // найденное открываем той же формой, что и кнопка «Редактировать» на вкладке;
+    // списки вкладок обновятся по событиям очереди записи или кнопкой «Обновить»
+    switch (hit.kind) {
+        case SearchHit::Kind::Product: {
+            ProductForm form(this);
+            form.loadData(hit.id);
+            form.exec();
+            break;
+        }
+        case SearchHit::Kind::Counterparty: {
+            CounterpartyForm form(this);
+            form.loadData(hit.id);
+            form.exec();
+            break;
+        }
+        case SearchHit::Kind::Document: {
+            if (hit.docType == DocumentType::Supply) {
+                SupplyForm form(m_writeQueue, this);
+                form.loadData(hit.id);
+                form.exec();
+            } else if (hit.docType == DocumentType::Transfer) {
+                TtnForm form(m_writeQueue, this);
+                form.loadData(hit.id);
+                form.exec();
+            } else {
+                QMessageBox::information(this, "Поиск",
+                    QString("Документ «%1» нельзя открыть из этой версии программы").arg(hit.title));
+            }
+            break;
+        }
+    }
+
+    m_searchEdit->clear();
 }
 
 void MainWindow::onAboutClicked()
@@ -3,27 +3,58 @@
 
 #include <QMainWindow>
 #include <QTabWidget>
+#include <QList>
 
-class DocumentService;
+#include <functional>
+
+#include "repositories/SearchRepository.h"
+
+class QLineEdit;
+class QTimer;
+
+class WriteQueue;
 
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
 public:
-    explicit MainWindow(DocumentService* docService, QWidget *parent = nullptr);
+    explicit MainWindow(WriteQueue* writeQueue, QWidget *parent = nullptr);
     ~MainWindow();
 
 private slots:
     void onAboutClicked();
     void onExitClicked();
 
+    void onCurrentTabChanged(int index);
+    void onPrewarmTick();
+
+    void onSearchHitActivated(const SearchHit& hit);
+
 private:
     void setupUi();
     void createMenuBar();
+    void createSearchBox();
+
+    // вкладка создаётся при первом открытии (или фоновым прогревом)
+    void addLazyTab(const QString& title, std::function<QWidget*()> factory);
+    void ensureTab(int index);
 
 private:
-    DocumentService* m_docService = nullptr;
+    WriteQueue* m_writeQueue = nullptr;
     QTabWidget* m_tabWidget = nullptr;
+
+    struct LazyTab {
+        QWidget* placeholder = nullptr;
+        std::function<QWidget*()> factory;     // пустая после создания
+    };
+    QList<LazyTab> m_tabs;
+
+    QTimer* m_prewarmTimer = nullptr;
+    QLineEdit* m_searchEdit = nullptr;
+
+    // прогрев начинается, когда окно уже показано и пользователь ничего не делает
+    static constexpr int kPrewarmDelayMs = 1500;
+    static constexpr int kPrewarmStepMs = 300;
 };
 
 #endif // MAINWINDOW_H
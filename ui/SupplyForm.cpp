@@ -1,8 +1,12 @@
 #include "SupplyForm.h"
 
 #include "DbManager.h"
-#include "DocumentService.h"
+#include "SqlCollation.h"
+#include "WriteQueue.h"
 #include "DecimalUtils.h"
+#include "repositories/QueryCache.h"
+#include "models/DocumentLinesModel.h"
+#include "models/DocumentLinesDelegate.h"
 
 #include <QVBoxLayout>
 #include <QHBoxLayout>
@@ -11,21 +15,23 @@
 #include <QLineEdit>
 #include <QDateEdit>
 #include <QComboBox>
-#include <QTableWidget>
+#include <QTableView>
 #include <QHeaderView>
 #include <QLabel>
 #include <QPushButton>
 #include <QMessageBox>
-#include <QDoubleSpinBox>
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QVariant>
 
 static QString safeText(const QString& s) { return s.trimmed(); }
 
-SupplyForm::SupplyForm(DocumentService* docService, QWidget* parent)
+// строки с нулевым количеством в поставке не сохраняются
+static constexpr double kMinLineQty = 0.000001;
+
+SupplyForm::SupplyForm(WriteQueue* writeQueue, QWidget* parent)
     : QDialog(parent)
-    , m_docService(docService)
+    , m_writeQueue(writeQueue)
 {
     setupUi();
     reloadProducts();
@@ -61,24 +67,32 @@ void SupplyForm::setupUi()
     auto* linesGroup = new QGroupBox("Товары", this);
     auto* linesLayout = new QVBoxLayout(linesGroup);
 
-    m_linesTable = new QTableWidget(this);
-    m_linesTable->setColumnCount(5);
-    m_linesTable->setHorizontalHeaderLabels(QStringList()
-        << "Товар" << "Кол-во (кг)" << "Цена" << "Сумма" << "Ед.");
-    m_linesTable->horizontalHeader()->setStretchLastSection(true);
-    m_linesTable->verticalHeader()->setVisible(false);
-    m_linesTable->setSelectionBehavior(QAbstractItemView::SelectRows);
-    m_linesTable->setSelectionMode(QAbstractItemView::SingleSelection);
-    m_linesTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
-    m_linesTable->setAlternatingRowColors(true);
-
-    m_linesTable->setColumnWidth(0, 360);
-    m_linesTable->setColumnWidth(1, 140);
-    m_linesTable->setColumnWidth(2, 120);
-    m_linesTable->setColumnWidth(3, 140);
-    m_linesTable->setColumnWidth(4, 60);
-
-    linesLayout->addWidget(m_linesTable);
+    // цена в поставке всегда из справочника товаров
+    m_linesModel = new DocumentLinesModel(this);
+    m_linesModel->setPriceEditable(false);
+
+    m_linesView = new QTableView(this);
+    m_linesView->setModel(m_linesModel);
+    m_linesView->setItemDelegate(new DocumentLinesDelegate(m_linesView));
+    m_linesView->horizontalHeader()->setStretchLastSection(true);
+    m_linesView->verticalHeader()->setVisible(false);
+    // фиксированная высота строк: вид не измеряет каждую строку большого документа
+    m_linesView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    m_linesView->setSelectionBehavior(QAbstractItemView::SelectRows);
+    m_linesView->setSelectionMode(QAbstractItemView::SingleSelection);
+    m_linesView->setEditTriggers(QAbstractItemView::DoubleClicked
+                                 | QAbstractItemView::SelectedClicked
+                                 | QAbstractItemView::EditKeyPressed
+                                 | QAbstractItemView::AnyKeyPressed);
+    m_linesView->setAlternatingRowColors(true);
+
+    m_linesView->setColumnWidth(DocumentLinesModel::ProductColumn, 360);
+    m_linesView->setColumnWidth(DocumentLinesModel::QtyColumn, 140);
+    m_linesView->setColumnWidth(DocumentLinesModel::PriceColumn, 120);
+    m_linesView->setColumnWidth(DocumentLinesModel::SumColumn, 140);
+    m_linesView->setColumnWidth(DocumentLinesModel::UnitColumn, 60);
+
+    linesLayout->addWidget(m_linesView);
 
     auto* linesBtnRow = new QHBoxLayout();
     m_addLineBtn = new QPushButton("Добавить строку", this);
@@ -121,46 +135,55 @@ void SupplyForm::setupUi()
     connect(m_postBtn, &QPushButton::clicked, this, &SupplyForm::onPostClicked);
     connect(m_cancelBtn, &QPushButton::clicked, this, &SupplyForm::onCancelDocumentClicked);
     connect(m_closeBtn, &QPushButton::clicked, this, &QDialog::reject);
+
+    connect(m_linesModel, &DocumentLinesModel::totalChanged, this, &SupplyForm::onTotalChanged);
 }
 
 void SupplyForm::reloadProducts()
 {
-    m_products.clear();
-
-    QSqlDatabase db = DbManager::instance().database();
-    QSqlQuery q(db);
-    if (!q.exec("SELECT id, name, price, unit FROM products WHERE is_active = 1 ORDER BY sort, name")) {
-        QMessageBox::warning(this, "Ошибка БД", "Не удалось загрузить товары:\n" + q.lastError().text());
+    QList<DocumentLinesModel::ProductItem> products;
+
+    QString error;
+    const auto rows = QueryCache::instance().select(
+        DbManager::instance().database(),
+        QString("SELECT id, name, price, unit FROM products WHERE is_active = 1 ORDER BY sort, %1")
+            .arg(SqlCollation::orderBy("name")),
+        {}, {"products"}, &error);
+    if (!rows) {
+        QMessageBox::warning(this, "Ошибка БД", "Не удалось загрузить товары:\n" + error);
         return;
     }
 
-    while (q.next()) {
-        ProductItem p;
-        p.id = q.value("id").toInt();
-        p.name = q.value("name").toString();
-        p.price = decimalFromVariant(q.value("price"));
-        p.unit = q.value("unit").toString();
-        m_products.append(p);
+    for (const QVariantList& row : *rows) {
+        DocumentLinesModel::ProductItem p;
+        p.id = row.at(0).toInt();
+        p.name = row.at(1).toString();
+        p.price = decimalFromVariant(row.at(2));
+        p.unit = row.at(3).toString();
+        products.append(p);
     }
+
+    m_linesModel->setProducts(products);
 }
 
 void SupplyForm::reloadCounterparties()
 {
     m_senderCombo->clear();
 
-    QSqlDatabase db = DbManager::instance().database();
-    QSqlQuery q(db);
     // для поставки логично показывать supplier/both
-    if (!q.exec("SELECT id, name, type FROM counterparties WHERE is_active = 1 AND type IN ('supplier','both') ORDER BY name")) {
-        QMessageBox::warning(this, "Ошибка БД", "Не удалось загрузить контрагентов:\n" + q.lastError().text());
+    QString error;
+    const auto rows = QueryCache::instance().select(
+        DbManager::instance().database(),
+        QString("SELECT id, name FROM counterparties WHERE is_active = 1 AND type IN ('supplier','both') ORDER BY %1")
+            .arg(SqlCollation::orderBy("name")),
+        {}, {"counterparties"}, &error);
+    if (!rows) {
+        QMessageBox::warning(this, "Ошибка БД", "Не удалось загрузить контрагентов:\n" + error);
         return;
     }
 
-    while (q.next()) {
-        const int id = q.value("id").toInt();
-        const QString name = q.value("name").toString();
-        m_senderCombo->addItem(name, id);
-    }
+    for (const QVariantList& row : *rows)
+        m_senderCombo->addItem(row.at(1).toString(), row.at(0).toInt());
 }
 
 void SupplyForm::setUiReadOnly(bool ro)
@@ -172,13 +195,7 @@ void SupplyForm::setUiReadOnly(bool ro)
     m_addLineBtn->setEnabled(!ro);
     m_removeLineBtn->setEnabled(!ro);
 
-    // таблица: комбо/спинбоксы
-    for (int r = 0; r < m_linesTable->rowCount(); ++r) {
-        if (auto* cb = qobject_cast<QComboBox*>(m_linesTable->cellWidget(r, 0)))
-            cb->setEnabled(!ro);
-        if (auto* sp = qobject_cast<QDoubleSpinBox*>(m_linesTable->cellWidget(r, 1)))
-            sp->setEnabled(!ro);
-    }
+    m_linesModel->setReadOnly(ro);
 }
 
 void SupplyForm::loadData(int documentId)
@@ -194,9 +211,8 @@ void SupplyForm::loadData(int documentId)
         m_dateEdit->setDate(QDate::currentDate());
         if (m_senderCombo->count() > 0) m_senderCombo->setCurrentIndex(0);
 
-        m_linesTable->setRowCount(0);
+        m_linesModel->clear();
         onAddLineClicked(); // хотя бы 1 строка
-        recalcTotals();
 
         m_postBtn->setEnabled(false);   // нельзя провести пока нет сохраненного id
         m_cancelBtn->setEnabled(false); // нечего отменять
@@ -238,13 +254,13 @@ void SupplyForm::loadData(int documentId)
     }
 
     // lines
-    m_linesTable->setRowCount(0);
     {
+        QList<DocumentLinesModel::Line> lines;
+
         QSqlQuery q(db);
         q.prepare(R"(
-            SELECT dl.product_id, dl.qty_kg, dl.price, dl.line_sum, p.unit
+            SELECT dl.id, dl.product_id, dl.qty_kg, dl.price
             FROM document_lines dl
-            LEFT JOIN products p ON p.id = dl.product_id
             WHERE dl.document_id = :doc
             ORDER BY dl.id
         )");
@@ -254,51 +270,21 @@ void SupplyForm::loadData(int documentId)
             QMessageBox::warning(this, "Ошибка БД", "Не удалось загрузить строки:\n" + q.lastError().text());
         } else {
             while (q.next()) {
-                const int productId = q.value(0).toInt();
-                const double qty = q.value(1).toDouble();
-                const Decimal price = decimalFromVariant(q.value(2));
-                const Decimal sum = decimalFromVariant(q.value(3));
-                const QString unit = q.value(4).toString();
-
-                const int r = m_linesTable->rowCount();
-                m_linesTable->insertRow(r);
-
-                // product combo
-                auto* cb = new QComboBox(this);
-                for (const auto& p : m_products) cb->addItem(p.name, p.id);
-                int pidx = cb->findData(productId);
-                if (pidx >= 0) cb->setCurrentIndex(pidx);
-                m_linesTable->setCellWidget(r, 0, cb);
-
-                // qty
-                auto* sp = new QDoubleSpinBox(this);
-                sp->setDecimals(3);
-                sp->setMinimum(0.0);
-                sp->setMaximum(1e9);
-                sp->setValue(qty);
-                m_linesTable->setCellWidget(r, 1, sp);
-
-                // price, sum, unit (readonly items)
-                m_linesTable->setItem(r, 2, new QTableWidgetItem(decimalToString(price)));
-                m_linesTable->setItem(r, 3, new QTableWidgetItem(decimalToString(sum)));
-                m_linesTable->setItem(r, 4, new QTableWidgetItem(unit));
-
-                for (int c : {2,3,4}) {
-                    m_linesTable->item(r, c)->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
-                    m_linesTable->item(r, c)->setFlags(m_linesTable->item(r, c)->flags() & ~Qt::ItemIsEditable);
-                }
-
-                connect(cb, &QComboBox::currentIndexChanged, this, &SupplyForm::onLineChanged);
-                connect(sp, QOverload<double>::of(&QDoubleSpinBox::valueChanged), this, &SupplyForm::onLineChanged);
+                DocumentLinesModel::Line line;
+                line.id = q.value(0).toInt();
+                line.productId = q.value(1).toInt();
+                line.qtyKg = q.value(2).toDouble();
+                line.price = decimalFromVariant(q.value(3));
+                lines.append(line);
             }
         }
+
+        m_linesModel->setLines(lines);
     }
 
-    if (m_linesTable->rowCount() == 0)
+    if (m_linesModel->rowCount() == 0)
         onAddLineClicked();
 
-    recalcTotals();
-
     const bool isDraft = (m_status == "DRAFT");
     m_postBtn->setEnabled(isDraft);
     m_cancelBtn->setEnabled(m_status == "POSTED");
@@ -309,115 +295,25 @@ void SupplyForm::loadData(int documentId)
 
 void SupplyForm::onAddLineClicked()
 {
-    const int r = m_linesTable->rowCount();
-    m_linesTable->insertRow(r);
-
-    auto* cb = new QComboBox(this);
-    for (const auto& p : m_products) cb->addItem(p.name, p.id);
-    m_linesTable->setCellWidget(r, 0, cb);
-
-    auto* sp = new QDoubleSpinBox(this);
-    sp->setDecimals(3);
-    sp->setMinimum(0.0);
-    sp->setMaximum(1e9);
-    sp->setValue(0.0);
-    m_linesTable->setCellWidget(r, 1, sp);
-
-    m_linesTable->setItem(r, 2, new QTableWidgetItem("0.00"));
-    m_linesTable->setItem(r, 3, new QTableWidgetItem("0.00"));
-    m_linesTable->setItem(r, 4, new QTableWidgetItem("кг"));
-
-    for (int c : {2,3,4}) {
-        m_linesTable->item(r, c)->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
-        m_linesTable->item(r, c)->setFlags(m_linesTable->item(r, c)->flags() & ~Qt::ItemIsEditable);
-    }
-
-    connect(cb, &QComboBox::currentIndexChanged, this, &SupplyForm::onLineChanged);
-    connect(sp, QOverload<double>::of(&QDoubleSpinBox::valueChanged), this, &SupplyForm::onLineChanged);
-
-    recalcTotals();
+    const int r = m_linesModel->appendLine();
+    m_linesView->setCurrentIndex(m_linesModel->index(r, DocumentLinesModel::ProductColumn));
+    m_linesView->scrollToBottom();
 }
 
 void SupplyForm::onRemoveLineClicked()
 {
-    const int r = m_linesTable->currentRow();
+    const int r = m_linesView->currentIndex().row();
     if (r < 0) return;
 
-    m_linesTable->removeRow(r);
+    m_linesModel->removeRow(r);
 
-    if (m_linesTable->rowCount() == 0)
+    if (m_linesModel->rowCount() == 0)
         onAddLineClicked();
-
-    recalcTotals();
 }
 
-void SupplyForm::onLineChanged()
+void SupplyForm::onTotalChanged()
 {
-    recalcTotals();
-}
-
-int SupplyForm::currentSelectedProductId(int row) const
-{
-    if (auto* cb = qobject_cast<QComboBox*>(m_linesTable->cellWidget(row, 0)))
-        return cb->currentData().toInt();
-    return 0;
-}
-
-double SupplyForm::currentQty(int row) const
-{
-    if (auto* sp = qobject_cast<QDoubleSpinBox*>(m_linesTable->cellWidget(row, 1)))
-        return sp->value();
-    return 0.0;
-}
-
-Decimal SupplyForm::productPriceById(int productId) const
-{
-    for (const auto& p : m_products)
-        if (p.id == productId) return p.price;
-    return Decimal(0);
-}
-
-QString SupplyForm::productNameById(int productId) const
-{
-    for (const auto& p : m_products)
-        if (p.id == productId) return p.name;
-    return {};
-}
-
-void SupplyForm::recalcTotals()
-{
-    Decimal total = 0;
-
-    for (int r = 0; r < m_linesTable->rowCount(); ++r) {
-        const int productId = currentSelectedProductId(r);
-        const double qty = currentQty(r);
-
-        const Decimal price = productPriceById(productId);
-        const Decimal sum = price * Decimal(qty);
-
-        // unit
-        QString unit = "кг";
-        for (const auto& p : m_products) {
-            if (p.id == productId) { unit = p.unit; break; }
-        }
-
-        if (!m_linesTable->item(r, 2)) m_linesTable->setItem(r, 2, new QTableWidgetItem());
-        if (!m_linesTable->item(r, 3)) m_linesTable->setItem(r, 3, new QTableWidgetItem());
-        if (!m_linesTable->item(r, 4)) m_linesTable->setItem(r, 4, new QTableWidgetItem());
-
-        m_linesTable->item(r, 2)->setText(decimalToString(price));
-        m_linesTable->item(r, 3)->setText(decimalToString(sum));
-        m_linesTable->item(r, 4)->setText(unit);
-
-        for (int c : {2,3,4}) {
-            m_linesTable->item(r, c)->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
-            m_linesTable->item(r, c)->setFlags(m_linesTable->item(r, c)->flags() & ~Qt::ItemIsEditable);
-        }
-
-        total += sum;
-    }
-
-    m_totalLabel->setText(decimalToString(total));
+    m_totalLabel->setText(decimalToString(m_linesModel->total()));
 }
 
 bool SupplyForm::validateForm()
@@ -434,9 +330,10 @@ bool SupplyForm::validateForm()
     }
 
     bool hasAnyQty = false;
-    for (int r = 0; r < m_linesTable->rowCount(); ++r) {
-        const int pid = currentSelectedProductId(r);
-        const double qty = currentQty(r);
+    const auto& lines = m_linesModel->lines();
+    for (int r = 0; r < lines.size(); ++r) {
+        const int pid = lines.at(r).productId;
+        const double qty = lines.at(r).qtyKg;
         if (pid <= 0) {
             QMessageBox::warning(this, "Ошибка", QString("В строке %1 не выбран товар").arg(r + 1));
             return false;
@@ -453,177 +350,65 @@ bool SupplyForm::validateForm()
     return true;
 }
 
-bool SupplyForm::deleteLines(int documentId)
-{
-    QSqlDatabase db = DbManager::instance().database();
-    QSqlQuery q(db);
-    q.prepare("DELETE FROM document_lines WHERE document_id = :doc");
-    q.bindValue(":doc", documentId);
-    if (!q.exec()) {
-        QMessageBox::critical(this, "Ошибка БД", "Не удалось удалить строки:\n" + q.lastError().text());
-        return false;
-    }
-    return true;
-}
-
-bool SupplyForm::insertLines(int documentId)
-{
-    QSqlDatabase db = DbManager::instance().database();
-
-    for (int r = 0; r < m_linesTable->rowCount(); ++r) {
-        const int productId = currentSelectedProductId(r);
-        const double qty = currentQty(r);
-        if (qty < 0.000001) continue;
-
-        const Decimal price = productPriceById(productId);
-        const Decimal sum = price * Decimal(qty);
-
-        QSqlQuery q(db);
-        q.prepare(R"(
-            INSERT INTO document_lines (document_id, product_id, qty_kg, price, line_sum)
-            VALUES (:doc, :pid, :qty, :price, :sum)
-        )");
-        q.bindValue(":doc", documentId);
-        q.bindValue(":pid", productId);
-        q.bindValue(":qty", qty);
-        q.bindValue(":price", decimalToString(price));
-        q.bindValue(":sum", decimalToString(sum));
-
-        if (!q.exec()) {
-            QMessageBox::critical(this, "Ошибка БД", "Не удалось вставить строку:\n" + q.lastError().text());
-            return false;
-        }
-    }
-
-    return true;
-}
-
-bool SupplyForm::createDocument()
-{
-    QSqlDatabase db = DbManager::instance().database();
-
-    const QString number = safeText(m_numberEdit->text());
-    const QString dateIso = m_dateEdit->date().toString(Qt::ISODate);
-    const int senderId = m_senderCombo->currentData().toInt();
-    const Decimal total = decimalFromString(m_totalLabel->text());
-
-    QSqlQuery q(db);
-    q.prepare(R"(
-        INSERT INTO documents (doc_type, number, date, status, sender_id, receiver_id, total_amount, notes)
-        VALUES ('supply', :number, :date, 'DRAFT', :sender, NULL, :total, NULL)
-    )");
-    q.bindValue(":number", number);
-    q.bindValue(":date", dateIso);
-    q.bindValue(":sender", senderId);
-    q.bindValue(":total", decimalToString(total));
-
-    if (!q.exec()) {
-        QMessageBox::critical(this, "Ошибка БД", "Не удалось создать документ:\n" + q.lastError().text());
-        return false;
-    }
-
-    m_documentId = q.lastInsertId().toInt();
-    m_status = "DRAFT";
-    return true;
-}
-
-bool SupplyForm::updateDocument()
+void SupplyForm::setBusy(bool busy)
 {
-    QSqlDatabase db = DbManager::instance().database();
-
-    const QString number = safeText(m_numberEdit->text());
-    const QString dateIso = m_dateEdit->date().toString(Qt::ISODate);
-    const int senderId = m_senderCombo->currentData().toInt();
-    const Decimal total = decimalFromString(m_totalLabel->text());
-
-    QSqlQuery q(db);
-    q.prepare(R"(
-        UPDATE documents
-        SET number = :number,
-            date = :date,
-            sender_id = :sender,
-            total_amount = :total,
-            updated_at = datetime('now')
-        WHERE id = :id AND doc_type='supply'
-    )");
-    q.bindValue(":number", number);
-    q.bindValue(":date", dateIso);
-    q.bindValue(":sender", senderId);
-    q.bindValue(":total", decimalToString(total));
-    q.bindValue(":id", m_documentId);
-
-    if (!q.exec()) {
-        QMessageBox::critical(this, "Ошибка БД", "Не удалось обновить документ:\n" + q.lastError().text());
-        return false;
-    }
-
-    if (q.numRowsAffected() == 0) {
-        QMessageBox::warning(this, "Ошибка", "Документ не обновлен (возможно не найден)");
-        return false;
-    }
+    // пока команда в очереди записи, строки не меняем: иначе markSaved() не совпадёт с diff
+    const bool isDraft = (m_status == "DRAFT");
+    setUiReadOnly(busy || !isDraft);
 
-    return true;
+    m_saveBtn->setEnabled(!busy && isDraft);
+    m_postBtn->setEnabled(!busy && isDraft);
+    m_cancelBtn->setEnabled(!busy && m_status == "POSTED");
 }
 
-bool SupplyForm::saveToDb()
+void SupplyForm::saveToDb(std::function<void()> onSaved)
 {
-    QSqlDatabase db = DbManager::instance().database();
-    if (!db.isOpen()) {
-        QMessageBox::critical(this, "Ошибка", "База данных не открыта");
-        return false;
-    }
-
-    if (!db.transaction()) {
-        QMessageBox::warning(this, "Предупреждение", "Не удалось начать транзакцию");
-    }
-
-    bool ok = true;
-
-    if (m_documentId <= 0) {
-        ok = createDocument();
-    } else {
-        ok = updateDocument();
-    }
-
-    if (ok) ok = deleteLines(m_documentId);
-    if (ok) ok = insertLines(m_documentId);
-
-    if (!ok) {
-        db.rollback();
-        return false;
+    if (!m_writeQueue) {
+        QMessageBox::critical(this, "Ошибка", "Очередь записи не передана");
+        return;
     }
 
-    if (!db.commit()) {
-        QMessageBox::critical(this, "Ошибка БД", "Не удалось зафиксировать транзакцию:\n" + db.lastError().text());
-        db.rollback();
-        return false;
-    }
+    Document doc;
+    doc.id = m_documentId;
+    doc.docType = DocumentType::Supply;
+    doc.number = safeText(m_numberEdit->text());
+    doc.date = m_dateEdit->date();
+    doc.senderId = m_senderCombo->currentData().toInt();
+
+    // для нового документа все строки попадут во вставку
+    const DocumentLinesDiff diff = m_linesModel->diff(kMinLineQty);
+
+    setBusy(true);
+    m_writeQueue->saveDraft(doc, diff).then(this, [this, onSaved](const WriteResult& r) {
+        setBusy(false);
+        if (!r.ok) {
+            QMessageBox::critical(this, "Ошибка БД", "Не удалось сохранить поставку:\n" + r.error);
+            return;
+        }
 
-    return true;
+        m_documentId = r.id;
+        m_status = "DRAFT";
+        m_linesModel->markSaved(r.lines, kMinLineQty);
+        onSaved();
+    });
 }
 
 void SupplyForm::onSaveClicked()
 {
     if (!validateForm()) return;
 
-    recalcTotals();
-
-    if (!saveToDb()) return;
+    saveToDb([this]() {
+        QMessageBox::information(this, "Успех", "Поставка сохранена");
+        emit saved();
 
-    QMessageBox::information(this, "Успех", "Поставка сохранена");
-    emit saved();
-
-    // теперь можно проводить
-    m_postBtn->setEnabled(true);
-    m_cancelBtn->setEnabled(false);
-
-    setWindowTitle(QString("Поставка %1 (DRAFT)").arg(m_numberEdit->text()));
+        setWindowTitle(QString("Поставка %1 (DRAFT)").arg(m_numberEdit->text()));
+    });
 }
 
 void SupplyForm::onPostClicked()
 {
-    if (!m_docService) {
-        QMessageBox::critical(this, "Ошибка", "DocumentService не передан");
+    if (!m_writeQueue) {
+        QMessageBox::critical(this, "Ошибка", "Очередь записи не передана");
         return;
     }
 
@@ -634,28 +419,29 @@ void SupplyForm::onPostClicked()
 
     // перед проведением убедимся что сохранено
     if (!validateForm()) return;
-    recalcTotals();
-    if (!saveToDb()) return;
-
-    if (!m_docService->postDocument(m_documentId)) {
-        QMessageBox::warning(this, "Ошибка", "Не удалось провести документ (проверьте логи и остатки/товары)");
-        return;
-    }
 
-    m_status = "POSTED";
-    QMessageBox::information(this, "Успех", "Документ проведен. Остатки увеличены.");
+    saveToDb([this]() {
+        setBusy(true);
+        m_writeQueue->postDocument(m_documentId).then(this, [this](const WriteResult& r) {
+            setBusy(false);
+            if (!r.ok) {
+                QMessageBox::warning(this, "Ошибка", "Не удалось провести документ:\n" + r.error);
+                return;
+            }
 
-    m_postBtn->setEnabled(false);
-    m_cancelBtn->setEnabled(true);
-    setUiReadOnly(true);
+            m_status = "POSTED";
+            QMessageBox::information(this, "Успех", "Документ проведен. Остатки увеличены.");
+            emit saved();
 
-    loadData(m_documentId); // подтянет статус/сумму
+            loadData(m_documentId); // подтянет статус/сумму
+        });
+    });
 }
 
 void SupplyForm::onCancelDocumentClicked()
 {
-    if (!m_docService) {
-        QMessageBox::critical(this, "Ошибка", "DocumentService не передан");
+    if (!m_writeQueue) {
+        QMessageBox::critical(this, "Ошибка", "Очередь записи не передана");
         return;
     }
 
@@ -664,11 +450,16 @@ void SupplyForm::onCancelDocumentClicked()
     if (QMessageBox::question(this, "Подтвердите", "Отменить документ (storno)?") != QMessageBox::Yes)
         return;
 
-    if (!m_docService->cancelDocument(m_documentId)) {
-        QMessageBox::warning(this, "Ошибка", "Не удалось отменить документ");
-        return;
-    }
+    setBusy(true);
+    m_writeQueue->cancelDocument(m_documentId).then(this, [this](const WriteResult& r) {
+        setBusy(false);
+        if (!r.ok) {
+            QMessageBox::warning(this, "Ошибка", "Не удалось отменить документ:\n" + r.error);
+            return;
+        }
 
-    QMessageBox::information(this, "Успех", "Документ отменен (storno сделано).");
-    loadData(m_documentId);
+        QMessageBox::information(this, "Успех", "Документ отменен (storno сделано).");
+        emit saved();
+        loadData(m_documentId);
+    });
 }
@@ -5,22 +5,26 @@
 #include <QList>
 #include <QString>
 
+#include <functional>
+
 #include "DecimalUtils.h"
+#include "repositories/IDocumentLineRepository.h"
 
 class QLineEdit;
 class QDateEdit;
 class QComboBox;
-class QTableWidget;
+class QTableView;
 class QLabel;
 class QPushButton;
 
-class DocumentService;
+class WriteQueue;
+class DocumentLinesModel;
 
 class SupplyForm : public QDialog
 {
     Q_OBJECT
 public:
-    explicit SupplyForm(DocumentService* docService, QWidget* parent = nullptr);
+    explicit SupplyForm(WriteQueue* writeQueue, QWidget* parent = nullptr);
 
     void loadData(int documentId); // если 0 — режим "Добавить"
 
@@ -33,48 +37,32 @@ private slots:
     void onSaveClicked();
     void onPostClicked();
     void onCancelDocumentClicked();
-    void onLineChanged();
+    void onTotalChanged();
 
 private:
     void setupUi();
     void reloadProducts();
     void reloadCounterparties();
     void setUiReadOnly(bool ro);
+    void setBusy(bool busy);
 
     bool validateForm();
-    void recalcTotals();
-
-    bool saveToDb();
-    bool createDocument();
-    bool updateDocument();
 
-    bool deleteLines(int documentId);
-    bool insertLines(int documentId);
-
-    int currentSelectedProductId(int row) const;
-    double currentQty(int row) const;
-    Decimal productPriceById(int productId) const;
-    QString productNameById(int productId) const;
+    // сохраняет черновик через очередь записи, onSaved вызывается после фиксации
+    void saveToDb(std::function<void()> onSaved);
 
 private:
-    DocumentService* m_docService = nullptr;
+    WriteQueue* m_writeQueue = nullptr;
 
     int m_documentId = 0;
     QString m_status = "DRAFT";
 
-    struct ProductItem {
-        int id = 0;
-        QString name;
-        Decimal price = 0;
-        QString unit = "кг";
-    };
-    QList<ProductItem> m_products;
-
     QLineEdit*   m_numberEdit = nullptr;
     QDateEdit*   m_dateEdit = nullptr;
     QComboBox*   m_senderCombo = nullptr;
 
-    QTableWidget* m_linesTable = nullptr;
+    QTableView*   m_linesView = nullptr;
+    DocumentLinesModel* m_linesModel = nullptr;
     QLabel*       m_totalLabel = nullptr;
 
     QPushButton*  m_addLineBtn = nullptr;
@@ -1,6 +1,12 @@
 #include "TTNForm.h"
 #include "DbManager.h"
+#include "SqlCollation.h"
 #include "DecimalUtils.h"
+#include "WriteQueue.h"
+#include "repositories/StockRepository.h"
+#include "repositories/QueryCache.h"
+#include "models/DocumentLinesModel.h"
+#include "models/DocumentLinesDelegate.h"
 
 #include <QVBoxLayout>
 #include <QHBoxLayout>
@@ -10,8 +16,9 @@
 #include <QDateEdit>
 #include <QComboBox>
 #include <QTextEdit>
-#include <QTableWidget>
+#include <QTableView>
 #include <QHeaderView>
+#include <QItemSelectionModel>
 #include <QPushButton>
 #include <QLabel>
 #include <QMessageBox>
@@ -21,30 +28,17 @@
 #include <QVariant>
 #include <QDate>
 
-
-static double toDoubleSafe(const QString& s)
-{
-    bool ok = false;
-    double v = s.trimmed().replace(',', '.').toDouble(&ok);
-    return ok ? v : 0.0;
-}
-
-static Decimal toDecimalSafe(const QString& s)
-{
-    return decimalFromString(s);
-}
-
 static QString money(const Decimal& v)
 {
     return decimalToString(v);
 }
 
-TtnForm::TtnForm(QWidget *parent)
+TtnForm::TtnForm(WriteQueue* writeQueue, QWidget *parent)
     : QDialog(parent)
+    , m_writeQueue(writeQueue)
 {
     setupUi();
     loadCounterparties();
-    loadProducts();
 }
 
 void TtnForm::setupUi()
@@ -80,19 +74,26 @@ void TtnForm::setupUi()
     auto* linesGroup = new QGroupBox("Товары", this);
     auto* linesLayout = new QVBoxLayout(linesGroup);
 
-    m_linesTable = new QTableWidget(this);
-    m_linesTable->setColumnCount(4);
-    m_linesTable->setHorizontalHeaderLabels(QStringList()
-                                            << "Товар"
-                                            << "Кол-во (кг)"
-                                            << "Цена"
-                                            << "Сумма");
-    m_linesTable->horizontalHeader()->setStretchLastSection(true);
-    m_linesTable->verticalHeader()->setVisible(false);
-    m_linesTable->setSelectionBehavior(QAbstractItemView::SelectRows);
-    m_linesTable->setSelectionMode(QAbstractItemView::SingleSelection);
-
-    linesLayout->addWidget(m_linesTable);
+    // в ТТН цена строки редактируется вручную
+    m_linesModel = new DocumentLinesModel(this);
+    m_linesModel->setPriceEditable(true);
+
+    m_linesView = new QTableView(this);
+    m_linesView->setModel(m_linesModel);
+    m_linesView->setItemDelegate(new DocumentLinesDelegate(m_linesView));
+    m_linesView->hideColumn(DocumentLinesModel::UnitColumn);
+    m_linesView->horizontalHeader()->setStretchLastSection(true);
+    m_linesView->verticalHeader()->setVisible(false);
+    m_linesView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    m_linesView->setSelectionBehavior(QAbstractItemView::SelectRows);
+    m_linesView->setSelectionMode(QAbstractItemView::SingleSelection);
+    m_linesView->setEditTriggers(QAbstractItemView::DoubleClicked
+                                 | QAbstractItemView::SelectedClicked
+                                 | QAbstractItemView::EditKeyPressed
+                                 | QAbstractItemView::AnyKeyPressed);
+    m_linesView->setColumnWidth(DocumentLinesModel::ProductColumn, 300);
+
+    linesLayout->addWidget(m_linesView);
 
     auto* linesButtons = new QHBoxLayout();
     m_addLineButton = new QPushButton("Добавить строку", this);
@@ -105,6 +106,10 @@ void TtnForm::setupUi()
     linesButtons->addWidget(m_totalLabel);
 
     linesLayout->addLayout(linesButtons);
+
+    m_availableLabel = new QLabel(this);
+    linesLayout->addWidget(m_availableLabel);
+
     mainLayout->addWidget(linesGroup);
 
     auto* footer = new QHBoxLayout();
@@ -122,7 +127,56 @@ void TtnForm::setupUi()
     connect(m_saveButton, &QPushButton::clicked, this, &TtnForm::onSaveClicked);
     connect(m_cancelButton, &QPushButton::clicked, this, &TtnForm::onCancelClicked);
 
-    connect(m_linesTable, &QTableWidget::cellChanged, this, &TtnForm::onRecalcTotals);
+    connect(m_linesModel, &DocumentLinesModel::totalChanged, this, &TtnForm::onTotalChanged);
+
+    connect(m_linesView->selectionModel(), &QItemSelectionModel::currentRowChanged,
+            this, &TtnForm::updateAvailableLabel);
+    connect(m_linesModel, &QAbstractItemModel::dataChanged, this, &TtnForm::updateAvailableLabel);
+}
+
+double TtnForm::balanceFor(int productId) const
+{
+    // остатки в памяти потока записи: без запросов к журналу и всегда после последней фиксации
+    if (m_writeQueue && m_writeQueue->timeline().isLoaded())
+        return m_writeQueue->timeline().balance(productId);
+
+    return StockRepository(DbManager::instance().database()).getStockBalance(productId);
+}
+
+double TtnForm::availableFor(int productId) const
+{
+    const double reserved = m_writeQueue ? m_writeQueue->reservations().reservedExcluding(productId, m_docId) : 0.0;
+    return balanceFor(productId) - reserved;
+}
+
+void TtnForm::updateAvailableLabel()
+{
+    const int row = m_linesView->currentIndex().row();
+    if (row < 0 || row >= m_linesModel->rowCount()) {
+        m_availableLabel->clear();
+        return;
+    }
+
+    const int productId = m_linesModel->lineAt(row).productId;
+    if (productId <= 0) {
+        m_availableLabel->clear();
+        return;
+    }
+
+    // сколько этот товар уже занимает в других строках документа
+    double inDocument = 0.0;
+    for (const auto& line : m_linesModel->lines()) {
+        if (line.productId == productId) inDocument += line.qtyKg;
+    }
+
+    const double balance = balanceFor(productId);
+    const double available = availableFor(productId);
+    m_availableLabel->setText(QString("Доступно: %1 кг (остаток %2, в резерве других документов %3), в этой ТТН: %4 кг")
+                                  .arg(QString::number(available, 'f', 3))
+                                  .arg(QString::number(balance, 'f', 3))
+                                  .arg(QString::number(balance - available, 'f', 3))
+                                  .arg(QString::number(inDocument, 'f', 3)));
+    m_availableLabel->setStyleSheet(inDocument > available + 1e-9 ? "color: #b00020;" : QString());
 }
 
 bool TtnForm::loadCounterparties()
@@ -133,16 +187,20 @@ bool TtnForm::loadCounterparties()
     m_senderCombo->clear();
     m_receiverCombo->clear();
 
-    QSqlQuery q(db);
-    if (!q.exec("SELECT id, name, type FROM counterparties WHERE is_active = 1 ORDER BY name")) {
-        QMessageBox::warning(this, "Ошибка БД", q.lastError().text());
+    QString error;
+    const auto rows = QueryCache::instance().select(
+        db, QString("SELECT id, name, type FROM counterparties WHERE is_active = 1 ORDER BY %1")
+                .arg(SqlCollation::orderBy("name")),
+        {}, {"counterparties"}, &error);
+    if (!rows) {
+        QMessageBox::warning(this, "Ошибка БД", error);
         return false;
     }
 
-    while (q.next()) {
-        const int id = q.value(0).toInt();
-        const QString name = q.value(1).toString();
-        const QString type = q.value(2).toString();
+    for (const QVariantList& row : *rows) {
+        const int id = row.at(0).toInt();
+        const QString name = row.at(1).toString();
+        const QString type = row.at(2).toString();
 
         if (type == "supplier" || type == "both") {
             m_senderCombo->addItem(name, id);
@@ -156,106 +214,59 @@ bool TtnForm::loadCounterparties()
 }
 
 bool TtnForm::loadProducts()
-{
-    return true;
-}
-
-void TtnForm::onAddLine()
 {
     QSqlDatabase db = DbManager::instance().database();
-    if (!db.isOpen()) {
-        QMessageBox::critical(this, "Ошибка", "База данных не открыта");
-        return;
-    }
+    if (!db.isOpen()) return false;
 
-    QList<QPair<int, QString>> products;
-    {
-        QSqlQuery q(db);
-        if (!q.exec("SELECT id, name FROM products WHERE is_active = 1 ORDER BY name")) {
-            QMessageBox::warning(this, "Ошибка БД", q.lastError().text());
-            return;
-        }
-        while (q.next()) products.append({q.value(0).toInt(), q.value(1).toString()});
+    // активные товары + товары, уже использованные в строках документа
+    QString error;
+    const auto rows = QueryCache::instance().select(db, QString(R"(
+        SELECT id, name, price, unit
+        FROM products
+        WHERE is_active = 1 OR id IN (SELECT DISTINCT product_id FROM document_lines WHERE document_id = ?)
+        ORDER BY %1
+    )").arg(SqlCollation::orderBy("name")), {m_docId}, {"products", "document_lines"}, &error);
+    if (!rows) {
+        QMessageBox::warning(this, "Ошибка БД", error);
+        return false;
     }
 
-    if (products.isEmpty()) {
-        QMessageBox::warning(this, "Нет данных", "Нет активных товаров");
-        return;
+    QList<DocumentLinesModel::ProductItem> products;
+    for (const QVariantList& row : *rows) {
+        DocumentLinesModel::ProductItem p;
+        p.id = row.at(0).toInt();
+        p.name = row.at(1).toString();
+        p.price = decimalFromVariant(row.at(2));
+        p.unit = row.at(3).toString();
+        products.append(p);
     }
 
-    const int row = m_linesTable->rowCount();
-    m_linesTable->blockSignals(true);
-    m_linesTable->insertRow(row);
-
-    auto* combo = new QComboBox(this);
-    for (auto& p : products) combo->addItem(p.second, p.first);
-    m_linesTable->setCellWidget(row, 0, combo);
-
-    auto* qtyItem = new QTableWidgetItem("0");
-    qtyItem->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
-    m_linesTable->setItem(row, 1, qtyItem);
+    m_linesModel->setProducts(products);
+    return true;
+}
 
-    Decimal price = 0;
-    {
-        QSqlQuery qp(db);
-        qp.prepare("SELECT price FROM products WHERE id = :id");
-        qp.bindValue(":id", combo->currentData());
-        if (qp.exec() && qp.next()) price = decimalFromVariant(qp.value(0));
+void TtnForm::onAddLine()
+{
+    if (m_linesModel->products().isEmpty()) {
+        QMessageBox::warning(this, "Нет данных", "Нет активных товаров");
+        return;
     }
-    auto* priceItem = new QTableWidgetItem(money(price));
-    priceItem->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
-    m_linesTable->setItem(row, 2, priceItem);
-
-    auto* sumItem = new QTableWidgetItem("0.00");
-    sumItem->setFlags(sumItem->flags() & ~Qt::ItemIsEditable);
-    sumItem->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
-    m_linesTable->setItem(row, 3, sumItem);
-
-    connect(combo, &QComboBox::currentIndexChanged, this, [this, row]() {
-        QSqlDatabase db = DbManager::instance().database();
-        if (!db.isOpen()) return;
-        auto* combo = qobject_cast<QComboBox*>(m_linesTable->cellWidget(row, 0));
-        if (!combo) return;
-
-        QSqlQuery qp(db);
-        qp.prepare("SELECT price FROM products WHERE id = :id");
-        qp.bindValue(":id", combo->currentData());
-        if (qp.exec() && qp.next()) {
-            const Decimal price = decimalFromVariant(qp.value(0));
-            m_linesTable->blockSignals(true);
-            m_linesTable->item(row, 2)->setText(money(price));
-            m_linesTable->blockSignals(false);
-            onRecalcTotals();
-        }
-    });
 
-    m_linesTable->blockSignals(false);
-    onRecalcTotals();
+    const int row = m_linesModel->appendLine();
+    m_linesView->setCurrentIndex(m_linesModel->index(row, DocumentLinesModel::ProductColumn));
+    m_linesView->scrollToBottom();
 }
 
 void TtnForm::onRemoveLine()
 {
-    const int row = m_linesTable->currentRow();
+    const int row = m_linesView->currentIndex().row();
     if (row < 0) return;
-    m_linesTable->removeRow(row);
-    onRecalcTotals();
+    m_linesModel->removeRow(row);
 }
 
-void TtnForm::onRecalcTotals()
+void TtnForm::onTotalChanged()
 {
-    Decimal total = 0;
-
-    m_linesTable->blockSignals(true);
-    for (int r = 0; r < m_linesTable->rowCount(); ++r) {
-        const double qty = toDoubleSafe(m_linesTable->item(r, 1)->text());
-        const Decimal price = toDecimalSafe(m_linesTable->item(r, 2)->text());
-        const Decimal sum = price * Decimal(qty);
-        m_linesTable->item(r, 3)->setText(money(sum));
-        total += sum;
-    }
-    m_linesTable->blockSignals(false);
-
-    m_totalLabel->setText("Итого: " + money(total));
+    m_totalLabel->setText("Итого: " + money(m_linesModel->total()));
 }
 
 void TtnForm::loadData(int docId)
@@ -265,8 +276,10 @@ void TtnForm::loadData(int docId)
     m_numberEdit->clear();
     m_dateEdit->setDate(QDate::currentDate());
     m_notesEdit->clear();
-    m_linesTable->setRowCount(0);
-    m_totalLabel->setText("Итого: 0.00");
+    m_linesModel->clear();
+
+    if (!loadProducts())
+        return;
 
     if (m_docId <= 0) {
         setWindowTitle("Добавить ТТН");
@@ -311,37 +324,10 @@ void TtnForm::loadData(int docId)
         m_notesEdit->setPlainText(q.value(5).toString());
     }
 
-    QSet<int> docProductIds;
-    {
-        QSqlQuery q(db);
-        q.prepare("SELECT DISTINCT product_id FROM document_lines WHERE document_id = :id");
-        q.bindValue(":id", m_docId);
-        if (q.exec()) {
-            while (q.next()) docProductIds.insert(q.value(0).toInt());
-        }
-    }
-
-    QList<QPair<int, QString>> products;
-    {
-        QSqlQuery q(db);
-        q.prepare(R"(
-            SELECT id, name
-            FROM products
-            WHERE is_active = 1 OR id IN (SELECT DISTINCT product_id FROM document_lines WHERE document_id = :doc)
-            ORDER BY name
-        )");
-        q.bindValue(":doc", m_docId);
-        if (!q.exec()) {
-            QMessageBox::warning(this, "Ошибка БД", q.lastError().text());
-            return;
-        }
-        while (q.next()) products.append({q.value(0).toInt(), q.value(1).toString()});
-    }
-
     // lines
     {
         QSqlQuery q(db);
-        q.prepare("SELECT product_id, qty_kg, price, line_sum FROM document_lines WHERE document_id = :id ORDER BY id");
+        q.prepare("SELECT id, product_id, qty_kg, price FROM document_lines WHERE document_id = :id ORDER BY id");
         q.bindValue(":id", m_docId);
 
         if (!q.exec()) {
@@ -349,66 +335,18 @@ void TtnForm::loadData(int docId)
             return;
         }
 
-        m_linesTable->blockSignals(true);
-
+        QList<DocumentLinesModel::Line> lines;
         while (q.next()) {
-            const int row = m_linesTable->rowCount();
-            m_linesTable->insertRow(row);
-
-            const int productId = q.value(0).toInt();
-            const double qty = q.value(1).toDouble();
-            const Decimal price = decimalFromVariant(q.value(2));
-
-            auto* combo = new QComboBox(this);
-            for (auto& p : products) combo->addItem(p.second, p.first);
-
-            int idx = combo->findData(productId);
-            if (idx >= 0) {
-                combo->setCurrentIndex(idx);
-            } else {
-                // если товара вообще нет в products (очень редкий случай) — добавим как “не найден”
-                combo->addItem(QString("[не найден ID %1]").arg(productId), productId);
-                combo->setCurrentIndex(combo->count() - 1);
-            }
-
-            m_linesTable->setCellWidget(row, 0, combo);
-
-            auto* qtyItem = new QTableWidgetItem(QString::number(qty, 'f', 3));
-            qtyItem->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
-            m_linesTable->setItem(row, 1, qtyItem);
-
-            auto* priceItem = new QTableWidgetItem(money(price));
-            priceItem->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
-            m_linesTable->setItem(row, 2, priceItem);
-
-            auto* sumItem = new QTableWidgetItem("0.00");
-            sumItem->setFlags(sumItem->flags() & ~Qt::ItemIsEditable);
-            sumItem->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
-            m_linesTable->setItem(row, 3, sumItem);
-
-            connect(combo, &QComboBox::currentIndexChanged, this, [this, row]() {
-                QSqlDatabase db = DbManager::instance().database();
-                if (!db.isOpen()) return;
-                auto* combo = qobject_cast<QComboBox*>(m_linesTable->cellWidget(row, 0));
-                if (!combo) return;
-
-                QSqlQuery qp(db);
-                qp.prepare("SELECT price FROM products WHERE id = :id");
-                qp.bindValue(":id", combo->currentData());
-                if (qp.exec() && qp.next()) {
-                    const Decimal price = decimalFromVariant(qp.value(0));
-                    m_linesTable->blockSignals(true);
-                    m_linesTable->item(row, 2)->setText(money(price));
-                    m_linesTable->blockSignals(false);
-                    onRecalcTotals();
-                }
-            });
+            DocumentLinesModel::Line line;
+            line.id = q.value(0).toInt();
+            line.productId = q.value(1).toInt();
+            line.qtyKg = q.value(2).toDouble();
+            line.price = decimalFromVariant(q.value(3));
+            lines.append(line);
         }
 
-        m_linesTable->blockSignals(false);
+        m_linesModel->setLines(lines);
     }
-
-    onRecalcTotals();
 }
 
 bool TtnForm::validateForm()
@@ -419,32 +357,6 @@ bool TtnForm::validateForm()
         return false;
     }
 
-    // Проверка уникальности номера (для активных, не скрытых документов).
-    // В схеме действует UNIQUE(number, doc_type), поэтому дублирование приведёт к ошибке SQLite.
-    // Лучше перехватить это на уровне формы и показать понятное сообщение.
-    {
-        QSqlDatabase db = DbManager::instance().database();
-        if (!db.isOpen()) {
-            QMessageBox::critical(this, "Ошибка", "База данных не открыта");
-            return false;
-        }
-
-        QSqlQuery q(db);
-        q.prepare("SELECT id FROM documents "
-                  "WHERE doc_type='transfer' AND number = :num AND is_deleted = 0 AND id <> :id "
-                  "LIMIT 1");
-        q.bindValue(":num", number);
-        q.bindValue(":id", m_docId);
-        if (!q.exec()) {
-            QMessageBox::warning(this, "Ошибка БД", q.lastError().text());
-            return false;
-        }
-        if (q.next()) {
-            QMessageBox::warning(this, "Ошибка", "ТТН с таким номером уже существует");
-            return false;
-        }
-    }
-
     if (m_senderCombo->currentIndex() < 0) {
         QMessageBox::warning(this, "Ошибка", "Выберите отправителя");
         return false;
@@ -455,107 +367,30 @@ bool TtnForm::validateForm()
         return false;
     }
 
-    if (m_linesTable->rowCount() <= 0) {
+    if (m_linesModel->rowCount() <= 0) {
         QMessageBox::warning(this, "Ошибка", "Добавьте хотя бы одну строку товара");
         return false;
     }
 
-    for (int r = 0; r < m_linesTable->rowCount(); ++r) {
-        const double qty = toDoubleSafe(m_linesTable->item(r, 1)->text());
-        if (qty <= 0.0) {
+    QHash<int, double> required;
+    for (const auto& line : m_linesModel->lines()) {
+        if (line.qtyKg <= 0.0) {
             QMessageBox::warning(this, "Ошибка", "Количество (кг) должно быть > 0");
             return false;
         }
+        required[line.productId] += line.qtyKg;
     }
 
-    return true;
-}
-
-bool TtnForm::insertDocument(int& outDocId)
-{
-    QSqlDatabase db = DbManager::instance().database();
-    if (!db.isOpen()) return false;
-
-    QSqlQuery q(db);
-    q.prepare("INSERT INTO documents (doc_type, number, date, status, sender_id, receiver_id, total_amount, notes) "
-              "VALUES ('transfer', :number, :date, 'DRAFT', :sender, :receiver, :total, :notes)");
-
-    q.bindValue(":number", m_numberEdit->text().trimmed());
-    q.bindValue(":date", m_dateEdit->date().toString("yyyy-MM-dd"));
-    q.bindValue(":sender", m_senderCombo->currentData().toInt());
-    q.bindValue(":receiver", m_receiverCombo->currentData().toInt());
-    q.bindValue(":total", decimalToString(Decimal(0)));
-    q.bindValue(":notes", m_notesEdit->toPlainText().trimmed());
-
-    if (!q.exec()) {
-        QMessageBox::critical(this, "Ошибка БД", q.lastError().text());
-        return false;
-    }
-
-    outDocId = q.lastInsertId().toInt();
-    return outDocId > 0;
-}
-
-bool TtnForm::updateDocument()
-{
-    QSqlDatabase db = DbManager::instance().database();
-    if (!db.isOpen()) return false;
-
-    QSqlQuery q(db);
-    q.prepare("UPDATE documents SET number=:number, date=:date, sender_id=:sender, receiver_id=:receiver, notes=:notes, "
-              "updated_at=datetime('now') WHERE id=:id AND doc_type='transfer'");
-
-    q.bindValue(":number", m_numberEdit->text().trimmed());
-    q.bindValue(":date", m_dateEdit->date().toString("yyyy-MM-dd"));
-    q.bindValue(":sender", m_senderCombo->currentData().toInt());
-    q.bindValue(":receiver", m_receiverCombo->currentData().toInt());
-    q.bindValue(":notes", m_notesEdit->toPlainText().trimmed());
-    q.bindValue(":id", m_docId);
-
-    if (!q.exec()) {
-        QMessageBox::critical(this, "Ошибка БД", q.lastError().text());
-        return false;
-    }
-
-    return true;
-}
-
-bool TtnForm::saveLines(int docId)
-{
-    QSqlDatabase db = DbManager::instance().database();
-    if (!db.isOpen()) return false;
-
-    {
-        QSqlQuery del(db);
-        del.prepare("DELETE FROM document_lines WHERE document_id = :id");
-        del.bindValue(":id", docId);
-        if (!del.exec()) {
-            QMessageBox::critical(this, "Ошибка БД", del.lastError().text());
-            return false;
-        }
-    }
-
-    QSqlQuery ins(db);
-    ins.prepare("INSERT INTO document_lines (document_id, product_id, qty_kg, price, line_sum) "
-                "VALUES (:doc, :prod, :qty, :price, :sum)");
-
-    for (int r = 0; r < m_linesTable->rowCount(); ++r) {
-        auto* combo = qobject_cast<QComboBox*>(m_linesTable->cellWidget(r, 0));
-        if (!combo) continue;
-
-        const int productId = combo->currentData().toInt();
-        const double qty = toDoubleSafe(m_linesTable->item(r, 1)->text());
-        const Decimal price = toDecimalSafe(m_linesTable->item(r, 2)->text());
-        const Decimal sum = price * Decimal(qty);
-
-        ins.bindValue(":doc", docId);
-        ins.bindValue(":prod", productId);
-        ins.bindValue(":qty", qty);
-        ins.bindValue(":price", decimalToString(price));
-        ins.bindValue(":sum", decimalToString(sum));
-
-        if (!ins.exec()) {
-            QMessageBox::critical(this, "Ошибка БД", ins.lastError().text());
+    // черновик ТТН резервирует товар, поэтому больше доступного сохранить нельзя
+    for (auto it = required.constBegin(); it != required.constEnd(); ++it) {
+        const double available = availableFor(it.key());
+        if (it.value() > available + 1e-9) {
+            const auto* product = m_linesModel->productById(it.key());
+            QMessageBox::warning(this, "Недостаточно товара",
+                                 QString("Товар «%1»: доступно %2 кг, в ТТН %3 кг")
+                                     .arg(product ? product->name : QString::number(it.key()))
+                                     .arg(QString::number(available, 'f', 3))
+                                     .arg(QString::number(it.value(), 'f', 3)));
             return false;
         }
     }
@@ -563,74 +398,43 @@ bool TtnForm::saveLines(int docId)
     return true;
 }
 
-bool TtnForm::recalcAndSaveTotal(int docId)
-{
-    QSqlDatabase db = DbManager::instance().database();
-    if (!db.isOpen()) return false;
-
-    QSqlQuery q(db);
-    q.prepare("SELECT COALESCE(SUM(line_sum), 0) FROM document_lines WHERE document_id = :id");
-    q.bindValue(":id", docId);
-    if (!q.exec() || !q.next()) {
-        QMessageBox::warning(this, "Ошибка БД", q.lastError().text());
-        return false;
-    }
-
-    const Decimal total = decimalFromVariant(q.value(0));
-
-    QSqlQuery upd(db);
-    upd.prepare("UPDATE documents SET total_amount = :t, updated_at=datetime('now') WHERE id = :id");
-    upd.bindValue(":t", decimalToString(total));
-    upd.bindValue(":id", docId);
-
-    if (!upd.exec()) {
-        QMessageBox::warning(this, "Ошибка БД", upd.lastError().text());
-        return false;
-    }
-
-    return true;
-}
-
 void TtnForm::onSaveClicked()
 {
     if (!validateForm())
         return;
 
-    QSqlDatabase db = DbManager::instance().database();
-    if (!db.isOpen()) {
-        QMessageBox::critical(this, "Ошибка", "База данных не открыта");
-        return;
-    }
-
-    if (!db.transaction()) {
-        QMessageBox::warning(this, "Ошибка", "Не удалось начать транзакцию");
-        return;
-    }
-
-    int docId = m_docId;
-
-    bool ok = true;
-    if (docId <= 0) ok = insertDocument(docId);
-    else ok = updateDocument();
-
-    if (ok) ok = saveLines(docId);
-    if (ok) ok = recalcAndSaveTotal(docId);
-
-    if (!ok) {
-        db.rollback();
+    if (!m_writeQueue) {
+        QMessageBox::critical(this, "Ошибка", "Очередь записи не передана");
         return;
     }
 
-    if (!db.commit()) {
-        db.rollback();
-        QMessageBox::warning(this, "Ошибка", "Не удалось зафиксировать изменения");
-        return;
-    }
+    Document doc;
+    doc.id = m_docId;
+    doc.docType = DocumentType::Transfer;
+    doc.number = m_numberEdit->text().trimmed();
+    doc.date = m_dateEdit->date();
+    doc.senderId = m_senderCombo->currentData().toInt();
+    doc.receiverId = m_receiverCombo->currentData().toInt();
+    doc.notes = m_notesEdit->toPlainText().trimmed();
+
+    // Уникальность номера проверяет сервис до начала транзакции.
+    const DocumentLinesDiff diff = m_linesModel->diff();
+
+    // до ответа очереди записи форму не редактируем
+    setEnabled(false);
+    m_writeQueue->saveDraft(doc, diff).then(this, [this](const WriteResult& r) {
+        setEnabled(true);
+        if (!r.ok) {
+            QMessageBox::warning(this, "Ошибка", "Не удалось сохранить ТТН:\n" + r.error);
+            return;
+        }
 
-    m_docId = docId;
+        m_docId = r.id;
+        m_linesModel->markSaved(r.lines);
 
-    emit saved();
-    accept();
+        emit saved();
+        accept();
+    });
 }
 
 void TtnForm::onCancelClicked()
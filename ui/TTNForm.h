@@ -2,21 +2,27 @@
 #define TTNFORM_H
 
 #include <QDialog>
+#include <QHash>
+
+#include "repositories/IDocumentLineRepository.h"
 
 class QLineEdit;
 class QDateEdit;
 class QComboBox;
 class QTextEdit;
-class QTableWidget;
+class QTableView;
 class QPushButton;
 class QLabel;
 
+class WriteQueue;
+class DocumentLinesModel;
+
 class TtnForm : public QDialog
 {
     Q_OBJECT
 
 public:
-    explicit TtnForm(QWidget *parent = nullptr);
+    explicit TtnForm(WriteQueue* writeQueue, QWidget *parent = nullptr);
 
     // docId <= 0 => создание, иначе редактирование
     void loadData(int docId = 0);
@@ -27,7 +33,7 @@ signals:
 private slots:
     void onAddLine();
     void onRemoveLine();
-    void onRecalcTotals();
+    void onTotalChanged();
     void onSaveClicked();
     void onCancelClicked();
 
@@ -38,15 +44,15 @@ private:
     bool loadCounterparties();
     bool loadProducts();
 
-    // работа с БД
-    bool insertDocument(int& outDocId);
-    bool updateDocument();
-    bool saveLines(int docId);
-    bool recalcAndSaveTotal(int docId);
+    double balanceFor(int productId) const;
+    // доступно к отгрузке = остаток - резерв других документов
+    double availableFor(int productId) const;
+    void updateAvailableLabel();
 
     int currentSelectedDocId() const { return m_docId; }
 
 private:
+    WriteQueue* m_writeQueue = nullptr;
     int m_docId = 0;
 
     // header
@@ -57,8 +63,10 @@ private:
     QTextEdit* m_notesEdit = nullptr;
 
     // lines
-    QTableWidget* m_linesTable = nullptr;
+    QTableView* m_linesView = nullptr;
+    DocumentLinesModel* m_linesModel = nullptr;
     QLabel* m_totalLabel = nullptr;
+    QLabel* m_availableLabel = nullptr;
 
     // buttons
     QPushButton* m_addLineButton = nullptr;
@@ -1,5 +1,8 @@
 #include "WriteOffForm.h"
 #include "DbManager.h"
+#include "SqlCollation.h"
+#include "StockReservations.h"
+#include "repositories/QueryCache.h"
 
 #include <QVBoxLayout>
 #include <QHBoxLayout>
@@ -13,16 +16,15 @@
 #include <QLabel>
 
 #include <QSqlDatabase>
-#include <QSqlQuery>
-#include <QSqlError>
 
 static QString fmtKg(double v)
 {
     return QString::number(v, 'f', 3);
 }
 
-WriteOffForm::WriteOffForm(QWidget* parent)
+WriteOffForm::WriteOffForm(const StockReservations* reservations, QWidget* parent)
     : QDialog(parent)
+    , m_reservations(reservations)
 {
     setupUi();
     loadProducts();
@@ -109,34 +111,39 @@ void WriteOffForm::loadProducts()
 {
     m_productCombo->clear();
 
-    QSqlDatabase db = DbManager::instance().database();
-    QSqlQuery q(db);
-
-    const QString sql = R"(
+    const QString sql = QString(R"(
         SELECT
             p.id,
             p.name,
             p.is_active,
-            COALESCE(SUM(im.qty_delta_kg), 0) AS bal
+            COALESCE((SELECT o.balance_kg FROM stock_opening_balances o WHERE o.product_id = p.id), 0)
+          + COALESCE(SUM(im.qty_delta_kg), 0) AS bal
         FROM products p
-        LEFT JOIN inventory_movements im ON im.product_id = p.id
+        LEFT JOIN inventory_movements im ON im.product_id = p.id AND im.cancelled_flag = 0
         GROUP BY p.id, p.name, p.is_active
         HAVING bal > 0.000001
-        ORDER BY p.is_active DESC, p.name ASC
-    )";
-
-    if (!q.exec(sql)) {
-        QMessageBox::warning(this, "Ошибка БД", "Не удалось загрузить товары:\n" + q.lastError().text());
+        ORDER BY p.is_active DESC, %1
+    )").arg(SqlCollation::orderBy("p.name"));
+
+    // резервы вычитаются после кэша: они живут в памяти, а не в таблицах
+    QString error;
+    const auto rows = QueryCache::instance().select(DbManager::instance().database(), sql, {},
+                                                    {"products", "inventory_movements"}, &error);
+    if (!rows) {
+        QMessageBox::warning(this, "Ошибка БД", "Не удалось загрузить товары:\n" + error);
         return;
     }
 
-    while (q.next()) {
-        const int id = q.value(0).toInt();
-        const QString name = q.value(1).toString();
-        const int isActive = q.value(2).toInt();
-        const double bal = q.value(3).toDouble();
+    for (const QVariantList& row : *rows) {
+        const int id = row.at(0).toInt();
+        const QString name = row.at(1).toString();
+        const int isActive = row.at(2).toInt();
+        const double reserved = m_reservations ? m_reservations->reserved(id) : 0.0;
+        const double bal = row.at(3).toDouble() - reserved;
+        if (bal <= 0.000001) continue;
 
         QString title = name + QString(" — %1 кг").arg(fmtKg(bal));
+        if (reserved > 0.0) title += QString(" (резерв %1 кг)").arg(fmtKg(reserved));
         if (isActive != 1) title += " (неактивный)";
 
         m_productCombo->addItem(title, id);
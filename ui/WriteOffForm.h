@@ -9,11 +9,14 @@ class QTextEdit;
 class QPushButton;
 class QLabel;
 
+class StockReservations;
+
 class WriteOffForm : public QDialog
 {
     Q_OBJECT
 public:
-    explicit WriteOffForm(QWidget* parent = nullptr);
+    // reservations: резерв черновиков не даёт списать обещанный товар
+    explicit WriteOffForm(const StockReservations* reservations, QWidget* parent = nullptr);
 
     int productId() const;
     double qtyKg() const;
@@ -31,6 +34,8 @@ private:
     void updateLimitsForCurrentProduct(); // NEW
 
 private:
+    const StockReservations* m_reservations = nullptr;
+
     QComboBox* m_productCombo = nullptr;
     QDoubleSpinBox* m_qtySpin = nullptr;
     QTextEdit* m_reasonEdit = nullptr;
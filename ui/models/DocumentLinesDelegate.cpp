@@ -0,0 +1,124 @@
+#include "DocumentLinesDelegate.h"
+#include "DocumentLinesModel.h"
+#include "widgets/SearchCompleter.h"
+
+#include <QComboBox>
+#include <QDoubleSpinBox>
+#include <QLineEdit>
+#include <QRegularExpressionValidator>
+
+DocumentLinesDelegate::DocumentLinesDelegate(QObject* parent)
+    : QStyledItemDelegate(parent)
+{
+}
+
+QWidget* DocumentLinesDelegate::createEditor(QWidget* parent, const QStyleOptionViewItem& option,
+                                             const QModelIndex& index) const
+{
+    const auto* model = qobject_cast<const DocumentLinesModel*>(index.model());
+    if (!model)
+        return QStyledItemDelegate::createEditor(parent, option, index);
+
+    switch (index.column()) {
+        case DocumentLinesModel::ProductColumn: {
+            auto* cb = new QComboBox(parent);
+            for (const auto& p : model->products())
+                cb->addItem(p.name, p.id);
+
+            // товар можно найти по любому слову названия: подсказки из FTS-индекса
+            cb->setEditable(true);
+            cb->setInsertPolicy(QComboBox::NoInsert);
+            cb->setCompleter(nullptr);
+
+            auto* completer = new SearchCompleter(SearchCompleter::Scope::Products, cb);
+            completer->attach(cb->lineEdit());
+
+            auto* self = const_cast<DocumentLinesDelegate*>(this);
+
+            connect(completer, &SearchCompleter::hitActivated, cb, [self, cb](const SearchHit& hit) {
+                int idx = cb->findData(hit.id);
+                if (idx < 0) {
+                    cb->addItem(hit.title, hit.id);
+                    idx = cb->count() - 1;
+                }
+                cb->setCurrentIndex(idx);
+                emit self->commitData(cb);
+                emit self->closeEditor(cb);
+            });
+
+            // выбор товара сразу фиксируем, без лишнего Enter
+            connect(cb, &QComboBox::activated, this, [self, cb]() {
+                emit self->commitData(cb);
+                emit self->closeEditor(cb);
+            });
+            return cb;
+        }
+        case DocumentLinesModel::QtyColumn: {
+            auto* sp = new QDoubleSpinBox(parent);
+            sp->setDecimals(3);
+            sp->setMinimum(0.0);
+            sp->setMaximum(1e9);
+            return sp;
+        }
+        case DocumentLinesModel::PriceColumn: {
+            auto* edit = new QLineEdit(parent);
+            edit->setValidator(new QRegularExpressionValidator(
+                QRegularExpression(R"(^\d+(?:[.,]\d{0,2})?$)"), edit));
+            return edit;
+        }
+        default:
+            return nullptr;
+    }
+}
+
+void DocumentLinesDelegate::setEditorData(QWidget* editor, const QModelIndex& index) const
+{
+    const QVariant value = index.data(Qt::EditRole);
+
+    if (auto* cb = qobject_cast<QComboBox*>(editor)) {
+        const int idx = cb->findData(value.toInt());
+        if (idx >= 0) {
+            cb->setCurrentIndex(idx);
+        } else if (value.toInt() > 0) {
+            // товар строки отсутствует в справочнике (например, деактивирован)
+            cb->addItem(index.data(Qt::DisplayRole).toString(), value.toInt());
+            cb->setCurrentIndex(cb->count() - 1);
+        }
+        return;
+    }
+    if (auto* sp = qobject_cast<QDoubleSpinBox*>(editor)) {
+        sp->setValue(value.toDouble());
+        return;
+    }
+    if (auto* edit = qobject_cast<QLineEdit*>(editor)) {
+        edit->setText(value.toString());
+        return;
+    }
+    QStyledItemDelegate::setEditorData(editor, index);
+}
+
+void DocumentLinesDelegate::setModelData(QWidget* editor, QAbstractItemModel* model,
+                                         const QModelIndex& index) const
+{
+    if (auto* cb = qobject_cast<QComboBox*>(editor)) {
+        model->setData(index, cb->currentData(), Qt::EditRole);
+        return;
+    }
+    if (auto* sp = qobject_cast<QDoubleSpinBox*>(editor)) {
+        sp->interpretText();
+        model->setData(index, sp->value(), Qt::EditRole);
+        return;
+    }
+    if (auto* edit = qobject_cast<QLineEdit*>(editor)) {
+        model->setData(index, edit->text(), Qt::EditRole);
+        return;
+    }
+    QStyledItemDelegate::setModelData(editor, model, index);
+}
+
+void DocumentLinesDelegate::updateEditorGeometry(QWidget* editor, const QStyleOptionViewItem& option,
+                                                 const QModelIndex& index) const
+{
+    Q_UNUSED(index)
+    editor->setGeometry(option.rect);
+}
@@ -0,0 +1,28 @@
+#ifndef DOCUMENTLINESDELEGATE_H
+#define DOCUMENTLINESDELEGATE_H
+
+#include <QStyledItemDelegate>
+
+/**
+ * @brief Редакторы ячеек DocumentLinesModel
+ *
+ * Виджет-редактор создаётся только для ячейки, которую сейчас правят,
+ * поэтому размер документа не влияет на число живых виджетов.
+ */
+class DocumentLinesDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+
+public:
+    explicit DocumentLinesDelegate(QObject* parent = nullptr);
+
+    QWidget* createEditor(QWidget* parent, const QStyleOptionViewItem& option,
+                          const QModelIndex& index) const override;
+    void setEditorData(QWidget* editor, const QModelIndex& index) const override;
+    void setModelData(QWidget* editor, QAbstractItemModel* model,
+                      const QModelIndex& index) const override;
+    void updateEditorGeometry(QWidget* editor, const QStyleOptionViewItem& option,
+                              const QModelIndex& index) const override;
+};
+
+#endif // DOCUMENTLINESDELEGATE_H
@@ -0,0 +1,325 @@
+#include "DocumentLinesModel.h"
+
+#include <QSet>
+
+DocumentLinesModel::DocumentLinesModel(QObject* parent)
+    : QAbstractTableModel(parent)
+{
+}
+
+int DocumentLinesModel::rowCount(const QModelIndex& parent) const
+{
+    if (parent.isValid()) return 0;
+    return m_lines.size();
+}
+
+int DocumentLinesModel::columnCount(const QModelIndex& parent) const
+{
+    if (parent.isValid()) return 0;
+    return ColumnCount;
+}
+
+QString DocumentLinesModel::productName(int productId) const
+{
+    if (const ProductItem* p = productById(productId))
+        return p->name;
+    if (productId <= 0)
+        return {};
+    return QString("[не найден ID %1]").arg(productId);
+}
+
+const DocumentLinesModel::ProductItem* DocumentLinesModel::productById(int productId) const
+{
+    const auto it = m_productIndex.constFind(productId);
+    if (it == m_productIndex.constEnd())
+        return nullptr;
+    return &m_products.at(it.value());
+}
+
+QVariant DocumentLinesModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_lines.size())
+        return {};
+
+    const Line& line = m_lines.at(index.row());
+
+    if (role == Qt::DisplayRole) {
+        switch (index.column()) {
+            case ProductColumn: return productName(line.productId);
+            case QtyColumn:     return QString::number(line.qtyKg, 'f', 3);
+            case PriceColumn:   return decimalToString(line.price);
+            case SumColumn:     return decimalToString(line.lineSum);
+            case UnitColumn: {
+                const ProductItem* p = productById(line.productId);
+                return p ? p->unit : QString("кг");
+            }
+            default: return {};
+        }
+    }
+
+    if (role == Qt::EditRole) {
+        switch (index.column()) {
+            case ProductColumn: return line.productId;
+            case QtyColumn:     return line.qtyKg;
+            case PriceColumn:   return decimalToString(line.price);
+            default: return {};
+        }
+    }
+
+    if (role == ProductIdRole)
+        return line.productId;
+
+    if (role == Qt::TextAlignmentRole && index.column() != ProductColumn)
+        return QVariant(int(Qt::AlignRight | Qt::AlignVCenter));
+
+    return {};
+}
+
+bool DocumentLinesModel::setData(const QModelIndex& index, const QVariant& value, int role)
+{
+    if (!index.isValid() || role != Qt::EditRole || m_readOnly)
+        return false;
+
+    const int row = index.row();
+    if (row < 0 || row >= m_lines.size())
+        return false;
+
+    Line updated = m_lines.at(row);
+
+    switch (index.column()) {
+        case ProductColumn: {
+            const int productId = value.toInt();
+            if (productId == updated.productId) return false;
+            updated.productId = productId;
+            // при смене товара цена всегда подтягивается из справочника
+            const ProductItem* p = productById(productId);
+            updated.price = p ? p->price : Decimal(0);
+            break;
+        }
+        case QtyColumn: {
+            const double qty = value.toDouble();
+            if (qty < 0.0 || qty == updated.qtyKg) return false;
+            updated.qtyKg = qty;
+            break;
+        }
+        case PriceColumn: {
+            if (!m_priceEditable) return false;
+            const Decimal price = decimalFromVariant(value);
+            if (price < 0 || price == updated.price) return false;
+            updated.price = price;
+            break;
+        }
+        default:
+            return false;
+    }
+
+    applyLineChange(row, updated);
+    return true;
+}
+
+void DocumentLinesModel::applyLineChange(int row, const Line& updated)
+{
+    Line& line = m_lines[row];
+    const Decimal oldSum = line.lineSum;
+
+    line = updated;
+    line.lineSum = line.price * Decimal(line.qtyKg);
+
+    // итог меняется только на разницу сумм строки
+    m_total += line.lineSum - oldSum;
+
+    emit dataChanged(index(row, ProductColumn), index(row, UnitColumn));
+    if (line.lineSum != oldSum)
+        emit totalChanged();
+}
+
+Qt::ItemFlags DocumentLinesModel::flags(const QModelIndex& index) const
+{
+    if (!index.isValid())
+        return Qt::NoItemFlags;
+
+    Qt::ItemFlags f = Qt::ItemIsSelectable | Qt::ItemIsEnabled;
+    if (m_readOnly)
+        return f;
+
+    switch (index.column()) {
+        case ProductColumn:
+        case QtyColumn:
+            f |= Qt::ItemIsEditable;
+            break;
+        case PriceColumn:
+            if (m_priceEditable) f |= Qt::ItemIsEditable;
+            break;
+        default:
+            break;
+    }
+    return f;
+}
+
+QVariant DocumentLinesModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return {};
+
+    switch (section) {
+        case ProductColumn: return "Товар";
+        case QtyColumn:     return "Кол-во (кг)";
+        case PriceColumn:   return "Цена";
+        case SumColumn:     return "Сумма";
+        case UnitColumn:    return "Ед.";
+        default: return {};
+    }
+}
+
+bool DocumentLinesModel::removeRows(int row, int count, const QModelIndex& parent)
+{
+    if (parent.isValid() || count <= 0 || row < 0 || row + count > m_lines.size())
+        return false;
+
+    Decimal removedSum = 0;
+    for (int r = row; r < row + count; ++r)
+        removedSum += m_lines.at(r).lineSum;
+
+    beginRemoveRows(QModelIndex(), row, row + count - 1);
+    m_lines.remove(row, count);
+    endRemoveRows();
+
+    if (removedSum != 0) {
+        m_total -= removedSum;
+        emit totalChanged();
+    }
+    return true;
+}
+
+void DocumentLinesModel::setProducts(const QList<ProductItem>& products)
+{
+    beginResetModel();
+    m_products = products;
+    m_productIndex.clear();
+    m_productIndex.reserve(m_products.size());
+    for (int i = 0; i < m_products.size(); ++i)
+        m_productIndex.insert(m_products.at(i).id, i);
+    endResetModel();
+}
+
+void DocumentLinesModel::setPriceEditable(bool editable)
+{
+    m_priceEditable = editable;
+}
+
+void DocumentLinesModel::setReadOnly(bool readOnly)
+{
+    m_readOnly = readOnly;
+}
+
+void DocumentLinesModel::setLines(const QList<Line>& lines)
+{
+    beginResetModel();
+    m_lines.clear();
+    m_lines.reserve(lines.size());
+    m_total = 0;
+    for (Line line : lines) {
+        line.lineSum = line.price * Decimal(line.qtyKg);
+        m_total += line.lineSum;
+        m_lines.append(line);
+    }
+    resetOriginal();
+    endResetModel();
+    emit totalChanged();
+}
+
+int DocumentLinesModel::appendLine(int productId)
+{
+    Line line;
+    if (productId <= 0 && !m_products.isEmpty())
+        productId = m_products.first().id;
+    line.productId = productId;
+    if (const ProductItem* p = productById(productId))
+        line.price = p->price;
+
+    const int row = m_lines.size();
+    beginInsertRows(QModelIndex(), row, row);
+    m_lines.append(line);
+    endInsertRows();
+    return row;
+}
+
+void DocumentLinesModel::clear()
+{
+    beginResetModel();
+    m_lines.clear();
+    m_original.clear();
+    m_total = 0;
+    endResetModel();
+    emit totalChanged();
+}
+
+bool DocumentLinesModel::isPersistable(const Line& line, double minQtyKg)
+{
+    return line.productId > 0 && line.qtyKg >= minQtyKg;
+}
+
+void DocumentLinesModel::resetOriginal()
+{
+    m_original.clear();
+    m_original.reserve(m_lines.size());
+    for (const auto& line : m_lines) {
+        if (line.id > 0)
+            m_original.insert(line.id, line);
+    }
+}
+
+DocumentLinesDiff DocumentLinesModel::diff(double minQtyKg) const
+{
+    DocumentLinesDiff d;
+    QSet<int> kept;
+    kept.reserve(m_lines.size());
+
+    for (const auto& line : m_lines) {
+        if (!isPersistable(line, minQtyKg))
+            continue;
+
+        DocumentLine dl;
+        dl.id = line.id;
+        dl.productId = line.productId;
+        dl.qtyKg = line.qtyKg;
+        dl.price = line.price;
+        dl.lineSum = line.lineSum;
+
+        if (line.id <= 0) {
+            d.inserted.append(dl);
+            continue;
+        }
+
+        kept.insert(line.id);
+        const auto it = m_original.constFind(line.id);
+        if (it == m_original.constEnd()
+            || it->productId != line.productId
+            || it->qtyKg != line.qtyKg
+            || it->price != line.price) {
+            d.updated.append(dl);
+        }
+    }
+
+    for (auto it = m_original.constBegin(); it != m_original.constEnd(); ++it) {
+        if (!kept.contains(it.key()))
+            d.deletedIds.append(it.key());
+    }
+
+    return d;
+}
+
+void DocumentLinesModel::markSaved(const DocumentLinesDiff& applied, double minQtyKg)
+{
+    // вставленные строки идут в diff() в порядке строк модели
+    int next = 0;
+    for (auto& line : m_lines) {
+        if (!isPersistable(line, minQtyKg)) {
+            line.id = 0;
+            continue;
+        }
+        if (line.id <= 0 && next < applied.inserted.size())
+            line.id = applied.inserted.at(next++).id;
+    }
+    resetOriginal();
+}
@@ -0,0 +1,113 @@
+#ifndef DOCUMENTLINESMODEL_H
+#define DOCUMENTLINESMODEL_H
+
+#include <QAbstractTableModel>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QVector>
+
+#include "DecimalUtils.h"
+#include "repositories/IDocumentLineRepository.h"
+
+/**
+ * @brief Модель строк документа (поставка, ТТН)
+ *
+ * Хранит строки в плоском векторе, итог документа пересчитывается
+ * по разнице сумм изменённой строки, а не обходом всей таблицы.
+ */
+class DocumentLinesModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum Column {
+        ProductColumn = 0,
+        QtyColumn,
+        PriceColumn,
+        SumColumn,
+        UnitColumn,
+        ColumnCount
+    };
+
+    enum Role {
+        ProductIdRole = Qt::UserRole + 1
+    };
+
+    struct ProductItem {
+        int id = 0;
+        QString name;
+        Decimal price = 0;
+        QString unit = "кг";
+    };
+
+    struct Line {
+        int id = 0;            // id строки в document_lines, 0 — новая строка
+        int productId = 0;
+        double qtyKg = 0.0;
+        Decimal price = 0;
+        Decimal lineSum = 0;
+    };
+
+    explicit DocumentLinesModel(QObject* parent = nullptr);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    bool setData(const QModelIndex& index, const QVariant& value, int role = Qt::EditRole) override;
+    Qt::ItemFlags flags(const QModelIndex& index) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    bool removeRows(int row, int count, const QModelIndex& parent = QModelIndex()) override;
+
+    // справочник товаров для выбора в строке
+    void setProducts(const QList<ProductItem>& products);
+    const QList<ProductItem>& products() const { return m_products; }
+    const ProductItem* productById(int productId) const;
+
+    // ТТН: цена редактируется вручную; поставка: цена берётся из справочника
+    void setPriceEditable(bool editable);
+    void setReadOnly(bool readOnly);
+    bool isReadOnly() const { return m_readOnly; }
+
+    void setLines(const QList<Line>& lines);
+    const QVector<Line>& lines() const { return m_lines; }
+    const Line& lineAt(int row) const { return m_lines.at(row); }
+
+    int appendLine(int productId = 0);
+    void clear();
+
+    Decimal total() const { return m_total; }
+
+    /**
+     * @brief Изменения относительно последних setLines()/markSaved()
+     *
+     * Строки без товара или с количеством меньше minQtyKg не сохраняются:
+     * новые пропускаются, ранее сохранённые попадают в удалённые.
+     */
+    DocumentLinesDiff diff(double minQtyKg = 0.0) const;
+
+    // зафиксировать применённый diff: проставить id новым строкам
+    void markSaved(const DocumentLinesDiff& applied, double minQtyKg = 0.0);
+
+signals:
+    void totalChanged();
+
+private:
+    void applyLineChange(int row, const Line& updated);
+    static bool isPersistable(const Line& line, double minQtyKg);
+    void resetOriginal();
+    QString productName(int productId) const;
+
+private:
+    QList<ProductItem> m_products;
+    QHash<int, int> m_productIndex;   // product id -> позиция в m_products
+
+    QVector<Line> m_lines;
+    QHash<int, Line> m_original;      // id строки -> состояние в БД
+    Decimal m_total = 0;
+
+    bool m_priceEditable = false;
+    bool m_readOnly = false;
+};
+
+#endif // DOCUMENTLINESMODEL_H
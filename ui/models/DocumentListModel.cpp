@@ -0,0 +1,388 @@
+#include "DocumentListModel.h"
+#include "ReadPool.h"
+#include "ChangeTracker.h"
+#include "repositories/SqlBatch.h"
+
+#include <QColor>
+#include <QSet>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QTimer>
+#include <QLoggingCategory>
+
+#include <algorithm>
+
+Q_LOGGING_CATEGORY(documentListModel, "ui.documentlist")
+
+namespace {
+
+QString docTypeToDb(DocumentType type)
+{
+    Document d;
+    d.docType = type;
+    return d.docTypeString();
+}
+
+} // namespace
+
+DocumentListModel::DocumentListModel(DocumentType docType, QObject* parent)
+    : QAbstractTableModel(parent)
+    , m_docType(docType)
+{
+}
+
+int DocumentListModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : m_rows.size();
+}
+
+int DocumentListModel::columnCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant DocumentListModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_rows.size())
+        return {};
+
+    const Row& row = m_rows[index.row()];
+
+    switch (role) {
+        case IdRole:     return row.id;
+        case StatusRole: return row.status;
+        default: break;
+    }
+
+    if (role == Qt::DisplayRole) {
+        switch (index.column()) {
+            case NumberColumn:   return row.number;
+            case DateColumn:     return row.date;
+            case StatusColumn:   return row.status;
+            case SenderColumn:   return row.senderName;
+            case ReceiverColumn: return row.receiverName;
+            case LinesColumn:    return row.lineCount;
+            case QtyColumn:      return row.qtyText;
+            case TotalColumn:    return row.total;
+            case NotesColumn:    return row.notes;
+            default: return {};
+        }
+    }
+
+    if (role == Qt::TextAlignmentRole) {
+        if (index.column() == LinesColumn) return QVariant(int(Qt::AlignCenter));
+        if (index.column() == QtyColumn || index.column() == TotalColumn)
+            return QVariant(int(Qt::AlignRight | Qt::AlignVCenter));
+    }
+
+    if (role == Qt::ForegroundRole) {
+        static const QVariant gray = QColor(Qt::gray);
+        if (row.status == QLatin1String("CANCELLED")) return gray;
+    }
+
+    return {};
+}
+
+QVariant DocumentListModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return {};
+
+    switch (section) {
+        case NumberColumn:   return "Номер";
+        case DateColumn:     return "Дата";
+        case StatusColumn:   return "Статус";
+        case SenderColumn:   return m_docType == DocumentType::Supply ? "Поставщик" : "Отправитель";
+        case ReceiverColumn: return "Получатель";
+        case LinesColumn:    return "Строк";
+        case QtyColumn:      return "Вес (кг)";
+        case TotalColumn:    return "Сумма";
+        case NotesColumn:    return "Примечание";
+        default: return {};
+    }
+}
+
+bool DocumentListModel::canFetchMore(const QModelIndex& parent) const
+{
+    return !parent.isValid() && !m_atEnd && !m_loading;
+}
+
+void DocumentListModel::fetchMore(const QModelIndex& parent)
+{
+    if (parent.isValid()) return;
+    requestPage();
+}
+
+int DocumentListModel::documentIdAt(int row) const
+{
+    return (row >= 0 && row < m_rows.size()) ? m_rows[row].id : 0;
+}
+
+QString DocumentListModel::statusAt(int row) const
+{
+    return (row >= 0 && row < m_rows.size()) ? m_rows[row].status : QString();
+}
+
+void DocumentListModel::refresh()
+{
+    beginResetModel();
+    m_rows.clear();
+    m_dateById.clear();
+    m_atEnd = false;
+    m_loading = false;
+    m_loadedVersion = -1;
+    ++m_generation;
+    endResetModel();
+
+    requestPage();
+}
+
+void DocumentListModel::refreshIfChanged()
+{
+    const quint64 generation = m_generation;
+
+    ReadPool::instance().run<qint64>([](QSqlDatabase db) {
+        return ChangeTracker::version(db, changeTables());
+    }).then(this, [this, generation](qint64 version) {
+        if (generation != m_generation) return;
+        if (ChangeTracker::isStale(m_loadedVersion, version))
+            refresh();
+    });
+}
+
+const QStringList& DocumentListModel::changeTables()
+{
+    // строки документов в списке не читаются, их итоги ведут триггеры в documents
+    static const QStringList tables = {"documents", "counterparties"};
+    return tables;
+}
+
+void DocumentListModel::requestPage()
+{
+    if (m_loading || m_atEnd) return;
+
+    m_loading = true;
+    emit loadingChanged(true);
+
+    const DocumentType docType = m_docType;
+    const quint64 generation = m_generation;
+    const QString afterDate = m_rows.isEmpty() ? QString() : m_rows.last().date;
+    const int afterId = m_rows.isEmpty() ? 0 : m_rows.last().id;
+
+    ReadPool::instance().run<Page>([docType, afterDate, afterId, generation](QSqlDatabase db) {
+        return loadPage(db, docType, afterDate, afterId, generation);
+    }).then(this, [this](const Page& page) {
+        if (page.generation != m_generation) return;
+
+        m_loading = false;
+        if (page.failed) {
+            // список не закончен: ту же страницу запросим снова (или раньше — при прокрутке)
+            emit loadingChanged(false);
+            QTimer::singleShot(kRetryMs, this, [this, generation = page.generation]() {
+                if (generation == m_generation) requestPage();
+            });
+            return;
+        }
+
+        m_atEnd = page.atEnd;
+        if (m_rows.isEmpty())
+            m_loadedVersion = page.version;
+
+        if (!page.rows.isEmpty()) {
+            const int first = m_rows.size();
+            beginInsertRows(QModelIndex(), first, first + page.rows.size() - 1);
+            for (const Row& row : page.rows) {
+                m_rows.append(row);
+                m_dateById.insert(row.id, row.date);
+            }
+            endInsertRows();
+        }
+        emit loadingChanged(false);
+    });
+}
+
+void DocumentListModel::reloadDocuments(const QList<int>& documentIds)
+{
+    if (documentIds.isEmpty()) return;
+
+    const DocumentType docType = m_docType;
+    const quint64 generation = m_generation;
+
+    ReadPool::instance().run<std::optional<QList<Row>>>([docType, documentIds](QSqlDatabase db) {
+        return loadRows(db, docType, documentIds);
+    }).then(this, [this, documentIds, generation](const std::optional<QList<Row>>& rows) {
+        // после полного перечитывания строки и так актуальны
+        if (generation != m_generation || !rows) return;
+        applyReloaded(documentIds, *rows);
+    });
+}
+
+void DocumentListModel::applyReloaded(const QList<int>& documentIds, const QList<Row>& rows)
+{
+    QSet<int> found;
+
+    for (const Row& row : rows) {
+        found.insert(row.id);
+
+        const int existing = rowOf(row.id);
+        if (existing >= 0 && m_rows[existing].date == row.date) {
+            m_rows[existing] = row;
+            emit dataChanged(index(existing, 0), index(existing, ColumnCount - 1));
+            continue;
+        }
+
+        // дата изменилась — строка переезжает на новое место
+        if (existing >= 0)
+            removeRowAt(existing);
+
+        // ниже загруженного хвоста — её принесёт обычная дозагрузка
+        if (!m_atEnd && !m_rows.isEmpty() && !isBefore(row, m_rows.last()))
+            continue;
+
+        const auto pos = std::lower_bound(m_rows.begin(), m_rows.end(), row, &DocumentListModel::isBefore);
+        insertRow(int(pos - m_rows.begin()), row);
+    }
+
+    // не вернулись — удалены, скрыты или другого типа
+    for (int id : documentIds) {
+        if (found.contains(id)) continue;
+
+        const int existing = rowOf(id);
+        if (existing >= 0)
+            removeRowAt(existing);
+    }
+}
+
+void DocumentListModel::insertRow(int at, const Row& row)
+{
+    beginInsertRows(QModelIndex(), at, at);
+    m_rows.insert(at, row);
+    m_dateById.insert(row.id, row.date);
+    endInsertRows();
+}
+
+void DocumentListModel::removeRowAt(int at)
+{
+    beginRemoveRows(QModelIndex(), at, at);
+    m_dateById.remove(m_rows.at(at).id);
+    m_rows.removeAt(at);
+    endRemoveRows();
+}
+
+int DocumentListModel::rowOf(int documentId) const
+{
+    const auto date = m_dateById.constFind(documentId);
+    if (date == m_dateById.cend()) return -1;
+
+    Row key;
+    key.id = documentId;
+    key.date = date.value();
+    const auto pos = std::lower_bound(m_rows.cbegin(), m_rows.cend(), key, &DocumentListModel::isBefore);
+    return pos != m_rows.cend() && pos->id == documentId ? int(pos - m_rows.cbegin()) : -1;
+}
+
+bool DocumentListModel::isBefore(const Row& a, const Row& b)
+{
+    if (a.date != b.date) return a.date > b.date;
+    return a.id > b.id;
+}
+
+QString DocumentListModel::selectSql()
+{
+    return R"(
+        SELECT
+            d.id, d.number, d.date, d.status,
+            cs.name, cr.name, d.total_amount, d.notes,
+            d.line_count, d.total_qty_kg
+        FROM documents d
+        LEFT JOIN counterparties cs ON cs.id = d.sender_id
+        LEFT JOIN counterparties cr ON cr.id = d.receiver_id
+        WHERE d.doc_type = :type AND d.is_deleted = 0
+    )";
+}
+
+DocumentListModel::Row DocumentListModel::rowFromQuery(const QSqlQuery& q)
+{
+    Row row;
+    row.id = q.value(0).toInt();
+    row.number = q.value(1).toString();
+    row.date = q.value(2).toString();
+    row.status = q.value(3).toString();
+    row.senderName = q.value(4).toString();
+    row.receiverName = q.value(5).toString();
+    row.total = q.value(6).toString();
+    row.notes = q.value(7).toString();
+    row.lineCount = q.value(8).toInt();
+    row.qtyText = QString::number(q.value(9).toDouble(), 'f', 3);
+    return row;
+}
+
+DocumentListModel::Page DocumentListModel::loadPage(QSqlDatabase db, DocumentType docType,
+                                                    const QString& afterDate, int afterId, quint64 generation)
+{
+    Page page;
+    page.generation = generation;
+
+    // версию — до данных (см. ChangeTracker)
+    if (afterDate.isEmpty())
+        page.version = ChangeTracker::version(db, changeTables());
+
+    QString sql = selectSql();
+    if (!afterDate.isEmpty())
+        sql += " AND (d.date < :afterDate OR (d.date = :afterDate AND d.id < :afterId))";
+    sql += " ORDER BY d.date DESC, d.id DESC LIMIT :limit";
+
+    QSqlQuery q(db);
+    q.setForwardOnly(true);
+    q.prepare(sql);
+    q.bindValue(":type", docTypeToDb(docType));
+    if (!afterDate.isEmpty()) {
+        q.bindValue(":afterDate", afterDate);
+        q.bindValue(":afterId", afterId);
+    }
+    q.bindValue(":limit", kPageSize);
+
+    if (!q.exec()) {
+        qWarning(documentListModel) << "DocumentListModel::loadPage SQL error:" << q.lastError().text();
+        page.failed = true;
+        return page;
+    }
+
+    while (q.next())
+        page.rows.append(rowFromQuery(q));
+
+    page.atEnd = page.rows.size() < kPageSize;
+    return page;
+}
+
+std::optional<QList<DocumentListModel::Row>> DocumentListModel::loadRows(QSqlDatabase db, DocumentType docType,
+                                                          const QList<int>& documentIds)
+{
+    QList<Row> rows;
+
+    for (qsizetype offset = 0; offset < documentIds.size(); offset += kSqlMaxBatchIds) {
+        const QList<int> batch = documentIds.mid(offset, kSqlMaxBatchIds);
+
+        // именованные и позиционные параметры в одном запросе Qt не смешивает
+        QString sql = selectSql();
+        QStringList names;
+        for (qsizetype i = 0; i < batch.size(); ++i) names.append(QString(":id%1").arg(i));
+        sql += QString(" AND d.id IN (%1)").arg(names.join(", "));
+
+        QSqlQuery q(db);
+        q.setForwardOnly(true);
+        q.prepare(sql);
+        q.bindValue(":type", docTypeToDb(docType));
+        for (qsizetype i = 0; i < batch.size(); ++i) q.bindValue(names.at(i), batch.at(i));
+
+        if (!q.exec()) {
+            qWarning(documentListModel) << "DocumentListModel::loadRows SQL error:" << q.lastError().text();
+            return std::nullopt;
+        }
+
+        while (q.next())
+            rows.append(rowFromQuery(q));
+    }
+
+    return rows;
+}
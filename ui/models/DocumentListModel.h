@@ -0,0 +1,136 @@
+#ifndef DOCUMENTLISTMODEL_H
+#define DOCUMENTLISTMODEL_H
+
+#include <QAbstractTableModel>
+#include <QHash>
+#include <QList>
+#include <QSqlDatabase>
+#include <QString>
+#include <QStringList>
+
+#include <optional>
+
+#include "repositories/IDocumentRepository.h"
+
+class QSqlQuery;
+
+/**
+ * @brief Список документов одного типа (поставки, ТТН)
+ *
+ * Имена контрагентов подтягиваются одним JOIN при чтении страницы.
+ * Сумма, число строк и вес — готовые столбцы documents (их ведут триггеры),
+ * строки документов для списка не читаются.
+ * Страницы грузятся в ReadPool по ключу (date, id) — так же, как журнал
+ * движений, — поэтому список на 100k+ документов открывается сразу.
+ *
+ * После проведения/отмены/удаления перечитываются только затронутые
+ * документы (reloadDocuments): строка обновляется, вставляется на своё
+ * место или убирается из списка. Строку по id находит rowOf() — по дате
+ * из m_dateById двоичным поиском, как в журнале движений.
+ *
+ * «Обновить» (refreshIfChanged) сначала сверяет счётчики изменений
+ * documents и counterparties с прочитанными при загрузке и, если они не
+ * сдвинулись, список не перечитывает.
+ */
+class DocumentListModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum Column {
+        NumberColumn = 0,
+        DateColumn,
+        StatusColumn,
+        SenderColumn,
+        ReceiverColumn,
+        LinesColumn,
+        QtyColumn,
+        TotalColumn,
+        NotesColumn,
+        ColumnCount
+    };
+
+    enum Role {
+        IdRole = Qt::UserRole + 1,
+        StatusRole                  // DRAFT / POSTED / CANCELLED
+    };
+
+    struct Row {
+        int id = 0;
+        QString number;
+        QString date;               // ISO, ключ сортировки
+        QString status;
+        QString senderName;
+        QString receiverName;
+        int lineCount = 0;
+        QString qtyText;
+        QString total;
+        QString notes;
+    };
+
+    struct Page {
+        quint64 generation = 0;
+        qint64 version = -1;        // ChangeTracker; читается только для первой страницы
+        QList<Row> rows;
+        bool atEnd = false;
+        bool failed = false;        // ошибка чтения — это не конец списка
+    };
+
+    static constexpr int kPageSize = 200;
+    static constexpr int kRetryMs = 3000;   // повтор страницы после ошибки чтения
+
+    explicit DocumentListModel(DocumentType docType, QObject* parent = nullptr);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+    bool canFetchMore(const QModelIndex& parent) const override;
+    void fetchMore(const QModelIndex& parent) override;
+
+    DocumentType docType() const { return m_docType; }
+
+    void refresh();
+
+    // «Обновить»: перечитать, только если документы или контрагенты менялись после загрузки
+    void refreshIfChanged();
+
+    // перечитать указанные документы и обновить только их строки
+    void reloadDocuments(const QList<int>& documentIds);
+
+    int documentIdAt(int row) const;
+    QString statusAt(int row) const;
+
+signals:
+    void loadingChanged(bool loading);
+
+private:
+    void requestPage();
+    void applyReloaded(const QList<int>& documentIds, const QList<Row>& rows);
+    void insertRow(int at, const Row& row);
+    void removeRowAt(int at);
+    int rowOf(int documentId) const;
+
+    static const QStringList& changeTables();
+    static QString selectSql();
+    static Row rowFromQuery(const QSqlQuery& q);
+    static Page loadPage(QSqlDatabase db, DocumentType docType, const QString& afterDate, int afterId, quint64 generation);
+    // nullopt — ошибка чтения (строки не трогаем)
+    static std::optional<QList<Row>> loadRows(QSqlDatabase db, DocumentType docType, const QList<int>& documentIds);
+
+    // строка a стоит в списке выше строки b
+    static bool isBefore(const Row& a, const Row& b);
+
+private:
+    DocumentType m_docType;
+    QList<Row> m_rows;
+    QHash<int, QString> m_dateById;     // id -> дата строки: ключ двоичного поиска в rowOf()
+
+    quint64 m_generation = 0;
+    qint64 m_loadedVersion = -1;    // версия на момент первой страницы
+    bool m_loading = false;
+    bool m_atEnd = false;
+};
+
+#endif // DOCUMENTLISTMODEL_H
@@ -0,0 +1,635 @@
+#include "MovementsModel.h"
+#include "ReadPool.h"
+#include "ChangeTracker.h"
+#include "repositories/SqlBatch.h"
+
+#include <QColor>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStringList>
+#include <QTimer>
+#include <QLoggingCategory>
+
+#include <algorithm>
+
+Q_LOGGING_CATEGORY(movementsModel, "ui.movements")
+
+namespace {
+
+QString docTypeToDb(DocumentType type)
+{
+    Document d;
+    d.docType = type;
+    return d.docTypeString();
+}
+
+QString docTypeText(const QString& t)
+{
+    if (t == "supply") return "Поставка";
+    if (t == "sale") return "Продажа";
+    if (t == "return") return "Возврат";
+    if (t == "transfer") return "ТТН";
+    if (t == "writeoff") return "Списание";
+    return t;
+}
+
+// условия фильтра; все поля индексируемые, кроме статуса/типа документа
+QString filterSql(const MovementsFilter& f)
+{
+    QString sql;
+    if (f.onlyPosted) sql += " AND d.status = 'POSTED'";
+    if (!f.showStorno) sql += " AND im.cancelled_flag = 0";
+    if (f.productId > 0) sql += " AND im.product_id = :product";
+    if (!f.docNumber.isEmpty())
+        sql += " AND im.document_id IN (SELECT id FROM documents WHERE number = :number)";
+    if (f.dateFrom.isValid()) sql += " AND im.movement_date >= :from";
+    if (f.dateTo.isValid()) sql += " AND im.movement_date <= :to";
+    if (f.docType) sql += " AND d.doc_type = :type";
+    return sql;
+}
+
+void bindFilter(QSqlQuery& q, const MovementsFilter& f)
+{
+    if (f.productId > 0) q.bindValue(":product", f.productId);
+    if (!f.docNumber.isEmpty()) q.bindValue(":number", f.docNumber);
+    if (f.dateFrom.isValid()) q.bindValue(":from", f.dateFrom.toString(Qt::ISODate));
+    if (f.dateTo.isValid()) q.bindValue(":to", f.dateTo.toString(Qt::ISODate));
+    if (f.docType) q.bindValue(":type", docTypeToDb(*f.docType));
+}
+
+} // namespace
+
+MovementsModel::MovementsModel(QObject* parent)
+    : QAbstractTableModel(parent)
+{
+}
+
+int MovementsModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : m_rows.size();
+}
+
+int MovementsModel::columnCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant MovementsModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_rows.size())
+        return {};
+
+    const Row& row = m_rows[index.row()];
+
+    if (role == Qt::DisplayRole) {
+        static const QString yes = QStringLiteral("Да");
+        static const QString no = QStringLiteral("Нет");
+
+        switch (index.column()) {
+            case IdColumn:       return row.id;
+            case DateColumn:     return row.date;
+            case DocumentColumn: return row.docNumber;
+            case TypeColumn:     return row.docTypeText;
+            case StatusColumn:   return row.status;
+            case ProductColumn:  return row.productName;
+            case QtyColumn:      return row.qtyText;
+            case StornoColumn:   return row.cancelled ? yes : no;
+            default: return {};
+        }
+    }
+
+    if (role == Qt::TextAlignmentRole) {
+        if (index.column() == IdColumn) return QVariant(int(Qt::AlignCenter));
+        if (index.column() == StornoColumn) return QVariant(int(Qt::AlignCenter));
+        if (index.column() == QtyColumn) return QVariant(int(Qt::AlignRight | Qt::AlignVCenter));
+    }
+
+    if (role == Qt::ForegroundRole) {
+        static const QVariant gray = QColor(Qt::gray);
+        if (row.cancelled) return gray;
+    }
+
+    return {};
+}
+
+QVariant MovementsModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return {};
+
+    switch (section) {
+        case IdColumn:       return "ID";
+        case DateColumn:     return "Дата";
+        case DocumentColumn: return "Документ";
+        case TypeColumn:     return "Тип";
+        case StatusColumn:   return "Статус";
+        case ProductColumn:  return "Товар";
+        case QtyColumn:      return "Δ (кг)";
+        case StornoColumn:   return "Storno";
+        default: return {};
+    }
+}
+
+bool MovementsModel::canFetchMore(const QModelIndex& parent) const
+{
+    return !parent.isValid() && !m_atEnd && !m_loading;
+}
+
+void MovementsModel::fetchMore(const QModelIndex& parent)
+{
+    if (parent.isValid()) return;
+    requestPage();
+}
+
+void MovementsModel::setFilter(const MovementsFilter& filter)
+{
+    m_filter = filter;
+    refresh();
+}
+
+void MovementsModel::refresh()
+{
+    beginResetModel();
+    m_rows.clear();
+    m_dateById.clear();
+    m_atEnd = false;
+    m_maxId = 0;
+    m_newerPending = false;
+    m_headTrimmed = false;
+    m_headLoading = false;
+    m_loadedVersion = -1;
+    ++m_generation;
+    m_loading = false;
+    endResetModel();
+
+    requestEstimate();
+    requestPage();
+}
+
+void MovementsModel::refreshIfChanged()
+{
+    const quint64 generation = m_generation;
+
+    ReadPool::instance().run<qint64>([](QSqlDatabase db) {
+        return ChangeTracker::version(db, changeTables());
+    }).then(this, [this, generation](qint64 version) {
+        if (generation != m_generation) return;
+        if (ChangeTracker::isStale(m_loadedVersion, version))
+            refresh();
+    });
+}
+
+const QStringList& MovementsModel::changeTables()
+{
+    static const QStringList tables = {"inventory_movements", "documents", "products"};
+    return tables;
+}
+
+void MovementsModel::requestPage()
+{
+    if (m_loading || m_atEnd) return;
+
+    m_loading = true;
+    emit loadingChanged(true);
+
+    const MovementsFilter filter = m_filter;
+    const quint64 generation = m_generation;
+    const QString afterDate = m_rows.isEmpty() ? QString() : m_rows.last().date;
+    const int afterId = m_rows.isEmpty() ? 0 : m_rows.last().id;
+
+    ReadPool::instance().run<Page>([filter, afterDate, afterId, generation](QSqlDatabase db) {
+        return loadPage(db, filter, afterDate, afterId, false, 0, generation);
+    }).then(this, [this](const Page& page) {
+        if (page.generation != m_generation) return;   // фильтр уже сменился
+
+        m_loading = false;
+        if (page.failed) {
+            emit loadingChanged(false);
+            retryLater(&MovementsModel::requestPage);
+            return;
+        }
+        if (m_rows.isEmpty())
+            m_loadedVersion = page.version;
+        applyPage(page);
+        emit loadingChanged(false);
+    });
+}
+
+void MovementsModel::retryLater(void (MovementsModel::*load)())
+{
+    // журнал не закончен: ту же страницу запросим снова (хвост — и раньше, при прокрутке)
+    const quint64 generation = m_generation;
+    QTimer::singleShot(kRetryMs, this, [this, load, generation]() {
+        if (generation == m_generation) (this->*load)();
+    });
+}
+
+void MovementsModel::applyPage(const Page& page)
+{
+    m_atEnd = page.atEnd;
+    if (page.rows.isEmpty()) return;
+
+    const int first = m_rows.size();
+    beginInsertRows(QModelIndex(), first, first + page.rows.size() - 1);
+    for (const Row& row : page.rows) {
+        m_rows.append(row);
+        m_dateById.insert(row.id, row.date);
+        m_maxId = qMax(m_maxId, row.id);
+    }
+    endInsertRows();
+
+    trimHead();
+}
+
+void MovementsModel::fetchNewer()
+{
+    if (!canFetchNewer() || m_rows.isEmpty()) return;
+
+    m_headLoading = true;
+    emit loadingChanged(true);
+
+    const MovementsFilter filter = m_filter;
+    const quint64 generation = m_generation;
+    const QString beforeDate = m_rows.first().date;
+    const int beforeId = m_rows.first().id;
+
+    ReadPool::instance().run<Page>([filter, beforeDate, beforeId, generation](QSqlDatabase db) {
+        return loadPage(db, filter, beforeDate, beforeId, true, 0, generation);
+    }).then(this, [this](const Page& page) {
+        if (page.generation != m_generation) return;
+
+        m_headLoading = false;
+        if (page.failed) {
+            emit loadingChanged(false);
+            retryLater(&MovementsModel::fetchNewer);
+            return;
+        }
+        applyHeadPage(page);
+        emit loadingChanged(false);
+    });
+}
+
+void MovementsModel::applyHeadPage(const Page& page)
+{
+    // страница прочитана снизу вверх; неполная — выше окна строк больше нет
+    m_headTrimmed = !page.atEnd;
+    if (page.rows.isEmpty()) return;
+
+    emit headAboutToChange();
+    beginInsertRows(QModelIndex(), 0, page.rows.size() - 1);
+    for (const Row& row : page.rows) {
+        m_rows.prepend(row);
+        m_dateById.insert(row.id, row.date);
+        m_maxId = qMax(m_maxId, row.id);
+    }
+    endInsertRows();
+    emit headChanged();
+
+    trimTail();
+}
+
+void MovementsModel::trimHead()
+{
+    const int excess = m_rows.size() - kMaxPages * kPageSize;
+    if (excess <= 0) return;
+
+    emit headAboutToChange();
+    beginRemoveRows(QModelIndex(), 0, excess - 1);
+    for (int i = 0; i < excess; ++i)
+        m_dateById.remove(m_rows.at(i).id);
+    m_rows.remove(0, excess);
+    endRemoveRows();
+    m_headTrimmed = true;
+    emit headChanged();
+}
+
+void MovementsModel::trimTail()
+{
+    const int excess = m_rows.size() - kMaxPages * kPageSize;
+    if (excess <= 0) return;
+
+    // хвост снова придёт обычной дозагрузкой
+    const int first = m_rows.size() - excess;
+    beginRemoveRows(QModelIndex(), first, m_rows.size() - 1);
+    for (int i = first; i < m_rows.size(); ++i)
+        m_dateById.remove(m_rows.at(i).id);
+    m_rows.resize(first);
+    endRemoveRows();
+    m_atEnd = false;
+}
+
+void MovementsModel::insertRow(int at, const Row& row)
+{
+    beginInsertRows(QModelIndex(), at, at);
+    m_rows.insert(at, row);
+    m_dateById.insert(row.id, row.date);
+    endInsertRows();
+}
+
+void MovementsModel::removeRowAt(int at)
+{
+    beginRemoveRows(QModelIndex(), at, at);
+    m_dateById.remove(m_rows.at(at).id);
+    m_rows.removeAt(at);
+    endRemoveRows();
+}
+
+void MovementsModel::loadNewer()
+{
+    // пока грузится первая страница, свежие строки придут вместе с ней
+    if (m_rows.isEmpty()) {
+        if (!m_loading) refresh();
+        return;
+    }
+    if (m_newerPending) return;
+    m_newerPending = true;
+
+    const MovementsFilter filter = m_filter;
+    const quint64 generation = m_generation;
+    const int newerThanId = m_maxId;
+
+    ReadPool::instance().run<Page>([filter, newerThanId, generation](QSqlDatabase db) {
+        return loadPage(db, filter, QString(), 0, false, newerThanId, generation);
+    }).then(this, [this](const Page& page) {
+        if (page.generation != m_generation) return;
+        m_newerPending = false;
+        if (page.failed) {
+            retryLater(&MovementsModel::loadNewer);
+            return;
+        }
+
+        for (const Row& row : page.rows) {
+            m_maxId = qMax(m_maxId, row.id);
+
+            // строки ниже загруженного хвоста придут обычной дозагрузкой, выше окна — fetchNewer()
+            if (!m_atEnd && !isBefore(row, m_rows.last()))
+                continue;
+            if (m_headTrimmed && isBefore(row, m_rows.first()))
+                continue;
+            if (m_dateById.contains(row.id))
+                continue;
+
+            const auto pos = std::lower_bound(m_rows.begin(), m_rows.end(), row, &MovementsModel::isBefore);
+            insertRow(int(pos - m_rows.begin()), row);
+        }
+        trimTail();
+    });
+}
+
+void MovementsModel::reloadMovements(const QList<int>& movementIds)
+{
+    if (movementIds.isEmpty()) return;
+
+    // пока грузится первая страница, изменения придут вместе с ней
+    if (m_rows.isEmpty()) {
+        if (!m_loading) refresh();
+        return;
+    }
+
+    const MovementsFilter filter = m_filter;
+    const quint64 generation = m_generation;
+
+    ReadPool::instance().run<std::optional<QList<Row>>>([filter, movementIds](QSqlDatabase db) {
+        return loadRows(db, filter, movementIds);
+    }).then(this, [this, movementIds, generation](const std::optional<QList<Row>>& rows) {
+        if (generation != m_generation || !rows) return;
+        applyReloaded(movementIds, *rows);
+    });
+}
+
+void MovementsModel::applyReloaded(const QList<int>& movementIds, const QList<Row>& rows)
+{
+    QSet<int> found;
+
+    for (const Row& row : rows) {
+        found.insert(row.id);
+        m_maxId = qMax(m_maxId, row.id);
+
+        const int existing = rowOf(row.id);
+        if (existing >= 0 && m_rows.at(existing).date == row.date) {
+            m_rows[existing] = row;
+            emit dataChanged(index(existing, 0), index(existing, ColumnCount - 1));
+            continue;
+        }
+        // дата сменилась — строка переезжает на новое место
+        if (existing >= 0)
+            removeRowAt(existing);
+        if (m_rows.isEmpty())
+            continue;
+
+        // ниже загруженного хвоста — её принесёт обычная дозагрузка, выше окна — fetchNewer()
+        if (!m_atEnd && !isBefore(row, m_rows.last()))
+            continue;
+        if (m_headTrimmed && isBefore(row, m_rows.first()))
+            continue;
+
+        const auto pos = std::lower_bound(m_rows.begin(), m_rows.end(), row, &MovementsModel::isBefore);
+        insertRow(int(pos - m_rows.begin()), row);
+    }
+
+    // не вернулись — удалены (архив) или больше не проходят фильтр
+    for (int id : movementIds) {
+        if (found.contains(id)) continue;
+
+        const int existing = rowOf(id);
+        if (existing >= 0)
+            removeRowAt(existing);
+    }
+    trimTail();
+}
+
+int MovementsModel::rowOf(int movementId) const
+{
+    const auto date = m_dateById.constFind(movementId);
+    if (date == m_dateById.cend()) return -1;
+
+    Row key;
+    key.id = movementId;
+    key.date = date.value();
+    const auto pos = std::lower_bound(m_rows.cbegin(), m_rows.cend(), key, &MovementsModel::isBefore);
+    return pos != m_rows.cend() && pos->id == movementId ? int(pos - m_rows.cbegin()) : -1;
+}
+
+void MovementsModel::markCancelled(const QList<int>& documentIds)
+{
+    const QSet<int> ids(documentIds.cbegin(), documentIds.cend());
+
+    // идём снизу, чтобы удаление строк не сдвигало ещё не просмотренные
+    for (int i = m_rows.size() - 1; i >= 0; --i) {
+        Row& row = m_rows[i];
+        if (!ids.contains(row.documentId) || row.cancelled)
+            continue;
+
+        if (!acceptsCancelled()) {
+            removeRowAt(i);
+            continue;
+        }
+
+        row.cancelled = true;
+        row.status = "CANCELLED";
+        emit dataChanged(index(i, StatusColumn), index(i, StornoColumn));
+    }
+}
+
+bool MovementsModel::isBefore(const Row& a, const Row& b)
+{
+    if (a.date != b.date) return a.date > b.date;
+    return a.id > b.id;
+}
+
+void MovementsModel::requestEstimate()
+{
+    const MovementsFilter filter = m_filter;
+    const quint64 generation = m_generation;
+
+    ReadPool::instance().run<qint64>([filter](QSqlDatabase db) {
+        return loadEstimate(db, filter);
+    }).then(this, [this, generation](qint64 estimate) {
+        if (generation == m_generation)
+            emit estimateChanged(estimate);
+    });
+}
+
+MovementsModel::Page MovementsModel::loadPage(QSqlDatabase db, const MovementsFilter& filter,
+                                              const QString& afterDate, int afterId, bool above,
+                                              int newerThanId, quint64 generation)
+{
+    Page page;
+    page.generation = generation;
+
+    // первая страница несёт версию, прочитанную до неё
+    if (afterDate.isEmpty() && newerThanId <= 0)
+        page.version = ChangeTracker::version(db, changeTables());
+
+    QString sql = selectSql();
+    sql += filterSql(filter);
+
+    if (newerThanId > 0) {
+        sql += " AND im.id > :newer ORDER BY im.id";
+    } else {
+        // ключ страницы: строки строго после последней загруженной;
+        // above — строго перед первой, в обратном порядке (вытесненные из окна сверху)
+        if (above) {
+            sql += " AND (im.movement_date > :afterDate OR (im.movement_date = :afterDate AND im.id > :afterId))";
+            sql += " ORDER BY im.movement_date ASC, im.id ASC LIMIT :limit";
+        } else {
+            if (!afterDate.isEmpty())
+                sql += " AND (im.movement_date < :afterDate OR (im.movement_date = :afterDate AND im.id < :afterId))";
+            sql += " ORDER BY im.movement_date DESC, im.id DESC LIMIT :limit";
+        }
+    }
+
+    QSqlQuery q(db);
+    q.setForwardOnly(true);
+    q.prepare(sql);
+    bindFilter(q, filter);
+
+    if (newerThanId > 0) {
+        q.bindValue(":newer", newerThanId);
+    } else {
+        if (!afterDate.isEmpty()) {
+            q.bindValue(":afterDate", afterDate);
+            q.bindValue(":afterId", afterId);
+        }
+        q.bindValue(":limit", kPageSize);
+    }
+
+    if (!q.exec()) {
+        qWarning(movementsModel) << "MovementsModel::loadPage SQL error:" << q.lastError().text();
+        page.failed = true;
+        return page;
+    }
+
+    while (q.next())
+        page.rows.append(rowFromQuery(q));
+
+    page.atEnd = newerThanId > 0 || page.rows.size() < kPageSize;
+    return page;
+}
+
+std::optional<QList<MovementsModel::Row>> MovementsModel::loadRows(QSqlDatabase db, const MovementsFilter& filter,
+                                                                   const QList<int>& movementIds)
+{
+    QList<Row> rows;
+
+    for (qsizetype offset = 0; offset < movementIds.size(); offset += kSqlMaxBatchIds) {
+        const QList<int> batch = movementIds.mid(offset, kSqlMaxBatchIds);
+
+        // фильтр — именованные параметры, поэтому id тоже именованные
+        QString sql = selectSql() + filterSql(filter);
+        QStringList names;
+        for (qsizetype i = 0; i < batch.size(); ++i) names.append(QString(":id%1").arg(i));
+        sql += QString(" AND im.id IN (%1)").arg(names.join(", "));
+
+        QSqlQuery q(db);
+        q.setForwardOnly(true);
+        q.prepare(sql);
+        bindFilter(q, filter);
+        for (qsizetype i = 0; i < batch.size(); ++i) q.bindValue(names.at(i), batch.at(i));
+
+        if (!q.exec()) {
+            qWarning(movementsModel) << "MovementsModel::loadRows SQL error:" << q.lastError().text();
+            return std::nullopt;
+        }
+
+        while (q.next())
+            rows.append(rowFromQuery(q));
+    }
+
+    return rows;
+}
+
+QString MovementsModel::selectSql()
+{
+    return R"(
+        SELECT
+            im.id, im.document_id, im.movement_date,
+            d.number, d.doc_type, d.status,
+            p.name, im.qty_delta_kg, im.cancelled_flag
+        FROM inventory_movements im
+        JOIN documents d ON d.id = im.document_id
+        JOIN products  p ON p.id = im.product_id
+        WHERE 1=1
+    )";
+}
+
+MovementsModel::Row MovementsModel::rowFromQuery(const QSqlQuery& q)
+{
+    Row row;
+    row.id = q.value(0).toInt();
+    row.documentId = q.value(1).toInt();
+    row.date = q.value(2).toString();
+    row.docNumber = q.value(3).toString();
+    row.docTypeText = docTypeText(q.value(4).toString());
+    row.status = q.value(5).toString();
+    row.productName = q.value(6).toString();
+    row.qtyKg = q.value(7).toDouble();
+    row.qtyText = QString::number(row.qtyKg, 'f', 3);
+    row.cancelled = q.value(8).toInt() == 1;
+    return row;
+}
+
+qint64 MovementsModel::loadEstimate(QSqlDatabase db, const MovementsFilter& filter)
+{
+    QSqlQuery q(db);
+
+    // без фильтра — диапазон id по первичному ключу, O(log n)
+    if (filter.isEmpty()) {
+        if (!q.exec("SELECT COALESCE(MAX(id) - MIN(id) + 1, 0) FROM inventory_movements") || !q.next())
+            return -1;
+        return q.value(0).toLongLong();
+    }
+
+    // товар/даты/storno считаются по индексам одной таблицы, без join документов
+    if (!filter.onlyPosted && filter.docNumber.isEmpty() && !filter.docType) {
+        QString sql = "SELECT COUNT(*) FROM inventory_movements im WHERE 1=1";
+        sql += filterSql(filter);
+        q.prepare(sql);
+        bindFilter(q, filter);
+        if (!q.exec() || !q.next())
+            return -1;
+        return q.value(0).toLongLong();
+    }
+
+    return -1;
+}
@@ -0,0 +1,185 @@
+#ifndef MOVEMENTSMODEL_H
+#define MOVEMENTSMODEL_H
+
+#include <QAbstractTableModel>
+#include <QDate>
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QSqlDatabase>
+#include <QString>
+#include <QStringList>
+
+#include <optional>
+
+#include "repositories/IDocumentRepository.h"
+
+class QSqlQuery;
+
+/**
+ * @brief Фильтр журнала движений; все условия уходят в SQL
+ */
+struct MovementsFilter {
+    bool onlyPosted = false;
+    bool showStorno = true;
+    int productId = 0;
+    QString docNumber;                      // точное совпадение номера
+    QDate dateFrom;
+    QDate dateTo;
+    std::optional<DocumentType> docType;
+
+    bool isEmpty() const
+    {
+        return !onlyPosted && showStorno && productId <= 0 && docNumber.isEmpty()
+            && !dateFrom.isValid() && !dateTo.isValid() && !docType;
+    }
+};
+
+/**
+ * @brief Журнал движений с постраничной загрузкой по ключу (movement_date, id)
+ *
+ * Страница — это «следующие kPageSize строк после последней загруженной»:
+ * WHERE (date, id) < (:date, :id) ORDER BY date DESC, id DESC LIMIT n.
+ * Такой запрос идёт по индексу и не зависит от глубины прокрутки (в отличие от OFFSET).
+ * Страницы читаются в ReadPool; представление запрашивает их через fetchMore(),
+ * когда прокрутка подходит к концу загруженного.
+ *
+ * Общее число строк — дешёвая оценка (см. estimateChanged), точный COUNT(*)
+ * по журналу не выполняется.
+ *
+ * В памяти — окно не больше kMaxPages страниц: дозагрузка снизу вытесняет
+ * строки сверху, и наоборот. Вытесненное сверху возвращает fetchNewer(),
+ * когда прокрутка доходит до начала окна (Qt сам просит только хвост).
+ * Строку по id находит rowOf() — по дате из m_dateById двоичным поиском.
+ */
+class MovementsModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum Column {
+        IdColumn = 0,
+        DateColumn,
+        DocumentColumn,
+        TypeColumn,
+        StatusColumn,
+        ProductColumn,
+        QtyColumn,
+        StornoColumn,
+        ColumnCount
+    };
+
+    struct Row {
+        int id = 0;
+        int documentId = 0;
+        QString date;               // ISO, ключ сортировки
+        QString docNumber;
+        QString docTypeText;
+        QString status;
+        QString productName;
+        double qtyKg = 0.0;
+        QString qtyText;
+        bool cancelled = false;
+    };
+
+    struct Page {
+        quint64 generation = 0;
+        qint64 version = -1;        // ChangeTracker; читается только для первой страницы
+        QList<Row> rows;
+        bool atEnd = false;
+        bool failed = false;        // ошибка чтения — это не конец журнала
+    };
+
+    static constexpr int kPageSize = 500;
+    static constexpr int kMaxPages = 20;
+    static constexpr int kRetryMs = 3000;   // повтор страницы после ошибки чтения
+
+    explicit MovementsModel(QObject* parent = nullptr);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+    bool canFetchMore(const QModelIndex& parent) const override;
+    void fetchMore(const QModelIndex& parent) override;
+
+    // над окном есть вытесненные строки; вернуть страницу над первой строкой
+    bool canFetchNewer() const { return m_headTrimmed && !m_headLoading; }
+    void fetchNewer();
+
+    const MovementsFilter& filter() const { return m_filter; }
+    void setFilter(const MovementsFilter& filter);
+
+    // перечитать с начала
+    void refresh();
+
+    // кнопка «Обновить»: перечитать, только если журнал, документы или товары менялись
+    void refreshIfChanged();
+
+    // дозагрузить движения, появившиеся после проведения документов
+    void loadNewer();
+
+    // отметить отменёнными строки отменённых документов без перечитывания
+    void markCancelled(const QList<int>& documentIds);
+
+    // перечитать указанные движения (изменения из другого экземпляра приложения)
+    void reloadMovements(const QList<int>& movementIds);
+
+    bool isLoading() const { return m_loading; }
+
+signals:
+    void loadingChanged(bool loading);
+    void estimateChanged(qint64 estimate);     // -1 — оценки нет
+
+    // строки над видимыми вставляются или удаляются: представлению держать ту же строку вверху
+    void headAboutToChange();
+    void headChanged();
+
+private:
+    void requestPage();
+    // страница не прочиталась: повторить load через kRetryMs, если фильтр тот же
+    void retryLater(void (MovementsModel::*load)());
+    void applyPage(const Page& page);
+    void applyHeadPage(const Page& page);
+    void trimHead();
+    void trimTail();
+    void insertRow(int at, const Row& row);
+    void removeRowAt(int at);
+    void requestEstimate();
+    void applyReloaded(const QList<int>& movementIds, const QList<Row>& rows);
+    int rowOf(int movementId) const;
+
+    static const QStringList& changeTables();
+    static Page loadPage(QSqlDatabase db, const MovementsFilter& filter,
+                         const QString& afterDate, int afterId, bool above, int newerThanId,
+                         quint64 generation);
+    static qint64 loadEstimate(QSqlDatabase db, const MovementsFilter& filter);
+    // nullopt — ошибка чтения (строки не трогаем)
+    static std::optional<QList<Row>> loadRows(QSqlDatabase db, const MovementsFilter& filter,
+                                              const QList<int>& movementIds);
+    static QString selectSql();
+    static Row rowFromQuery(const QSqlQuery& q);
+
+    // строка a стоит в журнале выше строки b
+    static bool isBefore(const Row& a, const Row& b);
+    bool acceptsCancelled() const { return m_filter.showStorno && !m_filter.onlyPosted; }
+
+private:
+    MovementsFilter m_filter;
+    QList<Row> m_rows;
+
+    // поколение запроса: ответы, пришедшие после смены фильтра, отбрасываются
+    quint64 m_generation = 0;
+    qint64 m_loadedVersion = -1;    // версия на момент первой страницы
+    bool m_loading = false;
+    bool m_atEnd = false;
+    bool m_newerPending = false;
+    int m_maxId = 0;             // самый большой id среди загруженных — граница для loadNewer()
+
+    bool m_headTrimmed = false;  // строки над окном вытеснены
+    bool m_headLoading = false;
+    QHash<int, QString> m_dateById;     // id -> дата строки окна: ключ двоичного поиска в rowOf()
+};
+
+#endif // MOVEMENTSMODEL_H
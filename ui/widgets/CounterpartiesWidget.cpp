@@ -1,6 +1,9 @@
 #include "CounterpartiesWidget.h"
 #include "CounterpartyForm.h"
 #include "DbManager.h"
+#include "ChangeTracker.h"
+#include "ChangeBus.h"
+#include "repositories/SearchRepository.h"
 #include <QHeaderView>
 #include <QMessageBox>
 #include <QSqlRecord>
@@ -15,6 +18,21 @@ void CounterpartiesWidget::setupUi()
 {
     QVBoxLayout* mainLayout = new QVBoxLayout(this);
 
+    m_searchEdit = new QLineEdit(this);
+    m_searchEdit->setPlaceholderText("Поиск по наименованию, адресу, ИНН");
+    m_searchEdit->setClearButtonEnabled(true);
+    mainLayout->addWidget(m_searchEdit);
+
+    // фильтр по FTS-индексу; запрос на каждую букву не нужен
+    m_searchTimer = new QTimer(this);
+    m_searchTimer->setSingleShot(true);
+    m_searchTimer->setInterval(200);
+    connect(m_searchEdit, &QLineEdit::textChanged, m_searchTimer, qOverload<>(&QTimer::start));
+    connect(m_searchTimer, &QTimer::timeout, this, &CounterpartiesWidget::onSearchChanged);
+
+    if (!SearchRepository(DbManager::instance().database()).isAvailable())
+        m_searchEdit->hide();
+
     m_tableView = new QTableView(this);
     m_model = new QSqlTableModel(this, DbManager::instance().database());
     m_model->setTable("counterparties");
@@ -48,20 +66,46 @@ void CounterpartiesWidget::setupUi()
     connect(m_addButton, &QPushButton::clicked, this, &CounterpartiesWidget::onAddClicked);
     connect(m_editButton, &QPushButton::clicked, this, &CounterpartiesWidget::onEditClicked);
     connect(m_refreshButton, &QPushButton::clicked, this, &CounterpartiesWidget::onRefreshClicked);
+
+    // QSqlTableModel по строкам не обновить: сверяем счётчик и перечитываем
+    connect(&ChangeBus::instance(), &ChangeBus::remoteChanged, this, [this](const ChangeSet& changes) {
+        if (changes.contains("counterparties")) refreshIfChanged();
+    });
     
     refreshModel();
 }
 
 void CounterpartiesWidget::refreshModel()
 {
+    m_loadedVersion = ChangeTracker::version(m_model->database(), {"counterparties"});
     m_model->select();
 }
 
+void CounterpartiesWidget::refreshIfChanged()
+{
+    const qint64 version = ChangeTracker::version(m_model->database(), {"counterparties"});
+    if (ChangeTracker::isStale(m_loadedVersion, version))
+        refreshModel();
+}
+
+void CounterpartiesWidget::onSearchChanged()
+{
+    QString filter = "is_active = 1";
+
+    // в выражении только слова, кавычки и *, одинарных кавычек там не бывает
+    const QString match = SearchRepository::matchExpression(m_searchEdit->text());
+    if (!match.isEmpty())
+        filter += QString(" AND id IN (SELECT rowid FROM counterparties_fts WHERE counterparties_fts MATCH '%1')").arg(match);
+
+    m_model->setFilter(filter);
+    refreshModel();
+}
+
 void CounterpartiesWidget::onAddClicked()
 {
     CounterpartyForm form(this);
     if (form.exec() == QDialog::Accepted) {
-        refreshModel();
+        refreshIfChanged();
     }
 }
 
@@ -79,12 +123,12 @@ void CounterpartiesWidget::onEditClicked()
     CounterpartyForm form(this);
     form.loadData(id);
     if (form.exec() == QDialog::Accepted) {
-        refreshModel();
+        refreshIfChanged();
     }
 }
 
 void CounterpartiesWidget::onRefreshClicked()
 {
-    refreshModel();
+    refreshIfChanged();
 }
 
@@ -7,6 +7,8 @@
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QSqlTableModel>
+#include <QLineEdit>
+#include <QTimer>
 
 class CounterpartiesWidget : public QWidget
 {
@@ -19,16 +21,23 @@ private slots:
     void onAddClicked();
     void onEditClicked();
     void onRefreshClicked();
+    void onSearchChanged();
 
 private:
     void setupUi();
     void refreshModel();
+    // «Обновить» и возврат из формы: select() только если таблица менялась
+    void refreshIfChanged();
     
+    QLineEdit* m_searchEdit;
+    QTimer* m_searchTimer;
     QTableView* m_tableView;
     QSqlTableModel* m_model;
     QPushButton* m_addButton;
     QPushButton* m_editButton;
     QPushButton* m_refreshButton;
+
+    qint64 m_loadedVersion = -1;    // ChangeTracker на момент последнего select()
 };
 
 #endif // COUNTERPARTIESWIDGET_H
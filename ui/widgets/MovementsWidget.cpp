@@ -1,122 +1,23 @@
 #include "MovementsWidget.h"
 #include "DbManager.h"
-
+#include "ChangeBus.h"
+#include "SqlCollation.h"
+#include "WriteQueue.h"
+#include "models/MovementsModel.h"
+#include "repositories/QueryCache.h"
+
+#include <QComboBox>
+#include <QDateEdit>
+#include <QLabel>
+#include <QLineEdit>
 #include <QSqlDatabase>
-#include <QSqlError>
-#include <QSqlQuery>
 #include <QHeaderView>
-#include <QDebug>
-#include <QColor>
-
-
-MovementsModel::MovementsModel(QObject* parent)
-    : QSqlQueryModel(parent)
-{
-}
-
-QVariant MovementsModel::data(const QModelIndex& index, int role) const
-{
-    if (!index.isValid())
-        return {};
+#include <QScrollBar>
+#include <QTimer>
 
-
-    if (role == Qt::TextAlignmentRole) {
-        if (index.column() == 0) return QVariant(int(Qt::AlignCenter));
-        if (index.column() == 7) return QVariant(int(Qt::AlignCenter));
-        if (index.column() == 6) return QVariant(int(Qt::AlignRight | Qt::AlignVCenter));
-    }
-
-    if (role == Qt::ForegroundRole) {
-        const int cancelled = QSqlQueryModel::data(this->index(index.row(), 7), Qt::DisplayRole).toInt();
-
-        if (cancelled == 1) return QColor(Qt::gray);
-    }
-
-    if (role == Qt::DisplayRole && index.column() == 3) {
-        const QString t = QSqlQueryModel::data(index, role).toString();
-        if (t == "supply") return "Поставка";
-        if (t == "sale") return "Продажа";
-        if (t == "return") return "Возврат";
-        if (t == "transfer") return "ТТН";
-        return t;
-    }
-
-    if (role == Qt::DisplayRole && index.column() == 7) {
-        const int v = QSqlQueryModel::data(index, role).toInt();
-        return v == 1 ? "Да" : "Нет";
-    }
-
-    return QSqlQueryModel::data(index, role);
-}
-
-void MovementsModel::setOnlyPosted(bool v)
-{
-    if (m_onlyPosted == v) return;
-    m_onlyPosted = v;
-    refresh();
-}
-
-void MovementsModel::setShowStorno(bool v)
-{
-    if (m_showStorno == v) return;
-    m_showStorno = v;
-    refresh();
-}
-
-void MovementsModel::refresh()
-{
-    QSqlDatabase db = DbManager::instance().database();
-    if (!db.isOpen()) {
-        setQuery(QSqlQuery()); // пусто
-        return;
-    }
-
-    QString sql = R"(
-        SELECT
-            im.id                AS id,
-            im.movement_date     AS date,
-            d.number             AS doc_number,
-            d.doc_type           AS doc_type,
-            d.status             AS status,
-            p.name               AS product_name,
-            im.qty_delta_kg      AS qty_delta_kg,
-            im.cancelled_flag    AS cancelled_flag
-        FROM inventory_movements im
-        LEFT JOIN documents d ON d.id = im.document_id
-        LEFT JOIN products  p ON p.id = im.product_id
-        WHERE 1=1
-    )";
-
-    if (m_onlyPosted) {
-        sql += " AND d.status = 'POSTED' ";
-    }
-
-    if (!m_showStorno) {
-        sql += " AND im.cancelled_flag = 0 ";
-    }
-
-    sql += " ORDER BY im.movement_date DESC, im.id DESC ";
-
-    setQuery(sql, db);
-
-    if (lastError().isValid()) {
-        qWarning() << "MovementsModel SQL error:" << lastError().text();
-        qWarning() << "SQL:" << sql;
-    }
-
-    setHeaderData(0, Qt::Horizontal, "ID");
-    setHeaderData(1, Qt::Horizontal, "Дата");
-    setHeaderData(2, Qt::Horizontal, "Документ");
-    setHeaderData(3, Qt::Horizontal, "Тип");
-    setHeaderData(4, Qt::Horizontal, "Статус");
-    setHeaderData(5, Qt::Horizontal, "Товар");
-    setHeaderData(6, Qt::Horizontal, "Δ (кг)");
-    setHeaderData(7, Qt::Horizontal, "Storno");
-}
-
-
-MovementsWidget::MovementsWidget(QWidget *parent)
+MovementsWidget::MovementsWidget(WriteQueue* writeQueue, QWidget *parent)
     : QWidget(parent)
+    , m_writeQueue(writeQueue)
 {
     setupUi();
 }
@@ -142,6 +43,43 @@ void MovementsWidget::setupUi()
 
     mainLayout->addLayout(topLayout);
 
+    // фильтры уходят в SQL, а не применяются к загруженным строкам
+    QHBoxLayout* filterLayout = new QHBoxLayout();
+
+    m_productCombo = new QComboBox(this);
+    m_productCombo->setMinimumWidth(200);
+    filterLayout->addWidget(new QLabel("Товар:", this));
+    filterLayout->addWidget(m_productCombo);
+
+    m_typeCombo = new QComboBox(this);
+    m_typeCombo->addItem("Все типы", -1);
+    m_typeCombo->addItem("Поставка", int(DocumentType::Supply));
+    m_typeCombo->addItem("Продажа", int(DocumentType::Sale));
+    m_typeCombo->addItem("Возврат", int(DocumentType::Return));
+    m_typeCombo->addItem("ТТН", int(DocumentType::Transfer));
+    m_typeCombo->addItem("Списание", int(DocumentType::WriteOff));
+    filterLayout->addWidget(m_typeCombo);
+
+    m_docNumberEdit = new QLineEdit(this);
+    m_docNumberEdit->setPlaceholderText("№ документа");
+    m_docNumberEdit->setClearButtonEnabled(true);
+    filterLayout->addWidget(m_docNumberEdit);
+
+    m_periodCheck = new QCheckBox("Период:", this);
+    m_fromEdit = new QDateEdit(QDate::currentDate().addMonths(-1), this);
+    m_fromEdit->setCalendarPopup(true);
+    m_toEdit = new QDateEdit(QDate::currentDate(), this);
+    m_toEdit->setCalendarPopup(true);
+    m_fromEdit->setEnabled(false);
+    m_toEdit->setEnabled(false);
+    filterLayout->addWidget(m_periodCheck);
+    filterLayout->addWidget(m_fromEdit);
+    filterLayout->addWidget(new QLabel("—", this));
+    filterLayout->addWidget(m_toEdit);
+    filterLayout->addStretch();
+
+    mainLayout->addLayout(filterLayout);
+
     m_tableView = new QTableView(this);
     m_model = new MovementsModel(this);
 
@@ -150,6 +88,7 @@ void MovementsWidget::setupUi()
     m_tableView->setSelectionMode(QAbstractItemView::SingleSelection);
     m_tableView->horizontalHeader()->setStretchLastSection(true);
     m_tableView->setAlternatingRowColors(true);
+    m_tableView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
 
     m_tableView->setColumnWidth(0, 60);
     m_tableView->setColumnWidth(1, 110);
@@ -162,25 +101,125 @@ void MovementsWidget::setupUi()
 
     mainLayout->addWidget(m_tableView);
 
+    m_statusLabel = new QLabel(this);
+    mainLayout->addWidget(m_statusLabel);
+
+    loadProducts();
+
     connect(m_refreshButton, &QPushButton::clicked, this, &MovementsWidget::onRefreshClicked);
 
-    connect(m_onlyPostedCheck, &QCheckBox::checkStateChanged, this, &MovementsWidget::onOnlyPostedChanged);
-    connect(m_showStornoCheck, &QCheckBox::checkStateChanged, this, &MovementsWidget::onShowStornoChanged);
+    connect(m_onlyPostedCheck, &QCheckBox::checkStateChanged, this, &MovementsWidget::onFilterChanged);
+    connect(m_showStornoCheck, &QCheckBox::checkStateChanged, this, &MovementsWidget::onFilterChanged);
+    connect(m_productCombo, &QComboBox::currentIndexChanged, this, &MovementsWidget::onFilterChanged);
+    connect(m_typeCombo, &QComboBox::currentIndexChanged, this, &MovementsWidget::onFilterChanged);
+    connect(m_docNumberEdit, &QLineEdit::editingFinished, this, &MovementsWidget::onFilterChanged);
+    connect(m_periodCheck, &QCheckBox::checkStateChanged, this, [this](Qt::CheckState state) {
+        m_fromEdit->setEnabled(state == Qt::Checked);
+        m_toEdit->setEnabled(state == Qt::Checked);
+        onFilterChanged();
+    });
+    connect(m_fromEdit, &QDateEdit::dateChanged, this, [this]() {
+        if (m_periodCheck->isChecked()) onFilterChanged();
+    });
+    connect(m_toEdit, &QDateEdit::dateChanged, this, [this]() {
+        if (m_periodCheck->isChecked()) onFilterChanged();
+    });
+
+    connect(m_model, &MovementsModel::loadingChanged, this, &MovementsWidget::updateStatusLabel);
+    connect(m_model, &MovementsModel::rowsInserted, this, &MovementsWidget::updateStatusLabel);
+    connect(m_model, &MovementsModel::rowsRemoved, this, &MovementsWidget::updateStatusLabel);
+
+    // окно модели: у начала окна возвращаем вытесненные строки, а вытеснение
+    // и возврат строк сверху не должны сдвигать то, что пользователь видит
+    connect(m_tableView->verticalScrollBar(), &QScrollBar::valueChanged, this, [this](int value) {
+        if (value == m_tableView->verticalScrollBar()->minimum() && m_model->canFetchNewer())
+            m_model->fetchNewer();
+    });
+    connect(m_model, &MovementsModel::headAboutToChange, this, [this]() {
+        m_topRow = m_tableView->indexAt(QPoint(0, 0));
+    });
+    connect(m_model, &MovementsModel::headChanged, this, [this]() {
+        // геометрия представления пересчитывается отложенно — прокручиваем после неё
+        QTimer::singleShot(0, this, [this]() {
+            if (m_topRow.isValid())
+                m_tableView->scrollTo(m_topRow, QAbstractItemView::PositionAtTop);
+        });
+    });
+    connect(m_model, &MovementsModel::modelReset, this, [this]() {
+        m_estimate = -1;
+        updateStatusLabel();
+    });
+    connect(m_model, &MovementsModel::estimateChanged, this, [this](qint64 estimate) {
+        m_estimate = estimate;
+        updateStatusLabel();
+    });
+
+    // проведение добавляет движения, отмена меняет флаг у уже загруженных
+    if (m_writeQueue) {
+        connect(m_writeQueue, &WriteQueue::documentPosted, m_model, &MovementsModel::loadNewer);
+        connect(m_writeQueue, &WriteQueue::documentsCancelled, m_model, &MovementsModel::markCancelled);
+    }
+
+    // движения, добавленные или отменённые другим экземпляром приложения
+    connect(&ChangeBus::instance(), &ChangeBus::remoteChanged, this, [this](const ChangeSet& changes) {
+        if (ChangeBus::isTableReset(changes, "inventory_movements"))
+            m_model->refreshIfChanged();
+        else if (changes.contains("inventory_movements"))
+            m_model->reloadMovements(ChangeBus::rowIds(changes, "inventory_movements"));
+    });
 
     m_model->refresh();
 }
 
-void MovementsWidget::onRefreshClicked()
+void MovementsWidget::loadProducts()
 {
-    m_model->refresh();
+    m_productCombo->clear();
+    m_productCombo->addItem("Все товары", 0);
+
+    // ошибку SQL пишет в лог сам кэш
+    const auto rows = QueryCache::instance().select(
+        DbManager::instance().database(),
+        QString("SELECT id, name FROM products ORDER BY is_active DESC, %1").arg(SqlCollation::orderBy("name")),
+        {}, {"products"});
+    if (!rows) return;
+
+    for (const QVariantList& row : *rows)
+        m_productCombo->addItem(row.at(1).toString(), row.at(0).toInt());
 }
 
-void MovementsWidget::onOnlyPostedChanged(Qt::CheckState state)
+void MovementsWidget::updateStatusLabel()
 {
-    m_model->setOnlyPosted(state == Qt::Checked);
+    QString text = QString("Показано: %1").arg(m_model->rowCount());
+    if (m_estimate >= 0)
+        text += QString(" из ≈%1").arg(m_estimate);
+    if (m_model->isLoading())
+        text += " (загрузка...)";
+    m_statusLabel->setText(text);
 }
 
-void MovementsWidget::onShowStornoChanged(Qt::CheckState state)
+void MovementsWidget::onRefreshClicked()
 {
-    m_model->setShowStorno(state == Qt::Checked);
+    // оценку сбрасывает modelReset, если журнал действительно перечитывается
+    m_model->refreshIfChanged();
+}
+
+void MovementsWidget::onFilterChanged()
+{
+    MovementsFilter filter;
+    filter.onlyPosted = m_onlyPostedCheck->isChecked();
+    filter.showStorno = m_showStornoCheck->isChecked();
+    filter.productId = m_productCombo->currentData().toInt();
+    filter.docNumber = m_docNumberEdit->text().trimmed();
+
+    if (m_periodCheck->isChecked()) {
+        filter.dateFrom = m_fromEdit->date();
+        filter.dateTo = m_toEdit->date();
+    }
+
+    const int type = m_typeCombo->currentData().toInt();
+    if (type >= 0)
+        filter.docType = static_cast<DocumentType>(type);
+
+    m_estimate = -1;
+    m_model->setFilter(filter);
 }
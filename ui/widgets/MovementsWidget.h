@@ -7,40 +7,33 @@
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QCheckBox>
-#include <QSqlQueryModel>
+#include <QPersistentModelIndex>
 
-class MovementsModel : public QSqlQueryModel
-{
-    Q_OBJECT
-public:
-    explicit MovementsModel(QObject* parent = nullptr);
+class QComboBox;
+class QDateEdit;
+class QLabel;
+class QLineEdit;
 
-    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
-
-    void setOnlyPosted(bool v);
-    void setShowStorno(bool v);
-
-    void refresh();
-
-private:
-    bool m_onlyPosted = false;
-    bool m_showStorno = true;
-};
+class MovementsModel;
+class WriteQueue;
 
 class MovementsWidget : public QWidget
 {
     Q_OBJECT
 
 public:
-    explicit MovementsWidget(QWidget *parent = nullptr);
+    explicit MovementsWidget(WriteQueue* writeQueue, QWidget *parent = nullptr);
 
 private slots:
     void onRefreshClicked();
-    void onOnlyPostedChanged(Qt::CheckState state);
-    void onShowStornoChanged(Qt::CheckState state);
+    void onFilterChanged();
 
 private:
     void setupUi();
+    void loadProducts();
+    void updateStatusLabel();
+
+    WriteQueue* m_writeQueue = nullptr;
 
     QTableView* m_tableView = nullptr;
     MovementsModel* m_model = nullptr;
@@ -48,6 +41,17 @@ private:
     QCheckBox* m_onlyPostedCheck = nullptr;
     QCheckBox* m_showStornoCheck = nullptr;
 
+    QComboBox* m_productCombo = nullptr;
+    QComboBox* m_typeCombo = nullptr;
+    QLineEdit* m_docNumberEdit = nullptr;
+    QCheckBox* m_periodCheck = nullptr;
+    QDateEdit* m_fromEdit = nullptr;
+    QDateEdit* m_toEdit = nullptr;
+
+    QLabel* m_statusLabel = nullptr;
+    qint64 m_estimate = -1;
+    QPersistentModelIndex m_topRow;     // верхняя видимая строка, пока окно модели сдвигается
+
     QPushButton* m_refreshButton = nullptr;
 };
 
@@ -1,5 +1,8 @@
 #include "ProductsWidget.h"
 #include "DbManager.h"
+#include "ChangeTracker.h"
+#include "ChangeBus.h"
+#include "repositories/SearchRepository.h"
 #include "ProductForm.h"
 
 #include <QHeaderView>
@@ -16,6 +19,21 @@ void ProductsWidget::setupUi()
 {
     QVBoxLayout* mainLayout = new QVBoxLayout(this);
 
+    m_searchEdit = new QLineEdit(this);
+    m_searchEdit->setPlaceholderText("Поиск по наименованию");
+    m_searchEdit->setClearButtonEnabled(true);
+    mainLayout->addWidget(m_searchEdit);
+
+    // фильтр по FTS-индексу; запрос на каждую букву не нужен
+    m_searchTimer = new QTimer(this);
+    m_searchTimer->setSingleShot(true);
+    m_searchTimer->setInterval(200);
+    connect(m_searchEdit, &QLineEdit::textChanged, m_searchTimer, qOverload<>(&QTimer::start));
+    connect(m_searchTimer, &QTimer::timeout, this, &ProductsWidget::onSearchChanged);
+
+    if (!SearchRepository(DbManager::instance().database()).isAvailable())
+        m_searchEdit->hide();
+
     m_tableView = new QTableView(this);
     m_model = new QSqlTableModel(this, DbManager::instance().database());
     m_model->setTable("products");
@@ -66,21 +84,47 @@ void ProductsWidget::setupUi()
     connect(m_editButton, &QPushButton::clicked, this, &ProductsWidget::onEditClicked);
     connect(m_refreshButton, &QPushButton::clicked, this, &ProductsWidget::onRefreshClicked);
 
+    // QSqlTableModel по строкам не обновить: сверяем счётчик и перечитываем
+    connect(&ChangeBus::instance(), &ChangeBus::remoteChanged, this, [this](const ChangeSet& changes) {
+        if (changes.contains("products")) refreshIfChanged();
+    });
+
     refreshModel();
 }
 
 void ProductsWidget::refreshModel()
 {
+    m_loadedVersion = ChangeTracker::version(m_model->database(), {"products"});
     m_model->select();
 }
 
+void ProductsWidget::refreshIfChanged()
+{
+    const qint64 version = ChangeTracker::version(m_model->database(), {"products"});
+    if (ChangeTracker::isStale(m_loadedVersion, version))
+        refreshModel();
+}
+
+void ProductsWidget::onSearchChanged()
+{
+    QString filter = "is_active = 1";
+
+    // в выражении только слова, кавычки и *, одинарных кавычек там не бывает
+    const QString match = SearchRepository::matchExpression(m_searchEdit->text());
+    if (!match.isEmpty())
+        filter += QString(" AND id IN (SELECT rowid FROM products_fts WHERE products_fts MATCH '%1')").arg(match);
+
+    m_model->setFilter(filter);
+    refreshModel();
+}
+
 void ProductsWidget::onAddClicked()
 {
     ProductForm form(this);
     form.loadData(0);
 
     if (form.exec() == QDialog::Accepted) {
-        refreshModel();
+        refreshIfChanged();
     }
 }
 
@@ -99,11 +143,11 @@ void ProductsWidget::onEditClicked()
     form.loadData(id);
 
     if (form.exec() == QDialog::Accepted) {
-        refreshModel();
+        refreshIfChanged();
     }
 }
 
 void ProductsWidget::onRefreshClicked()
 {
-    refreshModel();
+    refreshIfChanged();
 }
@@ -0,0 +1,105 @@
+#include "SearchCompleter.h"
+#include "ReadPool.h"
+
+#include <QAbstractItemView>
+#include <QLineEdit>
+#include <QStandardItemModel>
+#include <QTimer>
+
+namespace {
+
+constexpr int HitIndexRole = Qt::UserRole + 1;
+
+} // namespace
+
+SearchCompleter::SearchCompleter(Scope scope, QObject* parent)
+    : QCompleter(parent)
+    , m_scope(scope)
+{
+    m_model = new QStandardItemModel(this);
+    setModel(m_model);
+    setCompletionMode(QCompleter::UnfilteredPopupCompletion);
+    setCaseSensitivity(Qt::CaseInsensitive);
+    setMaxVisibleItems(12);
+
+    m_timer = new QTimer(this);
+    m_timer->setSingleShot(true);
+    m_timer->setInterval(kDebounceMs);
+    connect(m_timer, &QTimer::timeout, this, &SearchCompleter::onSearchTimeout);
+
+    connect(this, qOverload<const QModelIndex&>(&QCompleter::activated),
+            this, &SearchCompleter::onActivated);
+}
+
+void SearchCompleter::attach(QLineEdit* edit)
+{
+    m_edit = edit;
+    setWidget(edit);
+    connect(edit, &QLineEdit::textEdited, this, &SearchCompleter::onTextEdited);
+}
+
+void SearchCompleter::onTextEdited(const QString& text)
+{
+    if (text.trimmed().size() < kMinChars) {
+        m_timer->stop();
+        ++m_generation;
+        popup()->hide();
+        return;
+    }
+    m_timer->start();
+}
+
+void SearchCompleter::onSearchTimeout()
+{
+    if (!m_edit) return;
+
+    const QString text = m_edit->text();
+    const Scope scope = m_scope;
+    const quint64 generation = ++m_generation;
+
+    ReadPool::instance().run<QList<SearchHit>>([text, scope](QSqlDatabase db) {
+        SearchRepository repo(db);
+        return scope == Scope::Products ? repo.searchProducts(text)
+                                        : repo.searchAll(text, 8);
+    }).then(this, [this, generation](const QList<SearchHit>& hits) {
+        if (generation == m_generation)
+            showHits(hits);
+    });
+}
+
+void SearchCompleter::showHits(const QList<SearchHit>& hits)
+{
+    m_hits = hits;
+    m_model->clear();
+
+    for (int i = 0; i < hits.size(); ++i) {
+        const SearchHit& hit = hits.at(i);
+        auto* item = new QStandardItem(hit.title);
+        item->setData(i, HitIndexRole);
+        item->setToolTip(hit.details);
+        if (m_scope == Scope::Everything)
+            item->setText(hit.title + "  —  " + hit.details);
+        m_model->appendRow(item);
+    }
+
+    if (hits.isEmpty()) {
+        popup()->hide();
+        return;
+    }
+
+    // completionPrefix не фильтрует (UnfilteredPopupCompletion), только открывает список
+    setCompletionPrefix(m_edit->text());
+    complete();
+}
+
+void SearchCompleter::onActivated(const QModelIndex& index)
+{
+    const int i = index.data(HitIndexRole).toInt();
+    if (i < 0 || i >= m_hits.size()) return;
+
+    const SearchHit hit = m_hits.at(i);
+
+    // в поле оставляем само название, без пояснения
+    if (m_edit) m_edit->setText(hit.title);
+    emit hitActivated(hit);
+}
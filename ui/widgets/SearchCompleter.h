@@ -0,0 +1,60 @@
+#ifndef SEARCHCOMPLETER_H
+#define SEARCHCOMPLETER_H
+
+#include <QCompleter>
+#include <QList>
+#include <QString>
+
+#include "repositories/SearchRepository.h"
+
+class QLineEdit;
+class QStandardItemModel;
+class QTimer;
+
+/**
+ * @brief Подсказки по полнотекстовому индексу (SearchRepository)
+ *
+ * Ввод в привязанном поле с небольшой задержкой уходит запросом в ReadPool;
+ * найденное показывается всплывающим списком в порядке ранжирования.
+ * QCompleter сам ничего не фильтрует — всё делает FTS5.
+ */
+class SearchCompleter : public QCompleter
+{
+    Q_OBJECT
+
+public:
+    enum class Scope {
+        Products,       // только активные товары (выбор товара в строке документа)
+        Everything      // товары, контрагенты, документы
+    };
+
+    explicit SearchCompleter(Scope scope, QObject* parent = nullptr);
+
+    // поле, ввод которого отслеживается (для QComboBox — его lineEdit())
+    void attach(QLineEdit* edit);
+
+signals:
+    void hitActivated(const SearchHit& hit);
+
+private slots:
+    void onTextEdited(const QString& text);
+    void onSearchTimeout();
+    void onActivated(const QModelIndex& index);
+
+private:
+    void showHits(const QList<SearchHit>& hits);
+
+private:
+    Scope m_scope;
+    QLineEdit* m_edit = nullptr;
+    QStandardItemModel* m_model = nullptr;
+    QTimer* m_timer = nullptr;
+
+    QList<SearchHit> m_hits;
+    quint64 m_generation = 0;      // ответы на устаревший ввод отбрасываются
+
+    static constexpr int kDebounceMs = 150;
+    static constexpr int kMinChars = 2;
+};
+
+#endif // SEARCHCOMPLETER_H
@@ -1,7 +1,11 @@
 #include "StockBalancesWidget.h"
-#include "DbManager.h"
 #include "WriteOffForm.h"
+#include "WriteQueue.h"
 #include "DecimalUtils.h"
+#include "ReadPool.h"
+#include "SqlCollation.h"
+#include "ChangeTracker.h"
+#include "repositories/SqlBatch.h"
 
 #include <QSqlDatabase>
 #include <QSqlQuery>
@@ -10,8 +14,10 @@
 #include <QDebug>
 #include <QColor>
 #include <QMessageBox>
-#include <QDate>
-#include <QDateTime>
+#include <QSignalBlocker>
+#include <QSet>
+
+#include <algorithm>
 
 // ---------------------
 // Model
@@ -41,22 +47,33 @@ QVariant StockBalancesModel::data(const QModelIndex &index, int role) const
 
     const BalanceItem &item = m_data[index.row()];
 
+    switch (role) {
+        case ProductIdRole: return item.productId;
+        case IsActiveRole:  return item.isActive;
+        case BalanceRole:   return item.balanceKg;
+        default: break;
+    }
+
     if (role == Qt::DisplayRole) {
+        static const QString yes = QStringLiteral("Да");
+        static const QString no = QStringLiteral("Нет");
+
         switch (index.column()) {
             case 0: return item.productId;
             case 1: return item.productName;
-            case 2: return item.isActive ? "Да" : "Нет";
-            case 3: return QString::number(item.balanceKg, 'f', 2);
+            case 2: return item.isActive ? yes : no;
+            case 3: return item.balanceText;
             case 4: return item.unit;
-            case 5: return decimalToString(item.price);
-            case 6: return decimalToString(item.price * Decimal(item.balanceKg));
+            case 5: return item.priceText;
+            case 6: return item.sumText;
             default: return {};
         }
     }
 
     if (role == Qt::ForegroundRole) {
+        static const QVariant gray = QColor(Qt::gray);
         if (item.isActive == 0)
-            return QColor(Qt::gray);
+            return gray;
     }
 
     if (role == Qt::TextAlignmentRole) {
@@ -85,90 +102,321 @@ QVariant StockBalancesModel::headerData(int section, Qt::Orientation orientation
     return {};
 }
 
-void StockBalancesModel::setShowInactive(bool v)
+void StockBalancesModel::updateCells(BalanceItem &item, bool priceChanged)
 {
-    if (m_showInactive == v) return;
-    m_showInactive = v;
-    refresh();
+    if (priceChanged)
+        item.priceText = decimalToString(item.price);
+
+    item.balanceText = QString::number(item.balanceKg, 'f', 2);
+    item.sumText = decimalToString(item.price * Decimal(item.balanceKg));
 }
 
-void StockBalancesModel::setHideZero(bool v)
+void StockBalancesModel::refresh()
 {
-    if (m_hideZero == v) return;
-    m_hideZero = v;
-    refresh();
+    // агрегат по всему журналу считается в ReadPool, GUI не ждёт
+    const quint64 generation = ++m_generation;
+    m_loading = true;
+    m_deltasWhileLoading = false;
+
+    ReadPool::instance().run<std::optional<Loaded>>([](QSqlDatabase db) {
+        return loadAll(db);
+    }).then(this, [this, generation](const std::optional<Loaded> &loaded) {
+        if (generation != m_generation) return;
+        m_loading = false;
+
+        if (loaded) {
+            beginResetModel();
+            m_data = loaded->items;
+            m_loadedVersion = loaded->version;
+            rebuildIndex();
+            endResetModel();
+        }
+
+        // снимок мог быть прочитан до или после этих изменений — перечитываем
+        if (m_deltasWhileLoading)
+            refresh();
+    });
 }
 
-void StockBalancesModel::refresh()
+void StockBalancesModel::refreshIfChanged()
 {
-    beginResetModel();
-    m_data.clear();
+    if (m_loading) return;
+
+    const quint64 generation = m_generation;
+    ReadPool::instance().run<qint64>([](QSqlDatabase db) {
+        return ChangeTracker::version(db, changeTables());
+    }).then(this, [this, generation](qint64 version) {
+        // за это время модель уже перечитали
+        if (generation != m_generation || m_loading) return;
+        if (ChangeTracker::isStale(m_loadedVersion, version))
+            refresh();
+    });
+}
 
-    QSqlDatabase db = DbManager::instance().database();
-    if (!db.isOpen()) {
-        endResetModel();
-        return;
-    }
+const QStringList &StockBalancesModel::changeTables()
+{
+    static const QStringList tables = {"products", "inventory_movements"};
+    return tables;
+}
 
+std::optional<StockBalancesModel::Loaded> StockBalancesModel::loadAll(QSqlDatabase db)
+{
     // ВАЖНО:
     // Баланс считаем только по НЕотмененным движениям (cancelled_flag = 0),
     // иначе в таблице будут "фантомные" остатки и можно списать в минус.
-    QString sql = R"(
+    // Грузим все товары: фильтры применяет прокси, без повторного запроса.
+    // Движения закрытых лет лежат в архиве, вместо них — входящий остаток.
+    // порядок — прямо из idx_products_active_name, сумма — по индексу движений товара
+    const QString sql = QString(R"(
         SELECT
             p.id        AS id,
             p.name      AS name,
             p.is_active AS is_active,
             p.unit      AS unit,
             p.price     AS price,
-            COALESCE(SUM(CASE WHEN im.cancelled_flag = 0 THEN im.qty_delta_kg ELSE 0 END), 0) AS balance
+            COALESCE((SELECT o.balance_kg FROM stock_opening_balances o WHERE o.product_id = p.id), 0)
+          + (SELECT COALESCE(SUM(im.qty_delta_kg), 0)
+             FROM inventory_movements im
+             WHERE im.product_id = p.id AND im.cancelled_flag = 0) AS balance
         FROM products p
-        LEFT JOIN inventory_movements im ON p.id = im.product_id
-        WHERE 1=1
-    )";
+        ORDER BY p.is_active DESC, %1
+    )").arg(SqlCollation::orderBy("p.name"));
+
+    // версия до данных: запись между ними даст лишнее перечитывание, а не пропущенное
+    const qint64 version = ChangeTracker::version(db, changeTables());
 
-    if (!m_showInactive) {
-        sql += " AND p.is_active = 1 ";
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if (!query.exec(sql)) {
+        qWarning() << "StockBalancesModel::refresh SQL error:" << query.lastError().text();
+        qWarning() << "SQL:" << sql;
+        return std::nullopt;
     }
 
-    sql += R"(
-        GROUP BY p.id, p.name, p.is_active, p.unit, p.price
-    )";
+    Loaded loaded;
+    loaded.version = version;
+    while (query.next())
+        loaded.items.append(itemFromQuery(query));
+    return loaded;
+}
+
+StockBalancesModel::BalanceItem StockBalancesModel::itemFromQuery(const QSqlQuery &query)
+{
+    BalanceItem item;
+    item.productId = query.value(0).toInt();
+    item.productName = query.value(1).toString();
+    item.isActive = query.value(2).toInt();
+    item.unit = query.value(3).toString();
+    item.price = decimalFromVariant(query.value(4));
+    item.balanceKg = query.value(5).toDouble();
+    updateCells(item, true);
+    return item;
+}
 
-    if (m_hideZero) {
-        sql += " HAVING ABS(balance) > 0.000001 ";
+std::optional<QList<StockBalancesModel::BalanceItem>> StockBalancesModel::loadChanged(
+    QSqlDatabase db, const QList<int> &productIds, const QList<int> &movementIds)
+{
+    QSet<int> products(productIds.cbegin(), productIds.cend());
+
+    for (qsizetype offset = 0; offset < movementIds.size(); offset += kSqlMaxBatchIds) {
+        const QList<int> batch = movementIds.mid(offset, kSqlMaxBatchIds);
+
+        QSqlQuery q(db);
+        q.setForwardOnly(true);
+        q.prepare(QString("SELECT id, product_id FROM inventory_movements WHERE id IN (%1)")
+                      .arg(sqlPlaceholders(batch.size())));
+        for (int id : batch) q.addBindValue(id);
+        if (!q.exec()) {
+            qWarning() << "StockBalancesModel::loadChanged SQL error:" << q.lastError().text();
+            return std::nullopt;
+        }
+
+        int found = 0;
+        while (q.next()) {
+            products.insert(q.value(1).toInt());
+            ++found;
+        }
+        // товар удалённого движения уже не узнать
+        if (found != batch.size())
+            return std::nullopt;
     }
 
-    // sort убран -> сортируем по активности и имени
-    sql += " ORDER BY p.is_active DESC, p.name ASC ";
+    const QList<int> ids(products.cbegin(), products.cend());
+    QList<BalanceItem> items;
 
-    QSqlQuery query(db);
-    if (!query.exec(sql)) {
-        qWarning() << "StockBalancesModel::refresh SQL error:" << query.lastError().text();
-        qWarning() << "SQL:" << sql;
-        endResetModel();
+    for (qsizetype offset = 0; offset < ids.size(); offset += kSqlMaxBatchIds) {
+        const QList<int> batch = ids.mid(offset, kSqlMaxBatchIds);
+
+        QSqlQuery q(db);
+        q.setForwardOnly(true);
+        q.prepare(QString(R"(
+            SELECT
+                p.id, p.name, p.is_active, p.unit, p.price,
+                COALESCE((SELECT o.balance_kg FROM stock_opening_balances o WHERE o.product_id = p.id), 0)
+              + COALESCE((SELECT SUM(im.qty_delta_kg) FROM inventory_movements im
+                          WHERE im.product_id = p.id AND im.cancelled_flag = 0), 0) AS balance
+            FROM products p
+            WHERE p.id IN (%1)
+        )").arg(sqlPlaceholders(batch.size())));
+        for (int id : batch) q.addBindValue(id);
+        if (!q.exec()) {
+            qWarning() << "StockBalancesModel::loadChanged SQL error:" << q.lastError().text();
+            return std::nullopt;
+        }
+
+        while (q.next())
+            items.append(itemFromQuery(q));
+    }
+
+    return items;
+}
+
+void StockBalancesModel::reloadProducts(const QList<int> &productIds, const QList<int> &movementIds)
+{
+    if (productIds.isEmpty() && movementIds.isEmpty()) return;
+
+    if (m_loading) {
+        m_deltasWhileLoading = true;
+        return;
+    }
+
+    const quint64 generation = m_generation;
+    ReadPool::instance().run<std::optional<QList<BalanceItem>>>([productIds, movementIds](QSqlDatabase db) {
+        return loadChanged(db, productIds, movementIds);
+    }).then(this, [this, generation](const std::optional<QList<BalanceItem>> &items) {
+        if (generation != m_generation || m_loading) return;
+
+        if (!items) {
+            refresh();
+            return;
+        }
+
+        for (const BalanceItem &item : *items) {
+            const auto rowIt = m_rowByProduct.constFind(item.productId);
+            if (rowIt != m_rowByProduct.constEnd()) {
+                const int row = rowIt.value();
+                m_data[row] = item;
+                emit dataChanged(index(row, 0), index(row, columnCount() - 1));
+                continue;
+            }
+            insertItem(item);
+        }
+    });
+}
+
+bool StockBalancesModel::isBefore(const BalanceItem &a, const BalanceItem &b)
+{
+    if (a.isActive != b.isActive) return a.isActive > b.isActive;
+    const int byName = SqlCollation::compare(a.productName, b.productName);
+    if (byName != 0) return byName < 0;
+    return a.productId < b.productId;
+}
+
+void StockBalancesModel::insertItem(const BalanceItem &item)
+{
+    const auto pos = std::lower_bound(m_data.cbegin(), m_data.cend(), item, &StockBalancesModel::isBefore);
+    const int row = int(pos - m_data.cbegin());
+
+    beginInsertRows(QModelIndex(), row, row);
+    m_data.insert(row, item);
+    rebuildIndex();
+    endInsertRows();
+}
+
+void StockBalancesModel::rebuildIndex()
+{
+    m_rowByProduct.clear();
+    m_rowByProduct.reserve(m_data.size());
+    for (int i = 0; i < m_data.size(); ++i)
+        m_rowByProduct.insert(m_data[i].productId, i);
+}
+
+void StockBalancesModel::applyDeltas(const StockDeltas &deltas)
+{
+    if (m_loading) {
+        m_deltasWhileLoading = true;
         return;
     }
 
-    while (query.next()) {
-        BalanceItem item;
-        item.productId = query.value("id").toInt();
-        item.productName = query.value("name").toString();
-        item.isActive = query.value("is_active").toInt();
-        item.unit = query.value("unit").toString();
-        item.price = decimalFromVariant(query.value("price"));
-        item.balanceKg = query.value("balance").toDouble();
-        m_data.append(item);
+    QList<int> newProducts;
+    for (auto it = deltas.constBegin(); it != deltas.constEnd(); ++it) {
+        const auto rowIt = m_rowByProduct.constFind(it.key());
+        if (rowIt == m_rowByProduct.constEnd()) {
+            newProducts.append(it.key());
+            continue;
+        }
+
+        const int row = rowIt.value();
+        BalanceItem &item = m_data[row];
+        item.balanceKg += it.value();
+        updateCells(item, false);
+        emit dataChanged(index(row, 3), index(row, columnCount() - 1), {Qt::DisplayRole, BalanceRole});
     }
 
-    endResetModel();
+    // товар создан после загрузки — его строку с остатком целиком прочитает ReadPool;
+    // запись уже зафиксирована, так что дельту к прочитанному не добавляем
+    reloadProducts(newProducts, {});
+}
+
+void StockBalancesModel::setBalances(const QHash<int, double> &balances)
+{
+    if (m_data.isEmpty()) return;
+
+    // в модели теперь не текущие остатки: «Обновить» должно перечитать их
+    m_loadedVersion = -1;
+
+    for (BalanceItem &item : m_data) {
+        item.balanceKg = balances.value(item.productId, 0.0);
+        updateCells(item, false);
+    }
+    emit dataChanged(index(0, 3), index(m_data.size() - 1, columnCount() - 1), {Qt::DisplayRole, BalanceRole});
+}
+
+// ---------------------
+// Filter
+// ---------------------
+
+StockBalancesFilterModel::StockBalancesFilterModel(QObject *parent)
+    : QSortFilterProxyModel(parent)
+{
+    // при dataChanged строка с обнулившимся остатком скрывается/появляется сама
+    setDynamicSortFilter(true);
+}
+
+void StockBalancesFilterModel::setShowInactive(bool v)
+{
+    if (m_showInactive == v) return;
+    m_showInactive = v;
+    invalidateRowsFilter();
+}
+
+void StockBalancesFilterModel::setHideZero(bool v)
+{
+    if (m_hideZero == v) return;
+    m_hideZero = v;
+    invalidateRowsFilter();
+}
+
+bool StockBalancesFilterModel::filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const
+{
+    const QModelIndex idx = sourceModel()->index(sourceRow, 0, sourceParent);
+
+    if (!m_showInactive && idx.data(StockBalancesModel::IsActiveRole).toInt() == 0)
+        return false;
+
+    if (m_hideZero && qAbs(idx.data(StockBalancesModel::BalanceRole).toDouble()) <= 0.000001)
+        return false;
+
+    return true;
 }
 
 // ---------------------
 // Widget
 // ---------------------
 
-StockBalancesWidget::StockBalancesWidget(QWidget *parent)
+StockBalancesWidget::StockBalancesWidget(WriteQueue* writeQueue, QWidget *parent)
     : QWidget(parent)
+    , m_writeQueue(writeQueue)
 {
     setupUi();
 }
@@ -200,8 +448,10 @@ void StockBalancesWidget::setupUi()
 
     m_tableView = new QTableView(this);
     m_model = new StockBalancesModel(this);
+    m_filter = new StockBalancesFilterModel(this);
+    m_filter->setSourceModel(m_model);
 
-    m_tableView->setModel(m_model);
+    m_tableView->setModel(m_filter);
     m_tableView->setSelectionBehavior(QAbstractItemView::SelectRows);
     m_tableView->setSelectionMode(QAbstractItemView::SingleSelection);
     m_tableView->horizontalHeader()->setStretchLastSection(true);
@@ -216,6 +466,20 @@ void StockBalancesWidget::setupUi()
 
     mainLayout->addWidget(m_tableView);
 
+    // остатки на прошлую дату считает StockTimeline в памяти, без запросов к журналу
+    QHBoxLayout* timelineLayout = new QHBoxLayout();
+    timelineLayout->addWidget(new QLabel("Остатки на:", this));
+
+    m_timelineSlider = new QSlider(Qt::Horizontal, this);
+    m_timelineSlider->setEnabled(false);
+    timelineLayout->addWidget(m_timelineSlider, 1);
+
+    m_timelineLabel = new QLabel("сейчас", this);
+    m_timelineLabel->setMinimumWidth(90);
+    timelineLayout->addWidget(m_timelineLabel);
+
+    mainLayout->addLayout(timelineLayout);
+
     connect(m_refreshButton, &QPushButton::clicked, this, &StockBalancesWidget::onRefreshClicked);
     connect(m_writeOffButton, &QPushButton::clicked, this, &StockBalancesWidget::onWriteOffClicked);
 
@@ -223,22 +487,124 @@ void StockBalancesWidget::setupUi()
     connect(m_showInactiveCheck, &QCheckBox::checkStateChanged, this, &StockBalancesWidget::onShowInactiveChanged);
     connect(m_hideZeroCheck, &QCheckBox::checkStateChanged, this, &StockBalancesWidget::onHideZeroChanged);
 
+    connect(m_timelineSlider, &QSlider::valueChanged, this, &StockBalancesWidget::onTimelineMoved);
+
+    // перечитанная модель несёт текущие остатки — в режиме «на дату» подменяем их снова
+    connect(m_model, &QAbstractItemModel::modelReset, this, [this]() {
+        if (isAsOfMode()) showBalancesAsOf();
+    });
+
+    // остатки меняются и из других вкладок (поставки, ТТН)
+    if (m_writeQueue) {
+        connect(m_writeQueue, &WriteQueue::stockChanged, this, &StockBalancesWidget::onStockChanged);
+        connect(m_writeQueue, &WriteQueue::timelineLoaded, this, [this]() {
+            updateTimelineRange();
+            if (isAsOfMode()) showBalancesAsOf();
+        });
+        // изменения других экземпляров поток записи вносит в StockTimeline по товарам
+        connect(m_writeQueue, &WriteQueue::timelineChanged, this, [this]() {
+            if (isAsOfMode()) showBalancesAsOf();
+        });
+        updateTimelineRange();
+    }
+
+    // и из других экземпляров приложения на той же базе
+    connect(&ChangeBus::instance(), &ChangeBus::remoteChanged, this, &StockBalancesWidget::onRemoteChanged);
+
     m_model->refresh();
 }
 
 void StockBalancesWidget::onRefreshClicked()
 {
-    m_model->refresh();
+    updateTimelineRange();
+    m_model->refreshIfChanged();
+}
+
+void StockBalancesWidget::onStockChanged(const StockDeltas &deltas)
+{
+    if (!m_timelineStart.isValid()) {
+        updateTimelineRange();
+    }
+
+    if (isAsOfMode()) {
+        // проведение задним числом меняет и прошлые остатки
+        showBalancesAsOf();
+        return;
+    }
+    m_model->applyDeltas(deltas);
+}
+
+void StockBalancesWidget::onRemoteChanged(const ChangeSet &changes)
+{
+    // остатки на дату обновятся, когда поток записи внесёт изменения в StockTimeline
+    if (isAsOfMode()) return;
+
+    if (ChangeBus::isTableReset(changes, "products") || ChangeBus::isTableReset(changes, "inventory_movements")) {
+        m_model->refreshIfChanged();
+        return;
+    }
+    m_model->reloadProducts(ChangeBus::rowIds(changes, "products"),
+                            ChangeBus::rowIds(changes, "inventory_movements"));
+}
+
+void StockBalancesWidget::updateTimelineRange()
+{
+    if (!m_writeQueue || !m_writeQueue->timeline().isLoaded())
+        return;
+
+    const QDate today = QDate::currentDate();
+    QDate start = m_writeQueue->timeline().firstDate();
+    if (!start.isValid() || start > today)
+        start = today;
+
+    m_timelineStart = start;
+
+    const QSignalBlocker blocker(m_timelineSlider);
+    const int days = int(start.daysTo(today));
+    const QDate asOf = m_asOf;
+    m_timelineSlider->setRange(0, days);
+    m_timelineSlider->setPageStep(30);
+    m_timelineSlider->setValue(asOf.isValid() ? int(qBound(qint64(0), start.daysTo(asOf), qint64(days))) : days);
+    m_timelineSlider->setEnabled(days > 0);
+}
+
+void StockBalancesWidget::onTimelineMoved(int value)
+{
+    if (!m_timelineStart.isValid()) return;
+
+    // правый край — текущие остатки из журнала, с будущими датами и новыми товарами
+    if (value >= m_timelineSlider->maximum()) {
+        const bool wasAsOf = isAsOfMode();
+        m_asOf = QDate();
+        m_timelineLabel->setText("сейчас");
+        m_writeOffButton->setEnabled(true);
+        if (wasAsOf)
+            m_model->refresh();
+        return;
+    }
+
+    m_asOf = m_timelineStart.addDays(value);
+    m_timelineLabel->setText(m_asOf.toString("dd.MM.yyyy"));
+
+    // списание — только от текущего остатка
+    m_writeOffButton->setEnabled(false);
+    showBalancesAsOf();
+}
+
+void StockBalancesWidget::showBalancesAsOf()
+{
+    if (!m_writeQueue || !m_asOf.isValid()) return;
+    m_model->setBalances(m_writeQueue->timeline().balancesAt(m_asOf));
 }
 
 void StockBalancesWidget::onShowInactiveChanged(Qt::CheckState state)
 {
-    m_model->setShowInactive(state == Qt::Checked);
+    m_filter->setShowInactive(state == Qt::Checked);
 }
 
 void StockBalancesWidget::onHideZeroChanged(Qt::CheckState state)
 {
-    m_model->setHideZero(state == Qt::Checked);
+    m_filter->setHideZero(state == Qt::Checked);
 }
 
 int StockBalancesWidget::selectedProductId() const
@@ -250,9 +616,7 @@ int StockBalancesWidget::selectedProductId() const
     if (rows.isEmpty())
         return 0;
 
-    const QModelIndex idx = rows.first();
-    const QModelIndex idIdx = m_model->index(idx.row(), 0);
-    return m_model->data(idIdx, Qt::DisplayRole).toInt();
+    return rows.first().data(StockBalancesModel::ProductIdRole).toInt();
 }
 
 void StockBalancesWidget::onWriteOffClicked()
@@ -263,14 +627,15 @@ void StockBalancesWidget::onWriteOffClicked()
         return;
     }
 
-    WriteOffForm dlg(this);
+    WriteOffForm dlg(m_writeQueue ? &m_writeQueue->reservations() : nullptr, this);
     dlg.setProductId(selectedPid);
     dlg.lockProductSelection(true);
 
     // Если выбранный товар не отобразился в форме (обычно: остаток 0 и он отфильтрован),
     // то диалог будет без товара/или ОК будет выключен — но лучше сказать сразу.
     if (dlg.productId() != selectedPid) {
-        QMessageBox::warning(this, "Списание", "По выбранному товару нет остатка для списания.");
+        QMessageBox::warning(this, "Списание", "По выбранному товару нет свободного остатка для списания\n"
+                                                   "(остаток отсутствует или зарезервирован черновиками).");
         return;
     }
 
@@ -287,92 +652,19 @@ void StockBalancesWidget::onWriteOffClicked()
         return;
     }
 
-    QSqlDatabase db = DbManager::instance().database();
-    if (!db.isOpen()) {
-        QMessageBox::critical(this, "Ошибка", "База данных не открыта");
-        return;
-    }
-
-    // Проверяем актуальный баланс по НЕотмененным движениям
-    double balNow = 0.0;
-    {
-        QSqlQuery q(db);
-        q.prepare("SELECT COALESCE(SUM(qty_delta_kg),0) "
-                  "FROM inventory_movements WHERE product_id=:p AND cancelled_flag=0");
-        q.bindValue(":p", pid);
-        if (!q.exec() || !q.next()) {
-            QMessageBox::critical(this, "Ошибка БД", "Не удалось получить остаток:\n" + q.lastError().text());
-            return;
-        }
-        balNow = q.value(0).toDouble();
-    }
-
-    if (balNow + 1e-9 < qty) {
-        QMessageBox::warning(this, "Списание",
-                             QString("Недостаточно остатка для списания.\nДоступно: %1 кг")
-                                 .arg(QString::number(balNow, 'f', 3)));
-        return;
-    }
-
-    if (!db.transaction()) {
-        QMessageBox::warning(this, "Ошибка БД", "Не удалось начать транзакцию:\n" + db.lastError().text());
+    if (!m_writeQueue) {
+        QMessageBox::critical(this, "Ошибка", "Очередь записи не передана");
         return;
     }
 
-    int docId = 0;
-
-    // 1) Создаём документ списания (doc_type = 'writeoff')
-    {
-        const QString number = QString("WRITEOFF-%1").arg(QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss"));
-
-        QSqlQuery q(db);
-        q.prepare(R"(
-            INSERT INTO documents (doc_type, number, date, status, sender_id, receiver_id, total_amount, notes)
-            VALUES ('writeoff', :number, :date, 'POSTED', NULL, NULL, :total, :notes)
-        )");
-        q.bindValue(":number", number);
-        q.bindValue(":date", QDate::currentDate().toString(Qt::ISODate));
-        q.bindValue(":total", decimalToString(Decimal(0)));
-        q.bindValue(":notes", reason.trimmed().isEmpty() ? QVariant() : QVariant(reason.trimmed()));
-
-        if (!q.exec()) {
-            db.rollback();
-            QMessageBox::critical(this, "Ошибка БД", "Не удалось создать документ списания:\n" + q.lastError().text());
-            return;
-        }
-        docId = q.lastInsertId().toInt();
-        if (docId <= 0) {
-            db.rollback();
-            QMessageBox::critical(this, "Ошибка БД", "Не удалось получить ID документа списания");
+    // остаток проверяется сервисом до начала транзакции
+    m_writeQueue->writeOff(pid, qty, reason).then(this, [this](const WriteResult& r) {
+        if (!r.ok) {
+            QMessageBox::warning(this, "Списание", r.error);
             return;
         }
-    }
 
-    // 2) Движение склада с отрицательным qty (расход)
-    {
-        QSqlQuery q(db);
-        q.prepare(R"(
-            INSERT INTO inventory_movements (document_id, product_id, qty_delta_kg, movement_date, cancelled_flag)
-            VALUES (:doc, :prod, :qty, :date, 0)
-        )");
-        q.bindValue(":doc", docId);
-        q.bindValue(":prod", pid);
-        q.bindValue(":qty", -qty);
-        q.bindValue(":date", QDate::currentDate().toString(Qt::ISODate));
-
-        if (!q.exec()) {
-            db.rollback();
-            QMessageBox::critical(this, "Ошибка БД", "Не удалось создать движение списания:\n" + q.lastError().text());
-            return;
-        }
-    }
-
-    if (!db.commit()) {
-        db.rollback();
-        QMessageBox::critical(this, "Ошибка БД", "Не удалось зафиксировать списание:\n" + db.lastError().text());
-        return;
-    }
-
-    QMessageBox::information(this, "Списание", "Списание выполнено");
-    m_model->refresh();
+        // строку обновит сигнал stockChanged, он приходит раньше этого продолжения
+        QMessageBox::information(this, "Списание", "Списание выполнено");
+    });
 }
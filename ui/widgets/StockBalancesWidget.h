@@ -7,16 +7,46 @@
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QAbstractTableModel>
+#include <QSortFilterProxyModel>
+#include <QHash>
 #include <QCheckBox>
+#include <QDate>
+#include <QLabel>
+#include <QSlider>
 #include <QString>
+#include <QStringList>
 #include <QList>
+#include <QSqlDatabase>
 
-#include "DecimalUtils.h"
+#include <optional>
 
+#include "DecimalUtils.h"
+#include "DocumentService.h"
+#include "ChangeBus.h"
+
+class WriteQueue;
+class QSqlQuery;
+
+/**
+ * @brief Остатки по всем товарам
+ *
+ * Модель держит все товары и индекс product id -> строка: изменения остатков
+ * применяются как dataChanged только по затронутым строкам, без сброса модели.
+ * Фильтры («неактивные», «нулевые») применяет StockBalancesFilterModel.
+ *
+ * Строки для отображения (остаток, цена, сумма) форматируются один раз при
+ * загрузке/изменении строки: data() при прокрутке только отдаёт готовые значения.
+ */
 class StockBalancesModel : public QAbstractTableModel
 {
     Q_OBJECT
 public:
+    enum Roles {
+        ProductIdRole = Qt::UserRole + 1,
+        IsActiveRole,
+        BalanceRole
+    };
+
     explicit StockBalancesModel(QObject *parent = nullptr);
 
     int rowCount(const QModelIndex &parent = QModelIndex()) const override;
@@ -24,23 +54,81 @@ public:
     QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
     QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
 
-    void setShowInactive(bool v);
-    void setHideZero(bool v);
-
     void refresh();
 
+    // «Обновить»: перечитать, только если товары или движения менялись после загрузки
+    void refreshIfChanged();
+
+    // применить изменения остатков после проведения/отмены без перечитывания таблицы
+    void applyDeltas(const StockDeltas &deltas);
+
+    // перечитать строки товаров, затронутых другим экземпляром приложения;
+    // движения сводятся к их товарам, удалённые движения — к полному перечитыванию
+    void reloadProducts(const QList<int> &productIds, const QList<int> &movementIds);
+
+    // показать остатки на дату: balances — product id -> остаток, отсутствующие товары — 0
+    void setBalances(const QHash<int, double> &balances);
+
 private:
     struct BalanceItem {
         int productId = 0;
-        QString productName;
         int isActive = 1;
-        QString unit;
-        Decimal price = 0;
         double balanceKg = 0.0;
+        Decimal price = 0;
+
+        // готовые ячейки, пересчитываются в updateCells()
+        QString productName;
+        QString unit;
+        QString balanceText;
+        QString priceText;
+        QString sumText;
+    };
+
+    struct Loaded {
+        qint64 version = -1;              // ChangeTracker, прочитана до данных
+        QList<BalanceItem> items;
     };
 
+    static void updateCells(BalanceItem &item, bool priceChanged);
+    static std::optional<Loaded> loadAll(QSqlDatabase db);
+    static const QStringList &changeTables();
+
+    // nullopt — перечитать всё (ошибка или движение уже удалено)
+    static std::optional<QList<BalanceItem>> loadChanged(QSqlDatabase db, const QList<int> &productIds,
+                                                         const QList<int> &movementIds);
+    static BalanceItem itemFromQuery(const QSqlQuery &query);
+
+    // строка a стоит выше строки b: порядок loadAll (активные, затем по имени)
+    static bool isBefore(const BalanceItem &a, const BalanceItem &b);
+    // товар, которого ещё нет в модели (создан после загрузки), — на своё место
+    void insertItem(const BalanceItem &item);
+    void rebuildIndex();
+
     QList<BalanceItem> m_data;
+    QHash<int, int> m_rowByProduct;   // product id -> строка m_data
+
+    quint64 m_generation = 0;
+    qint64 m_loadedVersion = -1;      // -1 — в модели не то, что прочитано (остатки на дату)
+    bool m_loading = false;
+    bool m_deltasWhileLoading = false;
+};
+
+/**
+ * @brief Фильтр остатков: неактивные и нулевые строки скрываются без перезапроса
+ */
+class StockBalancesFilterModel : public QSortFilterProxyModel
+{
+    Q_OBJECT
+public:
+    explicit StockBalancesFilterModel(QObject *parent = nullptr);
 
+    void setShowInactive(bool v);
+    void setHideZero(bool v);
+
+protected:
+    bool filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const override;
+
+private:
     bool m_showInactive = true;
     bool m_hideZero = false;
 };
@@ -50,7 +138,7 @@ class StockBalancesWidget : public QWidget
     Q_OBJECT
 
 public:
-    explicit StockBalancesWidget(QWidget *parent = nullptr);
+    explicit StockBalancesWidget(WriteQueue* writeQueue, QWidget *parent = nullptr);
 
 private slots:
     void onRefreshClicked();
@@ -59,19 +147,36 @@ private slots:
 
     void onWriteOffClicked();
 
+    void onTimelineMoved(int value);
+    void onStockChanged(const StockDeltas &deltas);
+    void onRemoteChanged(const ChangeSet &changes);
+
 private:
     void setupUi();
 
+    // диапазон ползунка: от первого движения до сегодня; правый край — «сейчас»
+    void updateTimelineRange();
+    void showBalancesAsOf();
+    bool isAsOfMode() const { return m_asOf.isValid(); }
+
     int selectedProductId() const;
 
+    WriteQueue* m_writeQueue = nullptr;
+
     QTableView* m_tableView = nullptr;
     StockBalancesModel* m_model = nullptr;
+    StockBalancesFilterModel* m_filter = nullptr;
 
     QCheckBox* m_showInactiveCheck = nullptr;
     QCheckBox* m_hideZeroCheck = nullptr;
 
     QPushButton* m_refreshButton = nullptr;
     QPushButton* m_writeOffButton = nullptr;
+
+    QSlider* m_timelineSlider = nullptr;
+    QLabel* m_timelineLabel = nullptr;
+    QDate m_timelineStart;
+    QDate m_asOf;                       // невалидная — текущие остатки
 };
 
 #endif // STOCKBALANCESWIDGET_H
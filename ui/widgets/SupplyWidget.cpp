@@ -1,20 +1,21 @@
 #include "SupplyWidget.h"
+#include "ChangeBus.h"
 #include "DbManager.h"
 #include "SupplyForm.h"
-#include "DocumentService.h"
+#include "BulkCancelForm.h"
+#include "WriteQueue.h"
+#include "models/DocumentListModel.h"
 
-#include <QSqlTableModel>
 #include <QTableView>
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QPushButton>
 #include <QHeaderView>
 #include <QMessageBox>
-#include <QSqlRecord>
 
-SupplyWidget::SupplyWidget(DocumentService* docService, QWidget* parent)
+SupplyWidget::SupplyWidget(WriteQueue* writeQueue, QWidget* parent)
     : QWidget(parent)
-    , m_docService(docService)
+    , m_writeQueue(writeQueue)
 {
     setupUi();
 }
@@ -24,18 +25,11 @@ void SupplyWidget::setupUi()
     auto* mainLayout = new QVBoxLayout(this);
 
     m_tableView = new QTableView(this);
-    m_model = new QSqlTableModel(this, DbManager::instance().database());
-    m_model->setTable("documents");
-    m_model->setFilter("doc_type = 'supply'");
-    m_model->setEditStrategy(QSqlTableModel::OnManualSubmit);
-
-    m_model->setHeaderData(m_model->fieldIndex("number"), Qt::Horizontal, "Номер");
-    m_model->setHeaderData(m_model->fieldIndex("date"), Qt::Horizontal, "Дата");
-    m_model->setHeaderData(m_model->fieldIndex("status"), Qt::Horizontal, "Статус");
-    m_model->setHeaderData(m_model->fieldIndex("sender_id"), Qt::Horizontal, "Поставщик (ID)");
-    m_model->setHeaderData(m_model->fieldIndex("total_amount"), Qt::Horizontal, "Сумма");
+    m_model = new DocumentListModel(DocumentType::Supply, this);
 
     m_tableView->setModel(m_model);
+    m_tableView->hideColumn(DocumentListModel::ReceiverColumn);
+    m_tableView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
     m_tableView->setSelectionBehavior(QAbstractItemView::SelectRows);
     m_tableView->setSelectionMode(QAbstractItemView::SingleSelection);
     m_tableView->horizontalHeader()->setStretchLastSection(true);
@@ -49,12 +43,14 @@ void SupplyWidget::setupUi()
     m_editButton = new QPushButton("Редактировать", this);
     m_postButton = new QPushButton("Провести", this);
     m_cancelButton = new QPushButton("Отменить", this);
+    m_bulkCancelButton = new QPushButton("Массовая отмена...", this);
     m_refreshButton = new QPushButton("Обновить", this);
 
     buttonLayout->addWidget(m_addButton);
     buttonLayout->addWidget(m_editButton);
     buttonLayout->addWidget(m_postButton);
     buttonLayout->addWidget(m_cancelButton);
+    buttonLayout->addWidget(m_bulkCancelButton);
     buttonLayout->addWidget(m_refreshButton);
 
     mainLayout->addLayout(buttonLayout);
@@ -63,14 +59,43 @@ void SupplyWidget::setupUi()
     connect(m_editButton, &QPushButton::clicked, this, &SupplyWidget::onEditClicked);
     connect(m_postButton, &QPushButton::clicked, this, &SupplyWidget::onPostClicked);
     connect(m_cancelButton, &QPushButton::clicked, this, &SupplyWidget::onCancelClicked);
+    connect(m_bulkCancelButton, &QPushButton::clicked, this, &SupplyWidget::onBulkCancelClicked);
     connect(m_refreshButton, &QPushButton::clicked, this, &SupplyWidget::onRefreshClicked);
 
+    if (m_writeQueue) {
+        connect(m_writeQueue, &WriteQueue::documentSaved, this, [this](int documentId, DocumentType type) {
+            if (type == m_model->docType()) onDocumentsChanged({documentId});
+        });
+        connect(m_writeQueue, &WriteQueue::documentPosted, this, [this](int documentId, DocumentType type) {
+            if (type == m_model->docType()) onDocumentsChanged({documentId});
+        });
+        // тип отменённых/удалённых не передаётся: модель сама отбросит чужие документы
+        connect(m_writeQueue, &WriteQueue::documentsCancelled, this, &SupplyWidget::onDocumentsChanged);
+        connect(m_writeQueue, &WriteQueue::documentDeleted, this, [this](int documentId) {
+            onDocumentsChanged({documentId});
+        });
+    }
+
+    // документы, изменённые другим экземпляром приложения
+    connect(&ChangeBus::instance(), &ChangeBus::remoteChanged, this, [this](const ChangeSet& changes) {
+        // имена контрагентов приходят JOIN-ом, по строкам их не обновить
+        if (ChangeBus::isTableReset(changes, "documents") || changes.contains("counterparties"))
+            m_model->refreshIfChanged();
+        else if (changes.contains("documents"))
+            onDocumentsChanged(ChangeBus::rowIds(changes, "documents"));
+    });
+
     refreshModel();
 }
 
 void SupplyWidget::refreshModel()
 {
-    m_model->select();
+    m_model->refresh();
+}
+
+void SupplyWidget::onDocumentsChanged(const QList<int>& documentIds)
+{
+    m_model->reloadDocuments(documentIds);
 }
 
 int SupplyWidget::selectedDocId() const
@@ -78,19 +103,15 @@ int SupplyWidget::selectedDocId() const
     auto sel = m_tableView->selectionModel()->selectedRows();
     if (sel.isEmpty()) return 0;
 
-    const int row = sel.first().row();
-    return m_model->record(row).value("id").toInt();
+    return sel.first().data(DocumentListModel::IdRole).toInt();
 }
 
 void SupplyWidget::onAddClicked()
 {
-    SupplyForm form(m_docService, this);
+    // список обновится по сигналу documentSaved
+    SupplyForm form(m_writeQueue, this);
     form.loadData(0);
-    if (form.exec() == QDialog::Accepted) {
-        refreshModel();
-    } else {
-        refreshModel();
-    }
+    form.exec();
 }
 
 void SupplyWidget::onEditClicked()
@@ -101,13 +122,9 @@ void SupplyWidget::onEditClicked()
         return;
     }
 
-    SupplyForm form(m_docService, this);
+    SupplyForm form(m_writeQueue, this);
     form.loadData(docId);
-    if (form.exec() == QDialog::Accepted) {
-        refreshModel();
-    } else {
-        refreshModel();
-    }
+    form.exec();
 }
 
 void SupplyWidget::onPostClicked()
@@ -118,18 +135,19 @@ void SupplyWidget::onPostClicked()
         return;
     }
 
-    if (!m_docService) {
-        QMessageBox::critical(this, "Ошибка", "DocumentService не передан");
+    if (!m_writeQueue) {
+        QMessageBox::critical(this, "Ошибка", "Очередь записи не передана");
         return;
     }
 
-    if (!m_docService->postDocument(docId)) {
-        QMessageBox::warning(this, "Ошибка", "Не удалось провести документ");
-        return;
-    }
+    m_writeQueue->postDocument(docId).then(this, [this](const WriteResult& r) {
+        if (!r.ok) {
+            QMessageBox::warning(this, "Ошибка", "Не удалось провести документ:\n" + r.error);
+            return;
+        }
 
-    QMessageBox::information(this, "Успех", "Документ проведен. Остатки увеличены.");
-    refreshModel();
+        QMessageBox::information(this, "Успех", "Документ проведен. Остатки увеличены.");
+    });
 }
 
 void SupplyWidget::onCancelClicked()
@@ -140,24 +158,54 @@ void SupplyWidget::onCancelClicked()
         return;
     }
 
-    if (!m_docService) {
-        QMessageBox::critical(this, "Ошибка", "DocumentService не передан");
+    if (!m_writeQueue) {
+        QMessageBox::critical(this, "Ошибка", "Очередь записи не передана");
         return;
     }
 
     if (QMessageBox::question(this, "Подтвердите", "Отменить документ (storno)?") != QMessageBox::Yes)
         return;
 
-    if (!m_docService->cancelDocument(docId)) {
-        QMessageBox::warning(this, "Ошибка", "Не удалось отменить документ");
+    m_writeQueue->cancelDocument(docId).then(this, [this](const WriteResult& r) {
+        if (!r.ok) {
+            QMessageBox::warning(this, "Ошибка", "Не удалось отменить документ:\n" + r.error);
+            return;
+        }
+
+        QMessageBox::information(this, "Успех", "Документ отменен (storno сделано).");
+    });
+}
+
+void SupplyWidget::onBulkCancelClicked()
+{
+    if (!m_writeQueue) {
+        QMessageBox::critical(this, "Ошибка", "Очередь записи не передана");
         return;
     }
 
-    QMessageBox::information(this, "Успех", "Документ отменен (storno сделано).");
-    refreshModel();
+    BulkCancelForm form(DocumentType::Supply, this);
+    if (form.exec() != QDialog::Accepted)
+        return;
+
+    if (QMessageBox::question(this, "Подтвердите",
+                              "Отменить все проведённые поставки по фильтру (storno)?
+"
+                              "Остатки по ним будут уменьшены.") != QMessageBox::Yes)
+        return;
+
+    m_writeQueue->cancelPosted(form.filter()).then(this, [this](const WriteResult& r) {
+        if (!r.ok) {
+            QMessageBox::warning(this, "Ошибка", "Не удалось отменить документы:
+" + r.error);
+            return;
+        }
+
+        QMessageBox::information(this, "Успех", QString("Отменено документов: %1").arg(r.count));
+    });
 }
 
 void SupplyWidget::onRefreshClicked()
 {
-    refreshModel();
+    // без изменений в базе список не перечитывается
+    m_model->refreshIfChanged();
 }
@@ -3,40 +3,44 @@
 
 #include <QWidget>
 
+#include "repositories/IDocumentRepository.h"
+
 class QTableView;
 class QPushButton;
-class QSqlTableModel;
-
-class DocumentService;
+class WriteQueue;
+class DocumentListModel;
 
 class SupplyWidget : public QWidget
 {
     Q_OBJECT
 public:
-    explicit SupplyWidget(DocumentService* docService, QWidget* parent = nullptr);
+    explicit SupplyWidget(WriteQueue* writeQueue, QWidget* parent = nullptr);
 
 private slots:
     void onAddClicked();
     void onEditClicked();
     void onPostClicked();
     void onCancelClicked();
+    void onBulkCancelClicked();
     void onRefreshClicked();
 
 private:
     void setupUi();
     void refreshModel();
+    void onDocumentsChanged(const QList<int>& documentIds);
     int selectedDocId() const;
 
 private:
-    DocumentService* m_docService = nullptr;
+    WriteQueue* m_writeQueue = nullptr;
 
     QTableView* m_tableView = nullptr;
-    QSqlTableModel* m_model = nullptr;
+    DocumentListModel* m_model = nullptr;
 
     QPushButton* m_addButton = nullptr;
     QPushButton* m_editButton = nullptr;
     QPushButton* m_postButton = nullptr;
     QPushButton* m_cancelButton = nullptr;
+    QPushButton* m_bulkCancelButton = nullptr;
     QPushButton* m_refreshButton = nullptr;
 };
 
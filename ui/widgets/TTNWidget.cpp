@@ -1,16 +1,16 @@
 #include "TTNWidget.h"
+#include "ChangeBus.h"
 #include "DbManager.h"
 #include "TTNForm.h"
+#include "WriteQueue.h"
+#include "models/DocumentListModel.h"
 
 #include <QHeaderView>
 #include <QMessageBox>
-#include <QSqlRecord>
-#include <QSqlQuery>
-#include <QSqlError>
-#include <QDate>
 
-TTNWidget::TTNWidget(QWidget *parent)
+TTNWidget::TTNWidget(WriteQueue* writeQueue, QWidget *parent)
     : QWidget(parent)
+    , m_writeQueue(writeQueue)
 {
     setupUi();
 }
@@ -20,28 +20,13 @@ void TTNWidget::setupUi()
     QVBoxLayout* mainLayout = new QVBoxLayout(this);
 
     m_tableView = new QTableView(this);
-    m_model = new QSqlTableModel(this, DbManager::instance().database());
-    m_model->setTable("documents");
-
-    m_model->setFilter("doc_type = 'transfer' AND is_deleted = 0");
-
-    m_model->setEditStrategy(QSqlTableModel::OnManualSubmit);
-
-    m_model->setHeaderData(m_model->fieldIndex("number"), Qt::Horizontal, "Номер");
-    m_model->setHeaderData(m_model->fieldIndex("date"), Qt::Horizontal, "Дата");
-    m_model->setHeaderData(m_model->fieldIndex("status"), Qt::Horizontal, "Статус");
-    m_model->setHeaderData(m_model->fieldIndex("total_amount"), Qt::Horizontal, "Сумма");
+    m_model = new DocumentListModel(DocumentType::Transfer, this);
 
     m_tableView->setModel(m_model);
     m_tableView->setSelectionBehavior(QAbstractItemView::SelectRows);
     m_tableView->setSelectionMode(QAbstractItemView::SingleSelection);
     m_tableView->horizontalHeader()->setStretchLastSection(true);
-
-    const int idIdx = m_model->fieldIndex("id");
-    if (idIdx >= 0) m_tableView->hideColumn(idIdx);
-
-    const int delIdx = m_model->fieldIndex("is_deleted");
-    if (delIdx >= 0) m_tableView->hideColumn(delIdx);
+    m_tableView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
 
     mainLayout->addWidget(m_tableView);
 
@@ -74,13 +59,44 @@ void TTNWidget::setupUi()
     connect(m_tableView->selectionModel(), &QItemSelectionModel::selectionChanged,
             this, &TTNWidget::onSelectionChanged);
 
+    // статус выбранной строки мог смениться после проведения/отмены
+    connect(m_model, &DocumentListModel::dataChanged, this, &TTNWidget::updateButtonsByStatus);
+    connect(m_model, &DocumentListModel::rowsRemoved, this, &TTNWidget::updateButtonsByStatus);
+
+    if (m_writeQueue) {
+        connect(m_writeQueue, &WriteQueue::documentSaved, this, [this](int documentId, DocumentType type) {
+            if (type == m_model->docType()) onDocumentsChanged({documentId});
+        });
+        connect(m_writeQueue, &WriteQueue::documentPosted, this, [this](int documentId, DocumentType type) {
+            if (type == m_model->docType()) onDocumentsChanged({documentId});
+        });
+        connect(m_writeQueue, &WriteQueue::documentsCancelled, this, &TTNWidget::onDocumentsChanged);
+        connect(m_writeQueue, &WriteQueue::documentDeleted, this, [this](int documentId) {
+            onDocumentsChanged({documentId});
+        });
+    }
+
+    // документы, изменённые другим экземпляром приложения
+    connect(&ChangeBus::instance(), &ChangeBus::remoteChanged, this, [this](const ChangeSet& changes) {
+        // имена контрагентов приходят JOIN-ом, по строкам их не обновить
+        if (ChangeBus::isTableReset(changes, "documents") || changes.contains("counterparties"))
+            m_model->refreshIfChanged();
+        else if (changes.contains("documents"))
+            onDocumentsChanged(ChangeBus::rowIds(changes, "documents"));
+    });
+
     refreshModel();
-    updateButtonsByStatus();
 }
 
 void TTNWidget::refreshModel()
 {
-    m_model->select();
+    m_model->refresh();
+    updateButtonsByStatus();
+}
+
+void TTNWidget::onDocumentsChanged(const QList<int>& documentIds)
+{
+    m_model->reloadDocuments(documentIds);
 }
 
 int TTNWidget::selectedDocId() const
@@ -89,8 +105,7 @@ int TTNWidget::selectedDocId() const
     if (selection.isEmpty())
         return 0;
 
-    int row = selection.first().row();
-    return m_model->record(row).value("id").toInt();
+    return selection.first().data(DocumentListModel::IdRole).toInt();
 }
 
 QString TTNWidget::selectedDocStatus() const
@@ -99,8 +114,7 @@ QString TTNWidget::selectedDocStatus() const
     if (selection.isEmpty())
         return QString();
 
-    int row = selection.first().row();
-    return m_model->record(row).value("status").toString();
+    return selection.first().data(DocumentListModel::StatusRole).toString();
 }
 
 void TTNWidget::onSelectionChanged()
@@ -152,12 +166,10 @@ void TTNWidget::updateButtonsByStatus()
 
 void TTNWidget::onAddClicked()
 {
-    TtnForm form(this);
+    // список обновится по сигналу documentSaved
+    TtnForm form(m_writeQueue, this);
     form.loadData(0);
-    if (form.exec() == QDialog::Accepted) {
-        refreshModel();
-        updateButtonsByStatus();
-    }
+    form.exec();
 }
 
 void TTNWidget::onEditClicked()
@@ -174,12 +186,9 @@ void TTNWidget::onEditClicked()
         return;
     }
 
-    TtnForm form(this);
+    TtnForm form(m_writeQueue, this);
     form.loadData(docId);
-    if (form.exec() == QDialog::Accepted) {
-        refreshModel();
-        updateButtonsByStatus();
-    }
+    form.exec();
 }
 
 void TTNWidget::onPostClicked()
@@ -196,13 +205,19 @@ void TTNWidget::onPostClicked()
         return;
     }
 
-    if (!postDocumentSql(docId)) {
+    if (!m_writeQueue) {
+        QMessageBox::critical(this, "Ошибка", "Очередь записи не передана");
         return;
     }
 
-    QMessageBox::information(this, "Успех", "ТТН проведена");
-    refreshModel();
-    updateButtonsByStatus();
+    m_writeQueue->postDocument(docId).then(this, [this](const WriteResult& r) {
+        if (!r.ok) {
+            QMessageBox::warning(this, "Ошибка", "Не удалось провести ТТН:\n" + r.error);
+            return;
+        }
+
+        QMessageBox::information(this, "Успех", "ТТН проведена");
+    });
 }
 
 void TTNWidget::onCancelClicked()
@@ -219,13 +234,19 @@ void TTNWidget::onCancelClicked()
         return;
     }
 
-    if (!cancelDocumentSql(docId)) {
+    if (!m_writeQueue) {
+        QMessageBox::critical(this, "Ошибка", "Очередь записи не передана");
         return;
     }
 
-    QMessageBox::information(this, "Успех", "ТТН отменена (storno движения добавлены)");
-    refreshModel();
-    updateButtonsByStatus();
+    m_writeQueue->cancelDocument(docId).then(this, [this](const WriteResult& r) {
+        if (!r.ok) {
+            QMessageBox::warning(this, "Ошибка", "Не удалось отменить ТТН:\n" + r.error);
+            return;
+        }
+
+        QMessageBox::information(this, "Успех", "ТТН отменена (storno движения добавлены)");
+    });
 }
 
 void TTNWidget::onDeleteClicked()
@@ -256,346 +277,24 @@ void TTNWidget::onDeleteClicked()
         return;
     }
 
-    if (!deleteTtnSql(docId)) {
+    if (!m_writeQueue) {
+        QMessageBox::critical(this, "Ошибка", "Очередь записи не передана");
         return;
     }
 
-    QMessageBox::information(this, "Удаление", "Готово");
-    refreshModel();
-    updateButtonsByStatus();
-}
-
-void TTNWidget::onRefreshClicked()
-{
-    refreshModel();
-    updateButtonsByStatus();
-}
-
-// ---------------------------
-// SQL helpers
-// ---------------------------
-
-double TTNWidget::stockBalanceForProduct(int productId)
-{
-    QSqlDatabase db = DbManager::instance().database();
-    QSqlQuery q(db);
-
-    // Остаток рассчитывается по сумме всех движений, включая storno (cancelled_flag = 1).
-    // Это нужно для корректного "отката" (storno) при отмене проведённого документа.
-    q.prepare("SELECT COALESCE(SUM(qty_delta_kg), 0) "
-              "FROM inventory_movements WHERE product_id = :pid");
-    q.bindValue(":pid", productId);
-
-    if (!q.exec() || !q.next()) {
-        return 0.0;
-    }
-
-    return q.value(0).toDouble();
-}
-
-bool TTNWidget::documentIsTransferDraftOrPosted(int documentId, QString* outStatus)
-{
-    QSqlDatabase db = DbManager::instance().database();
-    QSqlQuery q(db);
-
-    q.prepare("SELECT status FROM documents WHERE id = :id AND doc_type = 'transfer'");
-    q.bindValue(":id", documentId);
-
-    if (!q.exec()) return false;
-    if (!q.next()) return false;
-
-    const QString status = q.value(0).toString();
-    if (outStatus) *outStatus = status;
-    return (status == "DRAFT" || status == "POSTED" || status == "CANCELLED");
-}
-
-bool TTNWidget::postDocumentSql(int documentId)
-{
-    QSqlDatabase db = DbManager::instance().database();
-    if (!db.isOpen()) {
-        QMessageBox::critical(this, "Ошибка", "База данных не открыта");
-        return false;
-    }
-
-    QString status;
-    if (!documentIsTransferDraftOrPosted(documentId, &status)) {
-        QMessageBox::warning(this, "Ошибка", "Документ не найден или не transfer");
-        return false;
-    }
-
-    if (status != "DRAFT") {
-        QMessageBox::warning(this, "Ошибка", "Документ не в статусе DRAFT");
-        return false;
-    }
-
-    QString docDate;
-    {
-        QSqlQuery q(db);
-        q.prepare("SELECT date FROM documents WHERE id = :id");
-        q.bindValue(":id", documentId);
-        if (!q.exec() || !q.next()) {
-            QMessageBox::critical(this, "Ошибка БД", q.lastError().text());
-            return false;
-        }
-        docDate = q.value(0).toString();
-        if (docDate.isEmpty()) docDate = QDate::currentDate().toString("yyyy-MM-dd");
-    }
-
-    struct Line { int productId; double qty; };
-    QList<Line> lines;
-
-    {
-        QSqlQuery q(db);
-        q.prepare("SELECT product_id, qty_kg FROM document_lines WHERE document_id = :id");
-        q.bindValue(":id", documentId);
-        if (!q.exec()) {
-            QMessageBox::critical(this, "Ошибка БД", q.lastError().text());
-            return false;
-        }
-        while (q.next()) {
-            lines.push_back(Line{ q.value(0).toInt(), q.value(1).toDouble() });
-        }
-    }
-
-    if (lines.isEmpty()) {
-        QMessageBox::warning(this, "Ошибка", "В документе нет строк товаров");
-        return false;
-    }
-
-    for (const auto& l : lines) {
-        const double bal = stockBalanceForProduct(l.productId);
-        if (bal + 1e-9 < l.qty) {
-            QMessageBox::warning(this, "Недостаточно товара",
-                                 QString("Недостаточно остатка по товару ID=%1.\nОстаток: %2, требуется: %3")
-                                     .arg(l.productId)
-                                     .arg(QString::number(bal, 'f', 3))
-                                     .arg(QString::number(l.qty, 'f', 3)));
-            return false;
-        }
-    }
-
-    if (!db.transaction()) {
-        QMessageBox::warning(this, "Ошибка", "Не удалось начать транзакцию");
-        return false;
-    }
-
-    {
-        QSqlQuery ins(db);
-        ins.prepare("INSERT INTO inventory_movements (document_id, product_id, qty_delta_kg, movement_date, cancelled_flag) "
-                    "VALUES (:doc, :pid, :qty, :dt, 0)");
-
-        for (const auto& l : lines) {
-            ins.bindValue(":doc", documentId);
-            ins.bindValue(":pid", l.productId);
-            ins.bindValue(":qty", -l.qty);
-            ins.bindValue(":dt", docDate);
-
-            if (!ins.exec()) {
-                db.rollback();
-                QMessageBox::critical(this, "Ошибка БД", ins.lastError().text());
-                return false;
-            }
-        }
-    }
-
-    {
-        QSqlQuery upd(db);
-        upd.prepare("UPDATE documents SET status='POSTED', updated_at=datetime('now') WHERE id=:id");
-        upd.bindValue(":id", documentId);
-
-        if (!upd.exec()) {
-            db.rollback();
-            QMessageBox::critical(this, "Ошибка БД", upd.lastError().text());
-            return false;
-        }
-    }
-
-    if (!db.commit()) {
-        db.rollback();
-        QMessageBox::warning(this, "Ошибка", "Не удалось зафиксировать транзакцию");
-        return false;
-    }
-
-    return true;
-}
-
-bool TTNWidget::cancelDocumentSql(int documentId)
-{
-    QSqlDatabase db = DbManager::instance().database();
-    if (!db.isOpen()) {
-        QMessageBox::critical(this, "Ошибка", "База данных не открыта");
-        return false;
-    }
-
-    QString status;
-    if (!documentIsTransferDraftOrPosted(documentId, &status)) {
-        QMessageBox::warning(this, "Ошибка", "Документ не найден или не transfer");
-        return false;
-    }
-
-    if (status != "POSTED") {
-        QMessageBox::warning(this, "Ошибка", "Отменить можно только POSTED");
-        return false;
-    }
-
-    if (!db.transaction()) {
-        QMessageBox::warning(this, "Ошибка", "Не удалось начать транзакцию");
-        return false;
-    }
-
-    // Упрощенная и корректная отмена для остатков:
-    // 1) помечаем движения этого документа как cancelled_flag = 1
-    // 2) НЕ вставляем storno-движения
-    // Баланс в UI считается только по cancelled_flag = 0,
-    // поэтому эффект документа полностью исчезает из остатков,
-    // и товар «возвращается».
-    {
-        QSqlQuery updMov(db);
-        updMov.prepare(
-            "UPDATE inventory_movements "
-            "SET cancelled_flag = 1 "
-            "WHERE document_id = :id AND cancelled_flag = 0"
-        );
-        updMov.bindValue(":id", documentId);
-
-        if (!updMov.exec()) {
-            db.rollback();
-            QMessageBox::critical(this, "Ошибка БД", updMov.lastError().text());
-            return false;
-        }
-
-        if (updMov.numRowsAffected() <= 0) {
-            db.rollback();
-            QMessageBox::warning(this, "Ошибка", "Нет движений для отмены (или уже отменено)");
-            return false;
-        }
-    }
-
-    {
-        QSqlQuery upd(db);
-        upd.prepare("UPDATE documents SET status='CANCELLED', updated_at=datetime('now') WHERE id=:id");
-        upd.bindValue(":id", documentId);
-
-        if (!upd.exec()) {
-            db.rollback();
-            QMessageBox::critical(this, "Ошибка БД", upd.lastError().text());
-            return false;
+    m_writeQueue->deleteDocument(docId).then(this, [this](const WriteResult& r) {
+        if (!r.ok) {
+            QMessageBox::warning(this, "Ошибка", "Не удалось удалить ТТН:\n" + r.error);
+            return;
         }
-    }
 
-    if (!db.commit()) {
-        db.rollback();
-        QMessageBox::warning(this, "Ошибка", "Не удалось зафиксировать транзакцию");
-        return false;
-    }
-
-    return true;
+        QMessageBox::information(this, "Удаление", "Готово");
+    });
 }
 
-bool TTNWidget::deleteTtnSql(int documentId)
+void TTNWidget::onRefreshClicked()
 {
-    QSqlDatabase db = DbManager::instance().database();
-    if (!db.isOpen()) {
-        QMessageBox::critical(this, "Ошибка", "База данных не открыта");
-        return false;
-    }
-
-    QString status;
-    if (!documentIsTransferDraftOrPosted(documentId, &status)) {
-        QMessageBox::warning(this, "Ошибка", "Документ не найден или не transfer");
-        return false;
-    }
-
-    // POSTED: “удаление” = корректная отмена (storno)
-    if (status == "POSTED") {
-        return cancelDocumentSql(documentId);
-    }
-
-    // CANCELLED: soft-delete (скрыть)
-    if (status == "CANCELLED") {
-        QSqlQuery q(db);
-        // В таблице documents действует UNIQUE(number, doc_type). Даже при soft-delete номер остаётся занятым.
-        // Поэтому при скрытии добавляем суффикс к номеру, чтобы освободить исходное значение.
-        q.prepare(
-            "UPDATE documents "
-            "SET is_deleted = 1, "
-            "    number = CASE WHEN instr(number, '[del ') = 0 THEN number || ' [del ' || id || ']' ELSE number END, "
-            "    updated_at = datetime('now') "
-            "WHERE id = :id AND doc_type = 'transfer'"
-        );
-        q.bindValue(":id", documentId);
-
-        if (!q.exec()) {
-            QMessageBox::critical(this, "Ошибка БД", q.lastError().text());
-            return false;
-        }
-        if (q.numRowsAffected() == 0) {
-            QMessageBox::warning(this, "Удаление", "Документ не найден");
-            return false;
-        }
-        return true;
-    }
-
-    // DRAFT: физическое удаление (движений быть не должно)
-    if (status != "DRAFT") {
-        QMessageBox::warning(this, "Удаление", "Нельзя удалить документ в этом статусе");
-        return false;
-    }
-
-    // Проверим, что движений нет
-    {
-        QSqlQuery q(db);
-        q.prepare("SELECT COUNT(1) FROM inventory_movements WHERE document_id = :id");
-        q.bindValue(":id", documentId);
-        if (!q.exec() || !q.next()) {
-            QMessageBox::critical(this, "Ошибка БД", q.lastError().text());
-            return false;
-        }
-        if (q.value(0).toInt() > 0) {
-            QMessageBox::warning(this, "Удаление",
-                                 "Нельзя удалить DRAFT: у документа уже есть движения склада.\n"
-                                 "Используйте отмену.");
-            return false;
-        }
-    }
-
-    if (!db.transaction()) {
-        QMessageBox::warning(this, "Ошибка", "Не удалось начать транзакцию");
-        return false;
-    }
-
-    {
-        QSqlQuery q(db);
-        q.prepare("DELETE FROM document_lines WHERE document_id = :id");
-        q.bindValue(":id", documentId);
-        if (!q.exec()) {
-            db.rollback();
-            QMessageBox::critical(this, "Ошибка БД", q.lastError().text());
-            return false;
-        }
-    }
-
-    {
-        QSqlQuery q(db);
-        q.prepare("DELETE FROM documents WHERE id = :id AND doc_type = 'transfer'");
-        q.bindValue(":id", documentId);
-        if (!q.exec()) {
-            db.rollback();
-            QMessageBox::critical(this, "Ошибка БД", q.lastError().text());
-            return false;
-        }
-        if (q.numRowsAffected() == 0) {
-            db.rollback();
-            QMessageBox::warning(this, "Удаление", "Документ не найден");
-            return false;
-        }
-    }
-
-    if (!db.commit()) {
-        db.rollback();
-        QMessageBox::warning(this, "Ошибка", "Не удалось зафиксировать транзакцию");
-        return false;
-    }
-
-    return true;
+    // без изменений в базе список не перечитывается
+    m_model->refreshIfChanged();
+    updateButtonsByStatus();
 }
@@ -6,14 +6,18 @@
 #include <QPushButton>
 #include <QVBoxLayout>
 #include <QHBoxLayout>
-#include <QSqlTableModel>
+
+#include "repositories/IDocumentRepository.h"
+
+class WriteQueue;
+class DocumentListModel;
 
 class TTNWidget : public QWidget
 {
     Q_OBJECT
 
 public:
-    explicit TTNWidget(QWidget *parent = nullptr);
+    explicit TTNWidget(WriteQueue* writeQueue, QWidget *parent = nullptr);
 
 private slots:
     void onAddClicked();
@@ -27,23 +31,18 @@ private slots:
 private:
     void setupUi();
     void refreshModel();
+    void onDocumentsChanged(const QList<int>& documentIds);
 
     int selectedDocId() const;
     QString selectedDocStatus() const;
 
     void updateButtonsByStatus();
 
-    bool postDocumentSql(int documentId);
-    bool cancelDocumentSql(int documentId);
-
-    bool deleteTtnSql(int documentId);
-
-    double stockBalanceForProduct(int productId);
-    bool documentIsTransferDraftOrPosted(int documentId, QString* outStatus);
-
 private:
+    WriteQueue* m_writeQueue = nullptr;
+
     QTableView* m_tableView = nullptr;
-    QSqlTableModel* m_model = nullptr;
+    DocumentListModel* m_model = nullptr;
 
     QPushButton* m_addButton = nullptr;
     QPushButton* m_editButton = nullptr;